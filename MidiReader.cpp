@@ -25,10 +25,30 @@
  */
 
 #include <stdarg.h>
+#include "RtMidi.h"
 #include "MidiReader.h"
 
 extern "C" {
 #include "midi_reader.c"
+#include "midi_capture.c"
+#include "midi_replay.c"
+#include "midi_smf.c"
+#include "midi_flightrec.c"
+#include "midi_rawcap.c"
+#include "midi_pparse.c"
+#include "midi_colstore.c"
+#include "midi_router.c"
+#include "midi_thru.c"
+#include "midi_xform.c"
+#include "midi_batch.c"
+#include "midi_state.c"
+#include "midi_hires.c"
+#include "midi_dispatch.c"
+#include "midi_demux.c"
+#include "midi_bcast.c"
+#include "midi_hub.c"
+#include "midi_pty.c"
+#include "midi_clock.c"
 }
 
 int
@@ -73,6 +93,85 @@ MidiReader::removeSource (int fd)
 	return (midi_reader_remove_source (&this->reader, fd));
 }
 
+bool
+MidiReader::addFilter (int fd, MidiReaderFilter filter, void *userData)
+{
+	return (midi_reader_add_filter (&this->reader, fd, filter, userData));
+}
+
+bool
+MidiReader::removeFilter (int fd, MidiReaderFilter filter, void *userData)
+{
+	return (midi_reader_remove_filter (&this->reader, fd, filter,
+						userData));
+}
+
+bool
+MidiReader::addSourceTap (int fd, MidiReaderTap tap, void *userData)
+{
+	return (midi_reader_add_source_tap (&this->reader, fd, tap,
+						userData));
+}
+
+bool
+MidiReader::removeSourceTap (int fd, MidiReaderTap tap, void *userData)
+{
+	return (midi_reader_remove_source_tap (&this->reader, fd, tap,
+						userData));
+}
+
+int
+MidiReader::getSourceId (int fd)
+{
+	return (midi_reader_get_source_id (&this->reader, fd));
+}
+
+uint64_t
+MidiReader::getTime ()
+{
+	return (midi_reader_get_time (&this->reader));
+}
+
+void
+MidiReader::setClock (MidiClock *clock)
+{
+	if (clock)
+		midi_reader_set_clock (&this->reader, clock->getFunction (),
+					clock->getArg ());
+	else
+		midi_reader_set_clock (&this->reader, NULL, NULL);
+}
+
+midi_reader_t*
+MidiReader::getHandle ()
+{
+	return (&this->reader);
+}
+
+int
+MidiReader::pump ()
+{
+	return (midi_reader_pump (&this->reader));
+}
+
+bool
+MidiReader::addTap (MidiReaderTap tap, void *userData)
+{
+	return (midi_reader_add_tap (&this->reader, tap, userData));
+}
+
+bool
+MidiReader::removeTap (MidiReaderTap tap, void *userData)
+{
+	return (midi_reader_remove_tap (&this->reader, tap, userData));
+}
+
+bool
+MidiReader::flushDump ()
+{
+	return (midi_reader_flush_dump (&this->reader));
+}
+
 bool
 MidiReader::setDumpFile (int fd)
 {
@@ -85,12 +184,41 @@ MidiReader::setDumpFile (const char *path, bool trunc)
 	return (midi_reader_set_dump_file (&this->reader, path, trunc));
 }
 
+bool
+MidiReader::setDumpCapture (int fd)
+{
+	return (midi_capture_set_dump (&this->reader, fd));
+}
+
+bool
+MidiReader::setDumpCapture (const char *path)
+{
+	int fd;
+
+	if (path == NULL)
+		return (false);
+	fd = open (path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return (false);
+	if ( ! midi_capture_set_dump (&this->reader, fd)) {
+		::close (fd);
+		return (false);
+	}
+	return (true);
+}
+
 void
 MidiReader::setCallback (MidiReaderFunc cb, void *user_data)
 {
 	midi_reader_set_callback (&this->reader, cb, user_data);
 }
 
+void
+MidiReader::setRawCallback (MidiReaderRawFunc cb, void *user_data)
+{
+	midi_reader_set_raw_callback (&this->reader, cb, user_data);
+}
+
 void
 MidiReader::resetFrame (MidiFrame& frame)
 {
@@ -121,6 +249,12 @@ MidiReader::getNext ()
 	return (midi_reader_get_next (&this->reader));
 }
 
+MidiFrame*
+MidiReader::pop ()
+{
+	return (midi_reader_pop (&this->reader));
+}
+
 void
 MidiReader::clearQueue ()
 {
@@ -168,3 +302,1776 @@ MidiReader::available ()
 	return (this->reader.frames.len);
 }
 
+
+MidiCaptureWriter::MidiCaptureWriter ()
+{
+	this->opened = false;
+}
+
+MidiCaptureWriter::~MidiCaptureWriter ()
+{
+	this->close ();
+}
+
+bool
+MidiCaptureWriter::open (int fd, unsigned int blockMax)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_capture_writer_open (&this->writer, fd, blockMax);
+	return (this->opened);
+}
+
+bool
+MidiCaptureWriter::open (const char *path, unsigned int blockMax)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_capture_writer_open_path (&this->writer, path,
+							blockMax);
+	return (this->opened);
+}
+
+bool
+MidiCaptureWriter::setCodec (MidiCaptureCodec codec, bool background)
+{
+	return (this->opened && midi_capture_writer_set_codec (&this->writer,
+							codec, background));
+}
+
+bool
+MidiCaptureWriter::write (const MidiFrame& frame)
+{
+	return (this->opened &&
+		midi_capture_write_frame (&this->writer, &frame));
+}
+
+bool
+MidiCaptureWriter::write (uint64_t ts, int source,
+				const unsigned char *data, int len)
+{
+	return (this->opened &&
+		midi_capture_write (&this->writer, ts, source, data, len));
+}
+
+bool
+MidiCaptureWriter::flush ()
+{
+	return (this->opened && midi_capture_writer_flush (&this->writer));
+}
+
+bool
+MidiCaptureWriter::close ()
+{
+	if ( ! this->opened)
+		return (false);
+	this->opened = false;
+	return (midi_capture_writer_close (&this->writer));
+}
+
+void
+MidiCaptureWriter::getStats (MidiCaptureStats& stats)
+{
+	if (this->opened)
+		midi_capture_writer_get_stats (&this->writer, &stats);
+	else
+		memset (&stats, 0, sizeof (MidiCaptureStats));
+}
+
+MidiCapture::MidiCapture ()
+{
+	memset (&this->cap, 0, sizeof (midi_capture_t));
+	this->cap.fd = -1;
+}
+
+MidiCapture::~MidiCapture ()
+{
+	this->close ();
+}
+
+bool
+MidiCapture::open (const char *path)
+{
+	this->close ();
+	return (midi_capture_open (&this->cap, path));
+}
+
+void
+MidiCapture::close ()
+{
+	midi_capture_close (&this->cap);
+}
+
+bool
+MidiCapture::seek (uint64_t t)
+{
+	return (midi_capture_seek (&this->cap, t));
+}
+
+bool
+MidiCapture::next (MidiFrame& frame)
+{
+	return (midi_capture_next (&this->cap, &frame));
+}
+
+bool
+MidiCapture::getRange (uint64_t& first, uint64_t& last)
+{
+	return (midi_capture_get_range (&this->cap, &first, &last));
+}
+
+uint64_t
+MidiCapture::count ()
+{
+	return (midi_capture_count (&this->cap));
+}
+
+unsigned int
+MidiCapture::getBlockCount ()
+{
+	return (this->cap.nblocks);
+}
+
+MidiReplay::MidiReplay ()
+{
+	memset (&this->replay, 0, sizeof (midi_replay_t));
+	this->replay.cap.fd = -1;
+	this->replay.timerfd = -1;
+	this->opened = false;
+	this->output = NULL;
+	this->callback = NULL;
+	this->userData = NULL;
+}
+
+MidiReplay::~MidiReplay ()
+{
+	this->close ();
+}
+
+bool
+MidiReplay::dispatch (const midi_frame_t *mf, void *userData)
+{
+	MidiReplay *self = static_cast<MidiReplay *> (userData);
+
+	if (self->output)
+		self->output->sendMessage (mf->data, mf->len);
+	if (self->callback)
+		return (self->callback (mf, self->userData));
+	return (true);
+}
+
+bool
+MidiReplay::open (const char *path)
+{
+	this->close ();
+	this->opened = midi_replay_open (&this->replay, path);
+	if (this->opened)
+		midi_replay_set_callback (&this->replay, dispatch, this);
+	return (this->opened);
+}
+
+void
+MidiReplay::close ()
+{
+	if (this->opened)
+		midi_replay_close (&this->replay);
+	this->opened = false;
+}
+
+bool
+MidiReplay::setMode (MidiReplayMode mode, double speed)
+{
+	return (midi_replay_set_mode (&this->replay, mode, speed));
+}
+
+void
+MidiReplay::setRange (uint64_t from, uint64_t to)
+{
+	midi_replay_set_range (&this->replay, from, to);
+}
+
+void
+MidiReplay::setReader (MidiReader *reader)
+{
+	midi_replay_set_reader (&this->replay,
+				reader ? reader->getHandle () : NULL);
+}
+
+void
+MidiReplay::setOutput (RtMidiOut *out)
+{
+	this->output = out;
+}
+
+void
+MidiReplay::setCallback (MidiReplayFunc cb, void *userData)
+{
+	this->callback = cb;
+	this->userData = userData;
+}
+
+bool
+MidiReplay::run ()
+{
+	return (this->opened && midi_replay_run (&this->replay));
+}
+
+void
+MidiReplay::stop ()
+{
+	midi_replay_stop (&this->replay);
+}
+
+void
+MidiReplay::getStats (MidiReplayStats& stats)
+{
+	midi_replay_get_stats (&this->replay, &stats);
+}
+
+void
+MidiReplay::dumpStats (int fd)
+{
+	midi_replay_dump_stats (&this->replay, fd);
+}
+
+MidiSmfWriter::MidiSmfWriter ()
+{
+	this->opened = false;
+	this->rtTime = 0;
+	this->rtFirst = true;
+}
+
+MidiSmfWriter::~MidiSmfWriter ()
+{
+	this->close ();
+}
+
+bool
+MidiSmfWriter::open (const char *path, int format, unsigned int ppq,
+			unsigned int tempo)
+{
+	if (this->opened)
+		return (false);
+	this->rtFirst = true;
+	this->opened = midi_smf_writer_open (&this->writer, path, format,
+						ppq, tempo);
+	return (this->opened);
+}
+
+bool
+MidiSmfWriter::close ()
+{
+	if ( ! this->opened)
+		return (false);
+	this->opened = false;
+	return (midi_smf_writer_close (&this->writer));
+}
+
+bool
+MidiSmfWriter::attach (MidiReader& reader)
+{
+	return (this->opened &&
+		reader.addTap (midi_smf_writer_tap, &this->writer));
+}
+
+void
+MidiSmfWriter::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_smf_writer_tap, &this->writer);
+}
+
+void
+MidiSmfWriter::attach (RtMidiIn& in)
+{
+	this->rtFirst = true;
+	in.setCallback (rtMidiCallback, this);
+}
+
+void
+MidiSmfWriter::detach (RtMidiIn& in)
+{
+	in.cancelCallback ();
+}
+
+bool
+MidiSmfWriter::write (const MidiFrame& frame)
+{
+	return (this->opened && midi_smf_writer_put (&this->writer, &frame));
+}
+
+void
+MidiSmfWriter::getStats (MidiSmfWriterStats& stats)
+{
+	midi_smf_writer_get_stats (&this->writer, &stats);
+}
+
+void
+MidiSmfWriter::rtMidiCallback (double timeStamp,
+				std::vector<unsigned char> *message,
+				void *userData)
+{
+	MidiSmfWriter *self = static_cast<MidiSmfWriter *> (userData);
+	MidiFrame f;
+
+	/* RtMidi gives delta times: rebuild the absolute time */
+	if (self->rtFirst) {
+		self->rtTime = midi_smf_now ();
+		self->rtFirst = false;
+	}
+	else
+		self->rtTime += (uint64_t) (timeStamp * 1e9);
+	if (message->empty () || message->size () > MIDI_FRAME_MAX)
+		return;
+	f.len = (unsigned char) message->size ();
+	memcpy (f.data, message->data (), f.len);
+	f.source = 0;
+	f.ts = self->rtTime;
+	self->write (f);
+}
+
+MidiSmfPlayer::MidiSmfPlayer ()
+{
+	memset (&this->player, 0, sizeof (midi_smf_player_t));
+	this->player.fd = -1;
+	this->opened = false;
+	this->callback = NULL;
+	this->userData = NULL;
+}
+
+MidiSmfPlayer::~MidiSmfPlayer ()
+{
+	this->close ();
+}
+
+bool
+MidiSmfPlayer::dispatch (const midi_smf_event_t *ev, const unsigned char *msg,
+			uint32_t len, void *userData)
+{
+	MidiSmfPlayer *self = static_cast<MidiSmfPlayer *> (userData);
+	int out = self->routes[ev->track];
+
+	if (out >= 0 && out < (int) self->outputs.size () &&
+		self->outputs[out])
+		self->outputs[out]->sendMessage (msg, len);
+	if (self->callback)
+		return (self->callback (ev, msg, len, self->userData));
+	return (true);
+}
+
+bool
+MidiSmfPlayer::open (const char *path)
+{
+	this->close ();
+	this->opened = midi_smf_player_open (&this->player, path);
+	if (this->opened) {
+		this->routes.assign (this->player.ntracks, 0);
+		midi_smf_player_set_callback (&this->player, dispatch, this);
+	}
+	return (this->opened);
+}
+
+void
+MidiSmfPlayer::close ()
+{
+	if (this->opened)
+		midi_smf_player_close (&this->player);
+	this->opened = false;
+	this->routes.clear ();
+}
+
+int
+MidiSmfPlayer::getTrackCount ()
+{
+	return (this->opened ? this->player.ntracks : 0);
+}
+
+int
+MidiSmfPlayer::addOutput (RtMidiOut *out)
+{
+	this->outputs.push_back (out);
+	return ((int) this->outputs.size () - 1);
+}
+
+bool
+MidiSmfPlayer::setTrackOutput (int track, int output)
+{
+	if (track < 0 || track >= (int) this->routes.size () ||
+		output >= (int) this->outputs.size ())
+		return (false);
+	this->routes[track] = output < 0 ? -1 : output;
+	return (true);
+}
+
+void
+MidiSmfPlayer::setCallback (MidiSmfPlayerFunc cb, void *userData)
+{
+	this->callback = cb;
+	this->userData = userData;
+}
+
+void
+MidiSmfPlayer::setLookahead (uint64_t lookahead, uint64_t spin)
+{
+	midi_smf_player_set_lookahead (&this->player, lookahead, spin);
+}
+
+uint64_t
+MidiSmfPlayer::getDuration ()
+{
+	return (midi_smf_player_get_duration (&this->player));
+}
+
+uint64_t
+MidiSmfPlayer::getPosition ()
+{
+	return (midi_smf_player_get_position (&this->player));
+}
+
+bool
+MidiSmfPlayer::seek (uint64_t ns)
+{
+	return (this->opened && midi_smf_player_seek (&this->player, ns));
+}
+
+bool
+MidiSmfPlayer::run ()
+{
+	return (this->opened && midi_smf_player_run (&this->player));
+}
+
+bool
+MidiSmfPlayer::start ()
+{
+	return (this->opened && midi_smf_player_start (&this->player));
+}
+
+void
+MidiSmfPlayer::stop ()
+{
+	if (this->opened)
+		midi_smf_player_stop (&this->player);
+}
+
+void
+MidiSmfPlayer::getStats (MidiSmfPlayerStats& stats)
+{
+	midi_smf_player_get_stats (&this->player, &stats);
+}
+
+MidiFlightRecorder::MidiFlightRecorder ()
+{
+	memset (&this->rec, 0, sizeof (midi_flightrec_t));
+	this->rec.fd = -1;
+	this->opened = false;
+}
+
+MidiFlightRecorder::~MidiFlightRecorder ()
+{
+	this->close ();
+}
+
+bool
+MidiFlightRecorder::open (const char *path, unsigned int nslots)
+{
+	this->close ();
+	this->opened = midi_flightrec_open (&this->rec, path, nslots);
+	return (this->opened);
+}
+
+void
+MidiFlightRecorder::close ()
+{
+	if (this->opened)
+		midi_flightrec_close (&this->rec);
+	this->opened = false;
+}
+
+bool
+MidiFlightRecorder::attach (MidiReader& reader)
+{
+	return (this->opened &&
+		reader.addTap (midi_flightrec_tap, &this->rec));
+}
+
+void
+MidiFlightRecorder::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_flightrec_tap, &this->rec);
+}
+
+void
+MidiFlightRecorder::record (const MidiFrame& frame)
+{
+	if (this->opened)
+		midi_flightrec_tap (&frame, &this->rec);
+}
+
+uint64_t
+MidiFlightRecorder::getCount ()
+{
+	return (midi_flightrec_get_count (&this->rec));
+}
+
+bool
+MidiFlightRecorder::snapshot (const char *path, uint64_t window)
+{
+	return (this->opened &&
+		midi_flightrec_snapshot (&this->rec, path, window));
+}
+
+bool
+MidiFlightRecorder::setSignal (int sig, const char *path)
+{
+	return (this->opened &&
+		midi_flightrec_set_signal (&this->rec, sig, path));
+}
+
+bool
+MidiFlightRecorder::recover (const char *ringPath, const char *path,
+				uint64_t window)
+{
+	return (midi_flightrec_recover (ringPath, path, window));
+}
+
+MidiRawCapture::MidiRawCapture ()
+{
+	memset (&this->rc, 0, sizeof (midi_rawcap_t));
+	this->rc.out = this->rc.idx = -1;
+	this->opened = false;
+}
+
+MidiRawCapture::~MidiRawCapture ()
+{
+	this->close ();
+}
+
+bool
+MidiRawCapture::open (int fd, const char *path)
+{
+	this->close ();
+	this->opened = midi_rawcap_open (&this->rc, fd, path);
+	return (this->opened);
+}
+
+bool
+MidiRawCapture::close ()
+{
+	if ( ! this->opened)
+		return (false);
+	this->opened = false;
+	return (midi_rawcap_close (&this->rc));
+}
+
+ssize_t
+MidiRawCapture::pump ()
+{
+	return (this->opened ? midi_rawcap_pump (&this->rc) : -1);
+}
+
+bool
+MidiRawCapture::run ()
+{
+	return (this->opened && midi_rawcap_run (&this->rc));
+}
+
+void
+MidiRawCapture::stop ()
+{
+	midi_rawcap_stop (&this->rc);
+}
+
+void
+MidiRawCapture::getStats (MidiRawCaptureStats& stats)
+{
+	midi_rawcap_get_stats (&this->rc, &stats);
+}
+
+long
+MidiRawCapture::parse (const char *path, MidiReader& reader, int id)
+{
+	return (midi_rawcap_parse (path, reader.getHandle (), id));
+}
+
+bool
+MidiRawCapture::convert (const char *path, const char *capPath)
+{
+	return (midi_rawcap_convert (path, capPath));
+}
+
+MidiParallelParser::MidiParallelParser (MidiReaderFlags flags, int threads,
+					size_t chunk)
+{
+	midi_pparse_init (&pp, flags, threads, chunk);
+}
+
+void
+MidiParallelParser::setCallback (MidiParallelFunc cb, void *userData)
+{
+	midi_pparse_set_callback (&pp, cb, userData);
+}
+
+bool
+MidiParallelParser::parseFile (const char *path)
+{
+	return (midi_pparse_file (&pp, path));
+}
+
+bool
+MidiParallelParser::parse (const unsigned char *data, size_t size)
+{
+	return (midi_pparse_buffer (&pp, data, size));
+}
+
+void
+MidiParallelParser::getStats (MidiParallelStats& stats)
+{
+	midi_pparse_get_stats (&pp, &stats);
+}
+
+MidiColumnStoreWriter::MidiColumnStoreWriter ()
+{
+	memset (&this->writer, 0, sizeof (this->writer));
+	this->writer.fd = -1;
+	this->opened = false;
+}
+
+MidiColumnStoreWriter::~MidiColumnStoreWriter ()
+{
+	this->close ();
+}
+
+bool
+MidiColumnStoreWriter::open (const char *path, uint32_t blockRows)
+{
+	this->close ();
+	this->opened = midi_colstore_writer_open (&this->writer, path,
+							blockRows);
+	return (this->opened);
+}
+
+bool
+MidiColumnStoreWriter::close ()
+{
+	if ( ! this->opened)
+		return (false);
+	this->opened = false;
+	return (midi_colstore_writer_close (&this->writer));
+}
+
+bool
+MidiColumnStoreWriter::attach (MidiReader& reader)
+{
+	return (this->opened &&
+		reader.addTap (midi_colstore_writer_tap, &this->writer));
+}
+
+void
+MidiColumnStoreWriter::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_colstore_writer_tap, &this->writer);
+}
+
+bool
+MidiColumnStoreWriter::write (const MidiFrame& frame)
+{
+	return (this->opened &&
+		midi_colstore_writer_put (&this->writer, &frame));
+}
+
+MidiColumnStore::MidiColumnStore ()
+{
+	memset (&this->store, 0, sizeof (this->store));
+	this->store.fd = -1;
+	this->opened = false;
+}
+
+MidiColumnStore::~MidiColumnStore ()
+{
+	this->close ();
+}
+
+bool
+MidiColumnStore::open (const char *path)
+{
+	this->close ();
+	this->opened = midi_colstore_open (&this->store, path);
+	return (this->opened);
+}
+
+void
+MidiColumnStore::close ()
+{
+	if (this->opened) {
+		midi_colstore_close (&this->store);
+		this->opened = false;
+	}
+}
+
+uint64_t
+MidiColumnStore::getRowCount ()
+{
+	return (this->opened ? this->store.nrows : 0);
+}
+
+bool
+MidiColumnStore::getRow (uint64_t index, MidiColumnRow& row)
+{
+	return (this->opened &&
+		midi_colstore_get_row (&this->store, index, &row));
+}
+
+uint64_t
+MidiColumnStore::query (const MidiColumnQuery& q, MidiColumnFunc cb,
+			void *userData, MidiColumnStats *stats)
+{
+	if ( ! this->opened) {
+		if (stats)
+			memset (stats, 0, sizeof (MidiColumnStats));
+		return (0);
+	}
+	return (midi_colstore_query (&this->store, &q, cb, userData, stats));
+}
+
+void
+MidiColumnStore::initQuery (MidiColumnQuery& q)
+{
+	midi_colstore_query_init (&q);
+}
+
+void
+MidiColumnStore::addType (MidiColumnQuery& q, unsigned char status,
+				int channel)
+{
+	midi_colstore_query_add_type (&q, status, channel);
+}
+
+bool
+MidiColumnStore::build (const char *srcPath, const char *path, int threads,
+			uint32_t blockRows)
+{
+	return (midi_colstore_build (srcPath, path, threads, blockRows));
+}
+
+MidiRouter::MidiRouter ()
+{
+	midi_router_init (&this->router);
+	memset (this->ports, 0, sizeof (this->ports));
+	midi_router_ctx_init (&this->ctx, &this->router);
+	this->stopFlag = 0;
+}
+
+MidiRouter::~MidiRouter ()
+{
+	while ( ! this->inputs.empty ())
+		this->detach (*this->inputs.back ()->in);
+	midi_router_destroy (&this->router);
+}
+
+void
+MidiRouter::sendPort (const unsigned char *buf, uint32_t len, uint32_t count,
+			void *userData)
+{
+	Port *port = static_cast<Port *> (userData);
+	uint32_t i, n;
+
+	(void) count;
+	if (port->batch) {
+		port->out->sendMessage (buf, len);
+		return;
+	}
+	/* split the batch into messages */
+	for (i = 0; i < len; i += n) {
+		if (buf[i] == 0xf0) {
+			for (n = 1; i + n < len && buf[i + n - 1] != 0xf7; n++)
+				;
+		}
+		else if (buf[i] >= 0x80)
+			n = midi_frame_len[buf[i] - 0x80];
+		else
+			n = 1;
+		if (i + n > len)
+			n = len - i;
+		port->out->sendMessage (buf + i, n);
+	}
+}
+
+void
+MidiRouter::rtMidiCallback (double timeStamp,
+				std::vector<unsigned char> *message,
+				void *userData)
+{
+	Input *input = static_cast<Input *> (userData);
+	MidiFrame f;
+
+	(void) timeStamp;
+	if (message->empty () || message->size () > MIDI_FRAME_MAX)
+		return;
+	f.len = (unsigned char) message->size ();
+	memcpy (f.data, message->data (), f.len);
+	f.source = input->source;
+	f.ts = midi_reader_get_time (NULL);
+	midi_router_route (&input->ctx, &f);
+	midi_router_flush (&input->ctx);
+}
+
+int
+MidiRouter::addOutput (RtMidiOut *out)
+{
+	int n = this->router.noutputs;
+
+	if (out == NULL || n >= MIDI_ROUTER_OUTPUTS_MAX)
+		return (-1);
+	this->ports[n].out = out;
+	this->ports[n].batch = (out->getCurrentApi () == RtMidi::DIRECT);
+	return (midi_router_add_output (&this->router, sendPort,
+					&this->ports[n]));
+}
+
+int
+MidiRouter::addOutput (MidiRouterOutputFunc fn, void *userData)
+{
+	return (midi_router_add_output (&this->router, fn, userData));
+}
+
+int
+MidiRouter::addRoute (const MidiRoute& route)
+{
+	return (midi_router_add_route (&this->router, &route));
+}
+
+void
+MidiRouter::clearRoutes ()
+{
+	midi_router_clear_routes (&this->router);
+}
+
+bool
+MidiRouter::compile ()
+{
+	return (midi_router_compile (&this->router));
+}
+
+void
+MidiRouter::initRoute (MidiRoute& route, int source, int output)
+{
+	midi_router_route_init (&route, source, output);
+}
+
+void
+MidiRouter::addType (MidiRoute& route, unsigned char status, int channel)
+{
+	midi_router_route_add_type (&route, status, channel);
+}
+
+bool
+MidiRouter::attach (RtMidiIn& in, int source)
+{
+	Input *input;
+
+	if (source < -1)
+		return (false);
+	this->detach (in);
+	input = new Input;
+	input->router = this;
+	input->in = &in;
+	input->source = source;
+	midi_router_ctx_init (&input->ctx, &this->router);
+	this->inputs.push_back (input);
+	in.setCallback (rtMidiCallback, input);
+	return (true);
+}
+
+void
+MidiRouter::detach (RtMidiIn& in)
+{
+	for (size_t i = 0; i < this->inputs.size (); i++) {
+		if (this->inputs[i]->in == &in) {
+			in.cancelCallback ();
+			delete this->inputs[i];
+			this->inputs.erase (this->inputs.begin () + i);
+			return;
+		}
+	}
+}
+
+bool
+MidiRouter::run (MidiReader& reader, int timeout)
+{
+	__atomic_store_n (&this->stopFlag, 0, __ATOMIC_RELEASE);
+	return (midi_router_run (&this->ctx, reader.getHandle (),
+					&this->stopFlag, timeout));
+}
+
+void
+MidiRouter::stop ()
+{
+	__atomic_store_n (&this->stopFlag, 1, __ATOMIC_RELEASE);
+}
+
+void
+MidiRouter::getStats (MidiRouterStats& stats)
+{
+	stats = this->ctx.stats;
+	for (size_t i = 0; i < this->inputs.size (); i++) {
+		stats.frames += this->inputs[i]->ctx.stats.frames;
+		stats.messages += this->inputs[i]->ctx.stats.messages;
+		stats.batches += this->inputs[i]->ctx.stats.batches;
+		stats.dropped += this->inputs[i]->ctx.stats.dropped;
+	}
+}
+
+MidiThru::MidiThru (int fd)
+{
+	midi_thru_init (&this->thru, fd);
+	this->stopFlag = 0;
+}
+
+void
+MidiThru::setOutput (int fd)
+{
+	this->flush ();
+	this->thru.fd = fd;
+}
+
+void
+MidiThru::skip (unsigned char status, int channel)
+{
+	midi_thru_skip (&this->thru, status, channel);
+}
+
+bool
+MidiThru::attach (MidiReader& reader)
+{
+	if (reader.getHandle ()->flags & MIDIR_RAW) {
+		reader.setRawCallback (midi_thru_raw, &this->thru);
+		return (true);
+	}
+	return (reader.addTap (midi_thru_tap, &this->thru));
+}
+
+void
+MidiThru::detach (MidiReader& reader)
+{
+	if (reader.getHandle ()->flags & MIDIR_RAW)
+		reader.setRawCallback (NULL, NULL);
+	else
+		reader.removeTap (midi_thru_tap, &this->thru);
+}
+
+bool
+MidiThru::flush ()
+{
+	return (midi_thru_flush (&this->thru));
+}
+
+bool
+MidiThru::run (MidiReader& reader, int timeout)
+{
+	__atomic_store_n (&this->stopFlag, 0, __ATOMIC_RELEASE);
+	return (midi_thru_run (&this->thru, reader.getHandle (),
+				&this->stopFlag, timeout));
+}
+
+void
+MidiThru::stop ()
+{
+	__atomic_store_n (&this->stopFlag, 1, __ATOMIC_RELEASE);
+}
+
+void
+MidiThru::getStats (MidiThruStats& stats)
+{
+	stats = this->thru.stats;
+}
+
+MidiTransform::MidiTransform ()
+{
+	midi_xform_init (&this->xform);
+}
+
+void
+MidiTransform::reset ()
+{
+	midi_xform_init (&this->xform);
+}
+
+void
+MidiTransform::filter (unsigned char status, int channel)
+{
+	midi_xform_filter (&this->xform, status, channel);
+}
+
+void
+MidiTransform::mapChannel (int from, int to, bool layer)
+{
+	midi_xform_map_channel (&this->xform, from, to, layer);
+}
+
+void
+MidiTransform::mapNote (int channel, int from, int to)
+{
+	midi_xform_map_note (&this->xform, channel, from, to);
+}
+
+void
+MidiTransform::transpose (int channel, int semitones)
+{
+	midi_xform_transpose (&this->xform, channel, semitones);
+}
+
+void
+MidiTransform::noteRange (int channel, int low, int high)
+{
+	midi_xform_note_range (&this->xform, channel, low, high);
+}
+
+void
+MidiTransform::velocityCurve (int min, int max, double gamma)
+{
+	midi_xform_velocity_curve (&this->xform, min, max, gamma);
+}
+
+void
+MidiTransform::velocityTable (const unsigned char table[128])
+{
+	midi_xform_velocity_table (&this->xform, table);
+}
+
+void
+MidiTransform::mapController (int from, int to)
+{
+	midi_xform_map_cc (&this->xform, from, to);
+}
+
+int
+MidiTransform::apply (const MidiFrame& frame, MidiFrame *out) const
+{
+	return (midi_xform_apply (&this->xform, &frame, out));
+}
+
+const midi_xform_t *
+MidiTransform::getHandle () const
+{
+	return (&this->xform);
+}
+
+bool
+MidiTransform::attach (MidiReader& reader, int fd)
+{
+	return (reader.addFilter (fd, midi_xform_run, &this->xform));
+}
+
+void
+MidiTransform::detach (MidiReader& reader, int fd)
+{
+	reader.removeFilter (fd, midi_xform_run, &this->xform);
+}
+
+MidiBatchTransform::MidiBatchTransform ()
+{
+	midi_batch_init (&this->batch);
+}
+
+void
+MidiBatchTransform::reset ()
+{
+	midi_batch_init (&this->batch);
+}
+
+void
+MidiBatchTransform::filter (unsigned char status, int channel)
+{
+	midi_batch_filter (&this->batch, status, channel);
+}
+
+void
+MidiBatchTransform::mapChannel (int from, int to)
+{
+	midi_batch_map_channel (&this->batch, from, to);
+}
+
+void
+MidiBatchTransform::transpose (int semitones)
+{
+	midi_batch_transpose (&this->batch, semitones);
+}
+
+void
+MidiBatchTransform::velocityTable (const unsigned char table[128])
+{
+	midi_batch_velocity_table (&this->batch, table);
+}
+
+size_t
+MidiBatchTransform::apply (uint32_t *msgs, size_t n) const
+{
+	return (midi_batch_apply4 (&this->batch, msgs, n));
+}
+
+size_t
+MidiBatchTransform::apply3 (unsigned char *msgs, size_t n) const
+{
+	return (midi_batch_apply3 (&this->batch, msgs, n));
+}
+
+MidiBatchIsa
+MidiBatchTransform::getIsa ()
+{
+	return (midi_batch_get_isa ());
+}
+
+MidiBatchIsa
+MidiBatchTransform::setIsa (MidiBatchIsa isa)
+{
+	return (midi_batch_set_isa (isa));
+}
+
+MidiState::MidiState ()
+{
+	midi_state_init (&this->state);
+}
+
+void
+MidiState::reset ()
+{
+	midi_state_reset (&this->state);
+}
+
+void
+MidiState::update (const MidiFrame& frame)
+{
+	midi_state_update (&this->state, &frame);
+}
+
+bool
+MidiState::attach (MidiReader& reader)
+{
+	return (reader.addTap (midi_state_tap, &this->state));
+}
+
+void
+MidiState::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_state_tap, &this->state);
+}
+
+bool
+MidiState::attach (MidiReader& reader, int fd)
+{
+	return (reader.addSourceTap (fd, midi_state_tap, &this->state));
+}
+
+void
+MidiState::detach (MidiReader& reader, int fd)
+{
+	reader.removeSourceTap (fd, midi_state_tap, &this->state);
+}
+
+bool
+MidiState::getChannel (int channel, MidiChannelState& copy) const
+{
+	return (midi_state_get_channel (&this->state, channel, &copy));
+}
+
+void
+MidiState::snapshot (MidiState& copy) const
+{
+	midi_state_snapshot (&this->state, &copy.state);
+}
+
+bool
+MidiState::isNoteOn (int channel, int note) const
+{
+	return (midi_state_note_on (&this->state, channel, note));
+}
+
+int
+MidiState::getController (int channel, int cc) const
+{
+	return (midi_state_get_cc (&this->state, channel, cc));
+}
+
+int
+MidiState::getProgram (int channel) const
+{
+	return (midi_state_get_program (&this->state, channel));
+}
+
+int
+MidiState::getPressure (int channel) const
+{
+	return (midi_state_get_pressure (&this->state, channel));
+}
+
+int
+MidiState::getPitchBend (int channel) const
+{
+	return (midi_state_get_bend (&this->state, channel));
+}
+
+midi_state_t *
+MidiState::getHandle ()
+{
+	return (&this->state);
+}
+
+MidiHiRes::MidiHiRes (MidiHiResFunc cb, void *userData)
+{
+	midi_hires_init (&this->hires, cb, userData);
+}
+
+bool
+MidiHiRes::enableController (int cc, bool enable)
+{
+	return (midi_hires_enable_cc (&this->hires, cc, enable));
+}
+
+void
+MidiHiRes::setPassthrough (bool passthrough)
+{
+	midi_hires_set_passthrough (&this->hires, passthrough);
+}
+
+bool
+MidiHiRes::process (MidiFrame& frame)
+{
+	return (midi_hires_process (&this->hires, &frame));
+}
+
+void
+MidiHiRes::flush ()
+{
+	midi_hires_flush (&this->hires);
+}
+
+bool
+MidiHiRes::attach (MidiReader& reader, int fd)
+{
+	return (reader.addFilter (fd, midi_hires_run, &this->hires));
+}
+
+void
+MidiHiRes::detach (MidiReader& reader, int fd)
+{
+	reader.removeFilter (fd, midi_hires_run, &this->hires);
+}
+
+void
+MidiHiRes::getStats (MidiHiResStats& stats)
+{
+	midi_hires_get_stats (&this->hires, &stats);
+}
+
+midi_hires_t *
+MidiHiRes::getHandle ()
+{
+	return (&this->hires);
+}
+
+MidiDispatcher::MidiDispatcher ()
+{
+	midi_dispatch_init (&this->dispatcher);
+}
+
+void
+MidiDispatcher::rtMidiCallback (double timeStamp,
+				std::vector<unsigned char> *message,
+				void *userData)
+{
+	MidiDispatcher *d = static_cast<MidiDispatcher *> (userData);
+	MidiFrame f;
+
+	(void) timeStamp;
+	if (message->empty () || message->size () > MIDI_FRAME_MAX)
+		return;
+	f.len = (unsigned char) message->size ();
+	memcpy (f.data, message->data (), f.len);
+	f.source = -1;
+	f.ts = midi_reader_get_time (NULL);
+	midi_dispatch_frame (&d->dispatcher, &f);
+}
+
+void
+MidiDispatcher::setDefault (MidiDispatchFunc fn, void *userData)
+{
+	midi_dispatch_set_default (&this->dispatcher, fn, userData);
+}
+
+bool
+MidiDispatcher::on (unsigned char status, int channel, int data1,
+			MidiDispatchFunc fn, void *userData)
+{
+	return (midi_dispatch_on (&this->dispatcher, status, channel, data1,
+					fn, userData));
+}
+
+bool
+MidiDispatcher::onSysex (const unsigned char *id, int len,
+				MidiDispatchFunc fn, void *userData)
+{
+	return (midi_dispatch_on_sysex (&this->dispatcher, id, len, fn,
+					userData));
+}
+
+MidiFrameState
+MidiDispatcher::dispatch (MidiFrame& frame)
+{
+	return (midi_dispatch_frame (&this->dispatcher, &frame));
+}
+
+void
+MidiDispatcher::attach (MidiReader& reader)
+{
+	reader.setCallback (midi_dispatch_callback, &this->dispatcher);
+}
+
+void
+MidiDispatcher::attach (RtMidiIn& in)
+{
+	in.setCallback (rtMidiCallback, this);
+}
+
+midi_dispatch_t *
+MidiDispatcher::getHandle ()
+{
+	return (&this->dispatcher);
+}
+
+MidiDemux::MidiDemux ()
+{
+	memset (&this->demux, 0, sizeof (midi_demux_t));
+	this->opened = false;
+}
+
+MidiDemux::~MidiDemux ()
+{
+	this->close ();
+}
+
+void
+MidiDemux::rtMidiCallback (double timeStamp,
+				std::vector<unsigned char> *message,
+				void *userData)
+{
+	MidiDemux *d = static_cast<MidiDemux *> (userData);
+	MidiFrame f;
+
+	(void) timeStamp;
+	if (message->empty () || message->size () > MIDI_FRAME_MAX)
+		return;
+	f.len = (unsigned char) message->size ();
+	memcpy (f.data, message->data (), f.len);
+	f.source = -1;
+	f.ts = midi_reader_get_time (NULL);
+	midi_demux_put (&d->demux, &f);
+}
+
+bool
+MidiDemux::open (uint32_t rings, unsigned int size)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_demux_init (&this->demux, rings, size);
+	return (this->opened);
+}
+
+void
+MidiDemux::close ()
+{
+	if (this->opened) {
+		midi_demux_free (&this->demux);
+		this->opened = false;
+	}
+}
+
+bool
+MidiDemux::put (const MidiFrame& frame)
+{
+	return (midi_demux_put (&this->demux, &frame));
+}
+
+bool
+MidiDemux::attach (MidiReader& reader)
+{
+	return (reader.addTap (midi_demux_tap, &this->demux));
+}
+
+void
+MidiDemux::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_demux_tap, &this->demux);
+}
+
+void
+MidiDemux::attach (RtMidiIn& in)
+{
+	in.setCallback (rtMidiCallback, this);
+}
+
+bool
+MidiDemux::get (int channel, MidiFrame& frame)
+{
+	return (midi_demux_get (&this->demux, channel, &frame));
+}
+
+unsigned int
+MidiDemux::count (int channel)
+{
+	return (midi_demux_count (&this->demux, channel));
+}
+
+bool
+MidiDemux::getStats (int channel, MidiDemuxStats& stats)
+{
+	return (midi_demux_get_stats (&this->demux, channel, &stats));
+}
+
+MidiBroadcast::MidiBroadcast ()
+{
+	memset (&this->bcast, 0, sizeof (midi_bcast_t));
+	this->opened = false;
+}
+
+MidiBroadcast::~MidiBroadcast ()
+{
+	this->close ();
+}
+
+void
+MidiBroadcast::rtMidiCallback (double timeStamp,
+				std::vector<unsigned char> *message,
+				void *userData)
+{
+	MidiBroadcast *b = static_cast<MidiBroadcast *> (userData);
+	MidiFrame f;
+
+	(void) timeStamp;
+	if (message->empty () || message->size () > MIDI_FRAME_MAX)
+		return;
+	f.len = (unsigned char) message->size ();
+	memcpy (f.data, message->data (), f.len);
+	f.source = -1;
+	f.ts = midi_reader_get_time (NULL);
+	midi_bcast_put (&b->bcast, &f);
+}
+
+bool
+MidiBroadcast::open (unsigned int ringSize)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_bcast_init (&this->bcast, ringSize);
+	return (this->opened);
+}
+
+void
+MidiBroadcast::close ()
+{
+	if (this->opened) {
+		midi_bcast_free (&this->bcast);
+		this->opened = false;
+	}
+}
+
+int
+MidiBroadcast::subscribe ()
+{
+	return (midi_bcast_subscribe (&this->bcast));
+}
+
+void
+MidiBroadcast::unsubscribe (int id)
+{
+	midi_bcast_unsubscribe (&this->bcast, id);
+}
+
+void
+MidiBroadcast::filter (int id, unsigned char status, int channel)
+{
+	midi_bcast_filter (&this->bcast, id, status, channel);
+}
+
+int
+MidiBroadcast::put (const MidiFrame& frame)
+{
+	return (midi_bcast_put (&this->bcast, &frame));
+}
+
+bool
+MidiBroadcast::attach (MidiReader& reader)
+{
+	return (reader.addTap (midi_bcast_tap, &this->bcast));
+}
+
+void
+MidiBroadcast::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_bcast_tap, &this->bcast);
+}
+
+void
+MidiBroadcast::attach (RtMidiIn& in)
+{
+	in.setCallback (rtMidiCallback, this);
+}
+
+const MidiFrame *
+MidiBroadcast::next (int id)
+{
+	return (midi_bcast_next (&this->bcast, id));
+}
+
+void
+MidiBroadcast::release (const MidiFrame *frame)
+{
+	midi_bcast_release (&this->bcast, frame);
+}
+
+bool
+MidiBroadcast::getStats (int id, MidiBroadcastStats& stats)
+{
+	return (midi_bcast_get_stats (&this->bcast, id, &stats));
+}
+
+MidiHub::MidiHub ()
+{
+	memset (&this->hub, 0, sizeof (midi_hub_t));
+	this->opened = false;
+}
+
+MidiHub::~MidiHub ()
+{
+	this->close ();
+}
+
+bool
+MidiHub::create (const char *name, unsigned int size)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_hub_create (&this->hub, name, size);
+	return (this->opened);
+}
+
+bool
+MidiHub::join (const char *name)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_hub_attach (&this->hub, name);
+	return (this->opened);
+}
+
+void
+MidiHub::close ()
+{
+	if (this->opened) {
+		midi_hub_close (&this->hub);
+		this->opened = false;
+	}
+}
+
+bool
+MidiHub::list (int n, std::string& name)
+{
+	char buf[MIDI_HUB_NAME_MAX + 1];
+
+	if ( ! midi_hub_list (n, buf, sizeof (buf)))
+		return (false);
+	name = buf;
+	return (true);
+}
+
+bool
+MidiHub::publish (const MidiFrame& frame)
+{
+	return (midi_hub_publish (&this->hub, &frame));
+}
+
+bool
+MidiHub::attach (MidiReader& reader)
+{
+	return (reader.addTap (midi_hub_tap, &this->hub));
+}
+
+void
+MidiHub::detach (MidiReader& reader)
+{
+	reader.removeTap (midi_hub_tap, &this->hub);
+}
+
+int
+MidiHub::next (MidiFrame& frame, int timeout)
+{
+	return (midi_hub_next (&this->hub, &frame, timeout));
+}
+
+void
+MidiHub::interrupt ()
+{
+	midi_hub_interrupt (&this->hub);
+}
+
+bool
+MidiHub::send (const unsigned char *message, size_t size)
+{
+	MidiFrame f;
+
+	if (message == NULL || size == 0 || size > MIDI_FRAME_MAX)
+		return (false);
+	f.len = (unsigned char) size;
+	memcpy (f.data, message, size);
+	f.source = -1;
+	f.ts = midi_reader_get_time (NULL);
+	return (midi_hub_send (&this->hub, &f));
+}
+
+bool
+MidiHub::getOutput (MidiFrame& frame)
+{
+	return (midi_hub_get_output (&this->hub, &frame));
+}
+
+bool
+MidiHub::startOutput (int fd)
+{
+	return (midi_hub_start_output (&this->hub, fd));
+}
+
+void
+MidiHub::stopOutput ()
+{
+	midi_hub_stop_output (&this->hub);
+}
+
+void
+MidiHub::getStats (MidiHubStats& stats)
+{
+	midi_hub_get_stats (&this->hub, &stats);
+}
+
+MidiVirtualPort::MidiVirtualPort ()
+{
+	this->pty.master = this->pty.slave = this->pty.lock = -1;
+	this->pty.name[0] = this->pty.path[0] = this->pty.slave_path[0] = 0;
+	this->opened = false;
+}
+
+MidiVirtualPort::~MidiVirtualPort ()
+{
+	this->close ();
+}
+
+bool
+MidiVirtualPort::open (const char *name)
+{
+	if (this->opened)
+		return (false);
+	this->opened = midi_pty_open (&this->pty, name);
+	return (this->opened);
+}
+
+void
+MidiVirtualPort::close ()
+{
+	if (this->opened) {
+		midi_pty_close (&this->pty);
+		this->opened = false;
+	}
+}
+
+int
+MidiVirtualPort::getDescriptor ()
+{
+	return (this->opened ? this->pty.master : -1);
+}
+
+const char *
+MidiVirtualPort::getPath ()
+{
+	return (this->opened ? this->pty.path : NULL);
+}
+
+MidiClock::MidiClock ()
+{
+}
+
+MidiClock::~MidiClock ()
+{
+}
+
+uint64_t
+MidiClock::now ()
+{
+	return (this->getFunction () (this->getArg ()));
+}
+
+MidiClockFunc
+MidiClock::getFunction ()
+{
+	return (midi_clock_monotonic);
+}
+
+void *
+MidiClock::getArg ()
+{
+	return (NULL);
+}
+
+MidiManualClock::MidiManualClock (uint64_t time)
+{
+	midi_clock_manual_init (&this->clock, time);
+}
+
+void
+MidiManualClock::set (uint64_t time)
+{
+	midi_clock_manual_set (&this->clock, time);
+}
+
+uint64_t
+MidiManualClock::advance (uint64_t delta)
+{
+	return (midi_clock_manual_advance (&this->clock, delta));
+}
+
+MidiClockFunc
+MidiManualClock::getFunction ()
+{
+	return (midi_clock_manual);
+}
+
+void *
+MidiManualClock::getArg ()
+{
+	return (&this->clock);
+}
+
+MidiTscClock::MidiTscClock (int ms)
+{
+	midi_clock_tsc_init (&this->clock, ms);
+}
+
+bool
+MidiTscClock::calibrate (int ms)
+{
+	return (midi_clock_tsc_init (&this->clock, ms));
+}
+
+bool
+MidiTscClock::usesCounter ()
+{
+	return (this->clock.counter);
+}
+
+MidiClockFunc
+MidiTscClock::getFunction ()
+{
+	return (midi_clock_tsc);
+}
+
+void *
+MidiTscClock::getArg ()
+{
+	return (&this->clock);
+}
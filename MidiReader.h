@@ -28,12 +28,71 @@
 #define MIDI_READER_HPP
 
 #include "midi_reader.h"
+#include "midi_capture.h"
+#include "midi_replay.h"
+#include "midi_smf.h"
+#include "midi_flightrec.h"
+#include "midi_rawcap.h"
+#include "midi_pparse.h"
+#include "midi_colstore.h"
+#include "midi_router.h"
+#include "midi_thru.h"
+#include "midi_xform.h"
+#include "midi_batch.h"
+#include "midi_state.h"
+#include "midi_hires.h"
+#include "midi_dispatch.h"
+#include "midi_demux.h"
+#include "midi_bcast.h"
+#include "midi_hub.h"
+#include "midi_pty.h"
+#include "midi_clock.h"
+#include <string>
+#include <vector>
+
+class RtMidiIn;
+class RtMidiOut;
+class MidiClock;
 
 typedef midi_frame_state_t MidiFrameState;
 typedef midi_reader_flags_t MidiReaderFlags;
 typedef midi_reader_callback_t MidiReaderFunc;
 typedef midi_frame_t MidiFrame;
 typedef midi_reader_stats_t MidiReaderStats;
+typedef midi_capture_stats_t MidiCaptureStats;
+typedef midi_capture_codec_t MidiCaptureCodec;
+typedef midi_replay_mode_t MidiReplayMode;
+typedef midi_replay_callback_t MidiReplayFunc;
+typedef midi_replay_stats_t MidiReplayStats;
+typedef midi_reader_tap_t MidiReaderTap;
+typedef midi_reader_filter_t MidiReaderFilter;
+typedef midi_reader_raw_callback_t MidiReaderRawFunc;
+typedef midi_smf_writer_stats_t MidiSmfWriterStats;
+typedef midi_smf_event_t MidiSmfEvent;
+typedef midi_smf_player_callback_t MidiSmfPlayerFunc;
+typedef midi_smf_player_stats_t MidiSmfPlayerStats;
+typedef midi_rawcap_stats_t MidiRawCaptureStats;
+typedef midi_pparse_callback_t MidiParallelFunc;
+typedef midi_pparse_stats_t MidiParallelStats;
+typedef midi_colstore_row_t MidiColumnRow;
+typedef midi_colstore_query_t MidiColumnQuery;
+typedef midi_colstore_stats_t MidiColumnStats;
+typedef midi_colstore_callback_t MidiColumnFunc;
+typedef midi_router_route_t MidiRoute;
+typedef midi_router_stats_t MidiRouterStats;
+typedef midi_router_output_t MidiRouterOutputFunc;
+typedef midi_thru_stats_t MidiThruStats;
+typedef midi_batch_isa_t MidiBatchIsa;
+typedef midi_state_channel_t MidiChannelState;
+typedef midi_hires_type_t MidiHiResType;
+typedef midi_hires_event_t MidiHiResEvent;
+typedef midi_hires_callback_t MidiHiResFunc;
+typedef midi_hires_stats_t MidiHiResStats;
+typedef midi_dispatch_handler_t MidiDispatchFunc;
+typedef midi_demux_stats_t MidiDemuxStats;
+typedef midi_bcast_stats_t MidiBroadcastStats;
+typedef midi_hub_stats_t MidiHubStats;
+typedef midi_clock_func_t MidiClockFunc;
 
 /* A MIDI reader. */
 class MidiReader
@@ -70,9 +129,63 @@ class MidiReader
 	 * failure. */
 	bool removeSource (int fd);
 
+	/* Add a filter function to the source reading from 'fd' (see
+	 * midi_reader_add_filter). Returns false if there is no such source
+	 * or if it has too many filters.
+	 */
+	bool addFilter (int fd, MidiReaderFilter filter, void *userData);
+
+	/* Remove a filter function of a source. Returns false if not found.
+	 */
+	bool removeFilter (int fd, MidiReaderFilter filter, void *userData);
+
+	/* Add a tap function to the source reading from 'fd' (see
+	 * midi_reader_add_source_tap). Returns false if there is no such
+	 * source or if it has too many taps.
+	 */
+	bool addSourceTap (int fd, MidiReaderTap tap, void *userData);
+
+	/* Remove a tap function of a source. Returns false if not found. */
+	bool removeSourceTap (int fd, MidiReaderTap tap, void *userData);
+
+	/* Get the id of the source reading from 'fd' (as reported in the
+	 * frames), or -1 if none.
+	 */
+	int getSourceId (int fd);
+
+	/* Get the current time of the reader (ns), as used for the frame
+	 * timestamps.
+	 */
+	uint64_t getTime ();
+
+	/* Set the clock of the timestamps of the frames, or NULL for the
+	 * default CLOCK_MONOTONIC (see midi_reader_set_clock). The clock
+	 * must stay valid while set.
+	 */
+	void setClock (MidiClock *clock);
+
+	/* Get the underlying C reader (see midi_reader.h). */
+	midi_reader_t *getHandle ();
+
+	/* Read all sources once and parse all the bytes read (see
+	 * midi_reader_pump). Returns the count of frames completed.
+	 */
+	int pump ();
+
+	/* Add a tap function, called with each accepted frame besides the
+	 * callback and the queue (see midi_reader_add_tap). Returns false if
+	 * there are too many taps.
+	 */
+	bool addTap (MidiReaderTap tap, void *userData);
+
+	/* Remove a tap function. Returns false if not found. */
+	bool removeTap (MidiReaderTap tap, void *userData);
+
 	/* Set the file descriptor where to dump frames.
 	 * Returns false on error.
-	 * Dump file is closed when calling "close" method.
+	 * Dump file is closed when calling "close" method. With flag
+	 * MIDIR_RAW, the chunks are written as read and flag MIDIR_DUMPHEX is
+	 * refused.
 	 */
 	bool setDumpFile (int fd);
 
@@ -82,6 +195,21 @@ class MidiReader
 	 */
 	bool setDumpFile (const char *path, bool trunc);
 
+	/* Dump the frames to 'fd' in the binary capture format (see class
+	 * MidiCapture and midi_capture_set_dump), not in raw mode. The block
+	 * index is written and 'fd' closed by method "close". Returns false
+	 * on error.
+	 */
+	bool setDumpCapture (int fd);
+
+	/* Same as other method "setDumpCapture", creating or truncating the
+	 * file 'path'.
+	 */
+	bool setDumpCapture (const char *path);
+
+	/* Write buffered dump data, if any. Returns false on error. */
+	bool flushDump ();
+
 	/* Set a user callback function with optional argument. Note that when
 	 * using a callback, you should call regularly method "getNext" or
 	 * "clearQueue" so that the internal queue get not full.
@@ -94,6 +222,11 @@ class MidiReader
 	 */
 	void setCallback (MidiReaderFunc cb, void *userData);
 
+	/* Set the callback called with each chunk of bytes read when the
+	 * reader has flag MIDIR_RAW (see midi_reader_set_raw_callback).
+	 */
+	void setRawCallback (MidiReaderRawFunc cb, void *userData);
+
 	/* Close this MIDI reader. Note that method "getNext" may be called
 	 * after this one until the frames already read and stored in the
 	 * internal queue are exhausted, but no new frame will be read.
@@ -119,6 +252,11 @@ class MidiReader
 	/* Return next valid MIDI frame read by the reader, or NULL if none. */
 	MidiFrame* getNext ();
 
+	/* Return the next frame of the internal queue without reading the
+	 * sources (after "pump", ..), or NULL if none.
+	 */
+	MidiFrame* pop ();
+
 	/* Remove all recorded frames. */
 	void clearQueue ();
 
@@ -150,4 +288,1269 @@ class MidiReader
 	unsigned int available ();
 };
 
+/* A writer of capture files (see midi_capture.h). */
+class MidiCaptureWriter
+{
+	protected:
+
+	midi_capture_writer_t writer;
+	bool opened;
+
+	public:
+
+	/* Create a closed capture writer. */
+	MidiCaptureWriter ();
+
+	/* Destroy the writer, closing it if needed. */
+	virtual ~MidiCaptureWriter ();
+
+	/* Start writing a capture to 'fd', which is not closed by method
+	 * "close". 'blockMax' is the maximal block payload size (0: default).
+	 * Returns false on error.
+	 */
+	bool open (int fd, unsigned int blockMax = 0);
+
+	/* Create or truncate the capture file 'path'. Returns false on error. */
+	bool open (const char *path, unsigned int blockMax = 0);
+
+	/* Compress the blocks with 'codec', in a background thread if
+	 * 'background' is true; write() waits at most
+	 * MIDI_CAPTURE_QUEUE_WAIT_MS for the thread, then refuses the frame.
+	 * Must be called before the first frame. Returns false on error.
+	 */
+	bool setCodec (MidiCaptureCodec codec, bool background = true);
+
+	/* Append a frame using its timestamp and source id. */
+	bool write (const MidiFrame& frame);
+
+	/* Append 'len' bytes read from 'source' at time 'ts' (ns). */
+	bool write (uint64_t ts, int source, const unsigned char *data,
+			int len);
+
+	/* Write the current block, if not empty. */
+	bool flush ();
+
+	/* Write the block index and close the capture. Returns false if any
+	 * write failed.
+	 */
+	bool close ();
+
+	/* Get the statistics of the writer. */
+	void getStats (MidiCaptureStats& stats);
+};
+
+/* A memory-mapped capture file, read with a cursor. */
+class MidiCapture
+{
+	protected:
+
+	midi_capture_t cap;
+
+	public:
+
+	/* Create a closed capture. */
+	MidiCapture ();
+
+	/* Destroy the capture, closing it if needed. */
+	virtual ~MidiCapture ();
+
+	/* Open the capture file 'path'. Returns false on error. */
+	bool open (const char *path);
+
+	/* Close the capture file. */
+	void close ();
+
+	/* Set the cursor at the first frame at or after time 't' (ns).
+	 * Returns false if there is no such frame.
+	 */
+	bool seek (uint64_t t);
+
+	/* Read the next frame. Returns false at the end of the capture. */
+	bool next (MidiFrame& frame);
+
+	/* Get the timestamps of the first and last frames. Returns false if
+	 * the capture is empty.
+	 */
+	bool getRange (uint64_t& first, uint64_t& last);
+
+	/* Get the count of frames in the capture. */
+	uint64_t count ();
+
+	/* Get the count of blocks in the capture. */
+	unsigned int getBlockCount ();
+};
+
+/* Replay of a capture file into a MidiReader, a RtMidiOut port and/or a
+ * user callback.
+ */
+class MidiReplay
+{
+	protected:
+
+	midi_replay_t replay;
+	bool opened;
+	RtMidiOut *output;
+	MidiReplayFunc callback;
+	void *userData;
+
+	static bool dispatch (const midi_frame_t *mf, void *userData);
+
+	public:
+
+	/* Create a closed replay. */
+	MidiReplay ();
+
+	/* Destroy the replay, closing it if needed. */
+	virtual ~MidiReplay ();
+
+	/* Open the capture file 'path', in original timing. The mode, range
+	 * and reader must be set after this. Returns false on error.
+	 */
+	bool open (const char *path);
+
+	/* Close the capture file. */
+	void close ();
+
+	/* Set the pacing (speed is used with MIDI_REPLAY_SCALED). Returns
+	 * false on error.
+	 */
+	bool setMode (MidiReplayMode mode, double speed = 1.0);
+
+	/* Replay only the frames between capture times 'from' and 'to' (ns,
+	 * 0 for no limit).
+	 */
+	void setRange (uint64_t from, uint64_t to);
+
+	/* Inject the frames into 'reader' (NULL for none). */
+	void setReader (MidiReader *reader);
+
+	/* Send the frames to the open port 'out' (NULL for none). */
+	void setOutput (RtMidiOut *out);
+
+	/* Set a user callback called for each frame (NULL for none). */
+	void setCallback (MidiReplayFunc cb, void *userData);
+
+	/* Run the replay (see midi_replay_run). Returns false on error. */
+	bool run ();
+
+	/* Stop a running replay, from another thread. */
+	void stop ();
+
+	/* Get the statistics of the last replay. */
+	void getStats (MidiReplayStats& stats);
+
+	/* Print the statistics of the last replay to a file descriptor. */
+	void dumpStats (int fd);
+};
+
+/* Streaming Standard MIDI File writer, fed by a MidiReader, a RtMidiIn
+ * port or explicit frames (see midi_smf.h).
+ */
+class MidiSmfWriter
+{
+	protected:
+
+	midi_smf_writer_t writer;
+	bool opened;
+	uint64_t rtTime;
+	bool rtFirst;
+
+	public:
+
+	/* Create a closed writer. */
+	MidiSmfWriter ();
+
+	/* Destroy the writer, closing it if needed. The writer must have been
+	 * detached from any reader or port before.
+	 */
+	virtual ~MidiSmfWriter ();
+
+	/* Create or truncate the file 'path' and start recording. 'format'
+	 * is 0 or 1 (one track per source); 'ppq' and 'tempo' (us per quarter
+	 * note) may be 0 for the defaults. Returns false on error.
+	 */
+	bool open (const char *path, int format = 0, unsigned int ppq = 0,
+			unsigned int tempo = 0);
+
+	/* Write the pending events and fix the chunks of the file. Returns
+	 * false if any write failed.
+	 */
+	bool close ();
+
+	/* Record the frames accepted by 'reader'. Returns false on error. */
+	bool attach (MidiReader& reader);
+
+	/* Stop recording the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Record the messages of 'in', using its callback: any user callback
+	 * must have been cancelled before.
+	 */
+	void attach (RtMidiIn& in);
+
+	/* Stop recording the messages of 'in' (cancels its callback). */
+	void detach (RtMidiIn& in);
+
+	/* Record a frame. Returns false if it was dropped. */
+	bool write (const MidiFrame& frame);
+
+	/* Get the statistics of the writer. */
+	void getStats (MidiSmfWriterStats& stats);
+
+	/* RtMidiIn callback, with the writer as user data. */
+	static void rtMidiCallback (double timeStamp,
+				std::vector<unsigned char> *message,
+				void *userData);
+};
+
+/* Standard MIDI File player sending each track to one of several RtMidiOut
+ * ports and/or to a user callback (see midi_smf.h). The outputs and routes
+ * must be set while the player is stopped.
+ */
+class MidiSmfPlayer
+{
+	protected:
+
+	midi_smf_player_t player;
+	bool opened;
+	std::vector<RtMidiOut *> outputs;
+	std::vector<int> routes;
+	MidiSmfPlayerFunc callback;
+	void *userData;
+
+	static bool dispatch (const midi_smf_event_t *ev,
+				const unsigned char *msg, uint32_t len,
+				void *userData);
+
+	public:
+
+	/* Create a closed player. */
+	MidiSmfPlayer ();
+
+	/* Destroy the player, closing it if needed. */
+	virtual ~MidiSmfPlayer ();
+
+	/* Load the file 'path'; all its tracks are sent to the first output.
+	 * Returns false on error.
+	 */
+	bool open (const char *path);
+
+	/* Stop the playback and release the file. */
+	void close ();
+
+	/* Get the count of tracks of the file. */
+	int getTrackCount ();
+
+	/* Add the open port 'out' as an output, returns its index. */
+	int addOutput (RtMidiOut *out);
+
+	/* Send the events of 'track' to output 'output' (-1 for none).
+	 * Returns false if the track or output does not exist.
+	 */
+	bool setTrackOutput (int track, int output);
+
+	/* Set a user callback called for each event (NULL for none). */
+	void setCallback (MidiSmfPlayerFunc cb, void *userData);
+
+	/* Set the lookahead window and the busy-wait time before each event
+	 * (ns, 0 to keep the current value).
+	 */
+	void setLookahead (uint64_t lookahead, uint64_t spin = 0);
+
+	/* Get the time of the last event of the song (ns). */
+	uint64_t getDuration ();
+
+	/* Get the time of the last event sent (ns). */
+	uint64_t getPosition ();
+
+	/* Move to time 'ns' of the song while stopped. Returns false on
+	 * error.
+	 */
+	bool seek (uint64_t ns);
+
+	/* Play in the calling thread until the end or "stop". */
+	bool run ();
+
+	/* Play in a background thread. Returns false on error. */
+	bool start ();
+
+	/* Stop the playback; the position is kept. */
+	void stop ();
+
+	/* Get the statistics of the last playback. */
+	void getStats (MidiSmfPlayerStats& stats);
+};
+
+/* Always-on flight recorder of the last frames into a ring file, saved
+ * as a capture file on demand (see midi_flightrec.h).
+ */
+class MidiFlightRecorder
+{
+	protected:
+
+	midi_flightrec_t rec;
+	bool opened;
+
+	public:
+
+	/* Create a closed recorder. */
+	MidiFlightRecorder ();
+
+	/* Destroy the recorder, closing it if needed. It must have been
+	 * detached from any reader before.
+	 */
+	virtual ~MidiFlightRecorder ();
+
+	/* Create the ring file 'path' with 'nslots' slots (a power of 2, 0
+	 * for the default). Returns false on error.
+	 */
+	bool open (const char *path, unsigned int nslots = 0);
+
+	/* Unmap the ring file, which is kept. */
+	void close ();
+
+	/* Record the frames accepted by 'reader'. Returns false on error. */
+	bool attach (MidiReader& reader);
+
+	/* Stop recording the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Record a frame. */
+	void record (const MidiFrame& frame);
+
+	/* Get the count of slots written since the creation of the ring. */
+	uint64_t getCount ();
+
+	/* Save the frames of the ring (of the last 'window' ns if not 0) to
+	 * the capture file 'path'. Returns false on error.
+	 */
+	bool snapshot (const char *path, uint64_t window = 0);
+
+	/* Save the ring to "<path>.<n>" on each signal 'sig'. Returns false
+	 * on error.
+	 */
+	bool setSignal (int sig, const char *path);
+
+	/* Save an existing ring file, as left by a crashed process, to the
+	 * capture file 'path'. Returns false on error.
+	 */
+	static bool recover (const char *ringPath, const char *path,
+				uint64_t window = 0);
+};
+
+/* Raw capture of the bytes of a device to a file with a side index of
+ * their time, parsed later (see midi_rawcap.h).
+ */
+class MidiRawCapture
+{
+	protected:
+
+	midi_rawcap_t rc;
+	bool opened;
+
+	public:
+
+	/* Create a closed capture. */
+	MidiRawCapture ();
+
+	/* Destroy the capture, closing it if needed. */
+	virtual ~MidiRawCapture ();
+
+	/* Start capturing the bytes of 'fd' into 'path' and "<path>.idx".
+	 * Returns false on error.
+	 */
+	bool open (int fd, const char *path);
+
+	/* Write the index and close the files. Returns false if any write
+	 * failed.
+	 */
+	bool close ();
+
+	/* Move the available bytes once (see midi_rawcap_pump). */
+	ssize_t pump ();
+
+	/* Capture until the end of data or "stop". Returns false on error. */
+	bool run ();
+
+	/* Stop "run", from another thread. */
+	void stop ();
+
+	/* Get the statistics of the capture. */
+	void getStats (MidiRawCaptureStats& stats);
+
+	/* Parse the raw capture 'path' into 'reader' with its timing, as
+	 * source 'id'. Returns the count of frames, or -1 on error.
+	 */
+	static long parse (const char *path, MidiReader& reader, int id = 0);
+
+	/* Convert the raw capture 'path' to the capture file 'capPath'.
+	 * Returns false on error.
+	 */
+	static bool convert (const char *path, const char *capPath);
+};
+
+/* Parallel offline parser of raw dumps, raw captures and capture files
+ * (see midi_pparse.h).
+ */
+class MidiParallelParser
+{
+	protected:
+
+	midi_pparse_t pp;
+
+	public:
+
+	/* Create a parser: 'flags' are those of the readers parsing raw
+	 * data; 'threads' and 'chunk' may be 0 for the defaults.
+	 */
+	MidiParallelParser (MidiReaderFlags flags = MIDIR_EXPAND,
+				int threads = 0, size_t chunk = 0);
+
+	/* Set the callback receiving the frames in order. */
+	void setCallback (MidiParallelFunc cb, void *userData);
+
+	/* Parse the capture or raw file 'path'. Returns false on error or if
+	 * the callback stopped the parse.
+	 */
+	bool parseFile (const char *path);
+
+	/* Parse raw MIDI bytes in memory. */
+	bool parse (const unsigned char *data, size_t size);
+
+	/* Get the statistics of the last parse. */
+	void getStats (MidiParallelStats& stats);
+};
+
+/* Writer of a columnar event store (see midi_colstore.h). */
+class MidiColumnStoreWriter
+{
+	protected:
+
+	midi_colstore_writer_t writer;
+	bool opened;
+
+	public:
+
+	/* Create a closed writer. */
+	MidiColumnStoreWriter ();
+
+	/* Destroy the writer, closing it if needed. The writer must have been
+	 * detached from any reader before.
+	 */
+	virtual ~MidiColumnStoreWriter ();
+
+	/* Create or truncate the store 'path'. 'blockRows' is the count of
+	 * rows per block (0: default). Returns false on error.
+	 */
+	bool open (const char *path, uint32_t blockRows = 0);
+
+	/* Write the last block and the summaries. Returns false if any write
+	 * failed.
+	 */
+	bool close ();
+
+	/* Store the frames accepted by 'reader'. Returns false on error. */
+	bool attach (MidiReader& reader);
+
+	/* Stop storing the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Store a frame. Returns false on error. */
+	bool write (const MidiFrame& frame);
+};
+
+/* Memory-mapped columnar event store, with queries skipping the blocks by
+ * their summary (see midi_colstore.h).
+ */
+class MidiColumnStore
+{
+	protected:
+
+	midi_colstore_t store;
+	bool opened;
+
+	public:
+
+	/* Create a closed store. */
+	MidiColumnStore ();
+
+	/* Destroy the store, closing it if needed. */
+	virtual ~MidiColumnStore ();
+
+	/* Map the store 'path'. Returns false on error. */
+	bool open (const char *path);
+
+	/* Unmap the store. */
+	void close ();
+
+	/* Get the count of rows. */
+	uint64_t getRowCount ();
+
+	/* Get the row 'index'. Returns false if out of range. */
+	bool getRow (uint64_t index, MidiColumnRow& row);
+
+	/* Run a query, calling 'cb' (NULL to count) with each row matched.
+	 * Returns the count of rows matched.
+	 */
+	uint64_t query (const MidiColumnQuery& q, MidiColumnFunc cb = NULL,
+			void *userData = NULL, MidiColumnStats *stats = NULL);
+
+	/* Initialize a query accepting all rows. */
+	static void initQuery (MidiColumnQuery& q);
+
+	/* Restrict the status bytes of a query (see
+	 * midi_colstore_query_add_type).
+	 */
+	static void addType (MidiColumnQuery& q, unsigned char status,
+				int channel = 0);
+
+	/* Build the store 'path' from the capture or raw file 'srcPath' with
+	 * 'threads' threads (0: count of CPUs). Returns false on error.
+	 */
+	static bool build (const char *srcPath, const char *path,
+				int threads = 0, uint32_t blockRows = 0);
+};
+
+/* Router connecting the sources of a MidiReader and RtMidiIn ports to
+ * RtMidiOut ports or output functions, thru compiled routes (see
+ * midi_router.h).
+ */
+class MidiRouter
+{
+	protected:
+
+	/* an output port */
+	struct Port {
+		RtMidiOut *out;
+		bool batch; /* the port takes several messages at once */
+	};
+
+	/* an input port, with its own routing context */
+	struct Input {
+		MidiRouter *router;
+		RtMidiIn *in;
+		int source;
+		midi_router_ctx_t ctx;
+	};
+
+	midi_router_t router;
+	Port ports[MIDI_ROUTER_OUTPUTS_MAX];
+	std::vector<Input *> inputs;
+	midi_router_ctx_t ctx; /* context of "run" */
+	int stopFlag;
+
+	/* Output function sending a batch to a port. */
+	static void sendPort (const unsigned char *buf, uint32_t len,
+				uint32_t count, void *userData);
+
+	/* RtMidiIn callback, with an input as user data. */
+	static void rtMidiCallback (double timeStamp,
+					std::vector<unsigned char> *message,
+					void *userData);
+
+	public:
+
+	/* Create a router without outputs or routes. */
+	MidiRouter ();
+
+	/* Destroy the router, detaching its RtMidiIn ports. */
+	virtual ~MidiRouter ();
+
+	/* Add an output port. Batches are sent at once to ports of the DIRECT
+	 * API, message per message to the others. Returns the index of the
+	 * output, or -1 on error.
+	 */
+	int addOutput (RtMidiOut *out);
+
+	/* Add an output function. Returns its index, or -1 on error. */
+	int addOutput (MidiRouterOutputFunc fn, void *userData);
+
+	/* Add a route. Returns its index, or -1 on error. */
+	int addRoute (const MidiRoute& route);
+
+	/* Remove all routes. */
+	void clearRoutes ();
+
+	/* Compile the routes; must be called after changing them, while not
+	 * routing. Returns false on error.
+	 */
+	bool compile ();
+
+	/* Initialize a route from 'source' (-1: all) to 'output', accepting
+	 * all messages without transform.
+	 */
+	static void initRoute (MidiRoute& route, int source = -1,
+				int output = 0);
+
+	/* Restrict the status bytes of a route (see
+	 * midi_router_route_add_type).
+	 */
+	static void addType (MidiRoute& route, unsigned char status,
+				int channel = 0);
+
+	/* Route the messages of 'in' as frames of source 'source'. Returns
+	 * false on error.
+	 */
+	bool attach (RtMidiIn& in, int source);
+
+	/* Stop routing the messages of 'in'. */
+	void detach (RtMidiIn& in);
+
+	/* Route the frames of 'reader' in the calling thread until "stop" is
+	 * called or all its sources are closed (see midi_router_run).
+	 */
+	bool run (MidiReader& reader, int timeout = 100);
+
+	/* Stop "run", from another thread or from an output. */
+	void stop ();
+
+	/* Get the statistics of all routing contexts. */
+	void getStats (MidiRouterStats& stats);
+};
+
+/* Soft-thru forwarding the input of a MidiReader to an output descriptor
+ * from the thread reading it (see midi_thru.h).
+ */
+class MidiThru
+{
+	protected:
+
+	midi_thru_t thru;
+	int stopFlag;
+
+	public:
+
+	/* Create a thru to 'fd', forwarding all messages. */
+	MidiThru (int fd = -1);
+
+	/* Set the output descriptor; it is not closed by the thru. */
+	void setOutput (int fd);
+
+	/* Do not forward the messages with status byte 'status' (see
+	 * midi_thru_skip).
+	 */
+	void skip (unsigned char status, int channel = 0);
+
+	/* Forward the frames (or the raw chunks, with MIDIR_RAW) of 'reader'
+	 * when "flush" is called. Returns false on error.
+	 */
+	bool attach (MidiReader& reader);
+
+	/* Stop forwarding the input of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Write the bytes to forward. Returns false on error. */
+	bool flush ();
+
+	/* Forward the input of 'reader' in the calling thread until "stop" is
+	 * called or all its sources are closed (see midi_thru_run).
+	 */
+	bool run (MidiReader& reader, int timeout = 100);
+
+	/* Stop "run", from another thread. */
+	void stop ();
+
+	/* Get the statistics of the thru. */
+	void getStats (MidiThruStats& stats);
+};
+
+/* Transform of channel messages compiled into lookup tables, set on a
+ * source of a MidiReader or on a route of a MidiRouter (see midi_xform.h).
+ */
+class MidiTransform
+{
+	protected:
+
+	midi_xform_t xform;
+
+	public:
+
+	/* Create a transform keeping all messages unchanged. */
+	MidiTransform ();
+
+	/* Keep all messages unchanged. */
+	void reset ();
+
+	/* Drop the messages with status byte 'status' (see
+	 * midi_xform_filter).
+	 */
+	void filter (unsigned char status, int channel = 0);
+
+	/* Send the messages of channel 'from' (0: all) to channel 'to' (0:
+	 * drop), or also to 'to' with 'layer'.
+	 */
+	void mapChannel (int from, int to, bool layer = false);
+
+	/* Map note 'from' to note 'to' (or MIDI_XFORM_DROP) on the new
+	 * channel 'channel' (0: all).
+	 */
+	void mapNote (int channel, int from, int to);
+
+	/* Transpose the notes of the new channel 'channel' (0: all). */
+	void transpose (int channel, int semitones);
+
+	/* Keep only the notes 'low' .. 'high' of the new channel 'channel'
+	 * (0: all).
+	 */
+	void noteRange (int channel, int low, int high);
+
+	/* Set the velocity curve (see midi_xform_velocity_curve). */
+	void velocityCurve (int min, int max, double gamma = 1.0);
+
+	/* Set the velocity table. */
+	void velocityTable (const unsigned char table[128]);
+
+	/* Map controller 'from' to controller 'to' (or MIDI_XFORM_DROP). */
+	void mapController (int from, int to);
+
+	/* Transform a frame into at most 16 frames 'out'. Returns the count
+	 * of frames, 0 if dropped.
+	 */
+	int apply (const MidiFrame& frame, MidiFrame *out) const;
+
+	/* Transform the frames of the source of 'reader' reading from 'fd',
+	 * in its parser (see midi_xform_run). The transform must stay valid
+	 * until detached. Returns false on error.
+	 */
+	bool attach (MidiReader& reader, int fd);
+
+	/* Stop transforming the frames of a source of 'reader'. */
+	void detach (MidiReader& reader, int fd);
+
+	/* Get the underlying C transform, for "MidiRoute::xform". */
+	const midi_xform_t *getHandle () const;
+};
+
+/* Batch transform of arrays of short messages packed in 3 or 4 bytes,
+ * with SIMD kernels (see midi_batch.h).
+ */
+class MidiBatchTransform
+{
+	protected:
+
+	midi_batch_t batch;
+
+	public:
+
+	/* Create a transform keeping all messages unchanged. */
+	MidiBatchTransform ();
+
+	/* Keep all messages unchanged. */
+	void reset ();
+
+	/* Drop the messages with status byte 'status' (see
+	 * midi_batch_filter).
+	 */
+	void filter (unsigned char status, int channel = 0);
+
+	/* Send the messages of channel 'from' (0: all) to channel 'to'. */
+	void mapChannel (int from, int to);
+
+	/* Transpose the notes, clamped to 0 .. 127. */
+	void transpose (int semitones);
+
+	/* Set the velocity table of note on. */
+	void velocityTable (const unsigned char table[128]);
+
+	/* Transform 'n' messages packed in 4 bytes, in place. Returns the
+	 * count of messages kept, moved to the start of the array.
+	 */
+	size_t apply (uint32_t *msgs, size_t n) const;
+
+	/* Same with messages packed in 3 bytes. */
+	size_t apply3 (unsigned char *msgs, size_t n) const;
+
+	/* Get the instruction set of the kernels. */
+	static MidiBatchIsa getIsa ();
+
+	/* Choose the instruction set of the kernels, if supported. Returns
+	 * the one used.
+	 */
+	static MidiBatchIsa setIsa (MidiBatchIsa isa);
+};
+
+/* Mirror of the state of the channels of a source (notes held,
+ * controllers, program, pressure and pitch bend), updated by the thread
+ * reading the source and read without locking by other threads (see
+ * midi_state.h). Channels are 1 .. 16.
+ */
+class MidiState
+{
+	protected:
+
+	midi_state_t state;
+
+	public:
+
+	/* Create a state with no note held. */
+	MidiState ();
+
+	/* Reset the state. */
+	void reset ();
+
+	/* Apply a frame, from the thread updating the state. */
+	void update (const MidiFrame& frame);
+
+	/* Update the state with the frames of all the sources of 'reader'.
+	 * Returns false on error.
+	 */
+	bool attach (MidiReader& reader);
+
+	/* Stop updating the state with the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Update the state with the frames of the source of 'reader' reading
+	 * from 'fd' only. Returns false on error.
+	 */
+	bool attach (MidiReader& reader, int fd);
+
+	/* Stop updating the state with the frames of a source of 'reader'. */
+	void detach (MidiReader& reader, int fd);
+
+	/* Copy the state of channel 'channel'. Returns false on error. */
+	bool getChannel (int channel, MidiChannelState& copy) const;
+
+	/* Copy the whole state into 'copy'. */
+	void snapshot (MidiState& copy) const;
+
+	/* Return true if note 'note' of channel 'channel' is held. */
+	bool isNoteOn (int channel, int note) const;
+
+	/* Get the value of controller 'cc' of channel 'channel', or -1 if it
+	 * was not received.
+	 */
+	int getController (int channel, int cc) const;
+
+	/* Get the program of channel 'channel', or -1 on error. */
+	int getProgram (int channel) const;
+
+	/* Get the channel pressure of channel 'channel', or -1 on error. */
+	int getPressure (int channel) const;
+
+	/* Get the pitch bend (0 .. 16383) of channel 'channel', or -1 on
+	 * error.
+	 */
+	int getPitchBend (int channel) const;
+
+	/* Get the underlying C state. */
+	midi_state_t *getHandle ();
+};
+
+/* Assembler of 14-bit controllers, RPN and NRPN giving one event per
+ * value, set on a source of a MidiReader (see midi_hires.h).
+ */
+class MidiHiRes
+{
+	protected:
+
+	midi_hires_t hires;
+
+	public:
+
+	/* Create an assembler for RPN and NRPN only, calling 'cb' with each
+	 * event, without pass-through.
+	 */
+	MidiHiRes (MidiHiResFunc cb = NULL, void *userData = NULL);
+
+	/* Enable (or disable) the 14-bit controller of MSB 'cc' (0 .. 31;
+	 * -1 for all but data entry). Returns false on error.
+	 */
+	bool enableController (int cc, bool enable = true);
+
+	/* Keep or remove the control changes used in the frames. */
+	void setPassthrough (bool passthrough);
+
+	/* Process a frame. Returns false if all its messages were used and
+	 * removed.
+	 */
+	bool process (MidiFrame& frame);
+
+	/* Give the pending MSB received alone. */
+	void flush ();
+
+	/* Process the frames of the source of 'reader' reading from 'fd',
+	 * before its callback (see midi_hires_run). The assembler must stay
+	 * valid until detached. Returns false on error.
+	 */
+	bool attach (MidiReader& reader, int fd);
+
+	/* Stop processing the frames of a source of 'reader'. */
+	void detach (MidiReader& reader, int fd);
+
+	/* Get the statistics of the assembler. */
+	void getStats (MidiHiResStats& stats);
+
+	/* Get the underlying C assembler. */
+	midi_hires_t *getHandle ();
+};
+
+/* Dispatcher of the frames of a MidiReader or of the messages of a
+ * RtMidiIn to handlers, thru flat tables indexed by status, channel, first
+ * data byte or sysex manufacturer ID (see midi_dispatch.h).
+ */
+class MidiDispatcher
+{
+	protected:
+
+	midi_dispatch_t dispatcher;
+
+	/* RtMidiIn callback, with a dispatcher as user data. */
+	static void rtMidiCallback (double timeStamp,
+					std::vector<unsigned char> *message,
+					void *userData);
+
+	public:
+
+	/* Create a dispatcher with no handler. */
+	MidiDispatcher ();
+
+	/* Set the handler of the frames without other handler, or NULL. */
+	void setDefault (MidiDispatchFunc fn, void *userData);
+
+	/* Set the handler of the messages of status 'status' (see
+	 * midi_dispatch_on). Returns false on error.
+	 */
+	bool on (unsigned char status, int channel, int data1,
+			MidiDispatchFunc fn, void *userData);
+
+	/* Set the handler of the sysex of manufacturer ID 'id' of 'len'
+	 * bytes, or of all of them if 'id' is NULL. Returns false on error.
+	 */
+	bool onSysex (const unsigned char *id, int len, MidiDispatchFunc fn,
+			void *userData);
+
+	/* Give a frame to its handler and return its result. */
+	MidiFrameState dispatch (MidiFrame& frame);
+
+	/* Dispatch the frames of 'reader', as its callback. */
+	void attach (MidiReader& reader);
+
+	/* Dispatch the messages of 'in', as its callback (messages longer
+	 * than MIDI_FRAME_MAX are ignored). The frames have source -1.
+	 */
+	void attach (RtMidiIn& in);
+
+	/* Get the underlying C dispatcher. */
+	midi_dispatch_t *getHandle ();
+};
+
+/* Demultiplexer of the frames of a MidiReader or of the messages of a
+ * RtMidiIn into a ring per channel and a ring for the system messages,
+ * each drained by its own consumer thread (see midi_demux.h).
+ */
+class MidiDemux
+{
+	protected:
+
+	midi_demux_t demux;
+	bool opened;
+
+	/* RtMidiIn callback, with a demultiplexer as user data. */
+	static void rtMidiCallback (double timeStamp,
+					std::vector<unsigned char> *message,
+					void *userData);
+
+	public:
+
+	/* Create a demultiplexer without rings. */
+	MidiDemux ();
+
+	/* Release the rings. */
+	virtual ~MidiDemux ();
+
+	/* Create rings of 'size' frames (0 for the default) for the channels
+	 * of 'rings' (see midi_demux_init). Returns false on failure.
+	 */
+	bool open (uint32_t rings = MIDI_DEMUX_ALL, unsigned int size = 0);
+
+	/* Release the rings, once the producer and the consumers stopped. */
+	void close ();
+
+	/* Queue a frame in the ring of its channel, from the producer
+	 * thread. Returns false if it was dropped or ignored.
+	 */
+	bool put (const MidiFrame& frame);
+
+	/* Queue the frames of 'reader', as a tap. Returns false on error. */
+	bool attach (MidiReader& reader);
+
+	/* Stop queueing the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Queue the messages of 'in', as its callback (messages longer than
+	 * MIDI_FRAME_MAX are ignored). The frames have source -1.
+	 */
+	void attach (RtMidiIn& in);
+
+	/* Get the next frame of channel 'channel' (1 .. 16, or 0 for the
+	 * system ring). Returns false if there is none.
+	 */
+	bool get (int channel, MidiFrame& frame);
+
+	/* Get the count of frames queued for channel 'channel'. */
+	unsigned int count (int channel);
+
+	/* Get the statistics of the ring of channel 'channel'. Returns false
+	 * if there is no such ring.
+	 */
+	bool getStats (int channel, MidiDemuxStats& stats);
+};
+
+/* Broadcast of the frames of a MidiReader or of the messages of a RtMidiIn
+ * to several subscribers, each with its own ring and filter, without copy
+ * per subscriber (see midi_bcast.h).
+ */
+class MidiBroadcast
+{
+	protected:
+
+	midi_bcast_t bcast;
+	bool opened;
+
+	/* RtMidiIn callback, with a broadcast as user data. */
+	static void rtMidiCallback (double timeStamp,
+					std::vector<unsigned char> *message,
+					void *userData);
+
+	public:
+
+	/* Create a broadcast without pool. */
+	MidiBroadcast ();
+
+	/* Release the pool. */
+	virtual ~MidiBroadcast ();
+
+	/* Allocate the pool, with rings of 'ringSize' frames (0 for the
+	 * default). Returns false on failure.
+	 */
+	bool open (unsigned int ringSize = 0);
+
+	/* Release the pool, once the producer and the subscribers stopped. */
+	void close ();
+
+	/* Add a subscriber accepting all frames, while the producer is not
+	 * running. Returns its id, or -1 on error.
+	 */
+	int subscribe ();
+
+	/* Remove subscriber 'id', while the producer is not running. */
+	void unsubscribe (int id);
+
+	/* Do not give the messages with status byte 'status' to subscriber
+	 * 'id' (see midi_bcast_filter).
+	 */
+	void filter (int id, unsigned char status, int channel = 0);
+
+	/* Broadcast a frame, from the producer thread. Returns the count of
+	 * subscribers it was given to.
+	 */
+	int put (const MidiFrame& frame);
+
+	/* Broadcast the frames of 'reader', as a tap. Returns false on
+	 * error.
+	 */
+	bool attach (MidiReader& reader);
+
+	/* Stop broadcasting the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Broadcast the messages of 'in', as its callback (messages longer
+	 * than MIDI_FRAME_MAX are ignored). The frames have source -1.
+	 */
+	void attach (RtMidiIn& in);
+
+	/* Get the next frame of subscriber 'id', or NULL if none. The frame
+	 * stays valid until released.
+	 */
+	const MidiFrame *next (int id);
+
+	/* Release a frame given by "next". */
+	void release (const MidiFrame *frame);
+
+	/* Get the statistics of subscriber 'id'. Returns false on error. */
+	bool getStats (int id, MidiBroadcastStats& stats);
+};
+
+/* Shared-memory hub: the owner process reads a device and publishes its
+ * frames, other processes read them and send frames to the owner (see
+ * midi_hub.h). Hubs are also listed as ports "hub:<name>" of the DIRECT
+ * API.
+ */
+class MidiHub
+{
+	protected:
+
+	midi_hub_t hub;
+	bool opened;
+
+	public:
+
+	/* Create a closed hub. */
+	MidiHub ();
+
+	/* Close the hub. */
+	virtual ~MidiHub ();
+
+	/* Create the hub 'name' as its owner, with rings of 'size' frames (0
+	 * for the default). Returns false on failure, or if a hub of the
+	 * same name exists.
+	 */
+	bool create (const char *name, unsigned int size = 0);
+
+	/* Join the hub 'name' as a client. Returns false on failure. */
+	bool join (const char *name);
+
+	/* Leave the hub; the owner removes it. */
+	void close ();
+
+	/* Get the name of the nth hub (0..). Returns false if none. */
+	static bool list (int n, std::string& name);
+
+	/* Publish a frame (owner). Returns false on error. */
+	bool publish (const MidiFrame& frame);
+
+	/* Publish the frames of 'reader', as a tap (owner). Returns false on
+	 * error.
+	 */
+	bool attach (MidiReader& reader);
+
+	/* Stop publishing the frames of 'reader'. */
+	void detach (MidiReader& reader);
+
+	/* Get the next frame published (client), waiting up to 'timeout' ms
+	 * (-1: no limit). Returns 1 if a frame was read, 0 on timeout or
+	 * interruption, -1 if the hub was closed.
+	 */
+	int next (MidiFrame& frame, int timeout = -1);
+
+	/* Interrupt "next" from another thread. */
+	void interrupt ();
+
+	/* Send a message to the owner (client). Returns false on error. */
+	bool send (const unsigned char *message, size_t size);
+
+	/* Get the next frame sent by the clients (owner). Returns false if
+	 * there is none.
+	 */
+	bool getOutput (MidiFrame& frame);
+
+	/* Write the frames sent by the clients to 'fd' from a thread
+	 * (owner). Returns false on failure.
+	 */
+	bool startOutput (int fd);
+
+	/* Stop writing the frames sent by the clients. */
+	void stopOutput ();
+
+	/* Get the statistics of the hub in this process. */
+	void getStats (MidiHubStats& stats);
+};
+
+/* A virtual port: a pseudo-terminal in raw mode whose other side is
+ * published in MIDI_PTY_DIR (see midi_pty.h), so that other programs open
+ * it as a MIDI device. Virtual ports are also listed as ports
+ * "virtual:<name>" of the DIRECT API.
+ */
+class MidiVirtualPort
+{
+	protected:
+
+	midi_pty_t pty;
+	bool opened;
+
+	public:
+
+	/* Create a closed port. */
+	MidiVirtualPort ();
+
+	/* Close the port. */
+	virtual ~MidiVirtualPort ();
+
+	/* Create the port 'name'. Returns false on failure. */
+	bool open (const char *name);
+
+	/* Close the port and remove it from MIDI_PTY_DIR. */
+	void close ();
+
+	/* Get the descriptor of our side of the port (non-blocking), to read
+	 * and write MIDI bytes, or -1 if closed. It stays owned by the port:
+	 * give a dup() of it to a MidiReader, which closes its sources.
+	 */
+	int getDescriptor ();
+
+	/* Get the path published for the other side, or NULL if closed. */
+	const char *getPath ();
+};
+
+/* A clock of timestamps (see midi_clock.h), for MidiReader::setClock, or
+ * for RtMidiIn::setClock thru getFunction and getArg. This one reads
+ * CLOCK_MONOTONIC.
+ */
+class MidiClock
+{
+	public:
+
+	/* Create a clock reading CLOCK_MONOTONIC. */
+	MidiClock ();
+
+	virtual ~MidiClock ();
+
+	/* Get the current time (ns). */
+	uint64_t now ();
+
+	/* Get the function of the clock and its argument. */
+	virtual MidiClockFunc getFunction ();
+	virtual void *getArg ();
+};
+
+/* A clock whose time only changes when set or advanced, for reproducible
+ * timestamps in tests and benchmarks.
+ */
+class MidiManualClock : public MidiClock
+{
+	protected:
+
+	midi_clock_manual_t clock;
+
+	public:
+
+	/* Create a clock at 'time' (ns). */
+	MidiManualClock (uint64_t time = 0);
+
+	/* Set the time (ns). */
+	void set (uint64_t time);
+
+	/* Advance the time by 'delta' ns. Returns the new time. */
+	uint64_t advance (uint64_t delta);
+
+	MidiClockFunc getFunction ();
+	void *getArg ();
+};
+
+/* A clock reading the counter of the processor, calibrated against
+ * CLOCK_MONOTONIC: no system call per timestamp.
+ */
+class MidiTscClock : public MidiClock
+{
+	protected:
+
+	midi_clock_tsc_t clock;
+
+	public:
+
+	/* Create a clock calibrated for 'ms' milliseconds (20 if 0). */
+	MidiTscClock (int ms = 0);
+
+	/* Calibrate the clock again. Returns false if there is no invariant
+	 * counter: the clock then reads CLOCK_MONOTONIC.
+	 */
+	bool calibrate (int ms = 0);
+
+	/* Does the clock read the counter of the processor ? */
+	bool usesCounter ();
+
+	MidiClockFunc getFunction ();
+	void *getArg ();
+};
+
 #endif /* MIDI_READER_HPP */
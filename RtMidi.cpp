@@ -196,11 +196,17 @@ class MidiInDirect: public MidiInApi
   void setPortName( const std::string &portName);
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
+  void setRawMode( bool raw );
+  void setThru( MidiOutApi *out, const unsigned char *skip );
+  void setClock( RtMidiIn::RtMidiClock clock, void *userData );
   static bool getSystemPort( unsigned int n, char *buf, unsigned int max);
+  static int getPort( unsigned int n, char *buf, unsigned int max);
 
  protected:
   std::string clientName;
   void initialize( const std::string& clientName );
+  void openHub( const char *name );
+  void startInput( void );
 };
 
 class MidiOutDirect: public MidiOutApi
@@ -217,6 +223,7 @@ class MidiOutDirect: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( const unsigned char *message, size_t size );
+  int getDescriptor( void );
 
  protected:
   std::string clientName;
@@ -225,6 +232,50 @@ class MidiOutDirect: public MidiOutApi
 
 #endif
 
+#if defined(__RTMIDI_LOOPBACK__)
+
+class MidiInLoopback: public MidiInApi
+{
+ public:
+  MidiInLoopback( const std::string &clientName, unsigned int queueSizeLimit );
+  ~MidiInLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::LOOPBACK; };
+  void openPort( unsigned int portNumber, const std::string &portName );
+  void openVirtualPort( const std::string &portName );
+  void closePort( void );
+  void setClientName( const std::string &clientName );
+  void setPortName( const std::string &portName);
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void setClock( RtMidiIn::RtMidiClock clock, void *userData );
+
+ protected:
+  void initialize( const std::string& clientName );
+  void startInput( void );
+};
+
+class MidiOutLoopback: public MidiOutApi
+{
+ public:
+  MidiOutLoopback( const std::string &clientName );
+  ~MidiOutLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::LOOPBACK; };
+  void openPort( unsigned int portNumber, const std::string &portName );
+  void openVirtualPort( const std::string &portName );
+  void closePort( void );
+  void setClientName( const std::string &clientName );
+  void setPortName( const std::string &portName);
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void sendMessage( const unsigned char *message, size_t size );
+  void setLink( unsigned int rate, double latency );
+
+ protected:
+  void initialize( const std::string& clientName );
+};
+
+#endif
+
 #if defined(__LINUX_ALSA__)
 
 class MidiInAlsa: public MidiInApi
@@ -539,6 +590,7 @@ const char* rtmidi_api_names[][2] = {
   { "winuwp"      , "Windows UWP" },
   { "amidi"       , "Android MIDI API" },
   { "direct"      , "MIDI devices direct access API" },
+  { "loopback"    , "In-process loopback" },
 };
 const unsigned int rtmidi_num_api_names =
   sizeof(rtmidi_api_names)/sizeof(rtmidi_api_names[0]);
@@ -572,6 +624,10 @@ extern "C" const RtMidi::Api rtmidi_compiled_apis[] = {
 #endif
 #if defined(__DIRECT__)
   RtMidi::DIRECT,
+#endif
+  // last: the in-process ports must not be chosen before the devices
+#if defined(__RTMIDI_LOOPBACK__)
+  RtMidi::LOOPBACK,
 #endif
   RtMidi::UNSPECIFIED,
 };
@@ -668,6 +724,10 @@ void RtMidiIn :: openMidiApi( RtMidi::Api api, const std::string &clientName, un
     if ( api == DIRECT )
     rtapi_ = new MidiInDirect( clientName, queueSizeLimit );
 #endif
+#if defined(__RTMIDI_LOOPBACK__)
+    if ( api == LOOPBACK )
+    rtapi_ = new MidiInLoopback( clientName, queueSizeLimit );
+#endif
 #if defined(__RTMIDI_DUMMY__)
   if ( api == RTMIDI_DUMMY )
     rtapi_ = new MidiInDummy( clientName, queueSizeLimit );
@@ -752,6 +812,10 @@ void RtMidiOut :: openMidiApi( RtMidi::Api api, const std::string &clientName )
     if ( api == DIRECT )
     rtapi_ = new MidiOutDirect( clientName );
 #endif
+#if defined(__RTMIDI_LOOPBACK__)
+    if ( api == LOOPBACK )
+    rtapi_ = new MidiOutLoopback( clientName );
+#endif
 #if defined(__RTMIDI_DUMMY__)
   if ( api == RTMIDI_DUMMY )
     rtapi_ = new MidiOutDummy( clientName );
@@ -923,6 +987,30 @@ void MidiInApi :: setBufferSize( unsigned int size, unsigned int count )
     inputData_.bufferCount = count;
 }
 
+void MidiInApi :: setRawMode( bool raw )
+{
+  if ( raw ) {
+    errorString_ = "MidiInApi::setRawMode: raw mode is not supported by this API.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
+void MidiInApi :: setThru( MidiOutApi *out, const unsigned char * )
+{
+  if ( out ) {
+    errorString_ = "MidiInApi::setThru: thru is not supported by this API.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
+void MidiInApi :: setClock( RtMidiIn::RtMidiClock clock, void * )
+{
+  if ( clock ) {
+    errorString_ = "MidiInApi::setClock: clocks are not supported by this API.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
 unsigned int MidiInApi::MidiQueue::size( unsigned int *__back,
                                          unsigned int *__front )
 {
@@ -993,6 +1081,12 @@ MidiOutApi :: ~MidiOutApi( void )
 {
 }
 
+void MidiOutApi :: setLink( unsigned int, double )
+{
+  errorString_ = "MidiOutApi::setLink: a simulated line is not supported by this API.";
+  error( RtMidiError::WARNING, errorString_ );
+}
+
 // *************************************************** //
 //
 // OS/API-specific methods.
@@ -5319,6 +5413,44 @@ void MidiOutAndroid :: sendMessage( const unsigned char *message, size_t size )
 
 #endif  // __AMIDI__
 
+//*********************************************************************//
+//  Common input of the DIRECT and LOOPBACK APIs
+//*********************************************************************//
+
+#if defined(__DIRECT__) || defined(__RTMIDI_LOOPBACK__)
+
+// Deliver a message, or a raw chunk, received at time 'ts' (ns) to the
+// callback or the queue; '*lastTime' is the time of the previous one.
+static void rtmidiDeliver( MidiInApi::RtMidiInData *data,
+                           const unsigned char *bytes, size_t len,
+                           uint64_t ts, uint64_t *lastTime, const char *api )
+{
+  MidiInApi::MidiMessage& message = data->message;
+
+  message.bytes.assign( bytes, bytes + len );
+  if ( data->firstMessage == true ) {
+    message.timeStamp = 0.0;
+    data->firstMessage = false;
+  }
+  else
+    message.timeStamp = (double) ( ts - *lastTime ) * 1e-9;
+  *lastTime = ts;
+
+  // Send message
+  if ( data->usingCallback ) {
+    RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback)
+                                          data->userCallback;
+    callback( message.timeStamp, &message.bytes, data->userData );
+  }
+  else {
+    // As long as we haven't reached our queue size limit, push the message.
+    if ( !data->queue.push( message ) )
+      std::cerr << "\n" << api << ": message queue limit reached!!\n\n";
+  }
+}
+
+#endif
+
 //*********************************************************************//
 //  API: DIRECT
 //
@@ -5334,12 +5466,19 @@ void MidiOutAndroid :: sendMessage( const unsigned char *message, size_t size )
 #include <unistd.h>
 #include <pthread.h>
 #include <time.h>
-#include <signal.h>
+#include <poll.h>
+#include <errno.h>
 #include "MidiReader.cpp"
 
 struct DirectMidiData {
   int fdPort;
   pthread_t thread;
+  bool running;
+  int wake[2];
+  midi_thru_t *thru;
+  midi_hub_t *hub;
+  midi_pty_t *pty;
+  uint64_t lastTime;
   };
 
 //*********************************************************************//
@@ -5358,6 +5497,13 @@ void MidiInDirect :: initialize( const std::string& clientName )
   DirectMidiData *data = new DirectMidiData;
 
   data->fdPort = -1;
+  data->running = false;
+  data->thru = NULL;
+  data->hub = NULL;
+  data->pty = NULL;
+  data->lastTime = 0;
+  if ( pipe( data->wake ) < 0 )
+    data->wake[0] = data->wake[1] = -1;
   this->clientName = clientName;
   apiData_ = (void *) data;
   inputData_.apiData = (void *) data;
@@ -5368,95 +5514,121 @@ MidiInDirect :: ~MidiInDirect()
   DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
   MidiInDirect::closePort();
 
+  if ( data->wake[0] > -1 ) {
+    close( data->wake[0] );
+    close( data->wake[1] );
+  }
+  delete data->thru;
   delete data;
 }
 
-static inline void tsleep ()
+static void directMidiRaw( const unsigned char *buf, int len, int /*source*/,
+                           uint64_t ts, void *userData )
 {
-  struct timespec wts;
-  wts.tv_sec = 0;
-  wts.tv_nsec = 200000;
-  nanosleep( &wts, NULL );
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (userData);
+  DirectMidiData *apiData = static_cast<DirectMidiData *> (data->apiData);
+
+  // forward the chunk before delivering it
+  if ( apiData->thru ) {
+    midi_thru_put_raw( apiData->thru, buf, len );
+    midi_thru_flush( apiData->thru );
+  }
+  rtmidiDeliver( data, buf, len, ts, &apiData->lastTime, "MidiInDirect" );
 }
 
 static void *directMidiHandler( void *ptr )
 {
-  struct timespec ts;
   MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
   DirectMidiData *apiData = static_cast<DirectMidiData *> (data->apiData);
-  RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback)
-                                        data->userCallback;
-  MidiInApi::MidiMessage message;
-  uint64_t timestamp, lastTime;
-  int i;
   MidiReader *reader;
   MidiFrame *mf;
+  struct pollfd pfd[2];
   static const unsigned char to_skip[] = { 0xfe, 0 };
 
-  reader = new MidiReader (MIDIR_EXPAND, to_skip);
+  // the reader owns the port descriptor from here
+  reader = new MidiReader (data->rawMode ? MIDIR_RAW : MIDIR_EXPAND, to_skip);
+  reader->setRawCallback (directMidiRaw, data);
+  midi_reader_set_clock (reader->getHandle (), data->clock,
+                         data->clockUserData);
   reader->addSource (apiData->fdPort, 0);
-
-  while (apiData->fdPort > -1) {
-    if ( ! data->doInput) {
-      tsleep ();
-      continue;
+  if (apiData->thru && ! data->rawMode)
+    reader->addTap (midi_thru_tap, apiData->thru);
+
+  pfd[0].fd = apiData->fdPort;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = apiData->wake[0];
+  pfd[1].events = POLLIN;
+  for (;;) {
+    // wait for input or for closePort()
+    if (poll (pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
     }
+    if (pfd[1].revents)
+      break;
+    if ((pfd[0].revents & (POLLERR | POLLNVAL)) ||
+        (pfd[0].revents & (POLLHUP | POLLIN)) == POLLHUP)
+      break;
 
-    if (reader->update ())
-      mf = reader->getNext ();
-    else
-      mf = NULL;
-    if (mf == NULL) {
-      tsleep ();
-      continue;
-    }
+    // parse all the bytes read, forward them, then deliver the messages;
+    // in raw mode, chunks are forwarded and delivered by pump()
+    reader->pump ();
+    if (apiData->thru && ! data->rawMode)
+      midi_thru_flush (apiData->thru);
+    while ((mf = reader->pop ()) != NULL)
+      rtmidiDeliver( data, mf->data, mf->len, mf->ts, &apiData->lastTime,
+                     "MidiInDirect" );
+  }
 
-    message.bytes.clear ();
-    for (i = 0; i < mf->len; i++)
-      message.bytes.push_back( mf->data[i] );
+  delete (reader);
+  return ( NULL );
+}
 
-    // Calculate time stamp.
-    clock_gettime( CLOCK_REALTIME, &ts );
-    timestamp = ts.tv_sec * 1000 + (ts.tv_nsec / 1000000);
-    if ( data->firstMessage == true ) {
-      message.timeStamp = 0.0;
-      data->firstMessage = false;
-    }
-    else
-      message.timeStamp = (double) ( timestamp - lastTime ) * 0.001;
-    lastTime = timestamp;
+// Input thread of a port attached to a hub (see midi_hub.h).
+static void *directMidiHubHandler( void *ptr )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
+  DirectMidiData *apiData = static_cast<DirectMidiData *> (data->apiData);
+  MidiFrame f;
+  int r;
 
-    // Send message
-    if ( data->usingCallback )
-      callback( message.timeStamp, &message.bytes, data->userData );
-    else {
-      // As long as we haven't reached our queue size limit, push the message.
-      if ( !data->queue.push( message ) )
-        std::cerr << "\nMidiInDirect: message queue limit reached!!\n\n";
+  while ( data->doInput ) {
+    r = midi_hub_next( apiData->hub, &f, -1 );
+    if ( r < 0 )
+      break;
+    if ( r > 0 && f.data[0] != 0xfe ) {
+      // frames are stamped by the publisher, unless we have our own clock
+      if ( data->clock )
+        f.ts = data->clock( data->clockUserData );
+      rtmidiDeliver( data, f.data, f.len, f.ts, &apiData->lastTime,
+                     "MidiInDirect" );
     }
   }
-
-  delete (reader);
-  pthread_exit( NULL );
   return ( NULL );
 }
 
-void MidiInDirect :: openPort( unsigned int portNumber, const std::string &portName )
+void MidiInDirect :: openPort( unsigned int portNumber, const std::string &/*portName*/ )
 {
   DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
   char buf[64];
+  int kind = MidiInDirect :: getPort( portNumber, buf, sizeof( buf ));
   int fd = -1;
 
-  if (data->fdPort > -1) {
+  if (data->fdPort > -1 || data->hub) {
     errorString_ = "MidiInDirect::openPort: A port is already open";
     error( RtMidiError::INVALID_USE, errorString_ );
   }
-  else if ( ! MidiInDirect :: getSystemPort( portNumber, buf, sizeof( buf ))) {
+  else if ( kind == 2 ) {
+    openHub( buf );
+    return;
+  }
+  else if ( kind == 0 ) {
     errorString_ = "MidiInDirect::openPort: Invalid port number";
     error( RtMidiError::INVALID_PARAMETER, errorString_ );
   }
   else {
-    fd = open( buf, O_RDONLY);
+    fd = open( buf, O_RDONLY | O_NONBLOCK | O_NOCTTY );
     if (fd < 0) {
       errorString_ = "MidiInDirect::openPort: unable to open port";
       error( RtMidiError::SYSTEM_ERROR, errorString_ );
@@ -5466,32 +5638,118 @@ void MidiInDirect :: openPort( unsigned int portNumber, const std::string &portN
       connected_ = true;
     }
   }
-  if ( fd < 0 )
+  if ( fd > -1 )
+    startInput();
+}
+
+// Start the input thread reading the port descriptor.
+void MidiInDirect :: startInput()
+{
+  DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
+
+  if ( data->wake[0] < 0 ) {
+    errorString_ = "MidiInDirect::openPort: error creating wake-up pipe!";
+    error( RtMidiError::THREAD_ERROR, errorString_ );
+    closePort();
     return;
+  }
 
-  if ( inputData_.doInput == false ) {
+  if ( ! data->running ) {
     // Start our MIDI input thread.
     pthread_attr_t attr;
     pthread_attr_init( &attr );
     pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_JOINABLE );
     pthread_attr_setschedpolicy( &attr, SCHED_OTHER );
 
+    inputData_.doInput = true;
     int err = pthread_create( &data->thread, &attr, directMidiHandler,
                               &inputData_ );
     pthread_attr_destroy( &attr );
     if ( err ) {
+      inputData_.doInput = false;
       errorString_ = "MidiInDirect::openPort: error starting MIDI-in thread!";
       error( RtMidiError::THREAD_ERROR, errorString_ );
       closePort();
     }
     else
-      inputData_.doInput = true;
+      data->running = true;
   }
 }
 
+void MidiInDirect :: openHub( const char *name )
+{
+  DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
+
+  data->hub = new midi_hub_t;
+  if ( ! midi_hub_attach( data->hub, name ) ) {
+    delete data->hub;
+    data->hub = NULL;
+    errorString_ = "MidiInDirect::openPort: unable to attach to the hub";
+    error( RtMidiError::SYSTEM_ERROR, errorString_ );
+    return;
+  }
+  connected_ = true;
+
+  inputData_.doInput = true;
+  if ( pthread_create( &data->thread, NULL, directMidiHubHandler,
+                       &inputData_ ) ) {
+    inputData_.doInput = false;
+    errorString_ = "MidiInDirect::openPort: error starting MIDI-in thread!";
+    error( RtMidiError::THREAD_ERROR, errorString_ );
+    closePort();
+  }
+  else
+    data->running = true;
+}
+
+// Create a virtual port (see midi_pty.h) named after 'portName', the
+// characters not allowed in its name being replaced by '_'.
+static midi_pty_t *directOpenVirtual( const std::string &portName )
+{
+  midi_pty_t *pty = new midi_pty_t;
+  std::string name( portName, 0, MIDI_PTY_NAME_MAX );
+
+  for ( size_t i = 0; i < name.size(); i++ ) {
+    if ( ! isalnum( (unsigned char) name[i] ) && name[i] != '-' &&
+         name[i] != '.' )
+      name[i] = '_';
+  }
+  if ( name.empty() || name[0] == '.' )
+    name = "_" + name.substr( 0, MIDI_PTY_NAME_MAX - 1 );
+  if ( ! midi_pty_open( pty, name.c_str() ) ) {
+    delete pty;
+    return ( NULL );
+  }
+  return ( pty );
+}
+
 void MidiInDirect :: openVirtualPort( const std::string &portName )
 {
-  error( RtMidiError::DRIVER_ERROR, "unsupported" );
+  DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
+
+  if (data->fdPort > -1 || data->hub) {
+    errorString_ = "MidiInDirect::openVirtualPort: A port is already open";
+    error( RtMidiError::INVALID_USE, errorString_ );
+    return;
+  }
+  data->pty = directOpenVirtual( portName );
+  if ( data->pty == NULL ) {
+    errorString_ = "MidiInDirect::openVirtualPort: unable to create the port";
+    error( RtMidiError::SYSTEM_ERROR, errorString_ );
+    return;
+  }
+  // the reader closes its own copy of the master side
+  data->fdPort = dup( data->pty->master );
+  if ( data->fdPort < 0 ) {
+    midi_pty_close( data->pty );
+    delete data->pty;
+    data->pty = NULL;
+    errorString_ = "MidiInDirect::openVirtualPort: unable to create the port";
+    error( RtMidiError::SYSTEM_ERROR, errorString_ );
+    return;
+  }
+  connected_ = true;
+  startInput();
 }
 
 #define DIRECT_MAX_SYSPORTS ((16*16)+(16*16))
@@ -5541,26 +5799,70 @@ bool MidiInDirect :: getSystemPort( unsigned int n, char *buf, unsigned int max)
   return (false);
 }
 
-unsigned int MidiInDirect :: getPortCount()
+// Count the system ports, the hubs and the virtual ports.
+static void directPortCount( unsigned int *system, unsigned int *hubs,
+                             unsigned int *virtuals )
 {
-  int count = 0;
+  char name[64];
 
-  for (int i = 0; i < DIRECT_MAX_SYSPORTS; i++) {
-    if (MidiInDirect :: getSystemPort( i, NULL, 0))
-      count++;
-  }
+  *system = 0;
+  // ports are numbered without gaps: stop at the first one missing
+  while (*system < DIRECT_MAX_SYSPORTS &&
+         MidiInDirect :: getSystemPort( *system, NULL, 0))
+    (*system)++;
+  *hubs = 0;
+  while (midi_hub_list( *hubs, name, sizeof( name )))
+    (*hubs)++;
+  *virtuals = 0;
+  while (midi_pty_list( *virtuals, name, sizeof( name )))
+    (*virtuals)++;
+}
 
-  return count;
+// Find port 'n': returns 1 for a system port (path in 'buf'), 2 for a
+// hub (name in 'buf'), 3 for a virtual port (path in 'buf'), 0 if there
+// is none.
+int MidiInDirect :: getPort( unsigned int n, char *buf, unsigned int max)
+{
+  unsigned int system, hubs, virtuals;
+
+  if (MidiInDirect :: getSystemPort( n, buf, max))
+    return 1;
+  directPortCount( &system, &hubs, &virtuals );
+  if (n < system || buf == NULL)
+    return 0;
+  if (n - system < hubs && midi_hub_list( n - system, buf, max))
+    return 2;
+  if (n - system >= hubs &&
+      midi_pty_list( n - system - hubs, buf, max))
+    return 3;
+  return 0;
+}
+
+unsigned int MidiInDirect :: getPortCount()
+{
+  unsigned int system, hubs, virtuals;
+
+  directPortCount( &system, &hubs, &virtuals );
+  return system + hubs + virtuals;
 }
 
 std::string MidiInDirect :: getPortName( unsigned int portNumber )
 {
   char buf[64];
+  int kind = MidiInDirect :: getPort( portNumber, buf, sizeof( buf ));
  
-  if (MidiInDirect :: getSystemPort( portNumber, buf, sizeof( buf ))) {
+  if (kind == 1) {
     std::string retStr( buf + 5 );
     return retStr;
   }
+  else if (kind == 2) {
+    std::string retStr( "hub:" );
+    return retStr + buf;
+  }
+  else if (kind == 3) {
+    std::string retStr( "virtual:" );
+    return retStr + ( buf + sizeof( MIDI_PTY_DIR ) );
+  }
   else {
     std::string retStr( "" );
     errorString_ = "MidiInDirect::getPortName: no ports available!";
@@ -5574,20 +5876,81 @@ void MidiInDirect :: closePort()
   DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
 
   inputData_.doInput = false;
-  if (data->fdPort > -1) {
+  if (data->hub) {
+    if (data->running) {
+      midi_hub_interrupt( data->hub );
+      pthread_join( data->thread, NULL );
+      data->running = false;
+    }
+    midi_hub_close( data->hub );
+    delete data->hub;
+    data->hub = NULL;
+  }
+  else if (data->running) {
+    // wake the input thread up and wait for it; its reader closes the port
+    char c = 0;
+    while ( write( data->wake[1], &c, 1 ) < 0 && errno == EINTR )
+      ;
+    pthread_join( data->thread, NULL );
+    data->running = false;
+    while ( read( data->wake[0], &c, 1 ) < 0 && errno == EINTR )
+      ;
+  }
+  else if (data->fdPort > -1)
     close( data->fdPort );
-    data->fdPort = -1;
+  data->fdPort = -1;
+  if (data->pty) {
+    midi_pty_close( data->pty );
+    delete data->pty;
+    data->pty = NULL;
   }
-  pthread_kill( data->thread, SIGKILL);
   connected_ = false;
 }
 
+void MidiInDirect :: setRawMode( bool raw )
+{
+  inputData_.rawMode = raw;
+}
+
+void MidiInDirect :: setClock( RtMidiIn::RtMidiClock clock, void *userData )
+{
+  inputData_.clock = clock;
+  inputData_.clockUserData = clock ? userData : NULL;
+}
+
+void MidiInDirect :: setThru( MidiOutApi *out, const unsigned char *skip )
+{
+  DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
+  int fd = -1;
+
+  if ( data->running ) {
+    errorString_ = "MidiInDirect::setThru: must be set before openPort()";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  delete data->thru;
+  data->thru = NULL;
+  if ( out == NULL )
+    return;
+  if ( out->getCurrentApi() == RtMidi::DIRECT )
+    fd = static_cast<MidiOutDirect *>(out)->getDescriptor();
+  if ( fd < 0 ) {
+    errorString_ = "MidiInDirect::setThru: an open DIRECT output port is needed";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  data->thru = new midi_thru_t;
+  midi_thru_init( data->thru, fd );
+  for ( ; skip && *skip; skip++ )
+    midi_thru_skip( data->thru, *skip, 0 );
+}
+
 void MidiInDirect:: setClientName( const std::string& )
 {
   error( RtMidiError::WARNING, "unsupported" );
 }
 
-void MidiInDirect :: setPortName( const std::string &portName )
+void MidiInDirect :: setPortName( const std::string &/*portName*/ )
 {
   error( RtMidiError::WARNING, "unsupported" );
 }
@@ -5608,6 +5971,12 @@ void MidiOutDirect :: initialize ( const std::string &clientName )
   apiData_ = (void *) data;
 
   data->fdPort = -1;
+  data->running = false;
+  data->wake[0] = data->wake[1] = -1;
+  data->thru = NULL;
+  data->hub = NULL;
+  data->pty = NULL;
+  data->lastTime = 0;
   this->clientName = clientName;
 }
 
@@ -5619,24 +5988,36 @@ MidiOutDirect :: ~MidiOutDirect()
   delete data;
 }
 
-void MidiOutDirect :: openPort( unsigned int portNumber, const std::string &portName )
+void MidiOutDirect :: openPort( unsigned int portNumber, const std::string &/*portName*/ )
 {
   DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
   char buf[64];
+  int kind = MidiInDirect :: getPort( portNumber, buf, sizeof( buf ));
 
-  if (data->fdPort > -1) {
+  if (data->fdPort > -1 || data->hub) {
     errorString_ = "MidiOutDirect::openPort: A port is already open";
     error( RtMidiError::INVALID_USE, errorString_ );
   }
-  else if ( ! MidiInDirect :: getSystemPort( portNumber, buf, sizeof( buf ))) {
+  else if ( kind == 2 ) {
+    data->hub = new midi_hub_t;
+    if ( midi_hub_attach( data->hub, buf ) )
+      connected_ = true;
+    else {
+      delete data->hub;
+      data->hub = NULL;
+      errorString_ = "MidiOutDirect::openPort: unable to attach to the hub";
+      error( RtMidiError::SYSTEM_ERROR, errorString_ );
+    }
+  }
+  else if ( kind == 0 ) {
     errorString_ = "MidiOutDirect::openPort: Invalid port number";
     error( RtMidiError::INVALID_PARAMETER, errorString_ );
   }
   else {
-    int fd = open( buf, O_RDONLY);
+    int fd = open( buf, O_WRONLY | O_NOCTTY );
 
     if (fd < 0) {
-      errorString_ = "MidiInDirect::openPort: unable to open port";
+      errorString_ = "MidiOutDirect::openPort: unable to open port";
       error( RtMidiError::SYSTEM_ERROR, errorString_ );
     }
     else {
@@ -5648,30 +6029,49 @@ void MidiOutDirect :: openPort( unsigned int portNumber, const std::string &port
 
 void MidiOutDirect :: openVirtualPort( const std::string &portName )
 {
-  error( RtMidiError::DRIVER_ERROR, "unsupported" );
+  DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
+
+  if (data->fdPort > -1 || data->hub) {
+    errorString_ = "MidiOutDirect::openVirtualPort: A port is already open";
+    error( RtMidiError::INVALID_USE, errorString_ );
+    return;
+  }
+  data->pty = directOpenVirtual( portName );
+  if ( data->pty == NULL ) {
+    errorString_ = "MidiOutDirect::openVirtualPort: unable to create the port";
+    error( RtMidiError::SYSTEM_ERROR, errorString_ );
+    return;
+  }
+  data->fdPort = data->pty->master;
+  connected_ = true;
 }
 
 unsigned int MidiOutDirect :: getPortCount()
 {
-  int count = 0;
-
-  // List of available ports
-  for (int i = 0; i < DIRECT_MAX_SYSPORTS; i++) {
-    if (MidiInDirect :: getSystemPort( i, NULL, 0))
-      count++;
-  }
+  unsigned int system, hubs, virtuals;
 
-  return count;
+  // system ports, then hubs, then virtual ports
+  directPortCount( &system, &hubs, &virtuals );
+  return system + hubs + virtuals;
 }
 
 std::string MidiOutDirect :: getPortName( unsigned int portNumber )
 {
   char buf[64];
+  int kind = MidiInDirect :: getPort( portNumber, buf, sizeof( buf ));
  
-  if (MidiInDirect :: getSystemPort( portNumber, buf, sizeof( buf ))) {
+  if (kind == 1) {
     std::string retStr( buf + 5 );
     return retStr;
   }
+  else if (kind == 2) {
+    std::string retStr( "hub:" );
+    return retStr + buf;
+  }
+  else if (kind == 3) {
+    std::string retStr( "virtual:" );
+    return retStr + ( buf + sizeof( MIDI_PTY_DIR ) );
+  }
   else {
     std::string retStr( "" );
     errorString_ = "MidiOutDirect::getPortName: no ports available!";
@@ -5684,10 +6084,22 @@ void MidiOutDirect :: closePort()
 {
   DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
 
+  if (data->pty) {
+    // the descriptor is the master side of the virtual port
+    midi_pty_close( data->pty );
+    delete data->pty;
+    data->pty = NULL;
+    data->fdPort = -1;
+  }
   if (data->fdPort > -1) {
     close( data->fdPort );
     data->fdPort = -1;
   }
+  if (data->hub) {
+    midi_hub_close( data->hub );
+    delete data->hub;
+    data->hub = NULL;
+  }
   connected_ = false;
 }
 
@@ -5696,30 +6108,62 @@ void MidiOutDirect:: setClientName( const std::string& )
   error( RtMidiError::WARNING, "unsupported" );
 }
 
-void MidiOutDirect :: setPortName( const std::string &portName )
+void MidiOutDirect :: setPortName( const std::string &/*portName*/ )
 {
   error( RtMidiError::WARNING, "unsupported" );
 }
 
+int MidiOutDirect :: getDescriptor()
+{
+  DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
+
+  return data->fdPort;
+}
+
 void MidiOutDirect :: sendMessage( const unsigned char *message, size_t size )
 {
   DirectMidiData *data = static_cast<DirectMidiData *> (apiData_);
 
-  if (data->fdPort > -1 && size > 0) {
-    int r;
-    int e = 0;
+  if (data->hub && size > 0) {
+    MidiFrame f;
+
+    if (size > MIDI_FRAME_MAX) {
+      errorString_ = "MidiOutDirect::sendMessage: message too long for a hub";
+      error( RtMidiError::WARNING, errorString_ );
+      return;
+    }
+    f.len = (unsigned char) size;
+    memcpy( f.data, message, size );
+    f.source = -1;
+    f.ts = midi_reader_get_time( NULL );
+    if ( ! midi_hub_send( data->hub, &f ) ) {
+      errorString_ = "MidiOutDirect::sendMessage: the hub output is full";
+      error( RtMidiError::WARNING, errorString_ );
+    }
+  }
+  else if (data->fdPort > -1 && size > 0) {
+    struct pollfd pfd;
+    ssize_t r;
 
+    // the master side of a virtual port is non-blocking: wait for room,
+    // at most 100 ms, while the other program reads
+    pfd.fd = data->fdPort;
+    pfd.events = POLLOUT;
     while (size > 0) {
-      r = write( data->fdPort, message, size);
-      if (r <= 0) {
-        if (++e == 10)
-          break;
-      }
-      else {
-        e = 0;
+      r = write( data->fdPort, message, size );
+      if (r > 0) {
         size -= (size_t) r;
         message += r;
       }
+      else if (r < 0 && errno == EINTR)
+        continue;
+      else if (r < 0 && errno == EAGAIN && poll( &pfd, 1, 100 ) > 0)
+        continue;
+      else {
+        errorString_ = "MidiOutDirect::sendMessage: the port does not accept the message, dropped!";
+        error( RtMidiError::WARNING, errorString_ );
+        break;
+      }
     }
   }
 }
@@ -5727,3 +6171,571 @@ void MidiOutDirect :: sendMessage( const unsigned char *message, size_t size )
 #endif  // __DIRECT__
 
 //*********************************************************************//
+//  API: LOOPBACK
+//
+//  The virtual ports of a direction are listed as the ports of the
+//  other one, so that output ports are connected in-process to input
+//  ports. Messages are received by an input thread at the time given
+//  by the simulated line of the output port, then go thru the queue or
+//  the callback of the input port.
+//
+//*********************************************************************//
+
+#if defined(__RTMIDI_LOOPBACK__)
+
+#include <pthread.h>
+#include <time.h>
+#include <utility>
+
+struct LoopbackInData;
+
+// A virtual port.
+struct LoopbackPort {
+  std::string name;
+  bool input;
+  int refs;
+  std::vector<LoopbackInData *> inputs;
+  };
+
+// A message sent, received at time 'due' (ns, monotonic).
+struct LoopbackEvent {
+  uint64_t due;
+  std::vector<unsigned char> bytes;
+  };
+
+// least count of messages waiting for their time of reception
+#define LOOPBACK_RING_MIN 1024
+
+struct LoopbackInData {
+  LoopbackPort *port;
+  bool owner;
+  pthread_t thread;
+  bool running;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // messages waiting, by time of reception; the vectors of the ring and
+  // of the input thread are swapped and keep their capacity
+  LoopbackEvent *ring;
+  unsigned int ringSize;
+  unsigned int front;
+  unsigned int count;
+  uint64_t lastTime;
+  };
+
+struct LoopbackOutData {
+  LoopbackPort *port;
+  bool owner;
+  uint64_t byteTime;
+  uint64_t latency;
+  uint64_t lineFree;
+  };
+
+// The virtual ports, and the lock of the ports and of their connections.
+static pthread_mutex_t loopbackLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<LoopbackPort *> loopbackPorts;
+
+static uint64_t loopbackTime( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// macOS has no pthread_condattr_setclock(): the condition variables of the
+// input ports then wait until a deadline of the realtime clock, converted
+// from the monotonic time 'due'.
+#if defined(__APPLE__)
+#define LOOPBACK_COND_REALTIME
+#endif
+
+static void loopbackDeadline( uint64_t due, struct timespec *ts )
+{
+#if defined(LOOPBACK_COND_REALTIME)
+  uint64_t now = loopbackTime();
+
+  clock_gettime( CLOCK_REALTIME, ts );
+  due = (uint64_t) ts->tv_sec * 1000000000ULL + (uint64_t) ts->tv_nsec +
+    ( due > now ? due - now : 0 );
+#endif
+  ts->tv_sec = (time_t) ( due / 1000000000ULL );
+  ts->tv_nsec = (long) ( due % 1000000000ULL );
+}
+
+// Find the nth virtual port created by an input port ('input') or by an
+// output port; loopbackLock must be held.
+static LoopbackPort *loopbackFind( unsigned int n, bool input )
+{
+  for ( size_t i = 0; i < loopbackPorts.size(); i++ ) {
+    if ( loopbackPorts[i]->input == input && n-- == 0 )
+      return loopbackPorts[i];
+  }
+  return NULL;
+}
+
+static unsigned int loopbackCount( bool input )
+{
+  unsigned int n = 0;
+
+  pthread_mutex_lock( &loopbackLock );
+  for ( size_t i = 0; i < loopbackPorts.size(); i++ ) {
+    if ( loopbackPorts[i]->input == input )
+      n++;
+  }
+  pthread_mutex_unlock( &loopbackLock );
+  return n;
+}
+
+static bool loopbackName( unsigned int n, bool input, std::string &name )
+{
+  LoopbackPort *port;
+
+  pthread_mutex_lock( &loopbackLock );
+  port = loopbackFind( n, input );
+  if ( port )
+    name = port->name;
+  pthread_mutex_unlock( &loopbackLock );
+  return port != NULL;
+}
+
+// Release a port; its creator ('owner') also removes it from the list.
+// loopbackLock must be held.
+static void loopbackRelease( LoopbackPort *port, bool owner )
+{
+  if ( owner ) {
+    for ( size_t i = 0; i < loopbackPorts.size(); i++ ) {
+      if ( loopbackPorts[i] == port ) {
+        loopbackPorts.erase( loopbackPorts.begin() + i );
+        break;
+      }
+    }
+  }
+  if ( --port->refs == 0 )
+    delete port;
+}
+
+//*********************************************************************//
+//  API: LOOPBACK
+//  Class Definitions: MidiInLoopback
+//*********************************************************************//
+
+MidiInLoopback :: MidiInLoopback( const std::string &clientName, unsigned int queueSizeLimit )
+  : MidiInApi( queueSizeLimit )
+{
+  MidiInLoopback::initialize( clientName );
+}
+
+void MidiInLoopback :: initialize( const std::string& )
+{
+  LoopbackInData *data = new LoopbackInData;
+  pthread_condattr_t attr;
+
+  data->port = NULL;
+  data->owner = false;
+  data->running = false;
+  data->stop = false;
+  data->lastTime = 0;
+  data->ringSize = inputData_.queue.ringSize > LOOPBACK_RING_MIN ?
+    inputData_.queue.ringSize : LOOPBACK_RING_MIN;
+  data->ring = new LoopbackEvent[ data->ringSize ];
+  for ( unsigned int i = 0; i < data->ringSize; i++ )
+    data->ring[i].bytes.reserve( 16 );
+  data->front = 0;
+  data->count = 0;
+  pthread_mutex_init( &data->lock, NULL );
+  // the times of reception are monotonic
+  pthread_condattr_init( &attr );
+#if !defined(LOOPBACK_COND_REALTIME)
+  pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+#endif
+  pthread_cond_init( &data->cond, &attr );
+  pthread_condattr_destroy( &attr );
+  apiData_ = (void *) data;
+  inputData_.apiData = (void *) data;
+}
+
+MidiInLoopback :: ~MidiInLoopback()
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+  MidiInLoopback::closePort();
+
+  pthread_cond_destroy( &data->cond );
+  pthread_mutex_destroy( &data->lock );
+  delete [] data->ring;
+  delete data;
+}
+
+static void *loopbackHandler( void *ptr )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
+  LoopbackInData *apiData = static_cast<LoopbackInData *> (data->apiData);
+  std::vector<unsigned char> bytes;
+  unsigned char status;
+  struct timespec ts;
+  uint64_t due;
+
+  bytes.reserve( 16 );
+  pthread_mutex_lock( &apiData->lock );
+  while ( ! apiData->stop ) {
+    if ( apiData->count == 0 ) {
+      pthread_cond_wait( &apiData->cond, &apiData->lock );
+      continue;
+    }
+
+    // wait for the time of reception of the first message
+    due = apiData->ring[apiData->front].due;
+    if ( due > loopbackTime() ) {
+      loopbackDeadline( due, &ts );
+      pthread_cond_timedwait( &apiData->cond, &apiData->lock, &ts );
+      continue;
+    }
+    bytes.swap( apiData->ring[apiData->front].bytes );
+    apiData->front = ( apiData->front + 1 ) % apiData->ringSize;
+    apiData->count--;
+    pthread_mutex_unlock( &apiData->lock );
+    // the time of reception is given by our clock, if any
+    if ( data->clock )
+      due = data->clock( data->clockUserData );
+    status = bytes[0];
+    if ( !( ( status == 0xF0 && ( data->ignoreFlags & 0x01 ) ) ||
+            ( ( status == 0xF1 || status == 0xF8 ) && ( data->ignoreFlags & 0x02 ) ) ||
+            ( status == 0xFE && ( data->ignoreFlags & 0x04 ) ) ) )
+      rtmidiDeliver( data, &bytes[0], bytes.size(), due, &apiData->lastTime,
+                     "MidiInLoopback" );
+    pthread_mutex_lock( &apiData->lock );
+  }
+  pthread_mutex_unlock( &apiData->lock );
+  return ( NULL );
+}
+
+void MidiInLoopback :: startInput()
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+
+  connected_ = true;
+  data->stop = false;
+  inputData_.doInput = true;
+  if ( pthread_create( &data->thread, NULL, loopbackHandler, &inputData_ ) ) {
+    inputData_.doInput = false;
+    errorString_ = "MidiInLoopback::openPort: error starting MIDI-in thread!";
+    error( RtMidiError::THREAD_ERROR, errorString_ );
+    closePort();
+  }
+  else
+    data->running = true;
+}
+
+void MidiInLoopback :: openPort( unsigned int portNumber, const std::string & )
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+  LoopbackPort *port;
+
+  if ( data->port ) {
+    errorString_ = "MidiInLoopback::openPort: A port is already open";
+    error( RtMidiError::INVALID_USE, errorString_ );
+    return;
+  }
+  pthread_mutex_lock( &loopbackLock );
+  port = loopbackFind( portNumber, false );
+  if ( port ) {
+    port->refs++;
+    port->inputs.push_back( data );
+    data->port = port;
+    data->owner = false;
+  }
+  pthread_mutex_unlock( &loopbackLock );
+  if ( port == NULL ) {
+    errorString_ = "MidiInLoopback::openPort: Invalid port number";
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+  startInput();
+}
+
+void MidiInLoopback :: openVirtualPort( const std::string &portName )
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+
+  if ( data->port ) {
+    errorString_ = "MidiInLoopback::openVirtualPort: A port is already open";
+    error( RtMidiError::INVALID_USE, errorString_ );
+    return;
+  }
+  data->port = new LoopbackPort;
+  data->port->name = portName;
+  data->port->input = true;
+  data->port->refs = 1;
+  data->port->inputs.push_back( data );
+  data->owner = true;
+  pthread_mutex_lock( &loopbackLock );
+  loopbackPorts.push_back( data->port );
+  pthread_mutex_unlock( &loopbackLock );
+  startInput();
+}
+
+void MidiInLoopback :: closePort()
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+  std::vector<LoopbackInData *> *inputs;
+
+  if ( data->port ) {
+    // no message is sent to us from here
+    pthread_mutex_lock( &loopbackLock );
+    inputs = &data->port->inputs;
+    for ( size_t i = 0; i < inputs->size(); i++ ) {
+      if ( (*inputs)[i] == data ) {
+        inputs->erase( inputs->begin() + i );
+        break;
+      }
+    }
+    loopbackRelease( data->port, data->owner );
+    pthread_mutex_unlock( &loopbackLock );
+    data->port = NULL;
+  }
+  if ( data->running ) {
+    pthread_mutex_lock( &data->lock );
+    data->stop = true;
+    pthread_cond_signal( &data->cond );
+    pthread_mutex_unlock( &data->lock );
+    pthread_join( data->thread, NULL );
+    data->running = false;
+  }
+  data->front = 0;
+  data->count = 0;
+  inputData_.doInput = false;
+  connected_ = false;
+}
+
+unsigned int MidiInLoopback :: getPortCount()
+{
+  // the virtual ports of the output ports
+  return loopbackCount( false );
+}
+
+std::string MidiInLoopback :: getPortName( unsigned int portNumber )
+{
+  std::string name;
+
+  if ( ! loopbackName( portNumber, false, name ) ) {
+    errorString_ = "MidiInLoopback::getPortName: no ports available!";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+  return name;
+}
+
+void MidiInLoopback :: setClock( RtMidiIn::RtMidiClock clock, void *userData )
+{
+  inputData_.clock = clock;
+  inputData_.clockUserData = clock ? userData : NULL;
+}
+
+void MidiInLoopback :: setClientName( const std::string& )
+{
+  error( RtMidiError::WARNING, "unsupported" );
+}
+
+void MidiInLoopback :: setPortName( const std::string &portName )
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+
+  pthread_mutex_lock( &loopbackLock );
+  if ( data->port && data->owner )
+    data->port->name = portName;
+  pthread_mutex_unlock( &loopbackLock );
+}
+
+//*********************************************************************//
+//  API: LOOPBACK
+//  Class Definitions: MidiOutLoopback
+//*********************************************************************//
+
+MidiOutLoopback :: MidiOutLoopback( const std::string &clientName ) : MidiOutApi()
+{
+  MidiOutLoopback::initialize( clientName );
+}
+
+void MidiOutLoopback :: initialize( const std::string& )
+{
+  LoopbackOutData *data = new LoopbackOutData;
+
+  data->port = NULL;
+  data->owner = false;
+  data->byteTime = 0;
+  data->latency = 0;
+  data->lineFree = 0;
+  apiData_ = (void *) data;
+}
+
+MidiOutLoopback :: ~MidiOutLoopback()
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+  MidiOutLoopback::closePort();
+
+  delete data;
+}
+
+void MidiOutLoopback :: openPort( unsigned int portNumber, const std::string & )
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+  LoopbackPort *port;
+
+  if ( data->port ) {
+    errorString_ = "MidiOutLoopback::openPort: A port is already open";
+    error( RtMidiError::INVALID_USE, errorString_ );
+    return;
+  }
+  pthread_mutex_lock( &loopbackLock );
+  port = loopbackFind( portNumber, true );
+  if ( port ) {
+    port->refs++;
+    data->port = port;
+    data->owner = false;
+  }
+  pthread_mutex_unlock( &loopbackLock );
+  if ( port == NULL ) {
+    errorString_ = "MidiOutLoopback::openPort: Invalid port number";
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+  connected_ = true;
+}
+
+void MidiOutLoopback :: openVirtualPort( const std::string &portName )
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+
+  if ( data->port ) {
+    errorString_ = "MidiOutLoopback::openVirtualPort: A port is already open";
+    error( RtMidiError::INVALID_USE, errorString_ );
+    return;
+  }
+  data->port = new LoopbackPort;
+  data->port->name = portName;
+  data->port->input = false;
+  data->port->refs = 1;
+  data->owner = true;
+  pthread_mutex_lock( &loopbackLock );
+  loopbackPorts.push_back( data->port );
+  pthread_mutex_unlock( &loopbackLock );
+  connected_ = true;
+}
+
+void MidiOutLoopback :: closePort()
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+
+  if ( data->port ) {
+    pthread_mutex_lock( &loopbackLock );
+    loopbackRelease( data->port, data->owner );
+    pthread_mutex_unlock( &loopbackLock );
+    data->port = NULL;
+  }
+  connected_ = false;
+}
+
+unsigned int MidiOutLoopback :: getPortCount()
+{
+  // the virtual ports of the input ports
+  return loopbackCount( true );
+}
+
+std::string MidiOutLoopback :: getPortName( unsigned int portNumber )
+{
+  std::string name;
+
+  if ( ! loopbackName( portNumber, true, name ) ) {
+    errorString_ = "MidiOutLoopback::getPortName: no ports available!";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+  return name;
+}
+
+void MidiOutLoopback :: setClientName( const std::string& )
+{
+  error( RtMidiError::WARNING, "unsupported" );
+}
+
+void MidiOutLoopback :: setPortName( const std::string &portName )
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+
+  pthread_mutex_lock( &loopbackLock );
+  if ( data->port && data->owner )
+    data->port->name = portName;
+  pthread_mutex_unlock( &loopbackLock );
+}
+
+void MidiOutLoopback :: setLink( unsigned int rate, double latency )
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+
+  // 10 bits per byte: start, data and stop bits
+  data->byteTime = rate ? 10000000000ULL / rate : 0;
+  data->latency = latency > 0.0 ? (uint64_t) ( latency * 1e9 ) : 0;
+  data->lineFree = 0;
+}
+
+void MidiOutLoopback :: sendMessage( const unsigned char *message, size_t size )
+{
+  LoopbackOutData *data = static_cast<LoopbackOutData *> (apiData_);
+  std::vector<LoopbackInData *> *inputs;
+  LoopbackInData *in;
+  unsigned int i, prev;
+  bool full = false;
+  uint64_t due;
+
+  if ( data->port == NULL || size == 0 )
+    return;
+
+  // the message is received when its last byte went thru the line
+  due = loopbackTime();
+  if ( data->byteTime ) {
+    if ( data->lineFree > due )
+      due = data->lineFree;
+    due += (uint64_t) size * data->byteTime;
+    data->lineFree = due;
+  }
+  due += data->latency;
+
+  pthread_mutex_lock( &loopbackLock );
+  inputs = &data->port->inputs;
+  for ( size_t n = 0; n < inputs->size(); n++ ) {
+    in = (*inputs)[n];
+    pthread_mutex_lock( &in->lock );
+    if ( in->count == in->ringSize ) {
+      pthread_mutex_unlock( &in->lock );
+      full = true;
+      continue;
+    }
+    i = ( in->front + in->count ) % in->ringSize;
+    in->ring[i].due = due;
+    in->ring[i].bytes.assign( message, message + size );
+    in->count++;
+    // messages of other ports may be received later: move the message
+    // before them
+    while ( i != in->front ) {
+      prev = ( i + in->ringSize - 1 ) % in->ringSize;
+      if ( in->ring[prev].due <= due )
+        break;
+      std::swap( in->ring[prev].due, in->ring[i].due );
+      in->ring[prev].bytes.swap( in->ring[i].bytes );
+      i = prev;
+    }
+    // the input thread only waits for the first message
+    if ( i == in->front )
+      pthread_cond_signal( &in->cond );
+    pthread_mutex_unlock( &in->lock );
+  }
+  pthread_mutex_unlock( &loopbackLock );
+
+  // reported once the ports are unlocked
+  if ( full ) {
+    errorString_ = "MidiOutLoopback::sendMessage: queue of an input port full, message dropped!";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
+#endif  // __RTMIDI_LOOPBACK__
+
+//*********************************************************************//
@@ -81,6 +81,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 
 /************************************************************************/
@@ -146,6 +147,8 @@ class RTMIDI_DLL_PUBLIC RtMidiError : public std::exception
 typedef void (*RtMidiErrorCallback)( RtMidiError::Type type, const std::string &errorText, void *userData );
 
 class MidiApi;
+class MidiOutApi;
+class RtMidiOut;
 
 class RTMIDI_DLL_PUBLIC RtMidi
 {
@@ -164,6 +167,7 @@ class RTMIDI_DLL_PUBLIC RtMidi
     WINDOWS_UWP,    /*!< The Microsoft Universal Windows Platform MIDI API. */
     ANDROID_AMIDI,  /*!< Native Android MIDI API. */
     DIRECT,         /*!< API for direct access to MIDI devices. */
+    LOOPBACK,       /*!< In-process loopback of output ports to input ports. */
     NUM_APIS        /*!< Number of values in this enum. */
   };
 
@@ -279,6 +283,9 @@ class RTMIDI_DLL_PUBLIC RtMidiIn : public RtMidi
   //! User callback function type definition.
   typedef void (*RtMidiCallback)( double timeStamp, std::vector<unsigned char> *message, void *userData );
 
+  //! Clock function type definition: the current time in nanoseconds.
+  typedef uint64_t (*RtMidiClock)( void *userData );
+
   //! Default constructor that allows an optional api, client name and queue size.
   /*!
     An exception will be thrown if a MIDI system initialization
@@ -413,6 +420,43 @@ class RTMIDI_DLL_PUBLIC RtMidiIn : public RtMidi
   */
   virtual void setBufferSize( unsigned int size, unsigned int count );
 
+  //! Deliver the input bytes as they are read, without parsing them into messages.
+  /*!
+    In raw mode, each chunk of bytes read from the device is given to
+    the callback or queued as one message, without validation, running
+    status expansion nor filtering by ignoreTypes(): a chunk may hold
+    several or partial MIDI messages. This is only supported by the
+    DIRECT API (other APIs issue a warning) and must be set before
+    openPort().
+  */
+  virtual void setRawMode( bool raw = true );
+
+  //! Forward the input bytes to an output port from the input thread.
+  /*!
+    The messages read (or the chunks, in raw mode) are written to the
+    port \e out as soon as read, before being given to the callback or
+    queued, without going thru the queue nor another thread. \e skip
+    may be a zero-terminated list of status bytes not forwarded (only
+    the real-time ones in raw mode). This is only supported by the
+    DIRECT API, with an open DIRECT output port (other APIs issue a
+    warning), and must be set before openPort(); \e out must stay open
+    while the input port is open. A NULL \e out disables the thru.
+  */
+  virtual void setThru( RtMidiOut *out, const unsigned char *skip = NULL );
+
+  //! Set the clock giving the time of reception of the messages.
+  /*!
+    \e clock is called with \e userData and returns the current time
+    in nanoseconds; the time stamps of the messages are the differences
+    of its times. A NULL \e clock restores the default one
+    (CLOCK_MONOTONIC). A manual clock gives reproducible time stamps in
+    tests, and a clock reading the counter of the processor is cheaper
+    on hot paths (see midi_clock.h for both). This is only supported
+    by the DIRECT and LOOPBACK APIs (other APIs issue a warning) and
+    must be set before openPort().
+  */
+  virtual void setClock( RtMidiClock clock, void *userData = 0 );
+
  protected:
   void openMidiApi( RtMidi::Api api, const std::string &clientName, unsigned int queueSizeLimit );
 };
@@ -511,6 +555,16 @@ class RTMIDI_DLL_PUBLIC RtMidiOut : public RtMidi
   */
   void sendMessage( const unsigned char *message, size_t size );
 
+  //! Simulate the line of the port.
+  /*!
+    Each message sent is received after the time needed to transmit
+    its bytes at \e rate bits per second (10 bits per byte, as on a
+    MIDI line; 31250 for a MIDI line, 0 for no limit), waiting for the
+    previous messages, plus \e latency seconds. This is only supported
+    by the LOOPBACK API (other APIs issue a warning).
+  */
+  virtual void setLink( unsigned int rate = 31250, double latency = 0.0 );
+
   //! Set an error callback function to be invoked when an error has occurred.
   /*!
     The callback function will be called whenever an error has occurred. It is best
@@ -519,6 +573,7 @@ class RTMIDI_DLL_PUBLIC RtMidiOut : public RtMidi
   virtual void setErrorCallback( RtMidiErrorCallback errorCallback = NULL, void *userData = 0 );
 
  protected:
+  friend class RtMidiIn;
   void openMidiApi( RtMidi::Api api, const std::string &clientName );
 };
 
@@ -581,6 +636,9 @@ class RTMIDI_DLL_PUBLIC MidiInApi : public MidiApi
   virtual void ignoreTypes( bool midiSysex, bool midiTime, bool midiSense );
   virtual double getMessage( std::vector<unsigned char> *message );
   virtual void setBufferSize( unsigned int size, unsigned int count );
+  virtual void setRawMode( bool raw );
+  virtual void setThru( MidiOutApi *out, const unsigned char *skip );
+  virtual void setClock( RtMidiIn::RtMidiClock clock, void *userData );
 
   // A MIDI structure used internally by the class to store incoming
   // messages.  Each message represents one and only one MIDI message.
@@ -624,11 +682,15 @@ class RTMIDI_DLL_PUBLIC MidiInApi : public MidiApi
     bool continueSysex;
     unsigned int bufferSize;
     unsigned int bufferCount;
+    bool rawMode;
+    RtMidiIn::RtMidiClock clock;
+    void *clockUserData;
 
     // Default constructor.
     RtMidiInData()
       : ignoreFlags(7), doInput(false), firstMessage(true), apiData(0), usingCallback(false),
-        userCallback(0), userData(0), continueSysex(false), bufferSize(1024), bufferCount(4) {}
+        userCallback(0), userData(0), continueSysex(false), bufferSize(1024), bufferCount(4),
+        rawMode(false), clock(0), clockUserData(0) {}
   };
 
  protected:
@@ -642,6 +704,7 @@ class RTMIDI_DLL_PUBLIC MidiOutApi : public MidiApi
   MidiOutApi( void );
   virtual ~MidiOutApi( void );
   virtual void sendMessage( const unsigned char *message, size_t size ) = 0;
+  virtual void setLink( unsigned int rate, double latency );
 };
 
 // **************************************************************** //
@@ -663,6 +726,9 @@ inline void RtMidiIn :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSen
 inline double RtMidiIn :: getMessage( std::vector<unsigned char> *message ) { return static_cast<MidiInApi *>(rtapi_)->getMessage( message ); }
 inline void RtMidiIn :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 inline void RtMidiIn :: setBufferSize( unsigned int size, unsigned int count ) { static_cast<MidiInApi *>(rtapi_)->setBufferSize(size, count); }
+inline void RtMidiIn :: setRawMode( bool raw ) { static_cast<MidiInApi *>(rtapi_)->setRawMode( raw ); }
+inline void RtMidiIn :: setThru( RtMidiOut *out, const unsigned char *skip ) { static_cast<MidiInApi *>(rtapi_)->setThru( out ? static_cast<MidiOutApi *>(out->rtapi_) : NULL, skip ); }
+inline void RtMidiIn :: setClock( RtMidiClock clock, void *userData ) { static_cast<MidiInApi *>(rtapi_)->setClock( clock, userData ); }
 
 inline RtMidi::Api RtMidiOut :: getCurrentApi( void ) throw() { return rtapi_->getCurrentApi(); }
 inline void RtMidiOut :: openPort( unsigned int portNumber, const std::string &portName ) { rtapi_->openPort( portNumber, portName ); }
@@ -673,6 +739,7 @@ inline unsigned int RtMidiOut :: getPortCount( void ) { return rtapi_->getPortCo
 inline std::string RtMidiOut :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiOut :: sendMessage( const std::vector<unsigned char> *message ) { static_cast<MidiOutApi *>(rtapi_)->sendMessage( &message->at(0), message->size() ); }
 inline void RtMidiOut :: sendMessage( const unsigned char *message, size_t size ) { static_cast<MidiOutApi *>(rtapi_)->sendMessage( message, size ); }
+inline void RtMidiOut :: setLink( unsigned int rate, double latency ) { static_cast<MidiOutApi *>(rtapi_)->setLink( rate, latency ); }
 inline void RtMidiOut :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 
 #endif
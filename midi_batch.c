@@ -0,0 +1,353 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "midi_batch.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define MIDI_BATCH_X86
+#endif
+
+/* size of the blocks of messages packed in 3 bytes */
+#define MIDI_BATCH_BLOCK	256
+
+/* kernels, with 'out' at or before 'in' */
+typedef size_t (*midi_batch_kernel_t) (const midi_batch_t *b,
+					const uint32_t *in, uint32_t *out,
+					size_t n);
+
+/* instruction set in use, or -1 if not chosen yet */
+static int midi_batch_isa = -1;
+
+void
+midi_batch_init (midi_batch_t *b)
+{
+	int s;
+
+	if (b == NULL)
+		return;
+	for (s = 0; s < 256; s++) {
+		b->status[s] = (uint32_t) s;
+		if (s >= 0x80)
+			b->status[s] |= MIDI_BATCH_KEEP;
+		if (s >= 0x80 && s <= 0xaf)
+			b->status[s] |= MIDI_BATCH_NOTE;
+		if (s >= 0x90 && s <= 0x9f)
+			b->status[s] |= MIDI_BATCH_NOTEON;
+	}
+	for (s = 0; s < 128; s++)
+		b->velocity[s] = (uint32_t) s;
+	b->transpose = 0;
+}
+
+void
+midi_batch_filter (midi_batch_t *b, unsigned char status, int channel)
+{
+	if (b == NULL || status < 0x80)
+		return;
+	if (status >= 0xf0) {
+		b->status[status] &= ~MIDI_BATCH_KEEP;
+		return;
+	}
+	for (int ch = 0; ch < 16; ch++) {
+		if (channel < 1 || channel > 16 || ch == channel - 1)
+			b->status[(status & 0xf0) | ch] &= ~MIDI_BATCH_KEEP;
+	}
+}
+
+void
+midi_batch_map_channel (midi_batch_t *b, int from, int to)
+{
+	uint32_t *e;
+
+	if (b == NULL || from < 0 || from > 16 || to < 1 || to > 16)
+		return;
+	for (int type = 0x80; type < 0xf0; type += 0x10) {
+		for (int ch = 0; ch < 16; ch++) {
+			if (from != 0 && ch != from - 1)
+				continue;
+			e = &b->status[type | ch];
+			*e = (*e & ~0xffU) | (uint32_t) (type | (to - 1));
+		}
+	}
+}
+
+void
+midi_batch_transpose (midi_batch_t *b, int semitones)
+{
+	if (b)
+		b->transpose = semitones < -127 ? -127 :
+				semitones > 127 ? 127 : semitones;
+}
+
+void
+midi_batch_velocity_table (midi_batch_t *b, const unsigned char table[128])
+{
+	if (b == NULL || table == NULL)
+		return;
+	b->velocity[0] = 0;
+	for (int n = 1; n < 128; n++) {
+		b->velocity[n] = table[n] & 0x7f;
+		if (b->velocity[n] == 0)
+			b->velocity[n] = 1;
+	}
+}
+
+static size_t
+midi_batch_scalar (const midi_batch_t *b, const uint32_t *in, uint32_t *out,
+			size_t n)
+{
+	uint32_t v, s, d1, d2;
+	size_t i, k = 0;
+	int t;
+
+	for (i = 0; i < n; i++) {
+		v = in[i];
+		s = b->status[v & 0xff];
+		if ( ! (s & MIDI_BATCH_KEEP))
+			continue;
+		d1 = (v >> 8) & 0xff;
+		d2 = (v >> 16) & 0xff;
+		if (s & MIDI_BATCH_NOTE) {
+			t = (int) d1 + b->transpose;
+			d1 = (uint32_t) (t < 0 ? 0 : t > 0x7f ? 0x7f : t);
+		}
+		if (s & MIDI_BATCH_NOTEON)
+			d2 = b->velocity[d2 & 0x7f];
+		out[k++] = (s & 0xff) | (d1 << 8) | (d2 << 16);
+	}
+	return (k);
+}
+
+#ifdef MIDI_BATCH_X86
+
+/* Store the lanes of 'r' selected by 'mask' at 'out'. */
+static inline size_t
+midi_batch_compact (const uint32_t *r, unsigned int mask, int lanes,
+			uint32_t *out)
+{
+	size_t k = 0;
+
+	for (int l = 0; l < lanes; l++) {
+		out[k] = r[l];
+		k += (mask >> l) & 1;
+	}
+	return (k);
+}
+
+__attribute__ ((target ("sse2")))
+static size_t
+midi_batch_sse2 (const midi_batch_t *b, const uint32_t *in, uint32_t *out,
+			size_t n)
+{
+	const __m128i ff = _mm_set1_epi32 (0xff);
+	const __m128i x7f = _mm_set1_epi32 (0x7f);
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i tr = _mm_set1_epi32 (b->transpose);
+	const __m128i keep = _mm_set1_epi32 (MIDI_BATCH_KEEP);
+	const __m128i note = _mm_set1_epi32 (MIDI_BATCH_NOTE);
+	const __m128i non = _mm_set1_epi32 (MIDI_BATCH_NOTEON);
+	__m128i v, s, d1, d2, t, vel, m;
+	uint32_t r[4];
+	size_t i, k = 0;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		v = _mm_loadu_si128 ((const __m128i *) (in + i));
+		/* no gather in SSE2: the lookups are loaded one by one */
+		s = _mm_set_epi32 ((int) b->status[in[i + 3] & 0xff],
+				(int) b->status[in[i + 2] & 0xff],
+				(int) b->status[in[i + 1] & 0xff],
+				(int) b->status[in[i] & 0xff]);
+		vel = _mm_set_epi32 ((int) b->velocity[(in[i + 3] >> 16) & 0x7f],
+				(int) b->velocity[(in[i + 2] >> 16) & 0x7f],
+				(int) b->velocity[(in[i + 1] >> 16) & 0x7f],
+				(int) b->velocity[(in[i] >> 16) & 0x7f]);
+		d1 = _mm_and_si128 (_mm_srli_epi32 (v, 8), ff);
+		d2 = _mm_and_si128 (_mm_srli_epi32 (v, 16), ff);
+
+		/* transpose and clamp the notes (16-bit min/max are enough) */
+		t = _mm_add_epi32 (d1, tr);
+		t = _mm_min_epi16 (_mm_max_epi16 (t, zero), x7f);
+		m = _mm_cmpeq_epi32 (_mm_and_si128 (s, note), note);
+		d1 = _mm_or_si128 (_mm_and_si128 (m, t),
+					_mm_andnot_si128 (m, d1));
+
+		/* velocity of note on */
+		m = _mm_cmpeq_epi32 (_mm_and_si128 (s, non), non);
+		d2 = _mm_or_si128 (_mm_and_si128 (m, vel),
+					_mm_andnot_si128 (m, d2));
+
+		v = _mm_or_si128 (_mm_and_si128 (s, ff),
+				_mm_or_si128 (_mm_slli_epi32 (d1, 8),
+						_mm_slli_epi32 (d2, 16)));
+		m = _mm_cmpeq_epi32 (_mm_and_si128 (s, keep), keep);
+		_mm_storeu_si128 ((__m128i *) r, v);
+		k += midi_batch_compact (r, (unsigned int) _mm_movemask_ps (
+					_mm_castsi128_ps (m)), 4, out + k);
+	}
+	return (k + midi_batch_scalar (b, in + i, out + k, n - i));
+}
+
+__attribute__ ((target ("avx2")))
+static size_t
+midi_batch_avx2 (const midi_batch_t *b, const uint32_t *in, uint32_t *out,
+			size_t n)
+{
+	const __m256i ff = _mm256_set1_epi32 (0xff);
+	const __m256i x7f = _mm256_set1_epi32 (0x7f);
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i tr = _mm256_set1_epi32 (b->transpose);
+	const __m256i keep = _mm256_set1_epi32 (MIDI_BATCH_KEEP);
+	const __m256i note = _mm256_set1_epi32 (MIDI_BATCH_NOTE);
+	const __m256i non = _mm256_set1_epi32 (MIDI_BATCH_NOTEON);
+	__m256i v, s, d1, d2, t, vel, m;
+	uint32_t r[8];
+	size_t i, k = 0;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = _mm256_loadu_si256 ((const __m256i *) (in + i));
+		s = _mm256_i32gather_epi32 ((const int *) b->status,
+						_mm256_and_si256 (v, ff), 4);
+		d1 = _mm256_and_si256 (_mm256_srli_epi32 (v, 8), ff);
+		d2 = _mm256_and_si256 (_mm256_srli_epi32 (v, 16), ff);
+		vel = _mm256_i32gather_epi32 ((const int *) b->velocity,
+						_mm256_and_si256 (d2, x7f), 4);
+
+		/* transpose and clamp the notes */
+		t = _mm256_add_epi32 (d1, tr);
+		t = _mm256_min_epi32 (_mm256_max_epi32 (t, zero), x7f);
+		m = _mm256_cmpeq_epi32 (_mm256_and_si256 (s, note), note);
+		d1 = _mm256_blendv_epi8 (d1, t, m);
+
+		/* velocity of note on */
+		m = _mm256_cmpeq_epi32 (_mm256_and_si256 (s, non), non);
+		d2 = _mm256_blendv_epi8 (d2, vel, m);
+
+		v = _mm256_or_si256 (_mm256_and_si256 (s, ff),
+				_mm256_or_si256 (_mm256_slli_epi32 (d1, 8),
+						_mm256_slli_epi32 (d2, 16)));
+		m = _mm256_cmpeq_epi32 (_mm256_and_si256 (s, keep), keep);
+		_mm256_storeu_si256 ((__m256i *) r, v);
+		k += midi_batch_compact (r, (unsigned int) _mm256_movemask_ps (
+					_mm256_castsi256_ps (m)), 8, out + k);
+	}
+	return (k + midi_batch_scalar (b, in + i, out + k, n - i));
+}
+
+#endif /* MIDI_BATCH_X86 */
+
+/* Get the best instruction set supported by the CPU. */
+static midi_batch_isa_t
+midi_batch_best_isa ()
+{
+#ifdef MIDI_BATCH_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2"))
+		return (MIDI_BATCH_AVX2);
+	if (__builtin_cpu_supports ("sse2"))
+		return (MIDI_BATCH_SSE2);
+#endif
+	return (MIDI_BATCH_SCALAR);
+}
+
+midi_batch_isa_t
+midi_batch_get_isa ()
+{
+	int isa = __atomic_load_n (&midi_batch_isa, __ATOMIC_RELAXED);
+
+	if (isa < 0) {
+		isa = (int) midi_batch_best_isa ();
+		__atomic_store_n (&midi_batch_isa, isa, __ATOMIC_RELAXED);
+	}
+	return ((midi_batch_isa_t) isa);
+}
+
+midi_batch_isa_t
+midi_batch_set_isa (midi_batch_isa_t isa)
+{
+	midi_batch_isa_t best = midi_batch_best_isa ();
+
+	if (isa > best)
+		isa = best;
+	__atomic_store_n (&midi_batch_isa, (int) isa, __ATOMIC_RELAXED);
+	return (isa);
+}
+
+/* Get the kernel of the instruction set in use. */
+static midi_batch_kernel_t
+midi_batch_kernel ()
+{
+	switch (midi_batch_get_isa ()) {
+#ifdef MIDI_BATCH_X86
+	case MIDI_BATCH_AVX2:
+		return (midi_batch_avx2);
+	case MIDI_BATCH_SSE2:
+		return (midi_batch_sse2);
+#endif
+	default:
+		return (midi_batch_scalar);
+	}
+}
+
+size_t
+midi_batch_apply4 (const midi_batch_t *b, uint32_t *msgs, size_t n)
+{
+	if (b == NULL || msgs == NULL)
+		return (0);
+	return (midi_batch_kernel () (b, msgs, msgs, n));
+}
+
+size_t
+midi_batch_apply3 (const midi_batch_t *b, unsigned char *msgs, size_t n)
+{
+	midi_batch_kernel_t kernel;
+	uint32_t blk[MIDI_BATCH_BLOCK];
+	const unsigned char *p;
+	unsigned char *q;
+	size_t i, j, m, kept, k = 0;
+
+	if (b == NULL || msgs == NULL)
+		return (0);
+	kernel = midi_batch_kernel ();
+	for (i = 0; i < n; i += m) {
+		m = n - i < MIDI_BATCH_BLOCK ? n - i : MIDI_BATCH_BLOCK;
+		p = msgs + i * 3;
+		for (j = 0; j < m; j++, p += 3)
+			blk[j] = p[0] | ((uint32_t) p[1] << 8) |
+				((uint32_t) p[2] << 16);
+		kept = kernel (b, blk, blk, m);
+		/* the kept messages of the block go after the previous ones */
+		q = msgs + k * 3;
+		for (j = 0; j < kept; j++, q += 3) {
+			q[0] = (unsigned char) blk[j];
+			q[1] = (unsigned char) (blk[j] >> 8);
+			q[2] = (unsigned char) (blk[j] >> 16);
+		}
+		k += kept;
+	}
+	return (k);
+}
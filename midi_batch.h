@@ -0,0 +1,120 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_BATCH_H
+#define MIDI_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* flags of the entries of the status table of a batch transform */
+#define MIDI_BATCH_KEEP		0x100 /* messages are kept */
+#define MIDI_BATCH_NOTE		0x200 /* the first data byte is a note */
+#define MIDI_BATCH_NOTEON	0x400 /* the second data byte is a velocity */
+
+/* instruction sets of the kernels */
+typedef enum midi_batch_isa_t {
+	MIDI_BATCH_SCALAR = 0,
+	MIDI_BATCH_SSE2 = 1,
+	MIDI_BATCH_AVX2 = 2
+} midi_batch_isa_t;
+
+/* Batch transform of arrays of short messages packed in 4 bytes (a 32-bit
+ * value: status | data1 << 8 | data2 << 16) or in 3 bytes. Messages are
+ * filtered on their status byte, their channel is remapped, notes are
+ * transposed and clamped to 0 .. 127 and the velocity of note on goes thru
+ * a table. The tables are compiled from the settings below; the kernels
+ * (scalar, SSE2 or AVX2, chosen at run time) handle several messages at
+ * once with table lookups only. Messages without a status byte are
+ * dropped.
+ */
+typedef struct midi_batch_t {
+	uint32_t status[256]; /* new status and flags of each status byte */
+	uint32_t velocity[128]; /* velocity table of note on */
+	int32_t transpose; /* added to the notes */
+} midi_batch_t;
+
+/* Initialize a batch transform keeping all messages unchanged. */
+void
+midi_batch_init (midi_batch_t *b);
+
+/* Drop the messages with status byte 'status'. For channel messages,
+ * 'status' is a type (0x80 .. 0xe0) and 'channel' is 1 .. 16, or 0 for
+ * all channels.
+ */
+void
+midi_batch_filter (midi_batch_t *b, unsigned char status, int channel);
+
+/* Send the messages of channel 'from' (1 .. 16, or 0 for all) to channel
+ * 'to' (1 .. 16).
+ */
+void
+midi_batch_map_channel (midi_batch_t *b, int from, int to);
+
+/* Transpose the notes of note and key pressure messages. */
+void
+midi_batch_transpose (midi_batch_t *b, int semitones);
+
+/* Set the velocity table of note on; entries 1 .. 127 are used, 0 is
+ * changed to 1 (see also midi_xform_velocity_curve).
+ */
+void
+midi_batch_velocity_table (midi_batch_t *b, const unsigned char table[128]);
+
+/* Get the instruction set used by the kernels. */
+midi_batch_isa_t
+midi_batch_get_isa ();
+
+/* Use the kernels of instruction set 'isa', if supported by the CPU, or
+ * else the best one below. Returns the instruction set used.
+ */
+midi_batch_isa_t
+midi_batch_set_isa (midi_batch_isa_t isa);
+
+/* Transform 'n' messages packed in 4 bytes, in place; the fourth byte is
+ * cleared. The kept messages are moved to the start of the array. Returns
+ * their count.
+ */
+size_t
+midi_batch_apply4 (const midi_batch_t *b, uint32_t *msgs, size_t n);
+
+/* Same as "midi_batch_apply4" with messages packed in 3 bytes (status,
+ * data1, data2; the second data byte of short messages is ignored).
+ */
+size_t
+midi_batch_apply3 (const midi_batch_t *b, unsigned char *msgs, size_t n);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_BATCH_H */
@@ -0,0 +1,242 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "midi_bcast.h"
+
+bool
+midi_bcast_init (midi_bcast_t *b, unsigned int ring_size)
+{
+	unsigned int n = 1;
+
+	if (b == NULL)
+		return (false);
+	memset (b, 0, sizeof (midi_bcast_t));
+	if (ring_size == 0)
+		ring_size = MIDI_BCAST_RING_DEFAULT;
+	while (n < ring_size)
+		n <<= 1;
+	b->ring_size = n;
+	b->nslots = MIDI_BCAST_SUBSCRIBERS_MAX * (n + 1) + 1;
+	b->slots = (midi_bcast_slot_t *) calloc (b->nslots,
+						sizeof (midi_bcast_slot_t));
+	if (b->slots == NULL)
+		return (false);
+	for (int i = 0; i < MIDI_BCAST_SUBSCRIBERS_MAX; i++) {
+		b->subs[i].ring = (uint32_t *) malloc (n * sizeof (uint32_t));
+		if (b->subs[i].ring == NULL) {
+			midi_bcast_free (b);
+			return (false);
+		}
+	}
+	return (true);
+}
+
+void
+midi_bcast_free (midi_bcast_t *b)
+{
+	if (b == NULL)
+		return;
+	for (int i = 0; i < MIDI_BCAST_SUBSCRIBERS_MAX; i++) {
+		free (b->subs[i].ring);
+		b->subs[i].ring = NULL;
+		b->subs[i].active = false;
+	}
+	free (b->slots);
+	b->slots = NULL;
+	b->nslots = 0;
+}
+
+/* Get an active subscriber, or NULL. */
+static midi_bcast_sub_t *
+midi_bcast_sub (midi_bcast_t *b, int id)
+{
+	if (b == NULL || b->slots == NULL || id < 0 ||
+		id >= MIDI_BCAST_SUBSCRIBERS_MAX || ! b->subs[id].active)
+		return (NULL);
+	return (&b->subs[id]);
+}
+
+int
+midi_bcast_subscribe (midi_bcast_t *b)
+{
+	midi_bcast_sub_t *s;
+
+	if (b == NULL || b->slots == NULL)
+		return (-1);
+	for (int i = 0; i < MIDI_BCAST_SUBSCRIBERS_MAX; i++) {
+		s = &b->subs[i];
+		if (s->active)
+			continue;
+		s->head = s->tail = 0;
+		memset (&s->stats, 0, sizeof (midi_bcast_stats_t));
+		s->types[0] = s->types[1] = UINT64_MAX;
+		s->active = true;
+		return (i);
+	}
+	return (-1);
+}
+
+void
+midi_bcast_unsubscribe (midi_bcast_t *b, int id)
+{
+	const midi_frame_t *mf;
+
+	if (midi_bcast_sub (b, id) == NULL)
+		return;
+	while ((mf = midi_bcast_next (b, id)) != NULL)
+		midi_bcast_release (b, mf);
+	b->subs[id].active = false;
+}
+
+void
+midi_bcast_filter (midi_bcast_t *b, int id, unsigned char status,
+			int channel)
+{
+	midi_bcast_sub_t *s = midi_bcast_sub (b, id);
+	int bit;
+
+	if (s == NULL || status < 0x80)
+		return;
+	for (int ch = 0; ch < 16; ch++) {
+		if (status < 0xf0) {
+			if (channel >= 1 && channel <= 16 && ch != channel - 1)
+				continue;
+			bit = MIDI_STATUS_BIT ((status & 0xf0) | ch);
+		}
+		else if (ch == 0)
+			bit = MIDI_STATUS_BIT (status);
+		else
+			break;
+		s->types[bit >> 6] &= ~(1ULL << (bit & 63));
+	}
+}
+
+/* Find a free slot, or return -1. */
+static int
+midi_bcast_alloc (midi_bcast_t *b)
+{
+	uint32_t i = b->next;
+
+	for (uint32_t n = 0; n < b->nslots; n++) {
+		if (__atomic_load_n (&b->slots[i].refs, __ATOMIC_ACQUIRE)
+			== 0) {
+			b->next = (i + 1) % b->nslots;
+			return ((int) i);
+		}
+		i = (i + 1) % b->nslots;
+	}
+	return (-1);
+}
+
+int
+midi_bcast_put (midi_bcast_t *b, const midi_frame_t *mf)
+{
+	midi_bcast_sub_t *s, *to[MIDI_BCAST_SUBSCRIBERS_MAX];
+	int i, n = 0, slot, bit;
+
+	if (b == NULL || b->slots == NULL || mf == NULL || mf->len == 0)
+		return (0);
+	bit = mf->data[0] >= 0x80 ? MIDI_STATUS_BIT (mf->data[0]) : -1;
+	for (i = 0; i < MIDI_BCAST_SUBSCRIBERS_MAX; i++) {
+		s = &b->subs[i];
+		if ( ! s->active)
+			continue;
+		if (bit >= 0 && ! (s->types[bit >> 6] & (1ULL << (bit & 63))))
+			s->stats.filtered++;
+		else if (s->tail - __atomic_load_n (&s->head, __ATOMIC_ACQUIRE)
+				>= b->ring_size)
+			s->stats.dropped++;
+		else
+			to[n++] = s;
+	}
+	if (n == 0)
+		return (0);
+	if ((slot = midi_bcast_alloc (b)) < 0) {
+		b->exhausted++;
+		return (0);
+	}
+	b->slots[slot].frame = *mf;
+	__atomic_store_n (&b->slots[slot].refs, (unsigned int) n,
+				__ATOMIC_RELAXED);
+	for (i = 0; i < n; i++) {
+		s = to[i];
+		s->ring[s->tail & (b->ring_size - 1)] = (uint32_t) slot;
+		s->stats.frames++;
+		__atomic_store_n (&s->tail, s->tail + 1, __ATOMIC_RELEASE);
+	}
+	b->frames++;
+	return (n);
+}
+
+void
+midi_bcast_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_bcast_put ((midi_bcast_t *) user_data, mf);
+}
+
+const midi_frame_t *
+midi_bcast_next (midi_bcast_t *b, int id)
+{
+	midi_bcast_sub_t *s = midi_bcast_sub (b, id);
+	uint32_t slot;
+	unsigned int h;
+
+	if (s == NULL)
+		return (NULL);
+	h = s->head;
+	if (h == __atomic_load_n (&s->tail, __ATOMIC_ACQUIRE))
+		return (NULL);
+	slot = s->ring[h & (b->ring_size - 1)];
+	__atomic_store_n (&s->head, h + 1, __ATOMIC_RELEASE);
+	return (&b->slots[slot].frame);
+}
+
+void
+midi_bcast_release (midi_bcast_t *b, const midi_frame_t *mf)
+{
+	midi_bcast_slot_t *slot;
+
+	if (b == NULL || b->slots == NULL || mf == NULL)
+		return;
+	/* the frame is the first member of its slot */
+	slot = (midi_bcast_slot_t *) mf;
+	if (slot < b->slots || slot >= b->slots + b->nslots)
+		return;
+	__atomic_fetch_sub (&slot->refs, 1, __ATOMIC_RELEASE);
+}
+
+bool
+midi_bcast_get_stats (midi_bcast_t *b, int id, midi_bcast_stats_t *stats)
+{
+	midi_bcast_sub_t *s = midi_bcast_sub (b, id);
+
+	if (s == NULL || stats == NULL)
+		return (false);
+	*stats = s->stats;
+	return (true);
+}
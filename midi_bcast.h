@@ -0,0 +1,147 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_BCAST_H
+#define MIDI_BCAST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* max count of subscribers */
+#define MIDI_BCAST_SUBSCRIBERS_MAX	16
+
+/* default count of frames of the ring of a subscriber */
+#define MIDI_BCAST_RING_DEFAULT	256
+
+/* statistics of a subscriber */
+typedef struct midi_bcast_stats_t {
+	unsigned long frames; /* count of frames given */
+	unsigned long filtered; /* count of frames filtered */
+	unsigned long dropped; /* frames lost because the ring was full */
+} midi_bcast_stats_t;
+
+/* a frame of the pool and its count of references */
+typedef struct midi_bcast_slot_t {
+	midi_frame_t frame; /* the frame */
+	unsigned int refs; /* count of subscribers holding the frame */
+} midi_bcast_slot_t;
+
+/* a subscriber: ring of indexes of slots */
+typedef struct midi_bcast_sub_t {
+	unsigned int tail __attribute__ ((aligned (64))); /* next free entry
+							   * (producer) */
+	midi_bcast_stats_t stats; /* statistics (producer) */
+	unsigned int head __attribute__ ((aligned (64))); /* next entry
+							   * (subscriber) */
+	bool active; /* subscribed */
+	uint64_t types[2]; /* accepted status bytes (MIDI_STATUS_BIT) */
+	uint32_t *ring; /* slot indexes */
+} midi_bcast_sub_t;
+
+/* Broadcast of frames to several subscribers without copy: a frame is
+ * written once into a slot of a pool, then the index of the slot is queued
+ * in the ring of each subscriber accepting it, and the slot is reused when
+ * all of them released it. The producer never waits: a subscriber whose
+ * ring is full loses the frame, the others do not. The pool is large
+ * enough for all the rings to be full while each subscriber holds one more
+ * frame.
+ */
+typedef struct midi_bcast_t {
+	midi_bcast_sub_t subs[MIDI_BCAST_SUBSCRIBERS_MAX]; /* subscribers */
+	unsigned int ring_size; /* count of entries of a ring (power of 2) */
+	midi_bcast_slot_t *slots; /* pool of frames */
+	uint32_t nslots; /* count of slots */
+	uint32_t next; /* next slot to try (producer) */
+	unsigned long frames; /* count of frames broadcast */
+	unsigned long exhausted; /* frames lost because the pool was full */
+} midi_bcast_t;
+
+/* Initialize a broadcast with rings of 'ring_size' frames (rounded up to a
+ * power of 2; 0 for the default). Returns false on failure.
+ */
+bool
+midi_bcast_init (midi_bcast_t *b, unsigned int ring_size);
+
+/* Release the pool and the rings. */
+void
+midi_bcast_free (midi_bcast_t *b);
+
+/* Add a subscriber accepting all frames. Must not be called while the
+ * producer is running. Returns its id, or -1 if there are too many.
+ */
+int
+midi_bcast_subscribe (midi_bcast_t *b);
+
+/* Remove subscriber 'id', releasing the frames of its ring. Must not be
+ * called while the producer is running.
+ */
+void
+midi_bcast_unsubscribe (midi_bcast_t *b, int id);
+
+/* Do not give the messages with status byte 'status' to subscriber 'id'.
+ * For channel messages, 'status' is a type (0x80 .. 0xe0) and 'channel'
+ * is 1 .. 16, or 0 for all channels.
+ */
+void
+midi_bcast_filter (midi_bcast_t *b, int id, unsigned char status,
+			int channel);
+
+/* Broadcast a frame. Must be called from one thread at a time; never
+ * blocks. Returns the count of subscribers it was given to.
+ */
+int
+midi_bcast_put (midi_bcast_t *b, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap", with the broadcast as
+ * argument.
+ */
+void
+midi_bcast_tap (const midi_frame_t *mf, void *user_data);
+
+/* Get the next frame of subscriber 'id', from its thread, or NULL if there
+ * is none. The frame stays valid until released.
+ */
+const midi_frame_t *
+midi_bcast_next (midi_bcast_t *b, int id);
+
+/* Release a frame given by "midi_bcast_next". */
+void
+midi_bcast_release (midi_bcast_t *b, const midi_frame_t *mf);
+
+/* Get the statistics of subscriber 'id'. Returns false on error. */
+bool
+midi_bcast_get_stats (midi_bcast_t *b, int id, midi_bcast_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_BCAST_H */
@@ -0,0 +1,1345 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "midi_capture.h"
+
+static const char midi_capture_magic[8] = { 'M', 'I', 'D', 'I', 'C', 'A', 'P', '1' };
+static const char midi_capture_block_magic[4] = { 'M', 'B', 'L', 'K' };
+static const char midi_capture_index_magic[4] = { 'M', 'I', 'D', 'X' };
+
+/* maximal size of a record header (three varints) */
+#define MIDI_CAPTURE_RECORD_HDR	30
+
+static inline void
+midi_capture_put16 (unsigned char *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+}
+
+static inline void
+midi_capture_put32 (unsigned char *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+static inline void
+midi_capture_put64 (unsigned char *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++, v >>= 8)
+		p[i] = v & 0xff;
+}
+
+static inline uint16_t
+midi_capture_get16 (const unsigned char *p)
+{
+	return ((uint16_t) (p[0] | (p[1] << 8)));
+}
+
+static inline uint32_t
+midi_capture_get32 (const unsigned char *p)
+{
+	uint32_t v = 0;
+
+	for (int i = 3; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+static inline uint64_t
+midi_capture_get64 (const unsigned char *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+static inline int
+midi_capture_put_varint (unsigned char *p, uint64_t v)
+{
+	int n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (unsigned char) ((v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char) v;
+	return (n);
+}
+
+/* Decode a varint at *p, not going past 'end'. Returns false if truncated. */
+static inline bool
+midi_capture_get_varint (const unsigned char **p, const unsigned char *end,
+				uint64_t *v)
+{
+	int shift = 0;
+
+	*v = 0;
+	while (*p < end && shift < 64) {
+		unsigned char b = *(*p)++;
+
+		*v |= (uint64_t) (b & 0x7f) << shift;
+		if ( ! (b & 0x80))
+			return (true);
+		shift += 7;
+	}
+	return (false);
+}
+
+static bool
+midi_capture_decode (midi_capture_t *cap, midi_frame_t *mf);
+
+/* LZ77 codec: sequences of a token (literal count << 4 | match length - 4,
+ * 15 meaning that bytes of 255 and a last byte follow), the literals, then
+ * the offset of the match (u16), except for the last sequence.
+ */
+#define MIDI_CAPTURE_LZ_MIN	4
+#define MIDI_CAPTURE_LZ_HASH	12
+
+static inline uint32_t
+midi_capture_lz_hash (const unsigned char *p)
+{
+	uint32_t v = (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+			((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+
+	return ((v * 2654435761U) >> (32 - MIDI_CAPTURE_LZ_HASH));
+}
+
+/* Write a length of more than 14 after its token. */
+static inline unsigned char *
+midi_capture_lz_len (unsigned char *op, const unsigned char *oend, size_t n)
+{
+	for (; n >= 255 && op < oend; n -= 255)
+		*op++ = 255;
+	if (op >= oend)
+		return (NULL);
+	*op++ = (unsigned char) n;
+	return (op);
+}
+
+/* Write a sequence of literals and a match (mlen 0: last sequence). */
+static unsigned char *
+midi_capture_lz_seq (unsigned char *op, const unsigned char *oend,
+			const unsigned char *lit, size_t nlit, size_t off,
+			size_t mlen)
+{
+	unsigned char *token;
+	size_t m = mlen ? mlen - MIDI_CAPTURE_LZ_MIN : 0;
+
+	if (op >= oend)
+		return (NULL);
+	token = op++;
+	*token = (unsigned char) (((nlit < 15 ? nlit : 15) << 4) |
+					(m < 15 ? m : 15));
+	if (nlit >= 15 && (op = midi_capture_lz_len (op, oend, nlit - 15)) == NULL)
+		return (NULL);
+	if ((size_t) (oend - op) < nlit + (mlen ? 2 : 0))
+		return (NULL);
+	memcpy (op, lit, nlit);
+	op += nlit;
+	if (mlen) {
+		*op++ = off & 0xff;
+		*op++ = (unsigned char) (off >> 8);
+		if (m >= 15)
+			op = midi_capture_lz_len (op, oend, m - 15);
+	}
+	return (op);
+}
+
+/* Compress 'n' bytes into at most 'max' bytes. Returns the compressed
+ * length, or 0 if it does not fit.
+ */
+static size_t
+midi_capture_lz_compress (const unsigned char *in, size_t n,
+				unsigned char *out, size_t max)
+{
+	uint32_t table[1 << MIDI_CAPTURE_LZ_HASH];
+	const unsigned char *anchor = in, *ip = in, *end = in + n, *ref;
+	unsigned char *op = out;
+	uint32_t h;
+	size_t len;
+
+	memset (table, 0, sizeof (table));
+	while (op && ip + MIDI_CAPTURE_LZ_MIN <= end) {
+		h = midi_capture_lz_hash (ip);
+		ref = table[h] ? in + table[h] - 1 : NULL;
+		table[h] = (uint32_t) (ip - in) + 1;
+		if (ref == NULL || ip - ref > 0xffff ||
+			memcmp (ref, ip, MIDI_CAPTURE_LZ_MIN) != 0) {
+			ip++;
+			continue;
+		}
+		len = MIDI_CAPTURE_LZ_MIN;
+		while (ip + len < end && ref[len] == ip[len])
+			len++;
+		op = midi_capture_lz_seq (op, out + max, anchor,
+					(size_t) (ip - anchor),
+					(size_t) (ip - ref), len);
+		ip += len;
+		anchor = ip;
+	}
+	if (op)
+		op = midi_capture_lz_seq (op, out + max, anchor,
+					(size_t) (end - anchor), 0, 0);
+	return (op ? (size_t) (op - out) : 0);
+}
+
+/* Read a length of more than 14. */
+static inline bool
+midi_capture_lz_get_len (const unsigned char **ip, const unsigned char *end,
+				size_t *n)
+{
+	unsigned char b;
+
+	do {
+		if (*ip >= end)
+			return (false);
+		b = *(*ip)++;
+		*n += b;
+	} while (b == 255);
+	return (true);
+}
+
+/* Decompress exactly 'n' bytes. Returns false if the data is corrupted. */
+static bool
+midi_capture_lz_decompress (const unsigned char *in, size_t len,
+				unsigned char *out, size_t n)
+{
+	const unsigned char *ip = in, *end = in + len;
+	size_t o = 0, nlit, mlen, off;
+
+	while (ip < end) {
+		nlit = *ip >> 4;
+		mlen = *ip++ & 0x0f;
+		if (nlit == 15 && ! midi_capture_lz_get_len (&ip, end, &nlit))
+			return (false);
+		if ((size_t) (end - ip) < nlit || n - o < nlit)
+			return (false);
+		memcpy (out + o, ip, nlit);
+		ip += nlit;
+		o += nlit;
+		if (ip == end)
+			break;
+		if (end - ip < 2)
+			return (false);
+		off = ip[0] | ((size_t) ip[1] << 8);
+		ip += 2;
+		if (mlen == 15 && ! midi_capture_lz_get_len (&ip, end, &mlen))
+			return (false);
+		mlen += MIDI_CAPTURE_LZ_MIN;
+		if (off == 0 || off > o || n - o < mlen)
+			return (false);
+		/* the match may overlap the output */
+		for (; mlen > 0; mlen--, o++)
+			out[o] = out[o - off];
+	}
+	return (o == n);
+}
+
+/* Set a cursor on the records of codec 0 in 'p'. */
+static void
+midi_capture_cursor (midi_capture_t *c, const unsigned char *p, uint32_t len,
+			uint32_t nframes, uint64_t t)
+{
+	memset (c, 0, sizeof (midi_capture_t));
+	c->p = p;
+	c->end = p + len;
+	c->left = nframes;
+	c->t = t;
+	c->source = -1;
+}
+
+static inline unsigned char *
+midi_capture_zigzag (unsigned char *p, int64_t v)
+{
+	return (p + midi_capture_put_varint (p, ((uint64_t) v << 1) ^
+						(uint64_t) (v >> 63)));
+}
+
+/* Pack the records of a block (codec 0, see midi_capture.h). Returns the
+ * packed length, or 0 if it exceeds 'max' or the block is corrupted.
+ */
+static uint32_t
+midi_capture_pack (const unsigned char *block, unsigned char *out,
+			uint32_t max)
+{
+	const unsigned char *payload = block + MIDI_CAPTURE_BLOCK_HEADER_LEN;
+	uint32_t len = midi_capture_get32 (block + 8);
+	uint32_t nframes = midi_capture_get32 (block + 12);
+	uint64_t t0 = midi_capture_get64 (block + 16);
+	uint32_t count[128], i, k, best;
+	unsigned char dict[64], idx[128], *op = out;
+	const unsigned char *oend = out + max;
+	midi_capture_t c;
+	midi_frame_t mf;
+	int64_t d, prev_d;
+	uint64_t prev_t;
+	int ndict = 0, src, pass, flen;
+
+	/* dictionary of the most frequent status bytes */
+	memset (count, 0, sizeof (count));
+	midi_capture_cursor (&c, payload, len, nframes, t0);
+	while (c.left > 0) {
+		if ( ! midi_capture_decode (&c, &mf))
+			return (0);
+		count[mf.data[0] - 0x80]++;
+	}
+	memset (idx, 63, sizeof (idx));
+	while (ndict < 63) {
+		for (best = 0, k = 0; k < 128; k++) {
+			if (count[k] > count[best])
+				best = k;
+		}
+		if (count[best] == 0)
+			break;
+		dict[ndict] = (unsigned char) (best + 0x80);
+		idx[best] = (unsigned char) ndict++;
+		count[best] = 0;
+	}
+	if ((size_t) (oend - op) < (size_t) ndict + 1 + nframes)
+		return (0);
+	*op++ = (unsigned char) ndict;
+	memcpy (op, dict, ndict);
+	op += ndict;
+
+	/* control bytes, then source and length varints, then timestamps,
+	 * then data bytes */
+	for (pass = 0; pass < 4; pass++) {
+		midi_capture_cursor (&c, payload, len, nframes, t0);
+		src = -2;
+		prev_t = t0;
+		prev_d = 0;
+		for (i = 0; i < nframes; i++) {
+			/* room for the largest entry of any stream */
+			if (oend - op < 2 * 10 + MIDI_FRAME_MAX ||
+				! midi_capture_decode (&c, &mf))
+				return (0);
+			flen = midi_frame_len[mf.data[0] - 0x80];
+			k = idx[mf.data[0] - 0x80];
+			switch (pass) {
+			case 0:
+				*op++ = (unsigned char) (k |
+					(flen <= 0 || flen != mf.len ? 0x40 : 0) |
+					(mf.source != src ? 0x80 : 0));
+				break;
+			case 1:
+				if (mf.source != src)
+					op += midi_capture_put_varint (op,
+						(uint64_t) (mf.source < 0 ?
+						0 : mf.source + 1));
+				if (flen <= 0 || flen != mf.len)
+					op += midi_capture_put_varint (op,
+							mf.len);
+				break;
+			case 2:
+				d = (int64_t) (mf.ts - prev_t);
+				op = midi_capture_zigzag (op, d - prev_d);
+				prev_t = mf.ts;
+				prev_d = d;
+				break;
+			default:
+				if (k == 63)
+					*op++ = mf.data[0];
+				memcpy (op, mf.data + 1, mf.len - 1);
+				op += mf.len - 1;
+				break;
+			}
+			src = mf.source;
+		}
+	}
+	return ((uint32_t) (op - out));
+}
+
+/* Unpack the records of a block into 'out' ('len' bytes, codec 0). Returns
+ * false if the packed data is corrupted.
+ */
+static bool
+midi_capture_unpack (const unsigned char *in, uint32_t in_len,
+			uint32_t nframes, unsigned char *out, uint32_t len)
+{
+	const unsigned char *end = in + in_len, *dict, *ctl, *aux, *ts, *data;
+	unsigned char rec[MIDI_CAPTURE_RECORD_HDR + MIDI_FRAME_MAX];
+	unsigned char *op = out, status, running = 0;
+	uint64_t v, dlen;
+	int64_t d = 0, dd;
+	uint32_t i, ndict;
+	int source = -2, flen, n;
+
+	if (in_len < 1 || (ndict = in[0]) > 63 ||
+		(size_t) (end - in) < 1 + ndict + (size_t) nframes)
+		return (false);
+	dict = in + 1;
+	ctl = dict + ndict;
+
+	/* find the start of the streams */
+	aux = ts = ctl + nframes;
+	for (i = 0; i < nframes; i++) {
+		n = ((ctl[i] & 0x80) ? 1 : 0) + ((ctl[i] & 0x40) ? 1 : 0);
+		while (n-- > 0) {
+			if ( ! midi_capture_get_varint (&ts, end, &v))
+				return (false);
+		}
+	}
+	data = ts;
+	for (i = 0; i < nframes; i++) {
+		if ( ! midi_capture_get_varint (&data, end, &v))
+			return (false);
+	}
+
+	for (i = 0; i < nframes; i++) {
+		if ((ctl[i] & 0x3f) == 63) {
+			if (data >= end)
+				return (false);
+			status = *data++;
+		}
+		else if ((ctl[i] & 0x3f) < ndict)
+			status = dict[ctl[i] & 0x3f];
+		else
+			return (false);
+		if (status < 0x80)
+			return (false);
+		flen = midi_frame_len[status - 0x80];
+		if (ctl[i] & 0x80) {
+			if ( ! midi_capture_get_varint (&aux, end, &v) ||
+				v > INT32_MAX)
+				return (false);
+			source = (int) v - 1;
+			running = 0;
+		}
+		dlen = (uint64_t) flen;
+		if ((ctl[i] & 0x40) && ( ! midi_capture_get_varint (&aux, end,
+						&dlen) || dlen == 0 ||
+					dlen > MIDI_FRAME_MAX))
+			return (false);
+		if (dlen == 0 || (uint64_t) (end - data) < dlen - 1)
+			return (false);
+		if ( ! midi_capture_get_varint (&ts, end, &v))
+			return (false);
+		dd = (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+		d += dd;
+
+		/* record of codec 0, as written by midi_capture_write */
+		n = midi_capture_put_varint (rec, ((uint64_t) d << 2) |
+					((ctl[i] & 0x40) ? 2 : 0) |
+					((ctl[i] & 0x80) ? 1 : 0));
+		if (ctl[i] & 0x80)
+			n += midi_capture_put_varint (rec + n,
+						(uint64_t) (source + 1));
+		if (ctl[i] & 0x40)
+			n += midi_capture_put_varint (rec + n, dlen);
+		if ( ! (status <= 0xef && status == running))
+			rec[n++] = status;
+		memcpy (rec + n, data, dlen - 1);
+		n += (int) dlen - 1;
+		data += dlen - 1;
+		if ((size_t) (out + len - op) < (size_t) n)
+			return (false);
+		memcpy (op, rec, n);
+		op += n;
+		if (status <= 0xef)
+			running = status;
+		else if (status < 0xf8)
+			running = 0;
+	}
+	return (op == out + len);
+}
+
+/* Compress a block of codec 0 into w->zblock. Returns the length of the
+ * compressed block, or 0 if it is not smaller.
+ */
+static uint32_t
+midi_capture_compress (midi_capture_writer_t *w, const unsigned char *block)
+{
+	uint32_t len = midi_capture_get32 (block + 4), plen, n;
+	unsigned char *z = w->zblock + MIDI_CAPTURE_BLOCK_HEADER_LEN;
+	size_t zlen;
+
+	plen = midi_capture_pack (block, w->pack, w->pack_max);
+	if (plen == 0)
+		return (0);
+	n = (uint32_t) midi_capture_put_varint (z, plen);
+	if (n >= len)
+		return (0);
+	zlen = midi_capture_lz_compress (w->pack, plen, z + n, len - n);
+	if (zlen == 0 || zlen + n >= len)
+		return (0);
+	memcpy (w->zblock, block, MIDI_CAPTURE_BLOCK_HEADER_LEN);
+	midi_capture_put32 (w->zblock + 4, (uint32_t) zlen + n);
+	midi_capture_put16 (w->zblock + 32, MIDI_CAPTURE_CODEC_PACK);
+	return ((uint32_t) (MIDI_CAPTURE_BLOCK_HEADER_LEN + zlen + n));
+}
+
+static bool
+midi_capture_write_all (int fd, const unsigned char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n > 0) {
+		r = write (fd, p, n);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			else if (errno == EAGAIN) {
+				struct pollfd pfd;
+
+				pfd.fd = fd;
+				pfd.events = POLLOUT;
+				poll (&pfd, 1, 100);
+				continue;
+			}
+			return (false);
+		}
+		else if (r == 0)
+			return (false);
+		p += r;
+		n -= (size_t) r;
+	}
+	return (true);
+}
+
+static void
+midi_capture_writer_reset_block (midi_capture_writer_t *w)
+{
+	w->block_len = 0;
+	w->nframes = 0;
+	w->t_first = 0;
+	w->t_prev = 0;
+	w->src_prev = -2;
+	w->running = 0;
+}
+
+bool
+midi_capture_writer_open (midi_capture_writer_t *w, int fd,
+				uint32_t block_max)
+{
+	unsigned char hdr[MIDI_CAPTURE_HEADER_LEN];
+	struct timespec ts;
+	off_t off;
+
+	if (w == NULL || fd < 0)
+		return (false);
+	memset (w, 0, sizeof (midi_capture_writer_t));
+	w->fd = -1;
+	if (block_max == 0)
+		block_max = MIDI_CAPTURE_BLOCK_DEFAULT;
+	else if (block_max < MIDI_CAPTURE_BLOCK_MIN)
+		block_max = MIDI_CAPTURE_BLOCK_MIN;
+	else if (block_max > MIDI_CAPTURE_BLOCK_MAX)
+		block_max = MIDI_CAPTURE_BLOCK_MAX;
+	w->block = (unsigned char *) malloc (MIDI_CAPTURE_BLOCK_HEADER_LEN +
+						block_max);
+	if (w->block == NULL)
+		return (false);
+	w->block_max = block_max;
+	w->flush_ns = MIDI_CAPTURE_FLUSH_NS;
+	midi_capture_writer_reset_block (w);
+
+	off = lseek (fd, 0, SEEK_CUR);
+	w->offset = off > 0 ? (uint64_t) off : 0;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	memset (hdr, 0, sizeof (hdr));
+	memcpy (hdr, midi_capture_magic, 8);
+	midi_capture_put16 (hdr + 8, MIDI_CAPTURE_VERSION);
+	midi_capture_put32 (hdr + 12, block_max);
+	midi_capture_put64 (hdr + 16, (uint64_t) ts.tv_sec * 1000000000ULL +
+					(uint64_t) ts.tv_nsec);
+	if ( ! midi_capture_write_all (fd, hdr, sizeof (hdr))) {
+		free (w->block);
+		w->block = NULL;
+		return (false);
+	}
+	w->fd = fd;
+	w->offset += sizeof (hdr);
+	w->stats.bytes_out = sizeof (hdr);
+	return (true);
+}
+
+bool
+midi_capture_writer_open_path (midi_capture_writer_t *w, const char *path,
+				uint32_t block_max)
+{
+	int fd;
+
+	if (w == NULL || path == NULL)
+		return (false);
+	fd = open (path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return (false);
+	if ( ! midi_capture_writer_open (w, fd, block_max)) {
+		close (fd);
+		return (false);
+	}
+	w->own_fd = true;
+	return (true);
+}
+
+static bool
+midi_capture_writer_add_index (midi_capture_writer_t *w,
+				const midi_capture_index_t *e)
+{
+	if (w->nindex == w->index_max) {
+		uint32_t n = w->index_max ? w->index_max * 2 : 64;
+		midi_capture_index_t *p;
+
+		p = (midi_capture_index_t *) realloc (w->index,
+					n * sizeof (midi_capture_index_t));
+		if (p == NULL)
+			return (false);
+		w->index = p;
+		w->index_max = n;
+	}
+	w->index[w->nindex++] = *e;
+	return (true);
+}
+
+/* Write a block, compressed if possible, and add it to the index. */
+static void
+midi_capture_writer_store (midi_capture_writer_t *w,
+				const unsigned char *block, bool compress)
+{
+	midi_capture_index_t e;
+	const unsigned char *out = block;
+	uint32_t n = MIDI_CAPTURE_BLOCK_HEADER_LEN +
+			midi_capture_get32 (block + 4), z = 0;
+
+	if (compress && w->codec == MIDI_CAPTURE_CODEC_PACK &&
+		(z = midi_capture_compress (w, block)) > 0) {
+		out = w->zblock;
+		n = z;
+	}
+	e.offset = w->offset;
+	e.t_first = midi_capture_get64 (block + 16);
+	e.t_last = midi_capture_get64 (block + 24);
+	e.nframes = midi_capture_get32 (block + 12);
+	if ( ! midi_capture_write_all (w->fd, out, n) ||
+		! midi_capture_writer_add_index (w, &e)) {
+		__atomic_store_n (&w->error, true, __ATOMIC_RELEASE);
+		return;
+	}
+	w->offset += n;
+	if (w->background)
+		pthread_mutex_lock (&w->lock);
+	w->stats.bytes_out += n;
+	w->stats.blocks++;
+	if (z > 0)
+		w->stats.compressed++;
+	if (w->background)
+		pthread_mutex_unlock (&w->lock);
+}
+
+/* Compression thread: write the queued blocks in order. */
+static void *
+midi_capture_writer_thread (void *arg)
+{
+	midi_capture_writer_t *w = (midi_capture_writer_t *) arg;
+	unsigned char *block;
+	bool compress;
+
+	pthread_mutex_lock (&w->lock);
+	for (;;) {
+		while (w->qhead == w->qtail && ! w->stop)
+			pthread_cond_wait (&w->cond, &w->lock);
+		if (w->qhead == w->qtail)
+			break;
+		block = w->queue[w->qhead % MIDI_CAPTURE_QUEUE_MAX];
+		/* catch up by writing blocks uncompressed */
+		compress = w->qtail - w->qhead <= MIDI_CAPTURE_QUEUE_MAX / 2;
+		pthread_mutex_unlock (&w->lock);
+		midi_capture_writer_store (w, block, compress);
+		pthread_mutex_lock (&w->lock);
+		w->qhead++;
+		pthread_cond_broadcast (&w->cond);
+	}
+	pthread_mutex_unlock (&w->lock);
+	return (NULL);
+}
+
+/* Release the compression buffers, stopping the thread if any. */
+static void
+midi_capture_writer_stop_codec (midi_capture_writer_t *w)
+{
+	if (w->background) {
+		pthread_mutex_lock (&w->lock);
+		w->stop = true;
+		pthread_cond_broadcast (&w->cond);
+		pthread_mutex_unlock (&w->lock);
+		pthread_join (w->thread, NULL);
+		pthread_cond_destroy (&w->cond);
+		pthread_mutex_destroy (&w->lock);
+		w->background = false;
+	}
+	for (int i = 0; i < MIDI_CAPTURE_QUEUE_MAX; i++) {
+		free (w->queue[i]);
+		w->queue[i] = NULL;
+	}
+	free (w->pack);
+	w->pack = NULL;
+	free (w->zblock);
+	w->zblock = NULL;
+	w->codec = MIDI_CAPTURE_CODEC_NONE;
+}
+
+bool
+midi_capture_writer_set_codec (midi_capture_writer_t *w,
+				midi_capture_codec_t codec, bool background)
+{
+	size_t n;
+
+	if (w == NULL || w->block == NULL || w->nframes > 0 ||
+		w->nindex > 0 || w->codec != MIDI_CAPTURE_CODEC_NONE ||
+		codec > MIDI_CAPTURE_CODEC_PACK)
+		return (false);
+	if (codec == MIDI_CAPTURE_CODEC_NONE)
+		return (true);
+	n = MIDI_CAPTURE_BLOCK_HEADER_LEN + w->block_max;
+	w->codec = codec;
+	w->pack_max = 2 * w->block_max + 1024;
+	w->pack = (unsigned char *) malloc (w->pack_max);
+	w->zblock = (unsigned char *) malloc (n);
+	if (w->pack == NULL || w->zblock == NULL)
+		goto fail;
+	if ( ! background)
+		return (true);
+	for (int i = 0; i < MIDI_CAPTURE_QUEUE_MAX; i++) {
+		w->queue[i] = (unsigned char *) malloc (n);
+		if (w->queue[i] == NULL)
+			goto fail;
+	}
+	w->qhead = w->qtail = 0;
+	w->stop = false;
+	pthread_mutex_init (&w->lock, NULL);
+	pthread_cond_init (&w->cond, NULL);
+	if (pthread_create (&w->thread, NULL, midi_capture_writer_thread,
+				w) != 0) {
+		pthread_cond_destroy (&w->cond);
+		pthread_mutex_destroy (&w->lock);
+		goto fail;
+	}
+	w->background = true;
+	return (true);
+
+fail:
+	midi_capture_writer_stop_codec (w);
+	return (false);
+}
+
+void
+midi_capture_writer_get_stats (midi_capture_writer_t *w,
+				midi_capture_stats_t *stats)
+{
+	if (w == NULL || stats == NULL)
+		return;
+	if (w->background)
+		pthread_mutex_lock (&w->lock);
+	*stats = w->stats;
+	if (w->background)
+		pthread_mutex_unlock (&w->lock);
+}
+
+/* Wait for a free buffer in the full queue, at most
+ * MIDI_CAPTURE_QUEUE_WAIT_MS; w->lock must be held.
+ */
+static bool
+midi_capture_writer_wait (midi_capture_writer_t *w)
+{
+	struct timespec ts;
+
+	w->stats.stalls++;
+	clock_gettime (CLOCK_REALTIME, &ts);
+	ts.tv_nsec += MIDI_CAPTURE_QUEUE_WAIT_MS * 1000000L;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+	while (w->qtail - w->qhead >= MIDI_CAPTURE_QUEUE_MAX)
+		if (pthread_cond_timedwait (&w->cond, &w->lock, &ts) != 0 &&
+			w->qtail - w->qhead >= MIDI_CAPTURE_QUEUE_MAX)
+			return (false);
+	return (true);
+}
+
+bool
+midi_capture_writer_flush (midi_capture_writer_t *w)
+{
+	unsigned char *h;
+
+	if (w == NULL || w->block == NULL)
+		return (false);
+	if (w->nframes == 0)
+		return ( ! __atomic_load_n (&w->error, __ATOMIC_ACQUIRE));
+
+	h = w->block;
+	memset (h, 0, MIDI_CAPTURE_BLOCK_HEADER_LEN);
+	memcpy (h, midi_capture_block_magic, 4);
+	midi_capture_put32 (h + 4, w->block_len);
+	midi_capture_put32 (h + 8, w->block_len);
+	midi_capture_put32 (h + 12, w->nframes);
+	midi_capture_put64 (h + 16, w->t_first);
+	midi_capture_put64 (h + 24, w->t_prev);
+	midi_capture_put16 (h + 32, MIDI_CAPTURE_CODEC_NONE);
+
+	if (w->background) {
+		/* give the block to the thread and take a free buffer; a
+		 * full queue means the file is slower than the input, so
+		 * wait a little, then keep the block */
+		pthread_mutex_lock (&w->lock);
+		if (w->qtail - w->qhead >= MIDI_CAPTURE_QUEUE_MAX &&
+			! midi_capture_writer_wait (w)) {
+			pthread_mutex_unlock (&w->lock);
+			return (false);
+		}
+		h = w->queue[w->qtail % MIDI_CAPTURE_QUEUE_MAX];
+		w->queue[w->qtail % MIDI_CAPTURE_QUEUE_MAX] = w->block;
+		w->block = h;
+		w->qtail++;
+		pthread_cond_broadcast (&w->cond);
+		pthread_mutex_unlock (&w->lock);
+	}
+	else
+		midi_capture_writer_store (w, h, true);
+	midi_capture_writer_reset_block (w);
+	return ( ! __atomic_load_n (&w->error, __ATOMIC_ACQUIRE));
+}
+
+bool
+midi_capture_write (midi_capture_writer_t *w, uint64_t ts, int source,
+			const unsigned char *data, int len)
+{
+	unsigned char *p;
+	unsigned char status;
+	int flen, n;
+	bool has_len, new_source, omit;
+
+	if (w == NULL || w->block == NULL || data == NULL ||
+		len <= 0 || len > MIDI_FRAME_MAX || data[0] < 0x80)
+		return (false);
+
+	/* start a new block? */
+	if (w->nframes > 0 &&
+		(w->block_len + MIDI_CAPTURE_RECORD_HDR + len > w->block_max ||
+		(ts > w->t_first && ts - w->t_first > w->flush_ns))) {
+		if ( ! midi_capture_writer_flush (w)) {
+			/* the block is kept while the queue is full */
+			if (w->background && w->nframes > 0) {
+				pthread_mutex_lock (&w->lock);
+				w->stats.refused++;
+				pthread_mutex_unlock (&w->lock);
+			}
+			return (false);
+		}
+	}
+	if (w->nframes == 0) {
+		w->t_first = ts;
+		w->t_prev = ts;
+	}
+	else if (ts < w->t_prev)
+		ts = w->t_prev;
+
+	if (source < 0)
+		source = -1;
+	status = data[0];
+	flen = midi_frame_len[status - 0x80];
+	has_len = (flen <= 0 || flen != len);
+	new_source = (source != w->src_prev);
+	if (new_source)
+		w->running = 0;
+	omit = (status <= 0xef && status == w->running);
+
+	p = w->block + MIDI_CAPTURE_BLOCK_HEADER_LEN + w->block_len;
+	n = midi_capture_put_varint (p, ((ts - w->t_prev) << 2) |
+					(has_len ? 2 : 0) |
+					(new_source ? 1 : 0));
+	if (new_source)
+		n += midi_capture_put_varint (p + n,
+					(uint64_t) (source < 0 ? 0 : source + 1));
+	if (has_len)
+		n += midi_capture_put_varint (p + n, (uint64_t) len);
+	if (omit) {
+		memcpy (p + n, data + 1, len - 1);
+		n += len - 1;
+	}
+	else {
+		memcpy (p + n, data, len);
+		n += len;
+	}
+	w->block_len += n;
+
+	/* update running status */
+	if (status <= 0xef)
+		w->running = status;
+	else if (status < 0xf8)
+		w->running = 0;
+	w->src_prev = source;
+	w->t_prev = ts;
+	w->nframes++;
+	if (w->background)
+		pthread_mutex_lock (&w->lock);
+	w->stats.frames++;
+	w->stats.bytes_in += len;
+	if (w->background)
+		pthread_mutex_unlock (&w->lock);
+	return (true);
+}
+
+bool
+midi_capture_write_frame (midi_capture_writer_t *w, const midi_frame_t *mf)
+{
+	if (mf == NULL)
+		return (false);
+	return (midi_capture_write (w, mf->ts, mf->source, mf->data, mf->len));
+}
+
+bool
+midi_capture_writer_close (midi_capture_writer_t *w)
+{
+	unsigned char *buf;
+	uint64_t index_offset;
+	size_t len;
+	bool ok;
+
+	if (w == NULL || w->block == NULL)
+		return (false);
+	if (w->background) {
+		/* closing may wait for a free buffer: keep the last block */
+		pthread_mutex_lock (&w->lock);
+		while (w->qtail - w->qhead >= MIDI_CAPTURE_QUEUE_MAX)
+			pthread_cond_wait (&w->cond, &w->lock);
+		pthread_mutex_unlock (&w->lock);
+	}
+	midi_capture_writer_flush (w);
+	midi_capture_writer_stop_codec (w);
+
+	/* block index and trailer */
+	index_offset = w->offset;
+	len = (size_t) w->nindex * MIDI_CAPTURE_INDEX_ENTRY_LEN +
+		MIDI_CAPTURE_TRAILER_LEN;
+	buf = (unsigned char *) calloc (1, len);
+	if (buf == NULL)
+		w->error = true;
+	else {
+		unsigned char *p = buf;
+
+		for (uint32_t i = 0; i < w->nindex;
+				i++, p += MIDI_CAPTURE_INDEX_ENTRY_LEN) {
+			midi_capture_put64 (p, w->index[i].offset);
+			midi_capture_put64 (p + 8, w->index[i].t_first);
+			midi_capture_put64 (p + 16, w->index[i].t_last);
+			midi_capture_put32 (p + 24, w->index[i].nframes);
+		}
+		memcpy (p, midi_capture_index_magic, 4);
+		midi_capture_put32 (p + 4, w->nindex);
+		midi_capture_put64 (p + 8, index_offset);
+		if ( ! midi_capture_write_all (w->fd, buf, len))
+			w->error = true;
+		else
+			w->stats.bytes_out += len;
+		free (buf);
+	}
+
+	ok = ! w->error;
+	free (w->block);
+	w->block = NULL;
+	free (w->index);
+	w->index = NULL;
+	w->nindex = 0;
+	w->index_max = 0;
+	if (w->own_fd)
+		close (w->fd);
+	w->fd = -1;
+	return (ok);
+}
+
+static bool
+midi_capture_dump_write (void *w, const midi_frame_t *mf)
+{
+	return (midi_capture_write_frame ((midi_capture_writer_t *) w, mf));
+}
+
+static bool
+midi_capture_dump_flush (void *w)
+{
+	return (midi_capture_writer_flush ((midi_capture_writer_t *) w));
+}
+
+static void
+midi_capture_dump_close (void *w)
+{
+	midi_capture_writer_close ((midi_capture_writer_t *) w);
+	free (w);
+}
+
+static const midi_reader_writer_t midi_capture_dump = {
+	midi_capture_dump_write,
+	midi_capture_dump_flush,
+	midi_capture_dump_close
+};
+
+bool
+midi_capture_set_dump (midi_reader_t *reader, int fd)
+{
+	midi_capture_writer_t *w;
+
+	if (reader == NULL || fd < 0 || (reader->flags & MIDIR_RAW))
+		return (false);
+	w = (midi_capture_writer_t *) malloc (sizeof (midi_capture_writer_t));
+	if (w == NULL)
+		return (false);
+	if ( ! midi_capture_writer_open (w, fd, 0)) {
+		free (w);
+		return (false);
+	}
+	if ( ! midi_reader_set_dump_writer (reader, &midi_capture_dump, w)) {
+		midi_capture_dump_close (w);
+		return (false);
+	}
+	return (midi_reader_set_dump_fd (reader, fd));
+}
+
+/* Read the index from the trailer, or rebuild it by scanning the blocks. */
+static bool
+midi_capture_load_index (midi_capture_t *cap)
+{
+	const unsigned char *t;
+	uint64_t off, idx;
+	uint32_t n, max = 0;
+
+	if (cap->size >= MIDI_CAPTURE_HEADER_LEN + MIDI_CAPTURE_TRAILER_LEN) {
+		t = cap->map + cap->size - MIDI_CAPTURE_TRAILER_LEN;
+		n = midi_capture_get32 (t + 4);
+		idx = midi_capture_get64 (t + 8);
+		if (memcmp (t, midi_capture_index_magic, 4) == 0 &&
+			idx >= MIDI_CAPTURE_HEADER_LEN &&
+			idx + (uint64_t) n * MIDI_CAPTURE_INDEX_ENTRY_LEN +
+			MIDI_CAPTURE_TRAILER_LEN == cap->size) {
+			cap->index = (midi_capture_index_t *) calloc (n ? n : 1,
+					sizeof (midi_capture_index_t));
+			if (cap->index == NULL)
+				return (false);
+			t = cap->map + idx;
+			for (uint32_t i = 0; i < n;
+				i++, t += MIDI_CAPTURE_INDEX_ENTRY_LEN) {
+				cap->index[i].offset = midi_capture_get64 (t);
+				cap->index[i].t_first = midi_capture_get64 (t + 8);
+				cap->index[i].t_last = midi_capture_get64 (t + 16);
+				cap->index[i].nframes = midi_capture_get32 (t + 24);
+				if (cap->index[i].offset +
+					MIDI_CAPTURE_BLOCK_HEADER_LEN > idx)
+					return (false);
+			}
+			cap->nblocks = n;
+			return (true);
+		}
+	}
+
+	/* no valid trailer: scan the blocks until the end or a truncated one */
+	cap->nblocks = 0;
+	for (off = MIDI_CAPTURE_HEADER_LEN;
+		off + MIDI_CAPTURE_BLOCK_HEADER_LEN <= cap->size; ) {
+		const unsigned char *h = cap->map + off;
+		uint64_t stored = midi_capture_get32 (h + 4);
+
+		if (memcmp (h, midi_capture_block_magic, 4) != 0 ||
+			off + MIDI_CAPTURE_BLOCK_HEADER_LEN + stored > cap->size)
+			break;
+		if (cap->nblocks == max) {
+			midi_capture_index_t *p;
+
+			max = max ? max * 2 : 64;
+			p = (midi_capture_index_t *) realloc (cap->index,
+					max * sizeof (midi_capture_index_t));
+			if (p == NULL)
+				return (false);
+			cap->index = p;
+		}
+		cap->index[cap->nblocks].offset = off;
+		cap->index[cap->nblocks].nframes = midi_capture_get32 (h + 12);
+		cap->index[cap->nblocks].t_first = midi_capture_get64 (h + 16);
+		cap->index[cap->nblocks].t_last = midi_capture_get64 (h + 24);
+		cap->nblocks++;
+		off += MIDI_CAPTURE_BLOCK_HEADER_LEN + stored;
+	}
+	return (true);
+}
+
+bool
+midi_capture_open (midi_capture_t *cap, const char *path)
+{
+	struct stat st;
+	void *map;
+
+	if (cap == NULL || path == NULL)
+		return (false);
+	memset (cap, 0, sizeof (midi_capture_t));
+	cap->fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (cap->fd < 0)
+		return (false);
+	if (fstat (cap->fd, &st) != 0 ||
+		(size_t) st.st_size < MIDI_CAPTURE_HEADER_LEN)
+		goto fail;
+	map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+			cap->fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	cap->map = (const unsigned char *) map;
+	cap->size = (size_t) st.st_size;
+	if (memcmp (cap->map, midi_capture_magic, 8) != 0)
+		goto fail;
+	cap->version = midi_capture_get16 (cap->map + 8);
+	cap->block_max = midi_capture_get32 (cap->map + 12);
+	cap->t_created = midi_capture_get64 (cap->map + 16);
+	if (cap->version == 0 || cap->version > MIDI_CAPTURE_VERSION ||
+		! midi_capture_load_index (cap))
+		goto fail;
+	if (cap->nblocks > 0)
+		midi_capture_seek_block (cap, 0);
+	return (true);
+
+fail:
+	midi_capture_close (cap);
+	return (false);
+}
+
+void
+midi_capture_close (midi_capture_t *cap)
+{
+	if (cap == NULL)
+		return;
+	if (cap->map)
+		munmap ((void *) cap->map, cap->size);
+	if (cap->fd > -1)
+		close (cap->fd);
+	free (cap->index);
+	free (cap->buf);
+	free (cap->tmp);
+	memset (cap, 0, sizeof (midi_capture_t));
+	cap->fd = -1;
+}
+
+bool
+midi_capture_seek_block (midi_capture_t *cap, uint32_t n)
+{
+	const unsigned char *h, *p;
+	uint32_t stored, len, codec;
+	uint64_t plen;
+
+	if (cap == NULL || cap->map == NULL || n >= cap->nblocks)
+		return (false);
+	cap->block = n;
+	cap->left = 0;
+	cap->pending = false;
+	h = cap->map + cap->index[n].offset;
+	stored = midi_capture_get32 (h + 4);
+	len = midi_capture_get32 (h + 8);
+	codec = midi_capture_get16 (h + 32);
+	if (memcmp (h, midi_capture_block_magic, 4) != 0 ||
+		codec > MIDI_CAPTURE_CODEC_PACK ||
+		cap->index[n].offset + MIDI_CAPTURE_BLOCK_HEADER_LEN +
+		stored > cap->size)
+		return (false);
+	p = h + MIDI_CAPTURE_BLOCK_HEADER_LEN;
+	if (codec == MIDI_CAPTURE_CODEC_NONE) {
+		cap->p = p;
+		cap->end = p + stored;
+	}
+	else {
+		/* decode the whole block, into the records of codec 0 */
+		if ( ! midi_capture_get_varint (&p, p + stored, &plen) ||
+			len > MIDI_CAPTURE_BLOCK_MAX ||
+			plen > 2 * (uint64_t) MIDI_CAPTURE_BLOCK_MAX + 1024)
+			return (false);
+		if (cap->buf_max < len) {
+			free (cap->buf);
+			cap->buf = (unsigned char *) malloc (len);
+			cap->buf_max = cap->buf ? len : 0;
+		}
+		if (cap->tmp_max < plen) {
+			free (cap->tmp);
+			cap->tmp = (unsigned char *) malloc ((size_t) plen);
+			cap->tmp_max = cap->tmp ? (uint32_t) plen : 0;
+		}
+		if (cap->buf == NULL || cap->tmp == NULL ||
+			! midi_capture_lz_decompress (p, (size_t) (h +
+				MIDI_CAPTURE_BLOCK_HEADER_LEN + stored - p),
+				cap->tmp, (size_t) plen) ||
+			! midi_capture_unpack (cap->tmp, (uint32_t) plen,
+				midi_capture_get32 (h + 12), cap->buf, len))
+			return (false);
+		cap->p = cap->buf;
+		cap->end = cap->buf + len;
+	}
+	cap->left = midi_capture_get32 (h + 12);
+	cap->t = midi_capture_get64 (h + 16);
+	cap->source = -1;
+	cap->running = 0;
+	return (true);
+}
+
+/* Decode the next record of the current block. */
+static bool
+midi_capture_decode (midi_capture_t *cap, midi_frame_t *mf)
+{
+	const unsigned char *p = cap->p;
+	uint64_t tag, v;
+	unsigned char status;
+	int len = 0, flen;
+	bool omitted;
+
+	if ( ! midi_capture_get_varint (&p, cap->end, &tag))
+		return (false);
+	if (tag & 1) {
+		if ( ! midi_capture_get_varint (&p, cap->end, &v))
+			return (false);
+		cap->source = (int) v - 1;
+		cap->running = 0;
+	}
+	if (tag & 2) {
+		if ( ! midi_capture_get_varint (&p, cap->end, &v) ||
+			v == 0 || v > MIDI_FRAME_MAX)
+			return (false);
+		len = (int) v;
+	}
+	if (p >= cap->end)
+		return (false);
+	omitted = ! (*p & 0x80);
+	status = omitted ? cap->running : *p;
+	if (status == 0)
+		return (false);
+	if (len == 0) {
+		flen = midi_frame_len[status - 0x80];
+		if (flen <= 0)
+			return (false);
+		len = flen;
+	}
+	if (p + len - (omitted ? 1 : 0) > cap->end)
+		return (false);
+
+	mf->data[0] = status;
+	if (omitted)
+		memcpy (mf->data + 1, p, len - 1);
+	else
+		memcpy (mf->data, p, len);
+	p += len - (omitted ? 1 : 0);
+	mf->len = (unsigned char) len;
+	cap->t += tag >> 2;
+	mf->ts = cap->t;
+	mf->source = cap->source;
+
+	if (status <= 0xef)
+		cap->running = status;
+	else if (status < 0xf8)
+		cap->running = 0;
+	cap->p = p;
+	cap->left--;
+	return (true);
+}
+
+bool
+midi_capture_next (midi_capture_t *cap, midi_frame_t *mf)
+{
+	if (cap == NULL || mf == NULL || cap->map == NULL)
+		return (false);
+	if (cap->pending) {
+		*mf = cap->frame;
+		cap->pending = false;
+		return (true);
+	}
+	while (cap->left == 0) {
+		if (cap->block + 1 >= cap->nblocks ||
+			! midi_capture_seek_block (cap, cap->block + 1))
+			return (false);
+	}
+	return (midi_capture_decode (cap, mf));
+}
+
+bool
+midi_capture_seek (midi_capture_t *cap, uint64_t t)
+{
+	uint32_t lo = 0, hi, mid;
+
+	if (cap == NULL || cap->map == NULL)
+		return (false);
+
+	/* first block having its last frame at or after t */
+	hi = cap->nblocks;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cap->index[mid].t_last < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo >= cap->nblocks) {
+		/* move the cursor to the end */
+		if (cap->nblocks > 0)
+			midi_capture_seek_block (cap, cap->nblocks - 1);
+		cap->left = 0;
+		return (false);
+	}
+	if ( ! midi_capture_seek_block (cap, lo))
+		return (false);
+	while (midi_capture_next (cap, &cap->frame)) {
+		if (cap->frame.ts >= t) {
+			cap->pending = true;
+			return (true);
+		}
+	}
+	return (false);
+}
+
+bool
+midi_capture_get_range (midi_capture_t *cap, uint64_t *first, uint64_t *last)
+{
+	if (cap == NULL || cap->nblocks == 0)
+		return (false);
+	if (first)
+		*first = cap->index[0].t_first;
+	if (last)
+		*last = cap->index[cap->nblocks - 1].t_last;
+	return (true);
+}
+
+uint64_t
+midi_capture_count (midi_capture_t *cap)
+{
+	uint64_t n = 0;
+
+	if (cap) {
+		for (uint32_t i = 0; i < cap->nblocks; i++)
+			n += cap->index[i].nframes;
+	}
+	return (n);
+}
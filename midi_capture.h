@@ -0,0 +1,308 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_CAPTURE_H
+#define MIDI_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Binary capture format. All integers are little-endian.
+ *
+ * File header (32 bytes):
+ *	0	magic "MIDICAP1"
+ *	8	version (u16)
+ *	10	flags (u16)
+ *	12	maximal block payload size (u32)
+ *	16	creation time (u64, ns)
+ *	24	reserved (u64)
+ *
+ * Then blocks, each one made of a 40-bytes header followed by its payload:
+ *	0	magic "MBLK"
+ *	4	stored payload size (u32)
+ *	8	decoded payload size (u32)
+ *	12	count of frames (u32)
+ *	16	timestamp of first frame (u64, ns)
+ *	24	timestamp of last frame (u64, ns)
+ *	32	codec (u16, 0 = none)
+ *	34	flags (u16)
+ *	36	reserved (u32)
+ *
+ * The payload is a sequence of records, decodable without the previous
+ * blocks:
+ *	varint	(delta_ts << 2) | (has_len << 1) | new_source
+ *	varint	source id + 1 (0: injected frame), only if new_source
+ *	varint	frame length, only if has_len (sysex, odd frames)
+ *	bytes	frame data, status byte omitted when it is the running status
+ * The delta timestamp is relative to the previous record of the block, or
+ * to the block timestamp for the first record. The running status is
+ * cleared at the start of each block, when the source changes and after
+ * any system common frame.
+ *
+ * With codec 1 (MIDI_CAPTURE_CODEC_PACK), the stored payload is the
+ * varint length of the packed records followed by these packed records
+ * compressed with an LZ77 codec (literal runs and matches of 4 bytes or
+ * more, 16-bits offsets, in the block only). The packed records are the
+ * frames of the block split into streams, each one only decodable with
+ * the previous ones:
+ *	u8	count of entries of the status dictionary (0..63)
+ *	bytes	status dictionary, most frequent status bytes first
+ *	bytes	one control byte per frame: index in the dictionary, or 63
+ *		if the status byte is in the data stream; 0x40 if the frame
+ *		length is given; 0x80 if the source changes
+ *	varints	source id + 1 and frame length, as flagged by control bytes
+ *	varints	delta of delta timestamps, zigzag-encoded, one per frame
+ *	bytes	status bytes not in the dictionary and data bytes
+ * The decoded payload size is that of the records of codec 0, which are
+ * rebuilt when reading.
+ *
+ * The file ends with the block index, one 32-bytes entry per block
+ * (offset u64, first timestamp u64, last timestamp u64, frames u32,
+ * reserved u32), then a 16-bytes trailer: magic "MIDX", count of blocks
+ * (u32), offset of the index (u64). If the trailer is missing (unclean
+ * shutdown), the index is rebuilt by scanning the blocks.
+ */
+
+#define MIDI_CAPTURE_VERSION		1
+#define MIDI_CAPTURE_HEADER_LEN		32
+#define MIDI_CAPTURE_BLOCK_HEADER_LEN	40
+#define MIDI_CAPTURE_INDEX_ENTRY_LEN	32
+#define MIDI_CAPTURE_TRAILER_LEN	16
+
+/* default and limits of the block payload size */
+#define MIDI_CAPTURE_BLOCK_DEFAULT	65536
+#define MIDI_CAPTURE_BLOCK_MIN		1024
+#define MIDI_CAPTURE_BLOCK_MAX		(16 * 1024 * 1024)
+
+/* a block is written when it spans more than this time (ns) */
+#define MIDI_CAPTURE_FLUSH_NS		1000000000ULL
+
+/* block codecs */
+typedef enum midi_capture_codec_t {
+	MIDI_CAPTURE_CODEC_NONE = 0,
+	MIDI_CAPTURE_CODEC_PACK = 1, /* packed streams, then LZ */
+} midi_capture_codec_t;
+
+/* count of blocks queued for the compression thread */
+#define MIDI_CAPTURE_QUEUE_MAX	16
+
+/* longest wait for a free buffer when the queue is full (ms) */
+#define MIDI_CAPTURE_QUEUE_WAIT_MS	100
+
+/* entry of the block index */
+typedef struct midi_capture_index_t {
+	uint64_t offset; /* offset of the block header in the file */
+	uint64_t t_first; /* timestamp of the first frame */
+	uint64_t t_last; /* timestamp of the last frame */
+	uint32_t nframes; /* count of frames */
+} midi_capture_index_t;
+
+/* statistics of a capture writer */
+typedef struct midi_capture_stats_t {
+	unsigned long frames; /* count of frames written */
+	unsigned long blocks; /* count of blocks written */
+	uint64_t bytes_in; /* count of frame bytes */
+	uint64_t bytes_out; /* count of bytes written to the file */
+	unsigned long compressed; /* count of blocks stored compressed */
+	unsigned long stalls; /* times the compression queue was full */
+	unsigned long refused; /* frames refused, the queue staying full */
+} midi_capture_stats_t;
+
+/* buffered capture writer */
+typedef struct midi_capture_writer_t {
+	int fd; /* output file descriptor */
+	bool own_fd; /* close fd when closing the writer */
+	uint64_t offset; /* current offset in the file */
+	unsigned char *block; /* block header and payload */
+	uint32_t block_max; /* maximal payload length */
+	uint32_t block_len; /* current payload length */
+	uint32_t nframes; /* frames in current block */
+	uint64_t t_first; /* timestamp of the first frame in block */
+	uint64_t t_prev; /* timestamp of the previous frame */
+	int src_prev; /* source of the previous frame */
+	unsigned char running; /* current running status or 0 */
+	uint64_t flush_ns; /* maximal time span of a block */
+	midi_capture_index_t *index; /* block index */
+	uint32_t nindex; /* count of index entries */
+	uint32_t index_max; /* allocated index entries */
+	bool error; /* a write error occurred */
+	midi_capture_stats_t stats;
+	midi_capture_codec_t codec; /* codec of the blocks */
+	unsigned char *pack; /* packed records of a block */
+	unsigned char *zblock; /* compressed block */
+	uint32_t pack_max; /* size of pack and zblock payload */
+	bool background; /* blocks are compressed by a thread */
+	unsigned char *queue[MIDI_CAPTURE_QUEUE_MAX]; /* blocks to write */
+	unsigned int qhead; /* next block to write (thread) */
+	unsigned int qtail; /* next free slot (producer) */
+	bool stop; /* stop the thread once the queue is empty */
+	pthread_t thread; /* compression thread */
+	pthread_mutex_t lock; /* lock of the queue and statistics */
+	pthread_cond_t cond; /* signaled when the queue changes */
+} midi_capture_writer_t;
+
+/* memory-mapped capture file, with a frame cursor */
+typedef struct midi_capture_t {
+	int fd; /* file descriptor */
+	const unsigned char *map; /* mapped file */
+	size_t size; /* size of the mapping */
+	uint32_t version; /* format version */
+	uint32_t block_max; /* maximal payload length */
+	uint64_t t_created; /* creation time of the file */
+	midi_capture_index_t *index; /* block index */
+	uint32_t nblocks; /* count of blocks */
+	uint32_t block; /* current block */
+	const unsigned char *p; /* cursor in current payload */
+	const unsigned char *end; /* end of current payload */
+	uint32_t left; /* frames left in current block */
+	uint64_t t; /* timestamp of the previous frame */
+	int source; /* source of the previous frame */
+	unsigned char running; /* current running status or 0 */
+	bool pending; /* "frame" is read but not returned yet */
+	midi_frame_t frame; /* frame decoded in advance by a seek */
+	unsigned char *buf; /* decoded payload of a compressed block */
+	uint32_t buf_max; /* allocated size of buf */
+	unsigned char *tmp; /* packed records of a compressed block */
+	uint32_t tmp_max; /* allocated size of tmp */
+} midi_capture_t;
+
+/* Open a capture writer on file descriptor 'fd' and write the file
+ * header. 'block_max' is the maximal payload size of the blocks (0 for the
+ * default). The file descriptor is not closed by "midi_capture_writer_close".
+ * Returns false on failure.
+ */
+bool
+midi_capture_writer_open (midi_capture_writer_t *w, int fd,
+				uint32_t block_max);
+
+/* Same as "midi_capture_writer_open" but creating or truncating the file
+ * 'path', which is closed by "midi_capture_writer_close".
+ */
+bool
+midi_capture_writer_open_path (midi_capture_writer_t *w, const char *path,
+				uint32_t block_max);
+
+/* Compress the next blocks with 'codec'. If 'background' is true, the
+ * blocks are compressed and written by a thread, so that writing a frame
+ * never waits for them; if the thread falls behind, blocks are written
+ * uncompressed until it catches up. If its queue is still full after
+ * MIDI_CAPTURE_QUEUE_WAIT_MS, the file is slower than the input: the block
+ * is kept and the frame is refused (see "midi_capture_write"). Must be
+ * called before the first frame.
+ * Returns false on failure.
+ */
+bool
+midi_capture_writer_set_codec (midi_capture_writer_t *w,
+				midi_capture_codec_t codec, bool background);
+
+/* Get the statistics of the writer. */
+void
+midi_capture_writer_get_stats (midi_capture_writer_t *w,
+				midi_capture_stats_t *stats);
+
+/* Append a frame of 'len' bytes read from source 'source' (-1 for none) at
+ * time 'ts' (ns). The frame must start with a status byte and timestamps
+ * should not decrease. Returns false on error, or if the frame needs a new
+ * block while the compression queue stays full; the frames written before
+ * are kept, and the frame may be written again later.
+ */
+bool
+midi_capture_write (midi_capture_writer_t *w, uint64_t ts, int source,
+			const unsigned char *data, int len);
+
+/* Same as "midi_capture_write" using the timestamp and source of 'mf'. */
+bool
+midi_capture_write_frame (midi_capture_writer_t *w, const midi_frame_t *mf);
+
+/* Write the current block, if not empty (queue it for the compression
+ * thread if any). Returns false on error, or if the queue stays full; the
+ * block is then kept for the next flush.
+ */
+bool
+midi_capture_writer_flush (midi_capture_writer_t *w);
+
+/* Flush the writer, write the block index and release resources.
+ * Returns false if any write failed.
+ */
+bool
+midi_capture_writer_close (midi_capture_writer_t *w);
+
+/* Dump the frames of 'reader' to 'fd' in the capture format, with their
+ * timestamp and source id, thru a buffered writer given to the reader (see
+ * midi_reader_set_dump_writer): the block index is written and 'fd' closed
+ * when the reader is closed. Returns false on error.
+ */
+bool
+midi_capture_set_dump (midi_reader_t *reader, int fd);
+
+/* Open a capture file for reading. The cursor is set at the first frame.
+ * Returns false on failure.
+ */
+bool
+midi_capture_open (midi_capture_t *cap, const char *path);
+
+/* Close a capture file. */
+void
+midi_capture_close (midi_capture_t *cap);
+
+/* Set the cursor at the first frame having a timestamp greater or equal to
+ * 't' (O(log n) on blocks). Returns false if there is no such frame.
+ */
+bool
+midi_capture_seek (midi_capture_t *cap, uint64_t t);
+
+/* Set the cursor at the first frame of block 'n'. Returns false on error. */
+bool
+midi_capture_seek_block (midi_capture_t *cap, uint32_t n);
+
+/* Read the next frame, including its timestamp and source. Returns false
+ * at the end of the capture or if it is corrupted.
+ */
+bool
+midi_capture_next (midi_capture_t *cap, midi_frame_t *mf);
+
+/* Get the timestamps of the first and last frames. Returns false if the
+ * capture is empty.
+ */
+bool
+midi_capture_get_range (midi_capture_t *cap, uint64_t *first, uint64_t *last);
+
+/* Get the count of frames in the capture. */
+uint64_t
+midi_capture_count (midi_capture_t *cap);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_CAPTURE_H */
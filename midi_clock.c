@@ -0,0 +1,182 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <time.h>
+#include "midi_clock.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define MIDI_CLOCK_X86
+#elif defined(__aarch64__) && defined(__GNUC__)
+#define MIDI_CLOCK_ARM64
+#endif
+
+uint64_t
+midi_clock_monotonic (void *arg)
+{
+	struct timespec ts;
+
+	(void) arg;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+void
+midi_clock_manual_init (midi_clock_manual_t *c, uint64_t time)
+{
+	if (c)
+		c->time = time;
+}
+
+void
+midi_clock_manual_set (midi_clock_manual_t *c, uint64_t time)
+{
+	if (c)
+		__atomic_store_n (&c->time, time, __ATOMIC_RELEASE);
+}
+
+uint64_t
+midi_clock_manual_advance (midi_clock_manual_t *c, uint64_t delta)
+{
+	if (c == NULL)
+		return (0);
+	return (__atomic_add_fetch (&c->time, delta, __ATOMIC_ACQ_REL));
+}
+
+uint64_t
+midi_clock_manual (void *arg)
+{
+	midi_clock_manual_t *c = (midi_clock_manual_t *) arg;
+
+	return (c ? __atomic_load_n (&c->time, __ATOMIC_ACQUIRE) : 0);
+}
+
+/* Read the counter, or return 0 if there is no invariant one. */
+static uint64_t
+midi_clock_tsc_read ()
+{
+#if defined(MIDI_CLOCK_X86)
+	return (__rdtsc ());
+#elif defined(MIDI_CLOCK_ARM64)
+	uint64_t v;
+
+	__asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (v));
+	return (v);
+#else
+	return (0);
+#endif
+}
+
+/* Is the counter invariant (constant rate in all power states) ? */
+static bool
+midi_clock_tsc_invariant ()
+{
+#if defined(MIDI_CLOCK_X86)
+	unsigned int a, b, c, d;
+
+	if ( ! __get_cpuid (0x80000007, &a, &b, &c, &d))
+		return (false);
+	return ((d & (1 << 8)) != 0);
+#elif defined(MIDI_CLOCK_ARM64)
+	return (true);
+#else
+	return (false);
+#endif
+}
+
+/* Read the counter and the time together: the time is taken between two
+ * reads of the counter, retried while they are far apart (preemption).
+ */
+static void
+midi_clock_tsc_sample (uint64_t *tsc, uint64_t *ns)
+{
+	uint64_t t1, t2, best = UINT64_MAX;
+	uint64_t n;
+	int i;
+
+	/* the first pass always stores, but the compiler cannot tell */
+	*tsc = 0;
+	*ns = 0;
+	for (i = 0; i < 5; i++) {
+		t1 = midi_clock_tsc_read ();
+		n = midi_clock_monotonic (NULL);
+		t2 = midi_clock_tsc_read ();
+		if (t2 - t1 < best) {
+			best = t2 - t1;
+			*tsc = t1 + (t2 - t1) / 2;
+			*ns = n;
+		}
+	}
+}
+
+bool
+midi_clock_tsc_init (midi_clock_tsc_t *c, int ms)
+{
+	struct timespec ts;
+	uint64_t tsc1, ns1;
+
+	if (c == NULL)
+		return (false);
+	c->counter = false;
+	c->mult = 0;
+	if ( ! midi_clock_tsc_invariant ())
+		return (false);
+	if (ms <= 0)
+		ms = 20;
+	midi_clock_tsc_sample (&c->tsc0, &c->ns0);
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep (&ts, &ts) != 0)
+		;
+	midi_clock_tsc_sample (&tsc1, &ns1);
+	if (tsc1 <= c->tsc0 || ns1 <= c->ns0)
+		return (false);
+	c->mult = (uint64_t) ((double) (ns1 - c->ns0) /
+				(double) (tsc1 - c->tsc0) *
+				(double) (1ULL << MIDI_CLOCK_TSC_SHIFT) + 0.5);
+	/* the ratio must stay below 2^32 to convert without overflow */
+	if (c->mult == 0 || c->mult >= (1ULL << 32))
+		return (false);
+	c->counter = true;
+	return (true);
+}
+
+uint64_t
+midi_clock_tsc (void *arg)
+{
+	midi_clock_tsc_t *c = (midi_clock_tsc_t *) arg;
+	uint64_t d;
+
+	if (c == NULL || ! c->counter)
+		return (midi_clock_monotonic (NULL));
+	d = midi_clock_tsc_read () - c->tsc0;
+	/* split so that the product does not overflow */
+	return (c->ns0 + (d >> MIDI_CLOCK_TSC_SHIFT) * c->mult +
+		(((d & ((1ULL << MIDI_CLOCK_TSC_SHIFT) - 1)) * c->mult) >>
+		MIDI_CLOCK_TSC_SHIFT));
+}
@@ -0,0 +1,103 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_CLOCK_H
+#define MIDI_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Function giving the current time of a clock in ns; 'arg' is the state
+ * of the clock given with the function. Clocks are used for the
+ * timestamps of the frames (see midi_reader_set_clock) and of the
+ * messages of RtMidiIn (see RtMidiIn::setClock).
+ */
+typedef uint64_t (*midi_clock_func_t) (void *arg);
+
+/* The default clock: CLOCK_MONOTONIC. 'arg' is not used. */
+uint64_t
+midi_clock_monotonic (void *arg);
+
+/* A manual clock, whose time only changes when set or advanced: for tests
+ * and benchmarks that need reproducible timestamps. The time may be
+ * changed by a thread while other threads read it.
+ */
+typedef struct midi_clock_manual_t {
+	uint64_t time; /* current time (ns) */
+} midi_clock_manual_t;
+
+/* Initialize a manual clock at 'time'. */
+void
+midi_clock_manual_init (midi_clock_manual_t *c, uint64_t time);
+
+/* Set the time of a manual clock. */
+void
+midi_clock_manual_set (midi_clock_manual_t *c, uint64_t time);
+
+/* Advance a manual clock by 'delta' ns. Returns the new time. */
+uint64_t
+midi_clock_manual_advance (midi_clock_manual_t *c, uint64_t delta);
+
+/* The clock function of a manual clock ('arg' is a midi_clock_manual_t). */
+uint64_t
+midi_clock_manual (void *arg);
+
+/* A clock reading the time-stamp counter of the processor (x86 TSC, or
+ * virtual counter of arm64) without a system call, converted to ns of
+ * CLOCK_MONOTONIC by a calibration. Its drift from CLOCK_MONOTONIC is
+ * that of the calibration (a few us per second); initialize it again to
+ * resynchronize it. Without an invariant counter it reads CLOCK_MONOTONIC.
+ */
+typedef struct midi_clock_tsc_t {
+	bool counter; /* the counter is used */
+	uint64_t tsc0; /* counter at calibration */
+	uint64_t ns0; /* time at calibration (ns) */
+	uint64_t mult; /* ns per tick, shifted left by MIDI_CLOCK_TSC_SHIFT */
+} midi_clock_tsc_t;
+
+/* precision of the ratio of a TSC clock */
+#define MIDI_CLOCK_TSC_SHIFT	24
+
+/* Initialize a TSC clock, calibrating it for 'ms' milliseconds (20 if 0).
+ * Returns false if there is no invariant counter: the clock then reads
+ * CLOCK_MONOTONIC.
+ */
+bool
+midi_clock_tsc_init (midi_clock_tsc_t *c, int ms);
+
+/* The clock function of a TSC clock ('arg' is a midi_clock_tsc_t). */
+uint64_t
+midi_clock_tsc (void *arg);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_CLOCK_H */
@@ -0,0 +1,487 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "midi_colstore.h"
+#include "midi_pparse.h"
+
+static const char midi_colstore_magic[8] = { 'M', 'I', 'D', 'I', 'C', 'O', 'L', '1' };
+
+/* offsets of the arrays of a block, for 'n' rows per block */
+#define MIDI_COLSTORE_TS(n)	0
+#define MIDI_COLSTORE_SRC(n)	((size_t) (n) * 8)
+#define MIDI_COLSTORE_STATUS(n)	((size_t) (n) * 10)
+#define MIDI_COLSTORE_D1(n)	((size_t) (n) * 11)
+#define MIDI_COLSTORE_D2(n)	((size_t) (n) * 12)
+#define MIDI_COLSTORE_BLOCK(n)	((size_t) (n) * 13)
+
+static bool
+midi_colstore_write_all (int fd, const void *buf, size_t n, off_t off)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+	ssize_t r;
+
+	while (n > 0) {
+		r = pwrite (fd, p, n, off);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return (false);
+		p += r;
+		off += r;
+		n -= (size_t) r;
+	}
+	return (true);
+}
+
+/* Write the header of the store. */
+static bool
+midi_colstore_write_header (midi_colstore_writer_t *w, uint64_t summaries)
+{
+	unsigned char hdr[MIDI_COLSTORE_HEADER_LEN];
+	uint32_t v;
+	struct timespec ts;
+	uint64_t t;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	t = (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+	memset (hdr, 0, sizeof (hdr));
+	memcpy (hdr, midi_colstore_magic, 8);
+	v = MIDI_COLSTORE_VERSION;
+	memcpy (hdr + 8, &v, 4);
+	v = MIDI_COLSTORE_BOM;
+	memcpy (hdr + 12, &v, 4);
+	memcpy (hdr + 16, &w->block_rows, 4);
+	memcpy (hdr + 20, &w->nblocks, 4);
+	memcpy (hdr + 24, &w->nrows, 8);
+	memcpy (hdr + 32, &summaries, 8);
+	memcpy (hdr + 40, &t, 8);
+	return (midi_colstore_write_all (w->fd, hdr, sizeof (hdr), 0));
+}
+
+static void
+midi_colstore_writer_reset_block (midi_colstore_writer_t *w)
+{
+	memset (w->block, 0, MIDI_COLSTORE_BLOCK (w->block_rows));
+	memset (&w->cur, 0, sizeof (midi_colstore_block_t));
+}
+
+bool
+midi_colstore_writer_open (midi_colstore_writer_t *w, const char *path,
+				uint32_t block_rows)
+{
+	if (w == NULL || path == NULL)
+		return (false);
+	memset (w, 0, sizeof (midi_colstore_writer_t));
+	w->fd = -1;
+	if (block_rows == 0)
+		block_rows = MIDI_COLSTORE_ROWS_DEFAULT;
+	else if (block_rows < MIDI_COLSTORE_ROWS_MIN)
+		block_rows = MIDI_COLSTORE_ROWS_MIN;
+	else if (block_rows > MIDI_COLSTORE_ROWS_MAX)
+		block_rows = MIDI_COLSTORE_ROWS_MAX;
+	w->block_rows = (block_rows + 7) & ~7U;
+	w->block = (unsigned char *) malloc (MIDI_COLSTORE_BLOCK (w->block_rows));
+	if (w->block == NULL)
+		return (false);
+	midi_colstore_writer_reset_block (w);
+	w->fd = open (path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	if (w->fd < 0 || ! midi_colstore_write_header (w, 0)) {
+		if (w->fd > -1)
+			close (w->fd);
+		free (w->block);
+		w->block = NULL;
+		w->fd = -1;
+		return (false);
+	}
+	return (true);
+}
+
+/* Write the current block and keep its summary. */
+static bool
+midi_colstore_writer_flush (midi_colstore_writer_t *w)
+{
+	midi_colstore_block_t *b;
+	uint32_t n;
+
+	if (w->cur.rows == 0)
+		return (true);
+	if (w->nblocks == w->blocks_max) {
+		n = w->blocks_max ? w->blocks_max * 2 : 64;
+		b = (midi_colstore_block_t *) realloc (w->blocks,
+					n * sizeof (midi_colstore_block_t));
+		if (b == NULL)
+			return (false);
+		w->blocks = b;
+		w->blocks_max = n;
+	}
+	if ( ! midi_colstore_write_all (w->fd, w->block,
+			MIDI_COLSTORE_BLOCK (w->block_rows),
+			(off_t) (MIDI_COLSTORE_HEADER_LEN + (uint64_t) w->nblocks *
+			MIDI_COLSTORE_BLOCK (w->block_rows))))
+		return (false);
+	w->blocks[w->nblocks++] = w->cur;
+	midi_colstore_writer_reset_block (w);
+	return (true);
+}
+
+bool
+midi_colstore_writer_put (midi_colstore_writer_t *w, const midi_frame_t *mf)
+{
+	midi_colstore_block_t *c;
+	uint32_t r, n;
+	int16_t src;
+	unsigned char st, d1, d2;
+	int bit;
+
+	if (w == NULL || w->block == NULL || mf == NULL || mf->len == 0 ||
+		w->error)
+		return (false);
+	c = &w->cur;
+	r = c->rows;
+	n = w->block_rows;
+	src = (int16_t) (mf->source < 0 ? -1 : mf->source);
+	st = mf->data[0];
+	d1 = mf->len > 1 ? mf->data[1] : 0;
+	d2 = mf->len > 2 ? mf->data[2] : 0;
+	memcpy (w->block + MIDI_COLSTORE_TS (n) + (size_t) r * 8, &mf->ts, 8);
+	memcpy (w->block + MIDI_COLSTORE_SRC (n) + (size_t) r * 2, &src, 2);
+	w->block[MIDI_COLSTORE_STATUS (n) + r] = st;
+	w->block[MIDI_COLSTORE_D1 (n) + r] = d1;
+	w->block[MIDI_COLSTORE_D2 (n) + r] = d2;
+
+	if (r == 0) {
+		c->ts_min = c->ts_max = mf->ts;
+		c->src_min = c->src_max = src;
+		c->d1_min = c->d1_max = d1;
+		c->d2_min = c->d2_max = d2;
+	}
+	else {
+		if (mf->ts < c->ts_min) c->ts_min = mf->ts;
+		if (mf->ts > c->ts_max) c->ts_max = mf->ts;
+		if (src < c->src_min) c->src_min = src;
+		if (src > c->src_max) c->src_max = src;
+		if (d1 < c->d1_min) c->d1_min = d1;
+		if (d1 > c->d1_max) c->d1_max = d1;
+		if (d2 < c->d2_min) c->d2_min = d2;
+		if (d2 > c->d2_max) c->d2_max = d2;
+	}
+	bit = st >= 0x80 ? MIDI_STATUS_BIT (st) : 0;
+	c->types[bit >> 6] |= 1ULL << (bit & 63);
+	c->rows++;
+	w->nrows++;
+	if (c->rows == n && ! midi_colstore_writer_flush (w)) {
+		w->error = true;
+		return (false);
+	}
+	return (true);
+}
+
+void
+midi_colstore_writer_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_colstore_writer_put ((midi_colstore_writer_t *) user_data, mf);
+}
+
+bool
+midi_colstore_writer_close (midi_colstore_writer_t *w)
+{
+	uint64_t off;
+	bool ok;
+
+	if (w == NULL || w->block == NULL)
+		return (false);
+	ok = ! w->error && midi_colstore_writer_flush (w);
+	off = MIDI_COLSTORE_HEADER_LEN + (uint64_t) w->nblocks *
+		MIDI_COLSTORE_BLOCK (w->block_rows);
+	if (ok)
+		ok = midi_colstore_write_all (w->fd, w->blocks,
+				w->nblocks * sizeof (midi_colstore_block_t),
+				(off_t) off);
+	/* the header is complete once the summaries are written */
+	if (ok)
+		ok = fsync (w->fd) == 0 && midi_colstore_write_header (w, off);
+	if (close (w->fd) != 0)
+		ok = false;
+	free (w->block);
+	free (w->blocks);
+	memset (w, 0, sizeof (midi_colstore_writer_t));
+	w->fd = -1;
+	return (ok);
+}
+
+static bool
+midi_colstore_build_frame (const midi_frame_t *mf, void *user_data)
+{
+	return (midi_colstore_writer_put ((midi_colstore_writer_t *) user_data,
+						mf));
+}
+
+bool
+midi_colstore_build (const char *src_path, const char *path, int nthreads,
+			uint32_t block_rows)
+{
+	midi_colstore_writer_t w;
+	midi_pparse_t pp;
+	bool ok;
+
+	if (src_path == NULL || ! midi_colstore_writer_open (&w, path,
+								block_rows))
+		return (false);
+	midi_pparse_init (&pp, MIDIR_EXPAND, nthreads, 0);
+	midi_pparse_set_callback (&pp, midi_colstore_build_frame, &w);
+	ok = midi_pparse_file (&pp, src_path);
+	if ( ! midi_colstore_writer_close (&w))
+		ok = false;
+	if ( ! ok)
+		unlink (path);
+	return (ok);
+}
+
+bool
+midi_colstore_open (midi_colstore_t *s, const char *path)
+{
+	struct stat st;
+	uint32_t version, bom;
+	uint64_t off;
+	void *map;
+
+	if (s == NULL || path == NULL)
+		return (false);
+	memset (s, 0, sizeof (midi_colstore_t));
+	s->fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (s->fd < 0)
+		return (false);
+	if (fstat (s->fd, &st) != 0 ||
+		(size_t) st.st_size < MIDI_COLSTORE_HEADER_LEN)
+		goto fail;
+	map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+			s->fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	s->map = (const unsigned char *) map;
+	s->size = (size_t) st.st_size;
+	if (memcmp (s->map, midi_colstore_magic, 8) != 0)
+		goto fail;
+	memcpy (&version, s->map + 8, 4);
+	memcpy (&bom, s->map + 12, 4);
+	memcpy (&s->block_rows, s->map + 16, 4);
+	memcpy (&s->nblocks, s->map + 20, 4);
+	memcpy (&s->nrows, s->map + 24, 8);
+	memcpy (&off, s->map + 32, 8);
+	/* a store not closed has no summaries */
+	if (version == 0 || version > MIDI_COLSTORE_VERSION ||
+		bom != MIDI_COLSTORE_BOM || off == 0 ||
+		s->block_rows < MIDI_COLSTORE_ROWS_MIN ||
+		s->block_rows > MIDI_COLSTORE_ROWS_MAX ||
+		(s->block_rows & 7) != 0 ||
+		off != MIDI_COLSTORE_HEADER_LEN + (uint64_t) s->nblocks *
+			MIDI_COLSTORE_BLOCK (s->block_rows) ||
+		off + (uint64_t) s->nblocks * sizeof (midi_colstore_block_t) >
+			s->size ||
+		s->nrows > (uint64_t) s->nblocks * s->block_rows)
+		goto fail;
+	s->blocks = (const midi_colstore_block_t *) (s->map + off);
+	madvise ((void *) s->map, s->size, MADV_RANDOM);
+	return (true);
+
+fail:
+	midi_colstore_close (s);
+	return (false);
+}
+
+void
+midi_colstore_close (midi_colstore_t *s)
+{
+	if (s == NULL)
+		return;
+	if (s->map)
+		munmap ((void *) s->map, s->size);
+	if (s->fd > -1)
+		close (s->fd);
+	memset (s, 0, sizeof (midi_colstore_t));
+	s->fd = -1;
+}
+
+/* Get the arrays of block 'b'. */
+static inline const unsigned char *
+midi_colstore_block (midi_colstore_t *s, uint32_t b)
+{
+	return (s->map + MIDI_COLSTORE_HEADER_LEN + (size_t) b *
+		MIDI_COLSTORE_BLOCK (s->block_rows));
+}
+
+/* Fill a row from the arrays of a block. */
+static inline void
+midi_colstore_fill_row (midi_colstore_t *s, const unsigned char *blk,
+			uint32_t b, uint32_t r, midi_colstore_row_t *row)
+{
+	uint32_t n = s->block_rows;
+	int16_t src;
+
+	row->index = (uint64_t) b * n + r;
+	memcpy (&row->ts, blk + MIDI_COLSTORE_TS (n) + (size_t) r * 8, 8);
+	memcpy (&src, blk + MIDI_COLSTORE_SRC (n) + (size_t) r * 2, 2);
+	row->source = src;
+	row->status = blk[MIDI_COLSTORE_STATUS (n) + r];
+	row->d1 = blk[MIDI_COLSTORE_D1 (n) + r];
+	row->d2 = blk[MIDI_COLSTORE_D2 (n) + r];
+}
+
+bool
+midi_colstore_get_row (midi_colstore_t *s, uint64_t index,
+			midi_colstore_row_t *row)
+{
+	uint32_t b;
+
+	if (s == NULL || s->map == NULL || row == NULL || index >= s->nrows)
+		return (false);
+	b = (uint32_t) (index / s->block_rows);
+	midi_colstore_fill_row (s, midi_colstore_block (s, b), b,
+				(uint32_t) (index % s->block_rows), row);
+	return (true);
+}
+
+void
+midi_colstore_query_init (midi_colstore_query_t *q)
+{
+	if (q) {
+		memset (q, 0, sizeof (midi_colstore_query_t));
+		q->ts_max = UINT64_MAX;
+		q->types[0] = q->types[1] = UINT64_MAX;
+		q->source = -2;
+		q->d1_max = 0xff;
+		q->d2_max = 0xff;
+	}
+}
+
+void
+midi_colstore_query_add_type (midi_colstore_query_t *q, unsigned char status,
+				int channel)
+{
+	int bit, ch;
+
+	if (q == NULL || status < 0x80)
+		return;
+	if (q->types[0] == UINT64_MAX && q->types[1] == UINT64_MAX)
+		q->types[0] = q->types[1] = 0;
+	if (status >= 0xf0 || (channel >= 1 && channel <= 16)) {
+		if (status < 0xf0)
+			status = (unsigned char) ((status & 0xf0) | (channel - 1));
+		bit = MIDI_STATUS_BIT (status);
+		q->types[bit >> 6] |= 1ULL << (bit & 63);
+		return;
+	}
+	for (ch = 0; ch < 16; ch++) {
+		bit = MIDI_STATUS_BIT ((status & 0xf0) | ch);
+		q->types[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+/* Check if a block may have rows matching a query. */
+static inline bool
+midi_colstore_block_match (const midi_colstore_block_t *b,
+				const midi_colstore_query_t *q)
+{
+	return (b->ts_max >= q->ts_min && b->ts_min <= q->ts_max &&
+		((b->types[0] & q->types[0]) | (b->types[1] & q->types[1])) &&
+		(q->source == -2 || (q->source >= b->src_min &&
+					q->source <= b->src_max)) &&
+		b->d1_max >= q->d1_min && b->d1_min <= q->d1_max &&
+		b->d2_max >= q->d2_min && b->d2_min <= q->d2_max);
+}
+
+uint64_t
+midi_colstore_query (midi_colstore_t *s, const midi_colstore_query_t *q,
+			midi_colstore_callback_t cb, void *user_data,
+			midi_colstore_stats_t *stats)
+{
+	midi_colstore_stats_t st;
+	midi_colstore_row_t row;
+	const unsigned char *blk, *status, *d1, *d2;
+	const uint64_t *ts;
+	const int16_t *src;
+	bool all_types, go = true;
+	uint32_t b, r, n;
+	int bit;
+
+	memset (&st, 0, sizeof (st));
+	if (s == NULL || s->map == NULL || q == NULL)
+		goto end;
+	all_types = q->types[0] == UINT64_MAX && q->types[1] == UINT64_MAX;
+	for (b = 0; go && b < s->nblocks; b++) {
+		if ( ! midi_colstore_block_match (&s->blocks[b], q)) {
+			st.skipped++;
+			continue;
+		}
+		st.blocks++;
+		n = s->blocks[b].rows;
+		blk = midi_colstore_block (s, b);
+		ts = (const uint64_t *) (blk + MIDI_COLSTORE_TS (s->block_rows));
+		src = (const int16_t *) (blk + MIDI_COLSTORE_SRC (s->block_rows));
+		status = blk + MIDI_COLSTORE_STATUS (s->block_rows);
+		d1 = blk + MIDI_COLSTORE_D1 (s->block_rows);
+		d2 = blk + MIDI_COLSTORE_D2 (s->block_rows);
+		st.scanned += n;
+		/* test the columns one after the other, cheapest first */
+		for (r = 0; r < n; r++) {
+			if (ts[r] < q->ts_min || ts[r] > q->ts_max)
+				continue;
+			if ( ! all_types) {
+				if (status[r] < 0x80)
+					continue;
+				bit = MIDI_STATUS_BIT (status[r]);
+				if ( ! (q->types[bit >> 6] & (1ULL << (bit & 63))))
+					continue;
+			}
+			if ((q->source != -2 && src[r] != q->source) ||
+				d1[r] < q->d1_min || d1[r] > q->d1_max ||
+				d2[r] < q->d2_min || d2[r] > q->d2_max)
+				continue;
+			st.rows++;
+			if (cb) {
+				midi_colstore_fill_row (s, blk, b, r, &row);
+				if ( ! cb (&row, user_data)) {
+					go = false;
+					break;
+				}
+			}
+		}
+	}
+
+end:
+	if (stats)
+		*stats = st;
+	return (st.rows);
+}
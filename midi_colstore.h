@@ -0,0 +1,219 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_COLSTORE_H
+#define MIDI_COLSTORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Columnar event store. The frames of a capture are stored by blocks of a
+ * fixed count of rows; in each block, the timestamps, sources, status and
+ * data bytes are stored as separate arrays, so that a query reads only the
+ * columns it tests. Each block has a summary (bounds of its columns and a
+ * bitmap of its message types) used to skip it without reading its rows.
+ * The file is mapped and its arrays used in place: integers are in the
+ * byte order of the host which built the file.
+ *
+ * File header (64 bytes):
+ *	0	magic "MIDICOL1"
+ *	8	version (u32)
+ *	12	byte order mark (u32, 0x01020304)
+ *	16	count of rows per block (u32)
+ *	20	count of blocks (u32)
+ *	24	count of rows (u64)
+ *	32	offset of the block summaries (u64), 0 until closed
+ *	40	creation time (u64, ns)
+ *	48	reserved (16 bytes)
+ *
+ * Then the blocks, each one made of the arrays of its rows, padded to the
+ * full count of rows: timestamps (u64), sources (i16, -1 for injected
+ * frames), status (u8), first and second data bytes (u8). Frames longer
+ * than 3 bytes (sysex) keep their first 3 bytes only. Then the block
+ * summaries (midi_colstore_block_t).
+ */
+
+#define MIDI_COLSTORE_VERSION		1
+#define MIDI_COLSTORE_HEADER_LEN	64
+#define MIDI_COLSTORE_BOM		0x01020304
+
+/* default and limits of the count of rows per block (multiple of 8) */
+#define MIDI_COLSTORE_ROWS_DEFAULT	4096
+#define MIDI_COLSTORE_ROWS_MIN		64
+#define MIDI_COLSTORE_ROWS_MAX		(1024 * 1024)
+
+/* summary of a block */
+typedef struct midi_colstore_block_t {
+	uint64_t ts_min; /* first and last timestamps */
+	uint64_t ts_max;
+	uint64_t types[2]; /* bitmap of the status bytes (MIDI_STATUS_BIT) */
+	uint32_t rows; /* count of rows */
+	int16_t src_min; /* bounds of the sources */
+	int16_t src_max;
+	uint8_t d1_min; /* bounds of the data bytes */
+	uint8_t d1_max;
+	uint8_t d2_min;
+	uint8_t d2_max;
+	uint32_t reserved;
+} midi_colstore_block_t;
+
+/* a row of the store */
+typedef struct midi_colstore_row_t {
+	uint64_t index; /* index of the row */
+	uint64_t ts; /* timestamp (ns) */
+	int source; /* source id, or -1 if injected */
+	unsigned char status; /* status byte */
+	unsigned char d1; /* data bytes, or 0 */
+	unsigned char d2;
+} midi_colstore_row_t;
+
+/* Query: rows matching all the conditions. "midi_colstore_query_init"
+ * accepts all rows.
+ */
+typedef struct midi_colstore_query_t {
+	uint64_t ts_min; /* interval of timestamps, inclusive */
+	uint64_t ts_max;
+	uint64_t types[2]; /* bitmap of the accepted status bytes */
+	int source; /* source id, or -2 for all */
+	unsigned char d1_min; /* intervals of data bytes, inclusive */
+	unsigned char d1_max;
+	unsigned char d2_min;
+	unsigned char d2_max;
+} midi_colstore_query_t;
+
+/* statistics of a query */
+typedef struct midi_colstore_stats_t {
+	uint64_t rows; /* count of rows matched */
+	uint64_t scanned; /* count of rows tested */
+	uint32_t blocks; /* count of blocks read */
+	uint32_t skipped; /* count of blocks skipped by their summary */
+} midi_colstore_stats_t;
+
+/* User callback function called with each row matched. The query stops if
+ * it returns false.
+ */
+typedef bool (*midi_colstore_callback_t) (const midi_colstore_row_t *row,
+						void *user_data);
+
+/* store writer, buffering one block */
+typedef struct midi_colstore_writer_t {
+	int fd; /* output file descriptor */
+	uint32_t block_rows; /* count of rows per block */
+	unsigned char *block; /* arrays of the current block */
+	midi_colstore_block_t cur; /* summary of the current block */
+	midi_colstore_block_t *blocks; /* summaries of the blocks written */
+	uint32_t nblocks; /* count of blocks written */
+	uint32_t blocks_max; /* allocated summaries */
+	uint64_t nrows; /* count of rows */
+	bool error; /* a write error occurred */
+} midi_colstore_writer_t;
+
+/* mapped store */
+typedef struct midi_colstore_t {
+	int fd; /* file descriptor */
+	const unsigned char *map; /* mapped file */
+	size_t size; /* size of the mapping */
+	uint32_t block_rows; /* count of rows per block */
+	uint32_t nblocks; /* count of blocks */
+	uint64_t nrows; /* count of rows */
+	const midi_colstore_block_t *blocks; /* block summaries */
+} midi_colstore_t;
+
+/* Create or truncate the store 'path'; 'block_rows' may be 0 for the
+ * default. Returns false on error.
+ */
+bool
+midi_colstore_writer_open (midi_colstore_writer_t *w, const char *path,
+				uint32_t block_rows);
+
+/* Append a frame. Returns false on error. */
+bool
+midi_colstore_writer_put (midi_colstore_writer_t *w, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap", with the writer as argument. */
+void
+midi_colstore_writer_tap (const midi_frame_t *mf, void *user_data);
+
+/* Write the last block and the summaries, and close the file. Returns false
+ * if any write failed.
+ */
+bool
+midi_colstore_writer_close (midi_colstore_writer_t *w);
+
+/* Build the store 'path' from a capture file or a raw dump 'src_path',
+ * parsed by 'nthreads' threads (0: count of CPUs; see midi_pparse.h).
+ * Returns false on error.
+ */
+bool
+midi_colstore_build (const char *src_path, const char *path, int nthreads,
+			uint32_t block_rows);
+
+/* Map the store 'path'. Returns false on error. */
+bool
+midi_colstore_open (midi_colstore_t *s, const char *path);
+
+/* Unmap the store. */
+void
+midi_colstore_close (midi_colstore_t *s);
+
+/* Get the row 'index'. Returns false if out of range. */
+bool
+midi_colstore_get_row (midi_colstore_t *s, uint64_t index,
+			midi_colstore_row_t *row);
+
+/* Initialize a query accepting all rows. */
+void
+midi_colstore_query_init (midi_colstore_query_t *q);
+
+/* Restrict the status bytes of a query: the first call replaces "all types"
+ * by 'status' only, the next ones add types. For channel messages, 'status'
+ * is a type (0x80 .. 0xe0) and 'channel' is 1 .. 16, or 0 for all channels;
+ * system messages (0xf0 .. 0xff) ignore 'channel'.
+ */
+void
+midi_colstore_query_add_type (midi_colstore_query_t *q, unsigned char status,
+				int channel);
+
+/* Run a query: call 'cb' (which may be NULL to count) with each row
+ * matched, in the order of the store. 'stats' may be NULL. Returns the
+ * count of rows matched.
+ */
+uint64_t
+midi_colstore_query (midi_colstore_t *s, const midi_colstore_query_t *q,
+			midi_colstore_callback_t cb, void *user_data,
+			midi_colstore_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_COLSTORE_H */
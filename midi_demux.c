@@ -0,0 +1,152 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "midi_demux.h"
+
+bool
+midi_demux_init (midi_demux_t *d, uint32_t rings, unsigned int size)
+{
+	unsigned int n = 1;
+
+	if (d == NULL)
+		return (false);
+	memset (d, 0, sizeof (midi_demux_t));
+	if (size == 0)
+		size = MIDI_DEMUX_SIZE_DEFAULT;
+	while (n < size)
+		n <<= 1;
+	for (int i = 0; i < 17; i++) {
+		if ( ! (rings & (1U << i)))
+			continue;
+		d->rings[i].frames = (midi_frame_t *)
+					malloc (n * sizeof (midi_frame_t));
+		if (d->rings[i].frames == NULL) {
+			midi_demux_free (d);
+			return (false);
+		}
+		d->rings[i].size = n;
+	}
+	return (true);
+}
+
+void
+midi_demux_free (midi_demux_t *d)
+{
+	if (d) {
+		for (int i = 0; i < 17; i++) {
+			free (d->rings[i].frames);
+			d->rings[i].frames = NULL;
+			d->rings[i].size = 0;
+		}
+	}
+}
+
+/* Get the ring of a channel (1 .. 16, or 0 for system), or NULL. */
+static midi_demux_ring_t *
+midi_demux_ring (midi_demux_t *d, int channel)
+{
+	midi_demux_ring_t *r;
+
+	if (d == NULL || channel < 0 || channel > 16)
+		return (NULL);
+	r = &d->rings[channel == 0 ? 16 : channel - 1];
+	return (r->frames ? r : NULL);
+}
+
+bool
+midi_demux_put (midi_demux_t *d, const midi_frame_t *mf)
+{
+	midi_demux_ring_t *r;
+	unsigned char st;
+	unsigned int t;
+
+	if (d == NULL || mf == NULL || mf->len == 0)
+		return (false);
+	st = mf->data[0];
+	r = &d->rings[st >= 0x80 && st < 0xf0 ? st & 0x0f : 16];
+	if (r->frames == NULL) {
+		d->ignored++;
+		return (false);
+	}
+	t = r->tail;
+	if (t - __atomic_load_n (&r->head, __ATOMIC_ACQUIRE) >= r->size) {
+		r->stats.dropped++;
+		return (false);
+	}
+	r->frames[t & (r->size - 1)] = *mf;
+	r->stats.frames++;
+	__atomic_store_n (&r->tail, t + 1, __ATOMIC_RELEASE);
+	return (true);
+}
+
+void
+midi_demux_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_demux_put ((midi_demux_t *) user_data, mf);
+}
+
+bool
+midi_demux_get (midi_demux_t *d, int channel, midi_frame_t *mf)
+{
+	midi_demux_ring_t *r = midi_demux_ring (d, channel);
+	unsigned int h;
+
+	if (r == NULL || mf == NULL)
+		return (false);
+	h = r->head;
+	if (h == __atomic_load_n (&r->tail, __ATOMIC_ACQUIRE))
+		return (false);
+	*mf = r->frames[h & (r->size - 1)];
+	__atomic_store_n (&r->head, h + 1, __ATOMIC_RELEASE);
+	return (true);
+}
+
+unsigned int
+midi_demux_count (midi_demux_t *d, int channel)
+{
+	midi_demux_ring_t *r = midi_demux_ring (d, channel);
+
+	unsigned int h;
+
+	if (r == NULL)
+		return (0);
+	h = __atomic_load_n (&r->head, __ATOMIC_ACQUIRE);
+	return (__atomic_load_n (&r->tail, __ATOMIC_ACQUIRE) - h);
+}
+
+bool
+midi_demux_get_stats (midi_demux_t *d, int channel,
+			midi_demux_stats_t *stats)
+{
+	midi_demux_ring_t *r = midi_demux_ring (d, channel);
+
+	if (r == NULL || stats == NULL)
+		return (false);
+	*stats = r->stats;
+	return (true);
+}
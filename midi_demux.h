@@ -0,0 +1,123 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_DEMUX_H
+#define MIDI_DEMUX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bit of the system ring in the set of rings, and all rings */
+#define MIDI_DEMUX_SYSTEM	(1U << 16)
+#define MIDI_DEMUX_ALL		0x1ffffU
+
+/* default count of frames of a ring */
+#define MIDI_DEMUX_SIZE_DEFAULT	1024
+
+/* statistics of a ring */
+typedef struct midi_demux_stats_t {
+	unsigned long frames; /* count of frames queued */
+	unsigned long dropped; /* frames lost because the ring was full */
+} midi_demux_stats_t;
+
+/* Single-producer single-consumer ring of frames. The indexes are on their
+ * own cache lines, so that the producer and the consumer do not share one.
+ */
+typedef struct midi_demux_ring_t {
+	unsigned int tail __attribute__ ((aligned (64))); /* next free slot
+							   * (producer) */
+	midi_demux_stats_t stats; /* statistics (producer) */
+	unsigned int head __attribute__ ((aligned (64))); /* next frame to
+							   * get (consumer) */
+	midi_frame_t *frames __attribute__ ((aligned (64))); /* frames, or
+							      * NULL */
+	unsigned int size; /* count of frames (power of 2) */
+} midi_demux_ring_t;
+
+/* Demultiplexer of frames into a ring per channel and a ring for the
+ * system messages, so that each consumer thread gets only the frames of
+ * its channels. Frames of a channel without ring are ignored.
+ */
+typedef struct midi_demux_t {
+	midi_demux_ring_t rings[17]; /* channels 1 .. 16, then system */
+	unsigned long ignored; /* frames of channels without ring */
+} midi_demux_t;
+
+/* Initialize a demultiplexer with rings of 'size' frames (rounded up to a
+ * power of 2; 0 for the default) for the channels of 'rings' (bit 'c' - 1
+ * for channel 'c', MIDI_DEMUX_SYSTEM for the system ring). Returns false
+ * on failure.
+ */
+bool
+midi_demux_init (midi_demux_t *d, uint32_t rings, unsigned int size);
+
+/* Release the rings. */
+void
+midi_demux_free (midi_demux_t *d);
+
+/* Queue a frame in the ring of its channel. Must be called from one thread
+ * at a time; never blocks. Returns false if the frame was dropped or
+ * ignored.
+ */
+bool
+midi_demux_put (midi_demux_t *d, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap", with the demultiplexer as
+ * argument.
+ */
+void
+midi_demux_tap (const midi_frame_t *mf, void *user_data);
+
+/* Get the next frame of channel 'channel' (1 .. 16, or 0 for the system
+ * ring) into 'mf'. Must be called from one thread at a time per ring.
+ * Returns false if there is none.
+ */
+bool
+midi_demux_get (midi_demux_t *d, int channel, midi_frame_t *mf);
+
+/* Get the count of frames queued for channel 'channel' (1 .. 16, or 0 for
+ * the system ring).
+ */
+unsigned int
+midi_demux_count (midi_demux_t *d, int channel);
+
+/* Get the statistics of the ring of channel 'channel' (1 .. 16, or 0 for
+ * the system ring). Returns false if there is no such ring.
+ */
+bool
+midi_demux_get_stats (midi_demux_t *d, int channel,
+			midi_demux_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_DEMUX_H */
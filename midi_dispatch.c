@@ -0,0 +1,168 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "midi_dispatch.h"
+
+void
+midi_dispatch_init (midi_dispatch_t *d)
+{
+	if (d) {
+		memset (d, 0, sizeof (midi_dispatch_t));
+		d->nhandlers = 1;
+	}
+}
+
+void
+midi_dispatch_set_default (midi_dispatch_t *d, midi_dispatch_handler_t fn,
+				void *user_data)
+{
+	if (d) {
+		d->handlers[0].fn = fn;
+		d->handlers[0].user_data = user_data;
+	}
+}
+
+/* Get the index of a handler, adding it if needed. Returns -1 if there
+ * are too many handlers.
+ */
+static int
+midi_dispatch_index (midi_dispatch_t *d, midi_dispatch_handler_t fn,
+			void *user_data)
+{
+	int i;
+
+	if (fn == NULL)
+		return (0);
+	for (i = 1; i < d->nhandlers; i++) {
+		if (d->handlers[i].fn == fn &&
+			d->handlers[i].user_data == user_data)
+			return (i);
+	}
+	if (d->nhandlers > MIDI_DISPATCH_HANDLERS_MAX)
+		return (-1);
+	d->handlers[i].fn = fn;
+	d->handlers[i].user_data = user_data;
+	d->nhandlers++;
+	return (i);
+}
+
+bool
+midi_dispatch_on (midi_dispatch_t *d, unsigned char status, int channel,
+			int data1, midi_dispatch_handler_t fn, void *user_data)
+{
+	int c, c0, c1, n, n0, n1, type, idx;
+
+	if (d == NULL || status < 0x80 || status == 0xf0 || channel < 0 ||
+		channel > 16 || data1 < -1 || data1 > 127)
+		return (false);
+	idx = midi_dispatch_index (d, fn, user_data);
+	if (idx < 0)
+		return (false);
+	if (status > 0xf0) {
+		d->system[status & 0x0f] = (unsigned char) idx;
+		return (true);
+	}
+	type = (status >> 4) - 8;
+	c0 = channel == 0 ? 0 : channel - 1;
+	c1 = channel == 0 ? 15 : channel - 1;
+	n0 = data1 == -1 ? 0 : data1;
+	n1 = data1 == -1 ? 127 : data1;
+	if (type >= 5)
+		n0 = n1 = 0;
+	for (c = c0; c <= c1; c++) {
+		for (n = n0; n <= n1; n++)
+			d->channel[(type * 16 + c) * 128 + n] =
+							(unsigned char) idx;
+	}
+	return (true);
+}
+
+bool
+midi_dispatch_on_sysex (midi_dispatch_t *d, const unsigned char *id,
+			int len, midi_dispatch_handler_t fn, void *user_data)
+{
+	int idx;
+
+	if (d == NULL)
+		return (false);
+	if (id && ! ((len == 1 && id[0] > 0 && id[0] < 0x80) ||
+		(len == 3 && id[0] == 0 && id[1] < 0x80 && id[2] < 0x80)))
+		return (false);
+	idx = midi_dispatch_index (d, fn, user_data);
+	if (idx < 0)
+		return (false);
+	if (id == NULL) {
+		memset (d->sysex, idx, sizeof (d->sysex));
+		memset (d->sysex3, idx, sizeof (d->sysex3));
+	}
+	else if (len == 1)
+		d->sysex[id[0]] = (unsigned char) idx;
+	else
+		d->sysex3[(id[1] << 7) | id[2]] = (unsigned char) idx;
+	return (true);
+}
+
+midi_frame_state_t
+midi_dispatch_frame (midi_dispatch_t *d, midi_frame_t *mf)
+{
+	const midi_dispatch_entry_t *e;
+	unsigned char st;
+	int type, d1, idx = 0;
+
+	if (d == NULL || mf == NULL || mf->len == 0)
+		return (MIDIF_NODATA);
+	st = mf->data[0];
+	if (st >= 0x80 && st < 0xf0) {
+		type = (st >> 4) - 8;
+		d1 = mf->len > 1 ? mf->data[1] & 0x7f : 0;
+		if (type == 1 && mf->len > 2 && mf->data[2] == 0)
+			type = 0;
+		else if (type >= 5)
+			d1 = 0;
+		idx = d->channel[(type * 16 + (st & 0x0f)) * 128 + d1];
+	}
+	else if (st == 0xf0) {
+		if (mf->len > 3 && mf->data[1] == 0)
+			idx = d->sysex3[((mf->data[2] & 0x7f) << 7) |
+						(mf->data[3] & 0x7f)];
+		else if (mf->len > 1)
+			idx = d->sysex[mf->data[1] & 0x7f];
+	}
+	else if (st > 0xf0)
+		idx = d->system[st & 0x0f];
+	e = &d->handlers[idx];
+	if (e->fn == NULL)
+		return (MIDIF_COMPLETE);
+	d->dispatched++;
+	return (e->fn (mf, e->user_data));
+}
+
+midi_frame_state_t
+midi_dispatch_callback (midi_frame_t *mf, void *user_data)
+{
+	return (midi_dispatch_frame ((midi_dispatch_t *) user_data, mf));
+}
@@ -0,0 +1,120 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_DISPATCH_H
+#define MIDI_DISPATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* max count of handlers of a dispatcher */
+#define MIDI_DISPATCH_HANDLERS_MAX	255
+
+/* Handler of a frame; same as a reader callback, so that its result is
+ * the result of "midi_dispatch_callback".
+ */
+typedef midi_frame_state_t (*midi_dispatch_handler_t) (midi_frame_t *mf,
+							void *user_data);
+
+/* a handler and its argument */
+typedef struct midi_dispatch_entry_t {
+	midi_dispatch_handler_t fn; /* handler */
+	void *user_data; /* user data for handler */
+} midi_dispatch_entry_t;
+
+/* Dispatcher of frames to handlers thru flat tables of handler indexes
+ * (0: default handler), so that each frame is given to one handler after
+ * one lookup:
+ * - channel messages by type, channel and first data byte (note, key
+ *   pressure, controller, program), or by type and channel (channel
+ *   pressure, pitch bend); a note on with velocity 0 is a note off;
+ * - system exclusive by manufacturer ID of 1 byte, or of 3 bytes (0x00
+ *   followed by 2 bytes);
+ * - other system messages by status byte.
+ * Running-status frames are dispatched on their first message, so readers
+ * should use MIDIR_EXPAND. Handlers are set while not dispatching.
+ */
+typedef struct midi_dispatch_t {
+	unsigned char channel[7 * 16 * 128]; /* channel messages */
+	unsigned char system[16]; /* system messages */
+	unsigned char sysex[128]; /* sysex of 1-byte IDs */
+	unsigned char sysex3[128 * 128]; /* sysex of 3-byte IDs */
+	midi_dispatch_entry_t handlers[MIDI_DISPATCH_HANDLERS_MAX + 1];
+	int nhandlers; /* count of handlers, default one included */
+	unsigned long dispatched; /* count of frames given to handlers */
+} midi_dispatch_t;
+
+/* Initialize a dispatcher with no handler. */
+void
+midi_dispatch_init (midi_dispatch_t *d);
+
+/* Set the handler of the frames without other handler, or NULL to keep
+ * them (MIDIF_COMPLETE).
+ */
+void
+midi_dispatch_set_default (midi_dispatch_t *d, midi_dispatch_handler_t fn,
+				void *user_data);
+
+/* Set the handler of the messages of status byte 'status'. For channel
+ * messages, 'status' is a type (0x80 .. 0xe0), 'channel' is 1 .. 16 or 0
+ * for all, and 'data1' the first data byte (note, controller, program) or
+ * -1 for all; it is ignored for channel pressure and pitch bend. For
+ * system exclusive, see "midi_dispatch_on_sysex". 'fn' may be NULL to
+ * remove the handler. Returns false on error or if there are too many
+ * handlers.
+ */
+bool
+midi_dispatch_on (midi_dispatch_t *d, unsigned char status, int channel,
+			int data1, midi_dispatch_handler_t fn, void *user_data);
+
+/* Set the handler of the system exclusive messages of manufacturer ID
+ * 'id' of 'len' bytes (1, or 3 if id[0] is 0x00), or of all of them if
+ * 'id' is NULL. Returns false on error or if there are too many handlers.
+ */
+bool
+midi_dispatch_on_sysex (midi_dispatch_t *d, const unsigned char *id,
+			int len, midi_dispatch_handler_t fn, void *user_data);
+
+/* Give a frame to its handler and return its result. */
+midi_frame_state_t
+midi_dispatch_frame (midi_dispatch_t *d, midi_frame_t *mf);
+
+/* Reader callback for "midi_reader_set_callback", with the dispatcher as
+ * argument.
+ */
+midi_frame_state_t
+midi_dispatch_callback (midi_frame_t *mf, void *user_data);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_DISPATCH_H */
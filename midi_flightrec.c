@@ -0,0 +1,365 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "midi_flightrec.h"
+#include "midi_capture.h"
+
+/* write end of the pipe of the recorder using a signal */
+static volatile int midi_flightrec_sigfd = -1;
+
+/* previous action of the signal */
+static struct sigaction midi_flightrec_oldact;
+
+bool
+midi_flightrec_open (midi_flightrec_t *fr, const char *path,
+			uint32_t nslots)
+{
+	struct timespec ts;
+	void *map;
+
+	if (fr == NULL || path == NULL || (nslots & (nslots - 1)))
+		return (false);
+	memset (fr, 0, sizeof (midi_flightrec_t));
+	fr->pipe[0] = fr->pipe[1] = -1;
+	if (nslots == 0)
+		nslots = MIDI_FLIGHTREC_SLOTS_DEFAULT;
+	fr->size = sizeof (midi_flightrec_header_t) +
+			(size_t) nslots * sizeof (midi_flightrec_slot_t);
+	fr->fd = open (path, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0644);
+	if (fr->fd < 0)
+		return (false);
+	if (ftruncate (fr->fd, (off_t) fr->size) != 0)
+		goto fail;
+	map = mmap (NULL, fr->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fr->fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+
+	/* the file is zero-filled: all slots are invalid */
+	fr->hdr = (midi_flightrec_header_t *) map;
+	fr->slots = (midi_flightrec_slot_t *) (fr->hdr + 1);
+	fr->mask = nslots - 1;
+	memcpy (fr->hdr->magic, MIDI_FLIGHTREC_MAGIC, 8);
+	fr->hdr->version = MIDI_FLIGHTREC_VERSION;
+	fr->hdr->nslots = nslots;
+	clock_gettime (CLOCK_REALTIME, &ts);
+	fr->hdr->created = (uint64_t) ts.tv_sec * 1000000000ULL +
+				(uint64_t) ts.tv_nsec;
+	fr->hdr->pid = (int32_t) getpid ();
+	return (true);
+
+fail:
+	close (fr->fd);
+	fr->fd = -1;
+	return (false);
+}
+
+void
+midi_flightrec_close (midi_flightrec_t *fr)
+{
+	char c = 'q';
+
+	if (fr == NULL || fr->hdr == NULL)
+		return;
+	if (fr->sig) {
+		sigaction (fr->sig, &midi_flightrec_oldact, NULL);
+		midi_flightrec_sigfd = -1;
+		while (write (fr->pipe[1], &c, 1) < 0 && errno == EINTR)
+			;
+		pthread_join (fr->thread, NULL);
+		close (fr->pipe[0]);
+		close (fr->pipe[1]);
+		fr->pipe[0] = fr->pipe[1] = -1;
+		free (fr->sig_path);
+		fr->sig_path = NULL;
+		fr->sig = 0;
+	}
+	fr->hdr->flags |= MIDI_FLIGHTREC_CLOSED;
+	munmap ((void *) fr->hdr, fr->size);
+	fr->hdr = NULL;
+	fr->slots = NULL;
+	close (fr->fd);
+	fr->fd = -1;
+}
+
+void
+midi_flightrec_record (midi_flightrec_t *fr, uint64_t ts, int source,
+			const unsigned char *data, unsigned int len)
+{
+	midi_flightrec_slot_t *s;
+	uint64_t pos, i, n;
+	unsigned int k;
+
+	if (fr == NULL || fr->hdr == NULL || len == 0 || len > MIDI_FRAME_MAX)
+		return;
+	n = (len + MIDI_FLIGHTREC_SLOT_DATA - 1) / MIDI_FLIGHTREC_SLOT_DATA;
+	pos = __atomic_fetch_add (&fr->hdr->head, n, __ATOMIC_RELAXED);
+	for (i = 0; i < n; i++) {
+		s = &fr->slots[(pos + i) & fr->mask];
+
+		/* invalidate the slot while it is written */
+		__atomic_store_n (&s->seq, 0, __ATOMIC_RELAXED);
+		__atomic_thread_fence (__ATOMIC_RELEASE);
+		s->ts = ts;
+		s->source = source;
+		s->len = i == 0 ? (unsigned char) len : 0;
+		k = len > MIDI_FLIGHTREC_SLOT_DATA ?
+			MIDI_FLIGHTREC_SLOT_DATA : len;
+		memcpy (s->data, data, k);
+		data += k;
+		len -= k;
+		__atomic_store_n (&s->seq, pos + i + 1, __ATOMIC_RELEASE);
+	}
+}
+
+void
+midi_flightrec_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_flightrec_record ((midi_flightrec_t *) user_data, mf->ts,
+				mf->source, mf->data, mf->len);
+}
+
+uint64_t
+midi_flightrec_get_count (midi_flightrec_t *fr)
+{
+	if (fr == NULL || fr->hdr == NULL)
+		return (0);
+	return (__atomic_load_n (&fr->hdr->head, __ATOMIC_RELAXED));
+}
+
+/* Copy the slot at position 'pos' of a ring; returns false if it was not
+ * written, or overwritten meanwhile.
+ */
+static bool
+midi_flightrec_read_slot (const midi_flightrec_slot_t *slots, uint64_t mask,
+				uint64_t pos, midi_flightrec_slot_t *out)
+{
+	const midi_flightrec_slot_t *s = &slots[pos & mask];
+
+	if (__atomic_load_n (&s->seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return (false);
+	memcpy (out, (const void *) s, sizeof (midi_flightrec_slot_t));
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	return (__atomic_load_n (&s->seq, __ATOMIC_RELAXED) == pos + 1);
+}
+
+/* Read the frame starting at position 'pos' of a ring. Returns the count
+ * of slots used, or 0 if there is no complete frame there.
+ */
+static uint64_t
+midi_flightrec_read_frame (const midi_flightrec_slot_t *slots, uint64_t mask,
+				uint64_t pos, uint64_t head, midi_frame_t *mf)
+{
+	midi_flightrec_slot_t s;
+	unsigned int i, n, k;
+
+	if ( ! midi_flightrec_read_slot (slots, mask, pos, &s) || s.len == 0)
+		return (0);
+	mf->len = s.len;
+	mf->source = s.source;
+	mf->ts = s.ts;
+	n = (s.len + MIDI_FLIGHTREC_SLOT_DATA - 1) / MIDI_FLIGHTREC_SLOT_DATA;
+	for (i = 0; i < n; i++) {
+		if (i > 0 && (pos + i >= head || ! midi_flightrec_read_slot (
+				slots, mask, pos + i, &s) || s.len != 0))
+			return (0);
+		k = mf->len - i * MIDI_FLIGHTREC_SLOT_DATA;
+		if (k > MIDI_FLIGHTREC_SLOT_DATA)
+			k = MIDI_FLIGHTREC_SLOT_DATA;
+		memcpy (mf->data + i * MIDI_FLIGHTREC_SLOT_DATA, s.data, k);
+	}
+	return (n);
+}
+
+/* Save the frames of a mapped ring to a capture file. */
+static bool
+midi_flightrec_save (midi_flightrec_header_t *hdr, const char *path,
+			uint64_t window)
+{
+	const midi_flightrec_slot_t *slots;
+	midi_capture_writer_t w;
+	midi_frame_t mf;
+	uint64_t head, pos, start, mask, n, last = 0;
+	bool ok;
+
+	slots = (const midi_flightrec_slot_t *) (hdr + 1);
+	mask = hdr->nslots - 1;
+	head = __atomic_load_n (&hdr->head, __ATOMIC_ACQUIRE);
+	start = head > hdr->nslots ? head - hdr->nslots : 0;
+
+	/* time of the last frame, for the window */
+	if (window) {
+		for (pos = start; pos < head; pos++) {
+			if (midi_flightrec_read_frame (slots, mask, pos, head,
+							&mf) && mf.ts > last)
+				last = mf.ts;
+		}
+		window = last > window ? last - window : 0;
+	}
+
+	if ( ! midi_capture_writer_open_path (&w, path, 0))
+		return (false);
+	ok = true;
+	for (pos = start; ok && pos < head; pos += n ? n : 1) {
+		n = midi_flightrec_read_frame (slots, mask, pos, head, &mf);
+		if (n && mf.ts >= window)
+			ok = midi_capture_write_frame (&w, &mf);
+	}
+	return (midi_capture_writer_close (&w) && ok);
+}
+
+bool
+midi_flightrec_snapshot (midi_flightrec_t *fr, const char *path,
+				uint64_t window)
+{
+	if (fr == NULL || fr->hdr == NULL || path == NULL)
+		return (false);
+	return (midi_flightrec_save (fr->hdr, path, window));
+}
+
+static void
+midi_flightrec_handler (int sig)
+{
+	int e = errno, fd = midi_flightrec_sigfd;
+	ssize_t r = 0;
+
+	/* only async-signal-safe calls here */
+	if (fd > -1)
+		r = write (fd, "s", 1);
+	(void) r;
+	(void) sig;
+	errno = e;
+}
+
+static void *
+midi_flightrec_thread (void *arg)
+{
+	midi_flightrec_t *fr = (midi_flightrec_t *) arg;
+	char c, *path;
+	ssize_t r;
+	size_t len = strlen (fr->sig_path) + 16;
+
+	path = (char *) malloc (len);
+	while (path) {
+		r = read (fr->pipe[0], &c, 1);
+		if (r < 0 && errno == EINTR)
+			continue;
+		else if (r <= 0 || c == 'q')
+			break;
+		snprintf (path, len, "%s.%u", fr->sig_path, ++fr->sig_count);
+		midi_flightrec_save (fr->hdr, path, 0);
+	}
+	free (path);
+	return (NULL);
+}
+
+bool
+midi_flightrec_set_signal (midi_flightrec_t *fr, int sig, const char *path)
+{
+	struct sigaction act;
+
+	if (fr == NULL || fr->hdr == NULL || path == NULL || sig <= 0 ||
+		fr->sig || midi_flightrec_sigfd > -1)
+		return (false);
+	fr->sig_path = strdup (path);
+	if (fr->sig_path == NULL)
+		return (false);
+	if (pipe (fr->pipe) != 0)
+		goto fail;
+	fcntl (fr->pipe[1], F_SETFL, O_NONBLOCK);
+	if (pthread_create (&fr->thread, NULL, midi_flightrec_thread, fr) != 0)
+		goto fail;
+	midi_flightrec_sigfd = fr->pipe[1];
+	memset (&act, 0, sizeof (act));
+	act.sa_handler = midi_flightrec_handler;
+	sigemptyset (&act.sa_mask);
+	act.sa_flags = SA_RESTART;
+	if (sigaction (sig, &act, &midi_flightrec_oldact) != 0) {
+		midi_flightrec_sigfd = -1;
+		while (write (fr->pipe[1], "q", 1) < 0 && errno == EINTR)
+			;
+		pthread_join (fr->thread, NULL);
+		goto fail;
+	}
+	fr->sig = sig;
+	return (true);
+
+fail:
+	if (fr->pipe[0] > -1) {
+		close (fr->pipe[0]);
+		close (fr->pipe[1]);
+	}
+	fr->pipe[0] = fr->pipe[1] = -1;
+	free (fr->sig_path);
+	fr->sig_path = NULL;
+	return (false);
+}
+
+bool
+midi_flightrec_recover (const char *ring_path, const char *path,
+			uint64_t window)
+{
+	midi_flightrec_header_t *hdr;
+	struct stat st;
+	void *map;
+	bool ok = false;
+	int fd;
+
+	if (ring_path == NULL || path == NULL)
+		return (false);
+	fd = open (ring_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return (false);
+	if (fstat (fd, &st) != 0 ||
+		(size_t) st.st_size < sizeof (midi_flightrec_header_t)) {
+		close (fd);
+		return (false);
+	}
+	map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		return (false);
+	hdr = (midi_flightrec_header_t *) map;
+	if (memcmp (hdr->magic, MIDI_FLIGHTREC_MAGIC, 8) == 0 &&
+		hdr->version == MIDI_FLIGHTREC_VERSION && hdr->nslots &&
+		(hdr->nslots & (hdr->nslots - 1)) == 0 &&
+		(uint64_t) st.st_size >= sizeof (midi_flightrec_header_t) +
+			(uint64_t) hdr->nslots * sizeof (midi_flightrec_slot_t))
+		ok = midi_flightrec_save (hdr, path, window);
+	munmap (map, (size_t) st.st_size);
+	return (ok);
+}
@@ -0,0 +1,145 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef MIDI_FLIGHTREC_H
+#define MIDI_FLIGHTREC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIDI_FLIGHTREC_MAGIC		"MIDIFLR1"
+#define MIDI_FLIGHTREC_VERSION		1
+
+/* default count of slots of the ring (must be a power of 2) */
+#define MIDI_FLIGHTREC_SLOTS_DEFAULT	65536
+
+/* count of frame bytes stored in a slot; longer frames use several
+ * consecutive slots */
+#define MIDI_FLIGHTREC_SLOT_DATA	11
+
+/* the recorder was closed cleanly */
+#define MIDI_FLIGHTREC_CLOSED		1
+
+/* header of a ring file */
+typedef struct midi_flightrec_header_t {
+	char magic[8]; /* MIDI_FLIGHTREC_MAGIC */
+	uint32_t version; /* MIDI_FLIGHTREC_VERSION */
+	uint32_t nslots; /* count of slots */
+	uint64_t head; /* count of slots written since creation */
+	uint64_t created; /* creation time (ns, realtime) */
+	int32_t pid; /* process recording */
+	uint32_t flags; /* MIDI_FLIGHTREC_CLOSED */
+	unsigned char reserved[24];
+} midi_flightrec_header_t;
+
+/* slot of a ring file (32 bytes) */
+typedef struct midi_flightrec_slot_t {
+	uint64_t seq; /* position of the slot + 1, 0 while written */
+	uint64_t ts; /* time of the frame (ns, monotonic) */
+	int32_t source; /* source of the frame */
+	unsigned char len; /* length of the frame, 0 for a continuation */
+	unsigned char data[MIDI_FLIGHTREC_SLOT_DATA]; /* frame bytes */
+} midi_flightrec_slot_t;
+
+/* Always-on flight recorder. Frames are written without lock nor system
+ * call into a fixed-size ring of slots in a shared memory-mapped file; the
+ * last frames may then be saved as a capture file (see midi_capture.h) on
+ * request, on a signal, or after a crash of the process, from the ring file
+ * left on disk.
+ */
+typedef struct midi_flightrec_t {
+	int fd; /* ring file */
+	midi_flightrec_header_t *hdr; /* mapped ring file */
+	midi_flightrec_slot_t *slots; /* slots, after the header */
+	size_t size; /* size of the mapping */
+	uint64_t mask; /* count of slots - 1 */
+	char *sig_path; /* path prefix of snapshots made on signal */
+	int sig; /* signal used, or 0 */
+	unsigned int sig_count; /* count of snapshots made on signal */
+	int pipe[2]; /* pipe from the signal handler to the thread */
+	pthread_t thread; /* snapshot thread */
+} midi_flightrec_t;
+
+/* Create or truncate the ring file 'path' with 'nslots' slots (a power of
+ * 2, or 0 for the default) and map it. A ring left by a crashed process must
+ * be saved with "midi_flightrec_recover" before. Returns false on failure.
+ */
+bool
+midi_flightrec_open (midi_flightrec_t *fr, const char *path,
+			uint32_t nslots);
+
+/* Stop the snapshot thread and unmap the ring file, which is kept. */
+void
+midi_flightrec_close (midi_flightrec_t *fr);
+
+/* Record a frame. May be called from any thread; never blocks. */
+void
+midi_flightrec_record (midi_flightrec_t *fr, uint64_t ts, int source,
+			const unsigned char *data, unsigned int len);
+
+/* Tap function for "midi_reader_add_tap", with the recorder as argument. */
+void
+midi_flightrec_tap (const midi_frame_t *mf, void *user_data);
+
+/* Get the count of slots written since the creation of the ring. */
+uint64_t
+midi_flightrec_get_count (midi_flightrec_t *fr);
+
+/* Save the frames of the ring to the capture file 'path'; with 'window'
+ * not 0, only those of the last 'window' ns. Recording may go on meanwhile.
+ * Returns false on error.
+ */
+bool
+midi_flightrec_snapshot (midi_flightrec_t *fr, const char *path,
+				uint64_t window);
+
+/* Make a snapshot "<path>.<n>" each time signal 'sig' is received, from a
+ * background thread. Only one recorder may use a signal. Returns false on
+ * error.
+ */
+bool
+midi_flightrec_set_signal (midi_flightrec_t *fr, int sig, const char *path);
+
+/* Save the frames of an existing ring file 'ring_path', as left by a
+ * crashed or running process, to the capture file 'path' (see
+ * "midi_flightrec_snapshot"). Returns false on error.
+ */
+bool
+midi_flightrec_recover (const char *ring_path, const char *path,
+			uint64_t window);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_FLIGHTREC_H */
@@ -0,0 +1,232 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "midi_hires.h"
+
+void
+midi_hires_init (midi_hires_t *h, midi_hires_callback_t cb,
+			void *user_data)
+{
+	if (h == NULL)
+		return;
+	memset (h, 0, sizeof (midi_hires_t));
+	for (int c = 0; c < 16; c++) {
+		h->channels[c].param[0] = h->channels[c].param[1] = 0x7f;
+		h->channels[c].pending = -1;
+	}
+	h->callback = cb;
+	h->user_data = user_data;
+}
+
+bool
+midi_hires_enable_cc (midi_hires_t *h, int cc, bool enable)
+{
+	uint32_t bits;
+
+	if (h == NULL || cc < -1 || cc > 31)
+		return (false);
+	bits = cc == -1 ? ~(1U << 6) : 1U << cc;
+	if (enable)
+		h->cc14 |= bits;
+	else
+		h->cc14 &= ~bits;
+	return (true);
+}
+
+void
+midi_hires_set_passthrough (midi_hires_t *h, bool passthrough)
+{
+	if (h)
+		h->passthrough = passthrough;
+}
+
+/* Give an event to the callback. */
+static void
+midi_hires_emit (midi_hires_t *h, int c, midi_hires_type_t type,
+			uint16_t param, uint16_t value, bool fine,
+			int source, uint64_t ts)
+{
+	midi_hires_event_t ev;
+
+	ev.type = type;
+	ev.channel = c + 1;
+	ev.param = param;
+	ev.value = value;
+	ev.fine = fine;
+	ev.source = source;
+	ev.ts = ts;
+	h->stats.events++;
+	if (h->callback)
+		h->callback (&ev, h->user_data);
+}
+
+/* Get the selected parameter of a channel. */
+static uint16_t
+midi_hires_param (const midi_hires_channel_t *ch)
+{
+	return ((uint16_t) ((ch->param[0] << 7) | ch->param[1]));
+}
+
+/* Give the event of a data entry or a 14-bit controller. */
+static void
+midi_hires_emit_value (midi_hires_t *h, int c, int cc, bool fine,
+			int source, uint64_t ts)
+{
+	midi_hires_channel_t *ch = &h->channels[c];
+
+	if (cc == 6 || cc == 96 || cc == 97)
+		midi_hires_emit (h, c, ch->nrpn ? MIDI_HIRES_NRPN :
+					MIDI_HIRES_RPN, midi_hires_param (ch),
+					ch->data, fine, source, ts);
+	else
+		midi_hires_emit (h, c, MIDI_HIRES_CC, (uint16_t) cc,
+					ch->values[cc], fine, source, ts);
+}
+
+/* Give the MSB of channel 'c' received alone, if any. */
+static void
+midi_hires_flush_channel (midi_hires_t *h, int c)
+{
+	midi_hires_channel_t *ch = &h->channels[c];
+
+	if (ch->pending >= 0) {
+		midi_hires_emit_value (h, c, ch->pending, false, ch->source,
+					ch->ts);
+		ch->pending = -1;
+	}
+}
+
+/* Process a control change. Returns true if it was used. */
+static bool
+midi_hires_cc (midi_hires_t *h, int c, int cc, int v, int source,
+		uint64_t ts)
+{
+	midi_hires_channel_t *ch = &h->channels[c];
+	bool selected = midi_hires_param (ch) != MIDI_HIRES_NULL;
+
+	if (ch->pending >= 0 && cc != ch->pending + 32)
+		midi_hires_flush_channel (h, c);
+
+	/* parameter selection */
+	if (cc >= 98 && cc <= 101) {
+		ch->nrpn = cc <= 99;
+		ch->param[(cc & 1) ? 0 : 1] = (unsigned char) v;
+		ch->data = 0;
+		return (true);
+	}
+
+	/* data entry */
+	if (selected && (cc == 6 || cc == 38 || cc == 96 || cc == 97)) {
+		if (cc == 6) {
+			ch->data = (uint16_t) (v << 7);
+			ch->pending = 6;
+			ch->source = source;
+			ch->ts = ts;
+			return (true);
+		}
+		if (cc == 38)
+			ch->data = (uint16_t) ((ch->data & 0x3f80) | v);
+		else if (cc == 96 && ch->data < 0x3fff)
+			ch->data++;
+		else if (cc == 97 && ch->data > 0)
+			ch->data--;
+		ch->pending = -1;
+		midi_hires_emit_value (h, c, cc, true, source, ts);
+		return (true);
+	}
+
+	/* 14-bit controllers */
+	if (cc < 32 && (h->cc14 & (1U << cc))) {
+		ch->values[cc] = (uint16_t) (v << 7);
+		ch->pending = cc;
+		ch->source = source;
+		ch->ts = ts;
+		return (true);
+	}
+	if (cc >= 32 && cc < 64 && (h->cc14 & (1U << (cc - 32)))) {
+		cc -= 32;
+		ch->values[cc] = (uint16_t) ((ch->values[cc] & 0x3f80) | v);
+		ch->pending = -1;
+		midi_hires_emit_value (h, c, cc, true, source, ts);
+		return (true);
+	}
+	return (false);
+}
+
+bool
+midi_hires_process (midi_hires_t *h, midi_frame_t *mf)
+{
+	unsigned char status;
+	int c, j, k;
+
+	if (h == NULL || mf == NULL || mf->len == 0)
+		return (true);
+	status = mf->data[0];
+	if (status < 0x80 || status >= 0xf0)
+		return (true);
+	c = status & 0x0f;
+	if ((status & 0xf0) != 0xb0) {
+		midi_hires_flush_channel (h, c);
+		return (true);
+	}
+	for (j = k = 1; j + 1 < mf->len; j += 2) {
+		if (midi_hires_cc (h, c, mf->data[j] & 0x7f,
+					mf->data[j + 1] & 0x7f,
+					mf->source, mf->ts) &&
+			! h->passthrough) {
+			h->stats.consumed++;
+			continue;
+		}
+		mf->data[k++] = mf->data[j];
+		mf->data[k++] = mf->data[j + 1];
+	}
+	mf->len = (unsigned char) k;
+	return (k > 1);
+}
+
+int
+midi_hires_run (const midi_frame_t *mf, midi_frame_t *out, void *user_data)
+{
+	memcpy (out, mf, sizeof (midi_frame_t));
+	return (midi_hires_process ((midi_hires_t *) user_data, out) ? 1 : 0);
+}
+
+void
+midi_hires_flush (midi_hires_t *h)
+{
+	if (h) {
+		for (int c = 0; c < 16; c++)
+			midi_hires_flush_channel (h, c);
+	}
+}
+
+void
+midi_hires_get_stats (midi_hires_t *h, midi_hires_stats_t *stats)
+{
+	if (h && stats)
+		*stats = h->stats;
+}
@@ -0,0 +1,144 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_HIRES_H
+#define MIDI_HIRES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* type of a high-resolution event */
+typedef enum midi_hires_type_t {
+	MIDI_HIRES_CC = 0, /* 14-bit controller (MSB 0 .. 31, LSB + 32) */
+	MIDI_HIRES_RPN = 1, /* registered parameter (data entry) */
+	MIDI_HIRES_NRPN = 2, /* non-registered parameter (data entry) */
+} midi_hires_type_t;
+
+/* value of the null parameter */
+#define MIDI_HIRES_NULL	0x3fff
+
+/* a high-resolution event assembled from several control changes */
+typedef struct midi_hires_event_t {
+	midi_hires_type_t type; /* type of event */
+	int channel; /* channel (1 .. 16) */
+	uint16_t param; /* controller (MSB number) or parameter number */
+	uint16_t value; /* value (0 .. 16383) */
+	bool fine; /* the LSB was received (else it is 0 or unchanged) */
+	int source; /* source of the last frame */
+	uint64_t ts; /* time of the last frame (ns, monotonic) */
+} midi_hires_event_t;
+
+/* User callback function called with each event assembled. */
+typedef void (*midi_hires_callback_t) (const midi_hires_event_t *ev,
+					void *user_data);
+
+/* statistics of an assembler */
+typedef struct midi_hires_stats_t {
+	unsigned long events; /* count of events assembled */
+	unsigned long consumed; /* control changes removed from the frames */
+} midi_hires_stats_t;
+
+/* state of a channel */
+typedef struct midi_hires_channel_t {
+	uint16_t values[32]; /* values of the 14-bit controllers */
+	unsigned char param[2]; /* MSB and LSB of the selected parameter */
+	bool nrpn; /* the selected parameter is a NRPN */
+	uint16_t data; /* data entry value of the selected parameter */
+	int pending; /* controller whose LSB is awaited (6: data entry), or
+		      * -1 */
+	int source; /* source of the pending MSB */
+	uint64_t ts; /* time of the pending MSB */
+} midi_hires_channel_t;
+
+/* Assembler of high-resolution controllers, set on a reader source. Per
+ * channel, it recognizes:
+ * - 14-bit controllers: a MSB (0 .. 31, for the controllers enabled) then
+ *   optionally its LSB (32 .. 63);
+ * - RPN (101, 100) and NRPN (99, 98) selections followed by data entry
+ *   MSB (6) then optionally LSB (38), increment (96) and decrement (97).
+ * One event is given to the callback per value: when the LSB is received,
+ * or when another message of the channel shows that the MSB came alone
+ * (the LSB is then 0). Without pass-through, the control changes used are
+ * removed from the frames; data entries without a selected parameter are
+ * never used.
+ */
+typedef struct midi_hires_t {
+	midi_hires_channel_t channels[16]; /* state of each channel */
+	uint32_t cc14; /* bit 'n' set if controllers 'n' and 'n' + 32 form
+			* a 14-bit controller */
+	bool passthrough; /* keep the control changes used in the frames */
+	midi_hires_callback_t callback; /* user callback */
+	void *user_data; /* user data for callback */
+	midi_hires_stats_t stats;
+} midi_hires_t;
+
+/* Initialize an assembler with no 14-bit controller, for RPN and NRPN
+ * only, without pass-through.
+ */
+void
+midi_hires_init (midi_hires_t *h, midi_hires_callback_t cb,
+			void *user_data);
+
+/* Enable (or disable) the 14-bit controller of MSB 'cc' (0 .. 31; -1 for
+ * all but data entry). Returns false if 'cc' is out of range.
+ */
+bool
+midi_hires_enable_cc (midi_hires_t *h, int cc, bool enable);
+
+/* Keep or remove the control changes used in the frames. */
+void
+midi_hires_set_passthrough (midi_hires_t *h, bool passthrough);
+
+/* Process a frame (running-status frames included). Returns false if all
+ * its messages were used and removed.
+ */
+bool
+midi_hires_process (midi_hires_t *h, midi_frame_t *mf);
+
+/* Filter function for "midi_reader_add_filter", with the assembler as
+ * argument: frames left empty are skipped.
+ */
+int
+midi_hires_run (const midi_frame_t *mf, midi_frame_t *out, void *user_data);
+
+/* Give the pending MSB received alone (at the end of input, ..). */
+void
+midi_hires_flush (midi_hires_t *h);
+
+/* Get the statistics of the assembler. */
+void
+midi_hires_get_stats (midi_hires_t *h, midi_hires_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_HIRES_H */
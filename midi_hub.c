@@ -0,0 +1,578 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "midi_hub.h"
+
+/* magic number and version of the shared memory */
+#define MIDI_HUB_MAGIC		0x4248494dU
+#define MIDI_HUB_VERSION	1
+
+/* maximal time of a single wait, so that a closing or an interruption
+ * missed is seen (ns) */
+#define MIDI_HUB_WAIT_MAX	100000000ULL
+
+/* longest time a client may take to fill an output slot it has taken;
+ * then the client is deemed dead and the slot is skipped (ns) */
+#define MIDI_HUB_SLOT_TIMEOUT	100000000ULL
+
+/* size of the header, before the rings */
+#define MIDI_HUB_HEADER	\
+	((sizeof (midi_hub_shm_t) + 63) & ~(size_t) 63)
+
+static uint64_t
+midi_hub_now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+/* Sleep while '*addr' is 'val', at most 'ns'. */
+static void
+midi_hub_wait (uint32_t *addr, uint32_t val, uint64_t ns)
+{
+	struct timespec ts;
+
+#ifdef __linux__
+	ts.tv_sec = (time_t) (ns / 1000000000ULL);
+	ts.tv_nsec = (long) (ns % 1000000000ULL);
+	syscall (SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+#else
+	/* no portable way to sleep on a shared word: poll it */
+	if (ns > 1000000ULL)
+		ns = 1000000ULL;
+	ts.tv_sec = 0;
+	ts.tv_nsec = (long) ns;
+	if (__atomic_load_n (addr, __ATOMIC_ACQUIRE) == val)
+		nanosleep (&ts, NULL);
+#endif
+}
+
+/* Wake the processes sleeping on '*addr'. */
+static void
+midi_hub_wake (uint32_t *addr)
+{
+#ifdef __linux__
+	syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+	(void) addr;
+#endif
+}
+
+/* Set the name of the shared memory of hub 'name'. */
+static bool
+midi_hub_set_name (midi_hub_t *h, const char *name)
+{
+	size_t len;
+
+	if (name == NULL || (len = strlen (name)) == 0 ||
+		len > MIDI_HUB_NAME_MAX)
+		return (false);
+	for (const char *p = name; *p; p++) {
+		if ( ! ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+			(*p >= '0' && *p <= '9') || *p == '-' || *p == '_' ||
+			*p == '.'))
+			return (false);
+	}
+	snprintf (h->name, sizeof (h->name), "/%s%s", MIDI_HUB_PREFIX, name);
+	return (true);
+}
+
+/* Map the shared memory of 'fd' and set the rings. */
+static bool
+midi_hub_map (midi_hub_t *h, int fd, size_t size)
+{
+	void *p;
+
+	p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return (false);
+	h->shm = (midi_hub_shm_t *) p;
+	h->map_size = size;
+	return (true);
+}
+
+/* Set the pointers to the rings of a mapped hub. */
+static void
+midi_hub_set_rings (midi_hub_t *h)
+{
+	h->in = (midi_hub_slot_t *) ((char *) h->shm + MIDI_HUB_HEADER);
+	h->out = h->in + h->size;
+}
+
+/* Reset the local state of a hub. */
+static void
+midi_hub_reset (midi_hub_t *h)
+{
+	memset (h, 0, sizeof (midi_hub_t));
+	h->out_fd = -1;
+}
+
+bool
+midi_hub_create (midi_hub_t *h, const char *name, unsigned int size)
+{
+	uint32_t n = 1;
+	size_t len;
+	int fd;
+
+	if (h == NULL)
+		return (false);
+	midi_hub_reset (h);
+	if ( ! midi_hub_set_name (h, name))
+		return (false);
+	if (size == 0)
+		size = MIDI_HUB_SIZE_DEFAULT;
+	while (n < size)
+		n <<= 1;
+	len = MIDI_HUB_HEADER + 2 * (size_t) n * sizeof (midi_hub_slot_t);
+
+	/* an existing hub is never replaced: it may be alive */
+	fd = shm_open (h->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		return (false);
+	if (ftruncate (fd, (off_t) len) < 0 || ! midi_hub_map (h, fd, len)) {
+		close (fd);
+		shm_unlink (h->name);
+		return (false);
+	}
+	close (fd);
+	h->owner = true;
+	h->size = n;
+	h->mask = n - 1;
+	h->shm->size = n;
+	h->shm->version = MIDI_HUB_VERSION;
+	midi_hub_set_rings (h);
+	for (uint32_t i = 0; i < n; i++)
+		h->out[i].seq = i;
+	__atomic_store_n (&h->shm->magic, MIDI_HUB_MAGIC, __ATOMIC_RELEASE);
+	return (true);
+}
+
+bool
+midi_hub_attach (midi_hub_t *h, const char *name)
+{
+	struct stat st;
+	uint32_t n;
+	int fd;
+
+	if (h == NULL)
+		return (false);
+	midi_hub_reset (h);
+	if ( ! midi_hub_set_name (h, name))
+		return (false);
+	fd = shm_open (h->name, O_RDWR, 0);
+	if (fd < 0)
+		return (false);
+	if (fstat (fd, &st) < 0 || st.st_uid != geteuid () ||
+		(size_t) st.st_size < MIDI_HUB_HEADER ||
+		! midi_hub_map (h, fd, (size_t) st.st_size)) {
+		close (fd);
+		return (false);
+	}
+	close (fd);
+	n = h->shm->size;
+	if (__atomic_load_n (&h->shm->magic, __ATOMIC_ACQUIRE) !=
+		MIDI_HUB_MAGIC || h->shm->version != MIDI_HUB_VERSION ||
+		n == 0 || (n & (n - 1)) || h->map_size < MIDI_HUB_HEADER +
+		2 * (size_t) n * sizeof (midi_hub_slot_t)) {
+		munmap (h->shm, h->map_size);
+		h->shm = NULL;
+		return (false);
+	}
+	h->size = n;
+	h->mask = n - 1;
+	midi_hub_set_rings (h);
+	h->cursor = __atomic_load_n (&h->shm->in_tail, __ATOMIC_ACQUIRE);
+	return (true);
+}
+
+void
+midi_hub_close (midi_hub_t *h)
+{
+	if (h == NULL || h->shm == NULL)
+		return;
+	if (h->owner) {
+		midi_hub_stop_output (h);
+		__atomic_store_n (&h->shm->closed, 1, __ATOMIC_SEQ_CST);
+		midi_hub_wake (&h->shm->in_tail);
+		shm_unlink (h->name);
+	}
+	munmap (h->shm, h->map_size);
+	h->shm = NULL;
+	h->in = h->out = NULL;
+}
+
+bool
+midi_hub_list (int n, char *name, size_t max)
+{
+	const size_t plen = strlen (MIDI_HUB_PREFIX);
+	struct stat st;
+	struct dirent *e;
+	DIR *dir;
+	bool found = false;
+
+	if (n < 0 || name == NULL || max == 0)
+		return (false);
+	if ((dir = opendir ("/dev/shm")) == NULL)
+		return (false);
+	while ((e = readdir (dir)) != NULL) {
+		/* the hubs of other users cannot be attached */
+		if (strncmp (e->d_name, MIDI_HUB_PREFIX, plen) != 0 ||
+			e->d_name[plen] == 0 ||
+			fstatat (dirfd (dir), e->d_name, &st,
+				AT_SYMLINK_NOFOLLOW) < 0 ||
+			! S_ISREG (st.st_mode) || st.st_uid != geteuid () ||
+			n-- > 0)
+			continue;
+		if (strlen (e->d_name + plen) < max) {
+			snprintf (name, max, "%s", e->d_name + plen);
+			found = true;
+		}
+		break;
+	}
+	closedir (dir);
+	return (found);
+}
+
+bool
+midi_hub_publish (midi_hub_t *h, const midi_frame_t *mf)
+{
+	midi_hub_slot_t *slot;
+	uint32_t t;
+
+	if (h == NULL || h->shm == NULL || ! h->owner || mf == NULL)
+		return (false);
+	t = h->shm->in_tail;
+	slot = &h->in[t & h->mask];
+	__atomic_store_n (&slot->seq, 2 * t + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	slot->frame = *mf;
+	__atomic_store_n (&slot->seq, 2 * t + 2, __ATOMIC_RELEASE);
+	__atomic_store_n (&h->shm->in_tail, t + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n (&h->shm->in_waiters, __ATOMIC_SEQ_CST))
+		midi_hub_wake (&h->shm->in_tail);
+	h->stats.frames++;
+	return (true);
+}
+
+void
+midi_hub_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_hub_publish ((midi_hub_t *) user_data, mf);
+}
+
+/* Bound the length of a frame copied from the shared memory, which any
+ * process of the hub may write.
+ */
+static void
+midi_hub_check_frame (midi_frame_t *mf)
+{
+	if (mf->len > MIDI_FRAME_MAX)
+		mf->len = MIDI_FRAME_MAX;
+}
+
+/* Read the frame of the cursor. Returns false if it was overwritten, then
+ * the cursor is moved to the next one.
+ */
+static bool
+midi_hub_read (midi_hub_t *h, midi_frame_t *mf)
+{
+	midi_hub_slot_t *slot = &h->in[h->cursor & h->mask];
+	uint32_t seq = 2 * h->cursor + 2;
+
+	if (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) == seq) {
+		memcpy (mf, &slot->frame, sizeof (midi_frame_t));
+		__atomic_thread_fence (__ATOMIC_ACQUIRE);
+		if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) == seq) {
+			midi_hub_check_frame (mf);
+			h->cursor++;
+			return (true);
+		}
+	}
+	h->stats.lost++;
+	h->cursor++;
+	return (false);
+}
+
+int
+midi_hub_next (midi_hub_t *h, midi_frame_t *mf, int timeout)
+{
+	uint64_t deadline = 0, now;
+	uint32_t tail;
+
+	if (h == NULL || h->shm == NULL || h->owner || mf == NULL)
+		return (-1);
+	if (timeout > 0)
+		deadline = midi_hub_now () + (uint64_t) timeout * 1000000ULL;
+	for (;;) {
+		tail = __atomic_load_n (&h->shm->in_tail, __ATOMIC_ACQUIRE);
+		if (h->cursor != tail) {
+			/* skip the frames overwritten */
+			if (tail - h->cursor > h->size) {
+				h->stats.lost += tail - h->cursor - h->size;
+				h->cursor = tail - h->size;
+			}
+			if (midi_hub_read (h, mf)) {
+				h->stats.frames++;
+				return (1);
+			}
+			continue;
+		}
+		if (__atomic_load_n (&h->shm->closed, __ATOMIC_ACQUIRE))
+			return (-1);
+		if (__atomic_exchange_n (&h->stop, 0, __ATOMIC_ACQ_REL))
+			return (0);
+		if (timeout == 0)
+			return (0);
+		now = midi_hub_now ();
+		if (timeout > 0 && now >= deadline)
+			return (0);
+
+		/* sleep until the next frame */
+		__atomic_add_fetch (&h->shm->in_waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n (&h->shm->in_tail, __ATOMIC_SEQ_CST) ==
+			tail && ! __atomic_load_n (&h->stop, __ATOMIC_ACQUIRE))
+			midi_hub_wait (&h->shm->in_tail, tail,
+					timeout > 0 && deadline - now <
+					MIDI_HUB_WAIT_MAX ? deadline - now :
+					MIDI_HUB_WAIT_MAX);
+		__atomic_sub_fetch (&h->shm->in_waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+void
+midi_hub_interrupt (midi_hub_t *h)
+{
+	if (h == NULL || h->shm == NULL)
+		return;
+	__atomic_store_n (&h->stop, 1, __ATOMIC_RELEASE);
+	midi_hub_wake (h->owner ? &h->shm->out_tail : &h->shm->in_tail);
+}
+
+bool
+midi_hub_send (midi_hub_t *h, const midi_frame_t *mf)
+{
+	midi_hub_slot_t *slot;
+	uint32_t pos, seq, mask;
+	int32_t diff;
+
+	if (h == NULL || h->shm == NULL || mf == NULL ||
+		__atomic_load_n (&h->shm->closed, __ATOMIC_ACQUIRE))
+		return (false);
+	mask = h->mask;
+	pos = __atomic_load_n (&h->shm->out_tail, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &h->out[pos & mask];
+		seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t) (seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n (&h->shm->out_tail,
+						&pos, pos + 1, false,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0) {
+			h->stats.dropped++;
+			return (false);
+		}
+		else
+			pos = __atomic_load_n (&h->shm->out_tail,
+						__ATOMIC_RELAXED);
+	}
+	slot->frame = *mf;
+	/* the owner may have skipped the slot if we were too slow */
+	seq = pos;
+	if ( ! __atomic_compare_exchange_n (&slot->seq, &seq, pos + 1, false,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		h->stats.dropped++;
+		return (false);
+	}
+	if (__atomic_load_n (&h->shm->out_waiters, __ATOMIC_SEQ_CST))
+		midi_hub_wake (&h->shm->out_tail);
+	h->stats.sent++;
+	return (true);
+}
+
+bool
+midi_hub_get_output (midi_hub_t *h, midi_frame_t *mf)
+{
+	midi_hub_slot_t *slot;
+	uint32_t pos;
+
+	if (h == NULL || h->shm == NULL || ! h->owner || mf == NULL)
+		return (false);
+	pos = h->shm->out_head;
+	slot = &h->out[pos & h->mask];
+	if (__atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return (false);
+	*mf = slot->frame;
+	midi_hub_check_frame (mf);
+	__atomic_store_n (&slot->seq, pos + h->size, __ATOMIC_RELEASE);
+	__atomic_store_n (&h->shm->out_head, pos + 1, __ATOMIC_RELEASE);
+	return (true);
+}
+
+/* Skip the output slot 'pos', taken by a client which did not fill it
+ * (owner). Returns false if the client filled it meanwhile.
+ */
+static bool
+midi_hub_skip_output (midi_hub_t *h, uint32_t pos)
+{
+	midi_hub_slot_t *slot = &h->out[pos & h->mask];
+	uint32_t seq = pos;
+
+	if ( ! __atomic_compare_exchange_n (&slot->seq, &seq, pos + h->size,
+					false, __ATOMIC_ACQ_REL,
+					__ATOMIC_RELAXED))
+		return (false);
+	__atomic_store_n (&h->shm->out_head, pos + 1, __ATOMIC_RELEASE);
+	h->stats.dropped++;
+	return (true);
+}
+
+/* Write a whole frame to the output descriptor. */
+static bool
+midi_hub_write (int fd, const midi_frame_t *mf)
+{
+	struct pollfd pfd;
+	int off = 0;
+	ssize_t r;
+
+	while (off < mf->len) {
+		r = write (fd, mf->data + off, mf->len - off);
+		if (r > 0)
+			off += (int) r;
+		else if (r < 0 && errno == EINTR)
+			continue;
+		else if (r < 0 && errno == EAGAIN) {
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			if (poll (&pfd, 1, 100) <= 0)
+				return (false);
+		}
+		else
+			return (false);
+	}
+	return (true);
+}
+
+/* Output thread: write the frames sent by the clients. */
+static void *
+midi_hub_output (void *arg)
+{
+	midi_hub_t *h = (midi_hub_t *) arg;
+	struct timespec ts = { 0, 100000 };
+	midi_frame_t mf;
+	uint64_t since = 0, now;
+	uint32_t tail, head, stuck = 0;
+
+	while ( ! __atomic_load_n (&h->stop, __ATOMIC_ACQUIRE)) {
+		tail = __atomic_load_n (&h->shm->out_tail, __ATOMIC_SEQ_CST);
+		if (midi_hub_get_output (h, &mf)) {
+			if (midi_hub_write (h->out_fd, &mf))
+				h->stats.sent++;
+			else
+				h->stats.dropped++;
+			continue;
+		}
+		head = h->shm->out_head;
+		if (tail != head) {
+			/* a client is writing its frame; it may also have
+			 * died after taking its slot, then the slot is
+			 * skipped so that the output goes on */
+			now = midi_hub_now ();
+			if (since == 0 || stuck != head) {
+				stuck = head;
+				since = now;
+				sched_yield ();
+			}
+			else if (now - since < MIDI_HUB_SLOT_TIMEOUT)
+				nanosleep (&ts, NULL);
+			else if (midi_hub_skip_output (h, head))
+				since = 0;
+			continue;
+		}
+		since = 0;
+		__atomic_add_fetch (&h->shm->out_waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n (&h->shm->out_tail, __ATOMIC_SEQ_CST) ==
+			tail && ! __atomic_load_n (&h->stop, __ATOMIC_ACQUIRE))
+			midi_hub_wait (&h->shm->out_tail, tail,
+					MIDI_HUB_WAIT_MAX);
+		__atomic_sub_fetch (&h->shm->out_waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	return (NULL);
+}
+
+bool
+midi_hub_start_output (midi_hub_t *h, int fd)
+{
+	if (h == NULL || h->shm == NULL || ! h->owner || h->running ||
+		fd < 0)
+		return (false);
+	h->out_fd = fd;
+	h->stop = 0;
+	if (pthread_create (&h->thread, NULL, midi_hub_output, h) != 0)
+		return (false);
+	h->running = true;
+	return (true);
+}
+
+void
+midi_hub_stop_output (midi_hub_t *h)
+{
+	if (h == NULL || ! h->running)
+		return;
+	midi_hub_interrupt (h);
+	pthread_join (h->thread, NULL);
+	h->running = false;
+	h->stop = 0;
+	h->out_fd = -1;
+}
+
+void
+midi_hub_get_stats (midi_hub_t *h, midi_hub_stats_t *stats)
+{
+	if (h && stats)
+		*stats = h->stats;
+}
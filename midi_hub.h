@@ -0,0 +1,189 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_HUB_H
+#define MIDI_HUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* prefix of the names of the shared memory objects of the hubs */
+#define MIDI_HUB_PREFIX	"midihub."
+
+/* max length of the name of a hub */
+#define MIDI_HUB_NAME_MAX	32
+
+/* default count of frames of the rings */
+#define MIDI_HUB_SIZE_DEFAULT	1024
+
+/* statistics of a hub, local to a process */
+typedef struct midi_hub_stats_t {
+	unsigned long frames; /* frames published (owner) or read (client) */
+	unsigned long lost; /* frames overwritten before being read (client) */
+	unsigned long sent; /* output frames sent (client) or written
+			     * (owner) */
+	unsigned long dropped; /* output frames lost: full ring, write
+				* error, slot skipped */
+} midi_hub_stats_t;
+
+/* a frame in shared memory */
+typedef struct midi_hub_slot_t {
+	uint32_t seq; /* sequence of the slot */
+	midi_frame_t frame; /* the frame */
+} midi_hub_slot_t;
+
+/* Header of the shared memory, followed by the input ring then the output
+ * ring. The input ring has one producer (the owner) and any count of
+ * readers, each with its own cursor in its process: the owner never waits,
+ * a reader too slow loses the frames overwritten. The output ring has
+ * several producers (the clients) and one consumer (the owner). Waiting
+ * processes sleep on the ring counters (futex on Linux); nobody makes a
+ * system call while there is data to read.
+ */
+typedef struct midi_hub_shm_t {
+	uint32_t magic; /* MIDI_HUB_MAGIC */
+	uint32_t version; /* version of the layout */
+	uint32_t size; /* count of frames of each ring (power of 2) */
+	uint32_t closed; /* set when the owner closes the hub */
+	uint32_t in_tail __attribute__ ((aligned (64))); /* count of frames
+							  * published */
+	uint32_t in_waiters; /* count of readers waiting */
+	uint32_t out_tail __attribute__ ((aligned (64))); /* count of output
+							   * slots taken */
+	uint32_t out_head __attribute__ ((aligned (64))); /* count of output
+							   * frames read */
+	uint32_t out_waiters; /* the owner is waiting for output */
+} midi_hub_shm_t;
+
+/* A hub, as seen by its owner (which reads the device) or by a client. */
+typedef struct midi_hub_t {
+	char name[MIDI_HUB_NAME_MAX + 16]; /* name of the shared memory */
+	bool owner; /* created by this process */
+	midi_hub_shm_t *shm; /* mapped shared memory */
+	size_t map_size; /* size of the mapping */
+	uint32_t size; /* count of frames of each ring, checked when mapped:
+			* the copy in shared memory is not used */
+	uint32_t mask; /* size - 1 */
+	midi_hub_slot_t *in; /* input ring */
+	midi_hub_slot_t *out; /* output ring */
+	uint32_t cursor; /* next input frame to read (client) */
+	int stop; /* set to interrupt a wait */
+	int out_fd; /* where to write the output (owner) */
+	pthread_t thread; /* output thread (owner) */
+	bool running; /* the output thread is running */
+	midi_hub_stats_t stats;
+} midi_hub_t;
+
+/* Create the hub 'name' (letters, digits, '-', '_', '.') with rings of
+ * 'size' frames (rounded up to a power of 2; 0 for the default). Only
+ * processes of the same user may join it. Returns false on failure, with
+ * errno EEXIST if a hub of the same name exists (a hub left by a process
+ * that crashed is removed with "rm /dev/shm/midihub.<name>").
+ */
+bool
+midi_hub_create (midi_hub_t *h, const char *name, unsigned int size);
+
+/* Attach to the hub 'name' as a client. Only the frames published after
+ * this call are read. The hub must belong to the user of the process.
+ * Returns false on failure.
+ */
+bool
+midi_hub_attach (midi_hub_t *h, const char *name);
+
+/* Detach from a hub. The owner stops its output thread, marks the hub
+ * closed for the clients and removes its name.
+ */
+void
+midi_hub_close (midi_hub_t *h);
+
+/* Get the name of the nth hub (0..) of the user into 'name'. Hubs are only
+ * listed on systems showing the shared memory objects as files (/dev/shm).
+ * Returns false if there is no such hub.
+ */
+bool
+midi_hub_list (int n, char *name, size_t max);
+
+/* Publish a frame (owner). Must be called from one thread at a time; never
+ * blocks. Returns false on error.
+ */
+bool
+midi_hub_publish (midi_hub_t *h, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap", with the hub as argument. */
+void
+midi_hub_tap (const midi_frame_t *mf, void *user_data);
+
+/* Get the next frame published (client), waiting up to 'timeout' ms (-1:
+ * no limit). Returns 1 if a frame was read, 0 on timeout or interruption,
+ * -1 if the hub was closed by its owner or on error.
+ */
+int
+midi_hub_next (midi_hub_t *h, midi_frame_t *mf, int timeout);
+
+/* Interrupt "midi_hub_next" or the output thread, from another thread. */
+void
+midi_hub_interrupt (midi_hub_t *h);
+
+/* Send a frame to the owner (client); several clients may send at once.
+ * A client taking more than 100 ms between taking its slot and filling
+ * it is deemed dead by the owner, which skips the slot. Returns false if
+ * the output ring is full, the slot was skipped or on error.
+ */
+bool
+midi_hub_send (midi_hub_t *h, const midi_frame_t *mf);
+
+/* Get the next frame sent by the clients (owner), without waiting.
+ * Returns false if there is none.
+ */
+bool
+midi_hub_get_output (midi_hub_t *h, midi_frame_t *mf);
+
+/* Start a thread writing the frames sent by the clients to 'fd' (owner;
+ * the descriptor is not closed by the hub). Returns false on failure.
+ */
+bool
+midi_hub_start_output (midi_hub_t *h, int fd);
+
+/* Stop the output thread. */
+void
+midi_hub_stop_output (midi_hub_t *h);
+
+/* Get the statistics of the hub in this process. */
+void
+midi_hub_get_stats (midi_hub_t *h, midi_hub_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_HUB_H */
@@ -0,0 +1,521 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "midi_pparse.h"
+#include "midi_capture.h"
+#include "midi_rawcap.h"
+
+/* length of the header of a packed frame: time, source and length */
+#define MIDI_PPARSE_REC_LEN	13
+
+/* chunks parsed in advance per thread */
+#define MIDI_PPARSE_AHEAD	2
+
+static uint64_t
+midi_pparse_now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+static inline uint64_t
+midi_pparse_get64 (const unsigned char *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+void
+midi_pparse_init (midi_pparse_t *p, midi_reader_flags_t flags, int nthreads,
+			size_t chunk)
+{
+	if (p == NULL)
+		return;
+	memset (p, 0, sizeof (midi_pparse_t));
+	p->flags = (midi_reader_flags_t) ((flags | MIDIR_NOQUEUE) &
+			~(MIDIR_RAW | MIDIR_DEBUG));
+	if (nthreads <= 0)
+		nthreads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	else if (nthreads > MIDI_PPARSE_THREADS_MAX)
+		nthreads = MIDI_PPARSE_THREADS_MAX;
+	p->nthreads = nthreads;
+	p->chunk = chunk ? chunk : MIDI_PPARSE_CHUNK_DEFAULT;
+}
+
+void
+midi_pparse_set_callback (midi_pparse_t *p, midi_pparse_callback_t cb,
+				void *user_data)
+{
+	if (p) {
+		p->callback = cb;
+		p->user_data = user_data;
+	}
+}
+
+/* Append a frame to the output of a chunk. */
+static void
+midi_pparse_put (midi_pparse_chunk_t *c, const midi_frame_t *mf)
+{
+	unsigned char *out;
+	size_t n = MIDI_PPARSE_REC_LEN + mf->len;
+	int32_t source = mf->source;
+
+	if (c->out_len + n > c->out_max) {
+		out = (unsigned char *) realloc (c->out, c->out_max * 2 + n);
+		if (out == NULL) {
+			c->error = true;
+			return;
+		}
+		c->out = out;
+		c->out_max = c->out_max * 2 + n;
+	}
+	out = c->out + c->out_len;
+	memcpy (out, &mf->ts, 8);
+	memcpy (out + 8, &source, 4);
+	out[12] = mf->len;
+	memcpy (out + MIDI_PPARSE_REC_LEN, mf->data, mf->len);
+	c->out_len += n;
+}
+
+static void
+midi_pparse_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_pparse_put ((midi_pparse_chunk_t *) user_data, mf);
+}
+
+/* Find the first split point at or after 'i': a status byte other than
+ * EOX and real-time messages, which is not part of a sysex. A reader drops
+ * a sysex when it exceeds MIDI_FRAME_MAX bytes, so it is enough to look for
+ * a F0 not followed by a F7 in the MIDI_FRAME_MAX bytes before.
+ */
+static size_t
+midi_pparse_resync (const unsigned char *d, size_t size, size_t i)
+{
+	size_t q, lim;
+
+	for (; i < size; i++) {
+		if (d[i] < 0x80 || d[i] >= 0xf7)
+			continue;
+		lim = i > MIDI_FRAME_MAX ? i - MIDI_FRAME_MAX : 0;
+		for (q = i; q > lim; q--) {
+			if (d[q - 1] == 0xf0 || d[q - 1] == 0xf7)
+				break;
+		}
+		if (q == lim || d[q - 1] != 0xf0)
+			return (i);
+	}
+	return (size);
+}
+
+/* Get the time of raw byte 'off' from the index: time of the last entry
+ * starting at or before it. '*e' is set to that entry.
+ */
+static uint64_t
+midi_pparse_time (midi_pparse_t *p, size_t off, size_t *e)
+{
+	size_t lo = 0, hi = p->nindex, mid;
+
+	if (p->nindex == 0) {
+		*e = 0;
+		return (0);
+	}
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (midi_pparse_get64 (p->index + mid *
+					MIDI_RAWCAP_ENTRY_LEN) <= off)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	*e = lo;
+	return (midi_pparse_get64 (p->index + lo * MIDI_RAWCAP_ENTRY_LEN + 8));
+}
+
+/* Parse a chunk of raw data with a reader. */
+static void
+midi_pparse_raw_chunk (midi_pparse_t *p, midi_reader_t *reader,
+			midi_pparse_chunk_t *c)
+{
+	midi_reader_source_t src;
+	size_t off = c->start, end, e, k;
+	uint64_t ts;
+
+	midi_reader_init (reader, p->flags, NULL);
+	midi_reader_add_tap (reader, midi_pparse_tap, c);
+	midi_reader_init_source (&src, 0);
+	ts = midi_pparse_time (p, off, &e);
+	while (off < c->end) {
+		/* up to the next index entry */
+		end = c->end;
+		if (e + 1 < p->nindex) {
+			k = (size_t) midi_pparse_get64 (p->index + (e + 1) *
+						MIDI_RAWCAP_ENTRY_LEN);
+			if (k > off && k < end)
+				end = k;
+		}
+		if (end - off > 0x10000000)
+			end = off + 0x10000000;
+		midi_reader_parse (reader, &src, p->data + off,
+					(int) (end - off), ts, false);
+		off = end;
+		ts = midi_pparse_time (p, off, &e);
+	}
+
+	/* a pending running-status frame is concluded by the first byte of
+	 * the next chunk, as read by a single reader */
+	midi_reader_parse (reader, &src, NULL, 0,
+				c->end < p->size ? ts : src.ts, true);
+}
+
+/* Decode the blocks of a chunk of a capture file. */
+static void
+midi_pparse_capture_chunk (midi_capture_t *cap, midi_pparse_chunk_t *c)
+{
+	midi_frame_t mf;
+	size_t b;
+
+	for (b = c->start; b < c->end && ! c->error; b++) {
+		if ( ! midi_capture_seek_block (cap, (uint32_t) b)) {
+			c->error = true;
+			break;
+		}
+		while (cap->left > 0 && midi_capture_next (cap, &mf))
+			midi_pparse_put (c, &mf);
+	}
+}
+
+static void *
+midi_pparse_thread (void *arg)
+{
+	midi_pparse_t *p = (midi_pparse_t *) arg;
+	midi_reader_t *reader = NULL;
+	midi_capture_t cap;
+	midi_pparse_chunk_t *c;
+	size_t ahead = (size_t) p->nthreads * MIDI_PPARSE_AHEAD;
+	bool ok;
+
+	/* each thread has its own reader or mapping of the capture */
+	if (p->path) {
+		memset (&cap, 0, sizeof (cap));
+		ok = midi_capture_open (&cap, p->path);
+	}
+	else {
+		reader = (midi_reader_t *) malloc (sizeof (midi_reader_t));
+		ok = reader != NULL;
+	}
+
+	pthread_mutex_lock (&p->lock);
+	for (;;) {
+		while ( ! p->stop && p->next < p->nchunks &&
+			p->next >= p->emitted + ahead)
+			pthread_cond_wait (&p->cond, &p->lock);
+		if (p->stop || p->next >= p->nchunks)
+			break;
+		c = &p->chunks[p->next++];
+		pthread_mutex_unlock (&p->lock);
+
+		if ( ! ok)
+			c->error = true;
+		else if (p->path)
+			midi_pparse_capture_chunk (&cap, c);
+		else
+			midi_pparse_raw_chunk (p, reader, c);
+
+		pthread_mutex_lock (&p->lock);
+		c->done = true;
+		pthread_cond_broadcast (&p->cond);
+	}
+	pthread_mutex_unlock (&p->lock);
+
+	if (p->path) {
+		if (ok)
+			midi_capture_close (&cap);
+	}
+	else
+		free (reader);
+	return (NULL);
+}
+
+/* Parse the chunks in threads and give the frames in order. */
+static bool
+midi_pparse_run (midi_pparse_t *p)
+{
+	pthread_t threads[MIDI_PPARSE_THREADS_MAX];
+	midi_pparse_chunk_t *c;
+	midi_frame_t mf;
+	const unsigned char *q;
+	int32_t source;
+	int n = 0, i;
+	size_t k;
+	bool ok = true;
+
+	p->next = 0;
+	p->emitted = 0;
+	p->stop = false;
+	pthread_mutex_init (&p->lock, NULL);
+	pthread_cond_init (&p->cond, NULL);
+	for (i = 0; i < p->nthreads && (size_t) i < p->nchunks; i++) {
+		if (pthread_create (&threads[n], NULL, midi_pparse_thread,
+					p) == 0)
+			n++;
+	}
+	if (n == 0 && p->nchunks > 0)
+		ok = false;
+	p->stats.threads = (unsigned int) n;
+
+	for (k = 0; ok && k < p->nchunks; k++) {
+		c = &p->chunks[k];
+		pthread_mutex_lock (&p->lock);
+		while ( ! c->done)
+			pthread_cond_wait (&p->cond, &p->lock);
+		pthread_mutex_unlock (&p->lock);
+
+		ok = ! c->error;
+		for (q = c->out; ok && q < c->out + c->out_len;
+			q += MIDI_PPARSE_REC_LEN + mf.len) {
+			memcpy (&mf.ts, q, 8);
+			memcpy (&source, q + 8, 4);
+			mf.source = source;
+			mf.len = q[12];
+			memcpy (mf.data, q + MIDI_PPARSE_REC_LEN, mf.len);
+			p->stats.frames++;
+			if (p->callback)
+				ok = p->callback (&mf, p->user_data);
+		}
+		free (c->out);
+		c->out = NULL;
+
+		pthread_mutex_lock (&p->lock);
+		p->emitted = k + 1;
+		pthread_cond_broadcast (&p->cond);
+		pthread_mutex_unlock (&p->lock);
+	}
+
+	pthread_mutex_lock (&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast (&p->cond);
+	pthread_mutex_unlock (&p->lock);
+	for (i = 0; i < n; i++)
+		pthread_join (threads[i], NULL);
+	for (k = 0; k < p->nchunks; k++)
+		free (p->chunks[k].out);
+	free (p->chunks);
+	p->chunks = NULL;
+	p->nchunks = 0;
+	pthread_cond_destroy (&p->cond);
+	pthread_mutex_destroy (&p->lock);
+	return (ok);
+}
+
+/* Add a chunk. */
+static bool
+midi_pparse_add_chunk (midi_pparse_t *p, size_t start, size_t end,
+			size_t *max)
+{
+	midi_pparse_chunk_t *c;
+
+	if (p->nchunks == *max) {
+		*max = *max ? *max * 2 : 64;
+		c = (midi_pparse_chunk_t *) realloc (p->chunks, *max *
+						sizeof (midi_pparse_chunk_t));
+		if (c == NULL)
+			return (false);
+		p->chunks = c;
+	}
+	c = &p->chunks[p->nchunks++];
+	memset (c, 0, sizeof (midi_pparse_chunk_t));
+	c->start = start;
+	c->end = end;
+	return (true);
+}
+
+/* Split raw data and parse it. */
+static bool
+midi_pparse_raw (midi_pparse_t *p)
+{
+	size_t start = 0, end, max = 0;
+
+	while (start < p->size) {
+		end = start + p->chunk < p->size ?
+			midi_pparse_resync (p->data, p->size,
+						start + p->chunk) : p->size;
+		if ( ! midi_pparse_add_chunk (p, start, end, &max)) {
+			free (p->chunks);
+			p->chunks = NULL;
+			p->nchunks = 0;
+			return (false);
+		}
+		start = end;
+	}
+	p->stats.chunks = (unsigned int) p->nchunks;
+	return (midi_pparse_run (p));
+}
+
+bool
+midi_pparse_buffer (midi_pparse_t *p, const unsigned char *data, size_t size)
+{
+	uint64_t t0 = midi_pparse_now ();
+	bool ok;
+
+	if (p == NULL || (data == NULL && size > 0))
+		return (false);
+	memset (&p->stats, 0, sizeof (midi_pparse_stats_t));
+	p->path = NULL;
+	p->data = data;
+	p->size = size;
+	p->index = NULL;
+	p->nindex = 0;
+	p->stats.bytes = size;
+	ok = midi_pparse_raw (p);
+	p->stats.duration = midi_pparse_now () - t0;
+	return (ok);
+}
+
+/* Map a whole file; returns NULL if it cannot be mapped or is empty. */
+static const unsigned char *
+midi_pparse_map (const char *path, size_t *size)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	*size = 0;
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return (NULL);
+	if (fstat (fd, &st) != 0 || st.st_size == 0) {
+		close (fd);
+		return (NULL);
+	}
+	map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		return (NULL);
+	*size = (size_t) st.st_size;
+	return ((const unsigned char *) map);
+}
+
+bool
+midi_pparse_file (midi_pparse_t *p, const char *path)
+{
+	midi_capture_t cap;
+	const unsigned char *data, *idx;
+	size_t size, isize, max = 0, b, start;
+	uint64_t t0 = midi_pparse_now ();
+	char *ipath;
+	bool ok;
+
+	if (p == NULL || path == NULL)
+		return (false);
+	memset (&p->stats, 0, sizeof (midi_pparse_stats_t));
+
+	/* capture file: chunks of blocks */
+	memset (&cap, 0, sizeof (cap));
+	if (midi_capture_open (&cap, path)) {
+		ok = true;
+		p->stats.bytes = cap.size;
+		for (b = start = 0; ok && b < cap.nblocks; b++) {
+			if (b + 1 == cap.nblocks ||
+				cap.index[b + 1].offset - cap.index[start].offset
+					>= p->chunk) {
+				ok = midi_pparse_add_chunk (p, start, b + 1,
+								&max);
+				start = b + 1;
+			}
+		}
+		midi_capture_close (&cap);
+		p->path = path;
+		p->stats.chunks = (unsigned int) p->nchunks;
+		if (ok)
+			ok = midi_pparse_run (p);
+		else {
+			free (p->chunks);
+			p->chunks = NULL;
+			p->nchunks = 0;
+		}
+		p->path = NULL;
+		p->stats.duration = midi_pparse_now () - t0;
+		return (ok);
+	}
+
+	/* raw data, with an optional raw capture index */
+	data = midi_pparse_map (path, &size);
+	if (data == NULL) {
+		p->stats.duration = midi_pparse_now () - t0;
+		return (size == 0 && access (path, R_OK) == 0);
+	}
+	ipath = (char *) malloc (strlen (path) + 5);
+	idx = NULL;
+	isize = 0;
+	if (ipath) {
+		strcpy (ipath, path);
+		strcat (ipath, ".idx");
+		idx = midi_pparse_map (ipath, &isize);
+		free (ipath);
+	}
+	p->path = NULL;
+	p->data = data;
+	p->size = size;
+	p->stats.bytes = size;
+	p->index = NULL;
+	p->nindex = 0;
+	if (idx && isize >= MIDI_RAWCAP_HEADER_LEN &&
+		memcmp (idx, MIDI_RAWCAP_MAGIC, 8) == 0) {
+		p->index = idx + MIDI_RAWCAP_HEADER_LEN;
+		p->nindex = (isize - MIDI_RAWCAP_HEADER_LEN) /
+				MIDI_RAWCAP_ENTRY_LEN;
+	}
+	ok = midi_pparse_raw (p);
+	munmap ((void *) data, size);
+	if (idx)
+		munmap ((void *) idx, isize);
+	p->data = NULL;
+	p->index = NULL;
+	p->stats.duration = midi_pparse_now () - t0;
+	return (ok);
+}
+
+void
+midi_pparse_get_stats (midi_pparse_t *p, midi_pparse_stats_t *stats)
+{
+	if (p && stats)
+		*stats = p->stats;
+}
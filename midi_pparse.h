@@ -0,0 +1,139 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef MIDI_PPARSE_H
+#define MIDI_PPARSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* default size of the chunks parsed by each thread */
+#define MIDI_PPARSE_CHUNK_DEFAULT	(4 * 1024 * 1024)
+
+/* max count of threads */
+#define MIDI_PPARSE_THREADS_MAX		64
+
+/* User callback function called with each frame, in the order of the
+ * file, from the calling thread. The parsing stops if it returns false.
+ */
+typedef bool (*midi_pparse_callback_t) (const midi_frame_t *mf,
+					void *user_data);
+
+/* statistics of a parse */
+typedef struct midi_pparse_stats_t {
+	uint64_t frames; /* count of frames */
+	uint64_t bytes; /* count of bytes of input */
+	unsigned int chunks; /* count of chunks */
+	unsigned int threads; /* count of threads used */
+	uint64_t duration; /* duration of the parse (ns) */
+} midi_pparse_stats_t;
+
+/* a chunk of input and its parsed frames */
+typedef struct midi_pparse_chunk_t {
+	size_t start; /* first byte (raw) or block (capture) */
+	size_t end; /* end of the chunk */
+	unsigned char *out; /* parsed frames, packed */
+	size_t out_len; /* length of out */
+	size_t out_max; /* allocated length of out */
+	bool done; /* parsed */
+	bool error; /* out of memory or bad data */
+} midi_pparse_chunk_t;
+
+/* Parallel offline parser of raw MIDI dumps, raw captures with their index
+ * (midi_rawcap.h) and capture files (midi_capture.h). The input is split
+ * into chunks: raw data at safe resync points, that is status bytes outside
+ * of a sysex, so that each chunk is parsed without the state of the
+ * previous one; capture files at block boundaries. Chunks are parsed by a
+ * pool of threads and the frames are given to the callback in order, the
+ * count of chunks parsed in advance being bounded. For well-formed data, the
+ * frames are the same as with one reader reading the whole input.
+ */
+typedef struct midi_pparse_t {
+	midi_reader_flags_t flags; /* flags of the readers parsing raw data */
+	int nthreads; /* count of threads */
+	size_t chunk; /* size of the chunks */
+	midi_pparse_callback_t callback; /* user callback */
+	void *user_data; /* user data for callback */
+	midi_pparse_stats_t stats;
+
+	/* state of a parse */
+	const char *path; /* capture file, or NULL for raw data */
+	const unsigned char *data; /* raw data */
+	size_t size; /* length of raw data */
+	const unsigned char *index; /* entries of the raw capture index */
+	size_t nindex; /* count of index entries */
+	midi_pparse_chunk_t *chunks; /* chunks */
+	size_t nchunks; /* count of chunks */
+	size_t next; /* next chunk to parse */
+	size_t emitted; /* count of chunks given to the callback */
+	bool stop; /* stop the threads */
+	pthread_mutex_t lock; /* lock of the state */
+	pthread_cond_t cond; /* signaled when a chunk is parsed or emitted */
+} midi_pparse_t;
+
+/* Initialize a parser. 'flags' are used for the readers parsing raw data
+ * (MIDIR_EXPAND, ..; MIDIR_NOQUEUE is implied). 'nthreads' and 'chunk' may
+ * be 0 for the count of CPUs and the default chunk size.
+ */
+void
+midi_pparse_init (midi_pparse_t *p, midi_reader_flags_t flags, int nthreads,
+			size_t chunk);
+
+/* Set the callback receiving the frames. */
+void
+midi_pparse_set_callback (midi_pparse_t *p, midi_pparse_callback_t cb,
+				void *user_data);
+
+/* Parse raw MIDI bytes in memory; the frames have no timestamp. Returns
+ * false on error or if the callback stopped the parse.
+ */
+bool
+midi_pparse_buffer (midi_pparse_t *p, const unsigned char *data, size_t size);
+
+/* Parse the file 'path': a capture file, or raw data with the time of its
+ * chunks if a raw capture index "<path>.idx" exists. Returns false on
+ * error or if the callback stopped the parse.
+ */
+bool
+midi_pparse_file (midi_pparse_t *p, const char *path);
+
+/* Get the statistics of the last parse. */
+void
+midi_pparse_get_stats (midi_pparse_t *p, midi_pparse_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_PPARSE_H */
@@ -0,0 +1,299 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* posix_openpt (), grantpt (), unlockpt () and ptsname () */
+#if defined(__linux__) && ! defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <termios.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "midi_pty.h"
+
+/* Set a terminal to raw mode: no line editing, echo, signals nor
+ * translation of bytes.
+ */
+static bool
+midi_pty_raw (int fd)
+{
+	struct termios t;
+
+	if (tcgetattr (fd, &t) < 0)
+		return (false);
+	cfmakeraw (&t);
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	return (tcsetattr (fd, TCSANOW, &t) == 0);
+}
+
+/* Create MIDI_PTY_DIR, or check that the existing one is a directory (not
+ * a link) of root or of ours, shared like /tmp: another user could
+ * otherwise redirect or remove the links of our ports.
+ */
+static bool
+midi_pty_check_dir ()
+{
+	struct stat st;
+
+	if (mkdir (MIDI_PTY_DIR, 01777) < 0 && errno != EEXIST)
+		return (false);
+	if (lstat (MIDI_PTY_DIR, &st) < 0 || ! S_ISDIR (st.st_mode) ||
+		(st.st_uid != 0 && st.st_uid != geteuid ()))
+		goto denied;
+	if ((st.st_mode & 07777) != 01777) {
+		/* created with our umask, or changed since */
+		if (st.st_uid != geteuid () || chmod (MIDI_PTY_DIR, 01777) < 0)
+			goto denied;
+	}
+	return (true);
+
+denied:
+	errno = EACCES;
+	return (false);
+}
+
+/* Set the path of the lock of the port 'name'. */
+static void
+midi_pty_lock_path (char *buf, size_t max, const char *name)
+{
+	snprintf (buf, max, "%s/.%s.lock", MIDI_PTY_DIR, name);
+}
+
+/* Take the lock of the port 'name', created if needed. Returns the
+ * descriptor of the locked file, -1 with errno EEXIST if the port is open.
+ */
+static int
+midi_pty_lock (const char *name)
+{
+	char path[sizeof (MIDI_PTY_DIR) + MIDI_PTY_NAME_MAX + 8];
+	struct stat st, fst;
+	int fd;
+
+	midi_pty_lock_path (path, sizeof (path), name);
+	for (int i = 0; i < 3; i++) {
+		/* readable by all, so that the others can test the lock */
+		fd = open (path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+				0644);
+		if (fd < 0)
+			return (-1);
+		if (flock (fd, LOCK_EX | LOCK_NB) < 0) {
+			close (fd);
+			if (errno == EWOULDBLOCK)
+				errno = EEXIST;
+			return (-1);
+		}
+		/* the file may have been removed by its previous owner
+		 * between our open and our lock */
+		if (fstat (fd, &fst) == 0 && lstat (path, &st) == 0 &&
+			st.st_dev == fst.st_dev && st.st_ino == fst.st_ino)
+			return (fd);
+		close (fd);
+	}
+	errno = EAGAIN;
+	return (-1);
+}
+
+/* Check whether the port 'name' is open, by testing its lock. */
+static bool
+midi_pty_alive (const char *name)
+{
+	char path[sizeof (MIDI_PTY_DIR) + MIDI_PTY_NAME_MAX + 8];
+	bool alive;
+	int fd;
+
+	midi_pty_lock_path (path, sizeof (path), name);
+	fd = open (path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return (false);
+	alive = flock (fd, LOCK_SH | LOCK_NB) < 0 && errno == EWOULDBLOCK;
+	close (fd);
+	return (alive);
+}
+
+bool
+midi_pty_open (midi_pty_t *p, const char *name)
+{
+	struct stat st;
+	const char *slave;
+	size_t len;
+
+	if (p == NULL)
+		return (false);
+	p->master = p->slave = p->lock = -1;
+	p->name[0] = p->path[0] = p->slave_path[0] = 0;
+	if (name == NULL || (len = strlen (name)) == 0 ||
+		len > MIDI_PTY_NAME_MAX || name[0] == '.')
+		return (false);
+	for (const char *c = name; *c; c++) {
+		if ( ! ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+			(*c >= '0' && *c <= '9') || *c == '-' || *c == '_' ||
+			*c == '.'))
+			return (false);
+	}
+
+	p->master = posix_openpt (O_RDWR | O_NOCTTY);
+	if (p->master < 0)
+		return (false);
+	if (grantpt (p->master) < 0 || unlockpt (p->master) < 0 ||
+		(slave = ptsname (p->master)) == NULL ||
+		strlen (slave) >= sizeof (p->slave_path))
+		goto fail;
+	snprintf (p->slave_path, sizeof (p->slave_path), "%s", slave);
+	p->slave = open (p->slave_path, O_RDWR | O_NOCTTY);
+	if (p->slave < 0 || ! midi_pty_raw (p->slave) ||
+		fcntl (p->master, F_SETFL, O_NONBLOCK) < 0)
+		goto fail;
+
+	/* publish the slave side, replacing a stale link of ours only */
+	if ( ! midi_pty_check_dir () || (p->lock = midi_pty_lock (name)) < 0)
+		goto fail;
+	snprintf (p->name, sizeof (p->name), "%s", name);
+	snprintf (p->path, sizeof (p->path), "%s/%s", MIDI_PTY_DIR, name);
+	if (lstat (p->path, &st) == 0) {
+		if (st.st_uid != geteuid ()) {
+			p->path[0] = 0;
+			errno = EEXIST;
+			goto fail;
+		}
+		unlink (p->path);
+	}
+	if (symlink (p->slave_path, p->path) < 0) {
+		p->path[0] = 0;
+		goto fail;
+	}
+	return (true);
+
+fail:
+	midi_pty_close (p);
+	return (false);
+}
+
+void
+midi_pty_close (midi_pty_t *p)
+{
+	char link[sizeof (p->slave_path)];
+	char lock[sizeof (MIDI_PTY_DIR) + MIDI_PTY_NAME_MAX + 8];
+	ssize_t len;
+
+	if (p == NULL)
+		return;
+	/* the link may have been replaced since */
+	if (p->path[0] && (len = readlink (p->path, link,
+						sizeof (link) - 1)) > 0) {
+		link[len] = 0;
+		if (strcmp (link, p->slave_path) == 0)
+			unlink (p->path);
+	}
+	if (p->lock > -1) {
+		/* removed while locked, see midi_pty_lock */
+		midi_pty_lock_path (lock, sizeof (lock), p->name);
+		unlink (lock);
+		close (p->lock);
+	}
+	if (p->slave > -1)
+		close (p->slave);
+	if (p->master > -1)
+		close (p->master);
+	p->master = p->slave = p->lock = -1;
+	p->name[0] = p->path[0] = p->slave_path[0] = 0;
+}
+
+static int
+midi_pty_cmp (const void *a, const void *b)
+{
+	return (strcmp (*(char * const *) a, *(char * const *) b));
+}
+
+bool
+midi_pty_list (int n, char *path, size_t max)
+{
+	struct dirent *e;
+	struct stat st;
+	char p[sizeof (MIDI_PTY_DIR) + 256];
+	char **names = NULL, **more;
+	size_t count = 0, size = 0, i;
+	bool found = false;
+	DIR *dir;
+
+	if (n < 0 || path == NULL || max == 0)
+		return (false);
+	if ((dir = opendir (MIDI_PTY_DIR)) == NULL)
+		return (false);
+	while ((e = readdir (dir)) != NULL) {
+		if (e->d_name[0] == '.' ||
+			strlen (e->d_name) > MIDI_PTY_NAME_MAX)
+			continue;
+		snprintf (p, sizeof (p), "%s/%s", MIDI_PTY_DIR, e->d_name);
+		if (lstat (p, &st) < 0 || ! S_ISLNK (st.st_mode))
+			continue;
+		/* the terminal of a stale link may belong to another
+		 * program now */
+		if ( ! midi_pty_alive (e->d_name)) {
+			if (st.st_uid == geteuid ()) {
+				unlink (p);
+				midi_pty_lock_path (p, sizeof (p), e->d_name);
+				unlink (p);
+			}
+			continue;
+		}
+		if (stat (p, &st) < 0 || ! S_ISCHR (st.st_mode))
+			continue;
+		if (count == size) {
+			size = size ? 2 * size : 16;
+			more = (char **) realloc (names, size * sizeof (char *));
+			if (more == NULL)
+				break;
+			names = more;
+		}
+		if ((names[count] = strdup (e->d_name)) != NULL)
+			count++;
+	}
+	closedir (dir);
+
+	/* in the order of the names, not of the directory, so that the ports
+	 * keep their numbers from a listing to the next */
+	if (count > 0)
+		qsort (names, count, sizeof (char *), midi_pty_cmp);
+	if ((size_t) n < count) {
+		snprintf (p, sizeof (p), "%s/%s", MIDI_PTY_DIR, names[n]);
+		if (strlen (p) < max) {
+			snprintf (path, max, "%s", p);
+			found = true;
+		}
+	}
+	for (i = 0; i < count; i++)
+		free (names[i]);
+	free (names);
+	return (found);
+}
@@ -0,0 +1,86 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_PTY_H
+#define MIDI_PTY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* directory where the virtual ports are published */
+#define MIDI_PTY_DIR	"/tmp/midi-virtual"
+
+/* max length of the name of a virtual port */
+#define MIDI_PTY_NAME_MAX	32
+
+/* A virtual port: a pseudo-terminal in raw mode. The program owning the
+ * port uses the master side; the slave side is published as a link named
+ * after the port in MIDI_PTY_DIR, so that other programs open it as a MIDI
+ * device. Bytes go thru unchanged in both directions. While the port is
+ * open, its owner holds a lock on the file ".<name>.lock" next to the
+ * link: a link without a locked file is stale, and its terminal may have
+ * been given to another program since.
+ */
+typedef struct midi_pty_t {
+	int master; /* master side, non-blocking */
+	int slave; /* slave side, kept open so that the master does not see
+		    * a hang-up when the other program closes it */
+	int lock; /* locked file of the port */
+	char name[MIDI_PTY_NAME_MAX + 1]; /* name of the port */
+	char path[sizeof (MIDI_PTY_DIR) + MIDI_PTY_NAME_MAX + 1]; /* link */
+	char slave_path[64]; /* path of the slave side */
+} midi_pty_t;
+
+/* Create the virtual port 'name' (letters, digits, '-', '_', '.'),
+ * replacing a stale link of the same name created by the same user; fails
+ * with errno EEXIST if a port of this name is open.
+ * MIDI_PTY_DIR is created if needed; it must be a directory owned by root
+ * or by the user, with mode 01777 like /tmp. Returns false on failure.
+ */
+bool
+midi_pty_open (midi_pty_t *p, const char *name);
+
+/* Close a virtual port and remove its link, unless it was replaced. */
+void
+midi_pty_close (midi_pty_t *p);
+
+/* Get the path of the link of the nth virtual port published (0..) into
+ * 'path', in the order of their names. Stale links are skipped, and
+ * removed if they belong to the user. Returns false if there is no such
+ * port.
+ */
+bool
+midi_pty_list (int n, char *path, size_t max);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_PTY_H */
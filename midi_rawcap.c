@@ -0,0 +1,395 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* splice () */
+#if defined(__linux__) && ! defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "midi_rawcap.h"
+#include "midi_capture.h"
+
+static bool
+midi_rawcap_write_all (int fd, const unsigned char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n > 0) {
+		r = write (fd, p, n);
+		if (r < 0 && errno == EINTR)
+			continue;
+		else if (r <= 0)
+			return (false);
+		p += r;
+		n -= (size_t) r;
+	}
+	return (true);
+}
+
+static inline void
+midi_rawcap_put64 (unsigned char *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static inline uint64_t
+midi_rawcap_get64 (const unsigned char *p)
+{
+	uint64_t v = 0;
+
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return (v);
+}
+
+static uint64_t
+midi_rawcap_now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+static void
+midi_rawcap_flush_index (midi_rawcap_t *rc)
+{
+	if (rc->nindex > 0 && ! midi_rawcap_write_all (rc->idx, rc->index,
+				rc->nindex * MIDI_RAWCAP_ENTRY_LEN))
+		rc->error = true;
+	rc->nindex = 0;
+	rc->t_flush = midi_rawcap_now ();
+}
+
+bool
+midi_rawcap_open (midi_rawcap_t *rc, int in, const char *path)
+{
+	unsigned char hdr[MIDI_RAWCAP_HEADER_LEN];
+	char *ipath;
+	size_t len;
+
+	if (rc == NULL || in < 0 || path == NULL)
+		return (false);
+	memset (rc, 0, sizeof (midi_rawcap_t));
+	rc->in = in;
+	rc->out = rc->idx = -1;
+	rc->pipe[0] = rc->pipe[1] = -1;
+	len = strlen (path) + 5;
+	ipath = (char *) malloc (len);
+	if (ipath == NULL)
+		return (false);
+	snprintf (ipath, len, "%s.idx", path);
+	rc->out = open (path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+	rc->idx = open (ipath, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+	free (ipath);
+	if (rc->out < 0 || rc->idx < 0)
+		goto fail;
+	memset (hdr, 0, sizeof (hdr));
+	memcpy (hdr, MIDI_RAWCAP_MAGIC, 8);
+	hdr[8] = MIDI_RAWCAP_VERSION;
+	if ( ! midi_rawcap_write_all (rc->idx, hdr, sizeof (hdr)))
+		goto fail;
+
+#ifdef __linux__
+	rc->use_splice = pipe (rc->pipe) == 0;
+#endif
+	rc->buf = (unsigned char *) malloc (MIDI_RAWCAP_CHUNK_MAX);
+	if (rc->buf == NULL)
+		goto fail;
+	rc->t_flush = midi_rawcap_now ();
+	return (true);
+
+fail:
+	midi_rawcap_close (rc);
+	return (false);
+}
+
+#ifdef __linux__
+/* Move up to 'max' bytes with splice(). Returns -2 if the device does not
+ * support it.
+ */
+static ssize_t
+midi_rawcap_splice (midi_rawcap_t *rc, uint64_t *ts)
+{
+	ssize_t n, r, left;
+
+	n = splice (rc->in, NULL, rc->pipe[1], NULL, MIDI_RAWCAP_CHUNK_MAX,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	*ts = midi_rawcap_now ();
+	if (n < 0 && errno == EINVAL)
+		return (-2);
+	else if (n < 0)
+		return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+	else if (n == 0)
+		return (-1);
+	for (left = n; left > 0; ) {
+		r = splice (rc->pipe[0], NULL, rc->out, NULL, (size_t) left,
+				SPLICE_F_MOVE);
+		if (r < 0 && errno == EINTR)
+			continue;
+		else if (r <= 0) {
+			rc->error = true;
+			return (-1);
+		}
+		left -= r;
+	}
+	rc->stats.spliced = true;
+	return (n);
+}
+#endif
+
+ssize_t
+midi_rawcap_pump (midi_rawcap_t *rc)
+{
+	unsigned char *e;
+	uint64_t ts;
+	ssize_t n = -2;
+
+	if (rc == NULL || rc->out < 0)
+		return (-1);
+#ifdef __linux__
+	if (rc->use_splice) {
+		n = midi_rawcap_splice (rc, &ts);
+		if (n == -2)
+			rc->use_splice = false;
+	}
+#endif
+	if (n == -2) {
+		n = read (rc->in, rc->buf, MIDI_RAWCAP_CHUNK_MAX);
+		ts = midi_rawcap_now ();
+		if (n < 0)
+			return (errno == EAGAIN || errno == EINTR ? 0 : -1);
+		else if (n == 0)
+			return (-1);
+		if ( ! midi_rawcap_write_all (rc->out, rc->buf, (size_t) n)) {
+			rc->error = true;
+			return (-1);
+		}
+	}
+	if (n <= 0)
+		return (n);
+
+	/* index entry of the chunk */
+	e = rc->index + rc->nindex * MIDI_RAWCAP_ENTRY_LEN;
+	midi_rawcap_put64 (e, rc->offset);
+	midi_rawcap_put64 (e + 8, ts);
+	rc->offset += (uint64_t) n;
+	rc->stats.chunks++;
+	rc->stats.bytes += (uint64_t) n;
+	if (++rc->nindex == MIDI_RAWCAP_INDEX_BUF ||
+		ts - rc->t_flush >= MIDI_RAWCAP_FLUSH_NS)
+		midi_rawcap_flush_index (rc);
+	return (n);
+}
+
+bool
+midi_rawcap_run (midi_rawcap_t *rc)
+{
+	struct pollfd pfd;
+	ssize_t n;
+
+	if (rc == NULL || rc->out < 0)
+		return (false);
+	pfd.fd = rc->in;
+	pfd.events = POLLIN;
+	while ( ! __atomic_load_n (&rc->stop, __ATOMIC_ACQUIRE)) {
+		if (poll (&pfd, 1, 100) > 0) {
+			n = midi_rawcap_pump (rc);
+			if (n < 0)
+				break;
+		}
+		else if (rc->nindex > 0 &&
+			midi_rawcap_now () - rc->t_flush >=
+				MIDI_RAWCAP_FLUSH_NS)
+			midi_rawcap_flush_index (rc);
+	}
+	return ( ! rc->error);
+}
+
+void
+midi_rawcap_stop (midi_rawcap_t *rc)
+{
+	if (rc)
+		__atomic_store_n (&rc->stop, 1, __ATOMIC_RELEASE);
+}
+
+bool
+midi_rawcap_close (midi_rawcap_t *rc)
+{
+	bool ok;
+
+	if (rc == NULL)
+		return (false);
+	if (rc->idx > -1) {
+		midi_rawcap_flush_index (rc);
+		if (close (rc->idx) != 0)
+			rc->error = true;
+	}
+	if (rc->out > -1 && close (rc->out) != 0)
+		rc->error = true;
+	if (rc->pipe[0] > -1) {
+		close (rc->pipe[0]);
+		close (rc->pipe[1]);
+	}
+	free (rc->buf);
+	rc->buf = NULL;
+	rc->out = rc->idx = -1;
+	rc->pipe[0] = rc->pipe[1] = -1;
+	ok = ! rc->error;
+	return (ok);
+}
+
+void
+midi_rawcap_get_stats (midi_rawcap_t *rc, midi_rawcap_stats_t *stats)
+{
+	if (rc && stats)
+		*stats = rc->stats;
+}
+
+/* Map a whole file read-only; 'size' may be 0. */
+static const unsigned char *
+midi_rawcap_map (const char *path, size_t *size)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return (NULL);
+	if (fstat (fd, &st) != 0) {
+		close (fd);
+		return (NULL);
+	}
+	*size = (size_t) st.st_size;
+	map = *size ? mmap (NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0) :
+			(void *) "";
+	close (fd);
+	if (map == MAP_FAILED)
+		return (NULL);
+	if (*size)
+		madvise (map, *size, MADV_SEQUENTIAL);
+	return ((const unsigned char *) map);
+}
+
+long
+midi_rawcap_parse (const char *path, midi_reader_t *reader, int id)
+{
+	const unsigned char *data, *idx, *e;
+	midi_reader_source_t src;
+	size_t size, isize, n, i;
+	uint64_t off, next;
+	char *ipath;
+	long count = -1;
+
+	if (path == NULL || reader == NULL)
+		return (-1);
+	ipath = (char *) malloc (strlen (path) + 5);
+	if (ipath == NULL)
+		return (-1);
+	sprintf (ipath, "%s.idx", path);
+	data = midi_rawcap_map (path, &size);
+	idx = midi_rawcap_map (ipath, &isize);
+	free (ipath);
+	if (data == NULL || idx == NULL || isize < MIDI_RAWCAP_HEADER_LEN ||
+		memcmp (idx, MIDI_RAWCAP_MAGIC, 8))
+		goto end;
+
+	/* an index cut by a crash loses its last entries only: the bytes
+	 * after the last entry get its time */
+	n = (isize - MIDI_RAWCAP_HEADER_LEN) / MIDI_RAWCAP_ENTRY_LEN;
+	midi_reader_init_source (&src, id);
+	count = 0;
+	for (i = 0; i < n; i++) {
+		e = idx + MIDI_RAWCAP_HEADER_LEN + i * MIDI_RAWCAP_ENTRY_LEN;
+		off = midi_rawcap_get64 (e);
+		next = i + 1 < n ? midi_rawcap_get64 (e +
+					MIDI_RAWCAP_ENTRY_LEN) : size;
+		if (next > size)
+			next = size;
+		if (off >= next)
+			continue;
+		/* the parser takes an int length */
+		while (off < next) {
+			uint64_t k = next - off > 0x10000000 ?
+					0x10000000 : next - off;
+
+			count += midi_reader_parse (reader, &src, data + off,
+						(int) k, midi_rawcap_get64 (
+						e + 8), false);
+			off += k;
+		}
+	}
+	count += midi_reader_parse (reader, &src, NULL, 0, src.ts, true);
+
+end:
+	if (data && size)
+		munmap ((void *) data, size);
+	if (idx && isize)
+		munmap ((void *) idx, isize);
+	return (count);
+}
+
+bool
+midi_rawcap_convert (const char *path, const char *cap_path)
+{
+	midi_reader_t *reader;
+	long n;
+	int fd;
+
+	if (path == NULL || cap_path == NULL)
+		return (false);
+	reader = (midi_reader_t *) malloc (sizeof (midi_reader_t));
+	if (reader == NULL)
+		return (false);
+	midi_reader_init (reader, (midi_reader_flags_t) (MIDIR_EXPAND |
+				MIDIR_NOQUEUE), NULL);
+	fd = open (cap_path, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		free (reader);
+		return (false);
+	}
+	if ( ! midi_capture_set_dump (reader, fd)) {
+		close (fd);
+		free (reader);
+		return (false);
+	}
+	n = midi_rawcap_parse (path, reader, 0);
+	midi_reader_close (reader);
+	free (reader);
+	return (n >= 0);
+}
@@ -0,0 +1,137 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef MIDI_RAWCAP_H
+#define MIDI_RAWCAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIDI_RAWCAP_MAGIC	"MIDIRIX1"
+#define MIDI_RAWCAP_VERSION	1
+
+/* length of the header of an index file and of its entries */
+#define MIDI_RAWCAP_HEADER_LEN	16
+#define MIDI_RAWCAP_ENTRY_LEN	16
+
+/* max count of bytes moved at once */
+#define MIDI_RAWCAP_CHUNK_MAX	65536
+
+/* count of index entries buffered before being written */
+#define MIDI_RAWCAP_INDEX_BUF	256
+
+/* max time between two writes of the index (ns) */
+#define MIDI_RAWCAP_FLUSH_NS	1000000000ULL
+
+/* statistics of a raw capture */
+typedef struct midi_rawcap_stats_t {
+	unsigned long chunks; /* count of chunks (reads) */
+	uint64_t bytes; /* count of bytes captured */
+	bool spliced; /* data was moved with splice() */
+} midi_rawcap_stats_t;
+
+/* Raw capture of the bytes of a device to a file, without parsing them.
+ * On Linux the bytes are moved with splice() thru a pipe, without copy to
+ * user space; otherwise (or if the device does not support it) by large
+ * reads. Each chunk is recorded in a side index file "<path>.idx" as (offset
+ * in file, time), so that the capture can be parsed later with its timing
+ * by "midi_rawcap_parse".
+ */
+typedef struct midi_rawcap_t {
+	int in; /* device */
+	int out; /* data file */
+	int idx; /* index file */
+	int pipe[2]; /* pipe for splice() */
+	bool use_splice; /* moving data with splice() */
+	unsigned char *buf; /* buffer for read() */
+	uint64_t offset; /* count of bytes written */
+	unsigned char index[MIDI_RAWCAP_INDEX_BUF * MIDI_RAWCAP_ENTRY_LEN];
+	uint32_t nindex; /* count of buffered index entries */
+	uint64_t t_flush; /* time of the last write of the index */
+	int stop; /* set to stop "midi_rawcap_run" */
+	bool error; /* a write failed */
+	midi_rawcap_stats_t stats;
+} midi_rawcap_t;
+
+/* Start capturing the bytes of 'in' (not closed by the capture) into the
+ * file 'path', created or truncated, with the index "<path>.idx". Returns
+ * false on failure.
+ */
+bool
+midi_rawcap_open (midi_rawcap_t *rc, int in, const char *path);
+
+/* Move the bytes available from the device to the file, once. Returns the
+ * count of bytes moved, 0 if none was available, -1 at the end of the
+ * device data or on error.
+ */
+ssize_t
+midi_rawcap_pump (midi_rawcap_t *rc);
+
+/* Capture until the end of the device data, an error, or a call to
+ * "midi_rawcap_stop" from another thread. Returns false on error.
+ */
+bool
+midi_rawcap_run (midi_rawcap_t *rc);
+
+/* Stop "midi_rawcap_run". */
+void
+midi_rawcap_stop (midi_rawcap_t *rc);
+
+/* Write the index and close the files. Returns false if any write
+ * failed.
+ */
+bool
+midi_rawcap_close (midi_rawcap_t *rc);
+
+/* Get the statistics of the capture. */
+void
+midi_rawcap_get_stats (midi_rawcap_t *rc, midi_rawcap_stats_t *stats);
+
+/* Parse the raw capture 'path' into 'reader', each chunk with the time it
+ * was read; frames get source id 'id'. Returns the count of frames parsed,
+ * or -1 on error.
+ */
+long
+midi_rawcap_parse (const char *path, midi_reader_t *reader, int id);
+
+/* Convert the raw capture 'path' to the capture file 'cap_path' (see
+ * midi_capture.h), expanding running status. Returns false on error.
+ */
+bool
+midi_rawcap_convert (const char *path, const char *cap_path);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_RAWCAP_H */
@@ -31,6 +31,8 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <time.h>
 #include "midi_reader.h"
 
 int
@@ -77,11 +79,13 @@ static void
 midi_reader_reset_source (midi_reader_source_t *src, bool to_close)
 {
 	if (src) {
+		int fd = src->fd;
+
 		memset (src, 0, sizeof (midi_reader_source_t));
-		if (to_close) {
-			close (src->fd);
-			src->fd = -1;
-		}
+		if (to_close && fd > -1)
+			close (fd);
+		src->fd = -1;
+		src->id = -1;
 		src->push_back = -1;
 		src->channel = -1;
 	}
@@ -134,6 +138,7 @@ midi_reader_add_source (midi_reader_t *reader, int fd, int channel)
 				return (true);
 		}
 		reader->sources[reader->nsources].fd = fd;
+		reader->sources[reader->nsources].id = reader->next_id++;
 		if (channel >= 1 && channel <= 16)
 			reader->sources[reader->nsources].channel = channel;
 		else
@@ -168,16 +173,168 @@ midi_reader_remove_source (midi_reader_t *reader, int fd)
 	}
 }
 
+int
+midi_reader_get_source_id (midi_reader_t *reader, int fd)
+{
+	if (reader && fd > -1) {
+		for (int i = 0; i < reader->nsources; i++) {
+			if (reader->sources[i].fd == fd)
+				return (reader->sources[i].id);
+		}
+	}
+	return (-1);
+}
+
+static midi_reader_source_t*
+midi_reader_find_source (midi_reader_t *reader, int fd)
+{
+	if (reader && fd > -1) {
+		for (int i = 0; i < reader->nsources; i++) {
+			if (reader->sources[i].fd == fd)
+				return (&reader->sources[i]);
+		}
+	}
+	return (NULL);
+}
+
+bool
+midi_reader_add_filter (midi_reader_t *reader, int fd,
+			midi_reader_filter_t filter, void *user_data)
+{
+	midi_reader_source_t *src = midi_reader_find_source (reader, fd);
+
+	if (src == NULL || filter == NULL ||
+		src->nfilters >= MIDI_READER_HOOKS_MAX)
+		return (false);
+	src->filters[src->nfilters].fn = filter;
+	src->filters[src->nfilters].user_data = user_data;
+	src->nfilters++;
+	return (true);
+}
+
+bool
+midi_reader_remove_filter (midi_reader_t *reader, int fd,
+				midi_reader_filter_t filter, void *user_data)
+{
+	midi_reader_source_t *src = midi_reader_find_source (reader, fd);
+
+	if (src == NULL)
+		return (false);
+	for (int i = 0; i < src->nfilters; i++) {
+		if (src->filters[i].fn == filter &&
+			src->filters[i].user_data == user_data) {
+			for (src->nfilters--; i < src->nfilters; i++)
+				src->filters[i] = src->filters[i + 1];
+			return (true);
+		}
+	}
+	return (false);
+}
+
+bool
+midi_reader_add_source_tap (midi_reader_t *reader, int fd,
+				midi_reader_tap_t tap, void *user_data)
+{
+	midi_reader_source_t *src = midi_reader_find_source (reader, fd);
+
+	if (src == NULL || tap == NULL || src->ntaps >= MIDI_READER_HOOKS_MAX)
+		return (false);
+	src->taps[src->ntaps].fn = tap;
+	src->taps[src->ntaps].user_data = user_data;
+	src->ntaps++;
+	return (true);
+}
+
+bool
+midi_reader_remove_source_tap (midi_reader_t *reader, int fd,
+				midi_reader_tap_t tap, void *user_data)
+{
+	midi_reader_source_t *src = midi_reader_find_source (reader, fd);
+
+	if (src == NULL)
+		return (false);
+	for (int i = 0; i < src->ntaps; i++) {
+		if (src->taps[i].fn == tap &&
+			src->taps[i].user_data == user_data) {
+			for (src->ntaps--; i < src->ntaps; i++)
+				src->taps[i] = src->taps[i + 1];
+			return (true);
+		}
+	}
+	return (false);
+}
+
+uint64_t
+midi_reader_get_time (midi_reader_t *reader)
+{
+	if (reader && reader->clock)
+		return (reader->clock (reader->clock_arg));
+	else {
+		struct timespec ts;
+
+		clock_gettime (CLOCK_MONOTONIC, &ts);
+		return ((uint64_t) ts.tv_sec * 1000000000ULL +
+			(uint64_t) ts.tv_nsec);
+	}
+}
+
+void
+midi_reader_set_clock (midi_reader_t *reader, midi_reader_clock_t clock,
+			void *arg)
+{
+	if (reader) {
+		reader->clock = clock;
+		reader->clock_arg = clock ? arg : NULL;
+	}
+}
+
+static void
+midi_reader_close_writer (midi_reader_t *reader)
+{
+	if (reader->writer) {
+		reader->writer->close (reader->writer_data);
+		reader->writer = NULL;
+		reader->writer_data = NULL;
+	}
+}
+
 bool
 midi_reader_set_dump_fd (midi_reader_t *reader, int fd)
 {
 	if (reader && fd > -1) {
+		/* raw chunks are not frames */
+		if ((reader->flags & MIDIR_RAW) &&
+			(reader->flags & MIDIR_DUMPHEX))
+			return (false);
 		reader->dumpfd = fd;
 		return (true);
 	}
 	return (false);
 }
 
+bool
+midi_reader_set_dump_writer (midi_reader_t *reader,
+				const midi_reader_writer_t *writer, void *w)
+{
+	if (reader == NULL || (writer && (reader->flags & MIDIR_RAW)))
+		return (false);
+	midi_reader_close_writer (reader);
+	reader->writer = writer;
+	reader->writer_data = writer ? w : NULL;
+	return (true);
+}
+
+bool
+midi_reader_flush_dump (midi_reader_t *reader)
+{
+	if (reader == NULL)
+		return (false);
+	else if (reader->writer)
+		return (reader->writer->flush (reader->writer_data));
+	else
+		return (true);
+}
+
 bool
 midi_reader_set_dump_file (midi_reader_t *reader,
 				const char *path, bool trunc)
@@ -209,6 +366,47 @@ midi_reader_set_callback (midi_reader_t *reader,
 	}
 }
 
+void
+midi_reader_set_raw_callback (midi_reader_t *reader,
+				midi_reader_raw_callback_t cb, void *user_data)
+{
+	if (reader) {
+		reader->raw_callback = cb;
+		reader->raw_user_data = user_data;
+	}
+}
+
+bool
+midi_reader_add_tap (midi_reader_t *reader, midi_reader_tap_t tap,
+			void *user_data)
+{
+	if (reader == NULL || tap == NULL ||
+		reader->ntaps >= MIDI_READER_TAPS_MAX)
+		return (false);
+	reader->taps[reader->ntaps].fn = tap;
+	reader->taps[reader->ntaps].user_data = user_data;
+	reader->ntaps++;
+	return (true);
+}
+
+bool
+midi_reader_remove_tap (midi_reader_t *reader, midi_reader_tap_t tap,
+			void *user_data)
+{
+	if (reader == NULL)
+		return (false);
+	for (int i = 0; i < reader->ntaps; i++) {
+		if (reader->taps[i].fn == tap &&
+			reader->taps[i].user_data == user_data) {
+			for (int j = i + 1; j < reader->ntaps; j++)
+				reader->taps[j - 1] = reader->taps[j];
+			reader->ntaps--;
+			return (true);
+		}
+	}
+	return (false);
+}
+
 static void
 midi_reader_read (midi_reader_t *reader)
 {
@@ -227,8 +425,10 @@ midi_reader_read (midi_reader_t *reader)
 			continue;
 		r = read (s->fd, s->buf + s->buf_len,
 				MIDI_READER_BUF_MAX - s->buf_len);
-		if (r > 0)
+		if (r > 0) {
 			s->buf_len += r;
+			s->ts = midi_reader_get_time (reader);
+		}
 	}
 }
 
@@ -266,6 +466,8 @@ midi_reader_push_frame (midi_reader_t *reader, midi_frame_t *mf,
 			midi_reader_source_t *src)
 {
 	midi_frame_state_t st;
+	unsigned long n;
+	int i;
 
 	/* user callback */
 	if (reader->callback) {
@@ -284,8 +486,16 @@ midi_reader_push_frame (midi_reader_t *reader, midi_frame_t *mf,
 		}
 	}
 
+	/* taps */
+	for (i = 0; i < src->ntaps; i++)
+		src->taps[i].fn (mf, src->taps[i].user_data);
+	for (i = 0; i < reader->ntaps; i++)
+		reader->taps[i].fn (mf, reader->taps[i].user_data);
+
 	/* dump */
-	if (reader->dumpfd > -1) {
+	if (reader->writer)
+		reader->writer->write (reader->writer_data, mf);
+	else if (reader->dumpfd > -1) {
 		if (reader->flags & MIDIR_DUMPHEX)
 			midi_frame_dump (mf, reader->dumpfd);
 		else
@@ -293,6 +503,8 @@ midi_reader_push_frame (midi_reader_t *reader, midi_frame_t *mf,
 	}
 
 	/* store */
+	if (reader->flags & MIDIR_NOQUEUE)
+		return (MIDIF_COMPLETE);
 	if (reader->frames.len == reader->frames.offset) {
 		reader->frames.len = 0;
 		reader->frames.offset = 0;
@@ -300,22 +512,73 @@ midi_reader_push_frame (midi_reader_t *reader, midi_frame_t *mf,
 	if (reader->frames.len < MIDI_READER_FRAMES_MAX) {
 		memcpy (&reader->frames.frames[reader->frames.len++],
 			mf, sizeof (midi_frame_t));
+		/* frames waiting to be read */
+		n = (unsigned long) (reader->frames.len -
+					reader->frames.offset);
+		if (n > reader->total.queued_max)
+			reader->total.queued_max = n;
 	}
-	else
+	else {
+		src->stats.missed++;
 		reader->total.missed++;
+	}
 
 	return (MIDIF_COMPLETE);
 }
 
+/* Filter a frame thru the filters of its source from the 'n'th one, and
+ * store the resulting frames, expanded if needed.
+ */
+static midi_frame_state_t
+midi_reader_push_filtered (midi_reader_t *reader, midi_frame_t *mf,
+				midi_reader_source_t *src, int n)
+{
+	midi_frame_t out[MIDI_READER_FILTER_OUT], f;
+	midi_frame_state_t r = MIDIF_COMPLETE;
+	int i, j, count, len;
+
+	if (n < src->nfilters) {
+		count = src->filters[n].fn (mf, out,
+						src->filters[n].user_data);
+		if (count <= 0) {
+			src->stats.skipped++;
+			reader->total.skipped++;
+			return (MIDIF_SKIPPED);
+		}
+		if (count > MIDI_READER_FILTER_OUT)
+			count = MIDI_READER_FILTER_OUT;
+		for (i = 0; i < count; i++)
+			r = midi_reader_push_filtered (reader, &out[i], src,
+							n + 1);
+		return (count == 1 ? r : MIDIF_COMPLETE);
+	}
+	len = mf->data[0] >= 0x80 ? midi_frame_len[mf->data[0] - 0x80] : 0;
+	if ( ! (reader->flags & MIDIR_EXPAND) || len < 2 ||
+		mf->data[0] > 0xef || mf->len == len)
+		return (midi_reader_push_frame (reader, mf, src));
+	f.source = mf->source;
+	f.ts = mf->ts;
+	f.data[0] = mf->data[0];
+	f.len = (unsigned char) len;
+	for (j = 1; j + len - 1 <= mf->len; j += len - 1) {
+		memcpy (f.data + 1, mf->data + j, len - 1);
+		midi_reader_push_frame (reader, &f, src);
+	}
+	return (MIDIF_COMPLETE);
+}
+
 static midi_frame_state_t
 midi_frame_process (midi_reader_t *reader, midi_frame_t *mf,
 			midi_reader_source_t *src)
 {
 	bool skipped = false;
+	int len;
 	const unsigned char *p;
 
 	if (mf->len == 0)
 		return (MIDIF_NODATA);
+	mf->source = src->id;
+	mf->ts = src->ts;
 	src->stats.read++;
 	reader->total.read++;
 	if (reader->to_skip) {
@@ -346,21 +609,29 @@ midi_frame_process (midi_reader_t *reader, midi_frame_t *mf,
 		}
 	}
 
+	/* filters */
+	if (src->nfilters > 0)
+		return (midi_reader_push_filtered (reader, mf, src, 0));
+
 	/* running-status expansion ? */
 	if ( ! (reader->flags & MIDIR_EXPAND) ||
-		(mf->data[0] < 0x80 || mf->data[0] > 0xef || mf->len == 3))
+		mf->data[0] < 0x80 || mf->data[0] > 0xef)
 		return (midi_reader_push_frame (reader, mf, src));
-	else if ((mf->len - 1) % 2)
+	len = midi_frame_len[mf->data[0] - 0x80];
+	if (mf->len == len)
+		return (midi_reader_push_frame (reader, mf, src));
+	else if ((mf->len - 1) % (len - 1))
 		return (MIDIF_ERROR);
 	else {
 		int i;
 		midi_frame_t f;
 
-		f.len = 3;
-		for (i = 1; i < mf->len; i += 2) {
-			f.data[0] = mf->data[0];
-			f.data[1] = mf->data[i];
-			f.data[2] = mf->data[i+1];
+		f.len = (unsigned char) len;
+		f.source = mf->source;
+		f.ts = mf->ts;
+		f.data[0] = mf->data[0];
+		for (i = 1; i < mf->len; i += len - 1) {
+			memcpy (f.data + 1, mf->data + i, len - 1);
 			midi_reader_push_frame (reader, &f, src);
 		}
 		return (MIDIF_COMPLETE);
@@ -372,12 +643,14 @@ midi_reader_close (midi_reader_t *reader)
 {
 	int i;
 
-	if (reader == NULL || reader->nsources == 0)
+	if (reader == NULL)
 		return;
 
 	for (i = 0; i < reader->nsources; i++)
 		midi_reader_reset_source_n (reader, i, true);
+	reader->nsources = 0;
 
+	midi_reader_close_writer (reader);
 	if (reader->dumpfd > -1) {
 		close (reader->dumpfd);
 		reader->dumpfd = -1;
@@ -390,6 +663,7 @@ midi_reader_push_byte (midi_reader_t *reader, midi_reader_source_t *src,
 {
 	int len;
 	midi_frame_t *mf = &src->current;
+	midi_frame_t rt;
 	unsigned char b;
 	midi_frame_state_t r;
 
@@ -398,14 +672,24 @@ midi_reader_push_byte (midi_reader_t *reader, midi_reader_source_t *src,
 		r = MIDIF_NODATA;
 	else if (data > 0xFF)
 		r = MIDIF_IOERROR;
+	else if (b >= 0xf8 && mf->len > 0) {
+		/* real-time bytes may appear anywhere: one gets its own
+		 * frame, the current one and the running status go on */
+		midi_frame_reset (&rt);
+		rt.data[0] = b;
+		rt.len = 1;
+		r = midi_frame_process (reader, &rt, src);
+		r = (r == MIDIF_COMPLETE ? MIDIF_REALTIME : MIDIF_NEXT);
+	}
 	else if (mf->len == MIDI_FRAME_MAX) {
 		/* error, too long frame */
 		r = MIDIF_ERROR;
 	}
-	else if (src->running != 0 && (b & 0x80) != 0) {
+	else if (src->running != 0 && (b & 0x80) != 0 && mf->len > 0) {
 		src->push_back = b;
 		src->running = 0;
-		if (mf->len == 0 || ((mf->len - 1) % 2))
+		len = midi_frame_len[mf->data[0] - 0x80];
+		if ((mf->len - 1) % (len - 1))
 			r = MIDIF_ERROR;
 		else
 			r = midi_frame_process (reader, mf, src);
@@ -414,8 +698,16 @@ midi_reader_push_byte (midi_reader_t *reader, midi_reader_source_t *src,
 		if (mf->len == 0) {
 			if (b >= 0x80 && b <= 0xef)
 				src->running = b;
-			else
+			else if (b >= 0xf8 && (reader->flags & MIDIR_EXPAND))
+				; /* real-time: the running status goes on */
+			else if (b >= 0x80 || ! (reader->flags & MIDIR_EXPAND))
 				src->running = 0;
+			else if (src->running != 0) {
+				/* expanded running status: the message gets
+				 * its own frame */
+				mf->data[mf->len++] = (unsigned char)
+							src->running;
+			}
 		}
 
 		mf->data[mf->len++] = (unsigned char) b;
@@ -434,8 +726,13 @@ midi_reader_push_byte (midi_reader_t *reader, midi_reader_source_t *src,
 				else
 					r = MIDIF_NEXT;
 			}
-			else if (src->running == 0 && len == mf->len)
+			else if (len == mf->len && (src->running == 0 ||
+					(reader->flags & MIDIR_EXPAND))) {
+				/* complete message; when expanding, messages
+				 * with running status are not delayed until
+				 * the next status byte */
 				r = midi_frame_process (reader, mf, src);
+			}
 			else
 				r = MIDIF_NEXT;
 		}
@@ -464,12 +761,16 @@ midi_reader_inject (midi_reader_t *reader, midi_frame_t *mf)
 	if (reader == NULL || mf == NULL || mf->len == 0)
 		return (0);
 	midi_reader_reset_source (&src, false);
-	src.fd = -1;
+	src.ts = midi_reader_get_time (reader);
 	for (i = 0; i < mf->len; i++) {
 		r = midi_reader_push_byte (reader, &src, mf->data[i]);
 		switch (r) {
 		case MIDIF_COMPLETE:
+			/* expanded running status: more messages follow */
+			midi_frame_reset (&src.current);
+			continue;
 		case MIDIF_NEXT:
+		case MIDIF_REALTIME:
 			continue;
 		default:
 			return (i);
@@ -477,7 +778,7 @@ midi_reader_inject (midi_reader_t *reader, midi_frame_t *mf)
 	}
 	/* push a fake active-sensing to conclude any pending running-status
 	 * frame */
-	if (src.running != 0)
+	if (src.running != 0 && src.current.len > 0)
 		midi_reader_push_byte (reader, &src, 0xfe);
 	return (i);
 }
@@ -499,6 +800,87 @@ midi_reader_inject_bytes (midi_reader_t *reader, int n, ...)
 	return (midi_reader_inject (reader, &f));
 }
 
+void
+midi_reader_init_source (midi_reader_source_t *src, int id)
+{
+	if (src) {
+		midi_reader_reset_source (src, false);
+		src->id = id;
+	}
+}
+
+int
+midi_reader_parse (midi_reader_t *reader, midi_reader_source_t *src,
+			const unsigned char *buf, int len, uint64_t ts,
+			bool end)
+{
+	midi_frame_state_t r;
+	int i = 0, n = 0, b;
+
+	if (reader == NULL || src == NULL || (buf == NULL && len > 0))
+		return (0);
+	src->ts = ts;
+	while (i < len || src->push_back > -1) {
+		if (src->push_back > -1) {
+			b = src->push_back;
+			src->push_back = -1;
+		}
+		else
+			b = buf[i++];
+		r = midi_reader_push_byte (reader, src, b);
+		switch (r) {
+		case MIDIF_COMPLETE:
+			n++;
+			midi_frame_reset (&src->current);
+			break;
+		case MIDIF_REALTIME:
+			n++;
+			break;
+		case MIDIF_ERROR:
+		case MIDIF_IOERROR:
+		case MIDIF_SKIPPED:
+			midi_frame_reset (&src->current);
+			break;
+		default:
+			break;
+		}
+	}
+	/* conclude a pending running-status frame, as in
+	 * "midi_reader_inject" */
+	if (end && src->running != 0 && src->current.len > 0) {
+		if (midi_reader_push_byte (reader, src, 0xfe) == MIDIF_COMPLETE)
+			n++;
+		midi_frame_reset (&src->current);
+		src->push_back = -1;
+	}
+	return (n);
+}
+
+int
+midi_reader_pump (midi_reader_t *reader)
+{
+	midi_reader_source_t *s;
+	int i, n = 0;
+
+	if (reader == NULL)
+		return (0);
+	if (reader->flags & MIDIR_RAW) {
+		midi_reader_update (reader);
+		return (0);
+	}
+	midi_reader_read (reader);
+	for (i = 0; i < reader->nsources; i++) {
+		s = &reader->sources[i];
+		if (s->buf_offset >= s->buf_len && s->push_back < 0)
+			continue;
+		n += midi_reader_parse (reader, s, s->buf + s->buf_offset,
+					s->buf_len - s->buf_offset, s->ts,
+					false);
+		s->buf_offset = s->buf_len;
+	}
+	return (n);
+}
+
 void
 midi_frame_dump (midi_frame_t *mf, int fd)
 {
@@ -522,6 +904,28 @@ midi_reader_update (midi_reader_t *reader)
 	/* read all sources */
 	midi_reader_read (reader);
 
+	/* raw mode: give the chunks read */
+	if (reader->flags & MIDIR_RAW) {
+		for (i = 0; i < reader->nsources; i++) {
+			s = &reader->sources[i];
+			if (s->buf_offset >= s->buf_len)
+				continue;
+			if (reader->raw_callback) {
+				reader->raw_callback (s->buf + s->buf_offset,
+					s->buf_len - s->buf_offset, s->id,
+					s->ts, reader->raw_user_data);
+			}
+			if (reader->dumpfd > -1) {
+				write (reader->dumpfd, s->buf + s->buf_offset,
+					s->buf_len - s->buf_offset);
+			}
+			s->stats.chunks++;
+			reader->total.chunks++;
+			s->buf_offset = s->buf_len;
+		}
+		return (false);
+	}
+
 	/* fill the queue */
 	if (++start >= reader->nsources)
 		start = 0;
@@ -541,6 +945,7 @@ midi_reader_update (midi_reader_t *reader)
 			break;
 		case MIDIF_NODATA:
 		case MIDIF_NEXT:
+		case MIDIF_REALTIME:
 			break;
 		}
 	}
@@ -558,6 +963,14 @@ midi_reader_get_next (midi_reader_t *reader)
 		return (&reader->frames.frames[reader->frames.offset++]);
 }
 
+midi_frame_t*
+midi_reader_pop (midi_reader_t *reader)
+{
+	if (reader == NULL || reader->frames.offset >= reader->frames.len)
+		return (NULL);
+	return (&reader->frames.frames[reader->frames.offset++]);
+}
+
 void
 midi_reader_clear_queue (midi_reader_t *reader)
 {
@@ -28,12 +28,13 @@
 #define MIDI_READER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define MIDI_READER_VERSION	104
+#define MIDI_READER_VERSION	105
 
 /* state of MIDI frame */
 typedef enum midi_frame_state_t {
@@ -43,6 +44,8 @@ typedef enum midi_frame_state_t {
 	MIDIF_NEXT = 0, /* waiting for next byte */
 	MIDIF_COMPLETE = 1, /* frame is complete */
 	MIDIF_SKIPPED = 2, /* frame complete but skipped */
+	MIDIF_REALTIME = 3, /* real-time frame complete, read within the
+			     * current frame which goes on */
 } midi_frame_state_t;
 
 /* max count of bytes in a MIDI frame */
@@ -52,6 +55,8 @@ typedef enum midi_frame_state_t {
 typedef struct midi_frame_t {
 	unsigned char len; /* current length */
 	unsigned char data[MIDI_FRAME_MAX]; /* data bytes */
+	int source; /* id of the source or -1 if injected */
+	uint64_t ts; /* time when the frame was read (ns, monotonic) */
 } midi_frame_t;
 
 /* max count of frames in midi_frames_t */
@@ -69,8 +74,13 @@ typedef enum midi_reader_flags_t
 {
 	MIDIR_NONE = 0,
 	MIDIR_DEBUG = 1, /* show frame content when it is read */
-	MIDIR_EXPAND = 2, /* expand running status frames */
+	MIDIR_EXPAND = 2, /* expand running status frames; each message is
+			   * then completed as soon as its last byte is
+			   * read */
 	MIDIR_DUMPHEX = 4, /* dump in hex format, not binary */
+	MIDIR_NOQUEUE = 16, /* do not store frames in the internal queue */
+	MIDIR_RAW = 32, /* do not parse: give the bytes read to the raw
+			 * callback */
 } midi_reader_flags_t;
 
 /* User callback function called each time a MIDI frame is read and validated.
@@ -82,6 +92,62 @@ typedef enum midi_reader_flags_t
 typedef midi_frame_state_t (*midi_reader_callback_t) (midi_frame_t* mf,
 							void *user_data);
 
+/* Tap function, called with each frame accepted by the reader (after the
+ * user callback, before the frame is dump'ed and queued). Taps must not
+ * change the frame and are called from the thread reading the sources.
+ */
+typedef void (*midi_reader_tap_t) (const midi_frame_t *mf, void *user_data);
+
+/* User callback function called in raw mode (MIDIR_RAW) with each chunk of
+ * 'len' bytes read at once from source 'source' at time 'ts' (ns,
+ * monotonic). The bytes are not checked and may hold partial frames.
+ */
+typedef void (*midi_reader_raw_callback_t) (const unsigned char *buf,
+						int len, int source,
+						uint64_t ts, void *user_data);
+
+/* Filter function of a source, called with each frame parsed from it after
+ * the channel of the source is applied, before the user callback. It stores
+ * in 'out' the frames to give in place of 'mf' (at most
+ * MIDI_READER_FILTER_OUT, changed or not) and returns their count, 0 to skip
+ * the frame. Filters are called from the thread reading the sources.
+ */
+typedef int (*midi_reader_filter_t) (const midi_frame_t *mf,
+					midi_frame_t *out, void *user_data);
+
+/* Clock function giving the time (ns) of the timestamps of the frames. */
+typedef uint64_t (*midi_reader_clock_t) (void *arg);
+
+/* max count of taps */
+#define MIDI_READER_TAPS_MAX	8
+
+/* max count of filters and of taps of a source */
+#define MIDI_READER_HOOKS_MAX	4
+
+/* max count of frames given by a filter */
+#define MIDI_READER_FILTER_OUT	16
+
+/* a tap and its argument */
+typedef struct midi_reader_tap_entry_t {
+	midi_reader_tap_t fn; /* tap function */
+	void *user_data; /* user data for tap */
+} midi_reader_tap_entry_t;
+
+/* a filter and its argument */
+typedef struct midi_reader_filter_entry_t {
+	midi_reader_filter_t fn; /* filter function */
+	void *user_data; /* user data for filter */
+} midi_reader_filter_entry_t;
+
+/* Writer of the dump in a format of its own (see midi_capture_set_dump),
+ * given the frames instead of the dump file.
+ */
+typedef struct midi_reader_writer_t {
+	bool (*write) (void *w, const midi_frame_t *mf); /* write a frame */
+	bool (*flush) (void *w); /* write buffered data */
+	void (*close) (void *w); /* conclude the dump and free the writer */
+} midi_reader_writer_t;
+
 /* max length of read buffer */
 #define MIDI_READER_BUF_MAX	256
 
@@ -95,14 +161,21 @@ typedef unsigned char midi_reader_buf_t[MIDI_READER_BUF_MAX];
 typedef struct midi_reader_stats_t
 {
 	unsigned long read; /* count of frames read */
+	unsigned long chunks; /* count of chunks read in raw mode */
 	unsigned long errors; /* count of erroneous incoming frames */
 	unsigned long skipped; /* count of frames read but skipped */
 	unsigned long missed; /* frames not stored in queue */
+	unsigned long queued_max; /* most frames waiting in the queue at
+				   * once (cumulated stats only); frames are
+				   * missed when MIDI_READER_FRAMES_MAX were
+				   * stored since the queue was last empty */
 } midi_reader_stats_t;
 
 /* source of data */
 typedef struct midi_reader_source_t {
 	int fd; /* file descriptors to read from */
+	int id; /* source id, reported in frames */
+	uint64_t ts; /* time of the last read */
 	unsigned char running; /* current running status command or 0 */
 	midi_reader_buf_t buf; /* input buffer */
 	int buf_len; /* current buf length */
@@ -110,6 +183,10 @@ typedef struct midi_reader_source_t {
 	int push_back; /* byte pushed-back or -1 if none */
 	midi_frame_t current; /* frame being parsed */
 	int channel; /* if 1-16, channel to update */
+	midi_reader_filter_entry_t filters[MIDI_READER_HOOKS_MAX]; /* filters */
+	int nfilters; /* count of filters */
+	midi_reader_tap_entry_t taps[MIDI_READER_HOOKS_MAX]; /* source taps */
+	int ntaps; /* count of source taps */
 	midi_reader_stats_t stats;
 } midi_reader_source_t;
 
@@ -119,12 +196,21 @@ typedef struct midi_reader_t
 	midi_reader_flags_t flags; /* reader flags */
 	midi_reader_source_t sources[MIDI_READER_IN_MAX]; /* input sources */
 	int nsources; /* count of input devices */
+	int next_id; /* id of the next added source */
 	int dumpfd; /* dump file descriptor */
+	const midi_reader_writer_t *writer; /* dump writer or NULL */
+	void *writer_data; /* argument of the dump writer */
 	midi_frames_t frames; /* frames that were read */
 	const unsigned char *to_skip; /* status bytes to skip */
 	midi_reader_callback_t callback; /* callback function */
 	void *user_data; /* user data for callback */
+	midi_reader_tap_entry_t taps[MIDI_READER_TAPS_MAX]; /* taps */
+	int ntaps; /* count of taps */
+	midi_reader_raw_callback_t raw_callback; /* raw mode callback */
+	void *raw_user_data; /* user data for raw_callback */
 	midi_reader_stats_t total; /* cumulated stats */
+	midi_reader_clock_t clock; /* clock of the timestamps */
+	void *clock_arg; /* argument of the clock */
 } midi_reader_t;
 
 /* list of possible MIDI frames length indexed by the status byte.
@@ -143,6 +229,13 @@ static const int midi_frame_len[128] = {
 	/* F8 system real-time */ 1, 1, 1, 1, 1, 1, 1, 1
 };
 
+/* Bit of a status byte in a 128-bits type bitmap: channel messages have a
+ * bit per type and channel (0..111), system messages a bit each (112..127).
+ */
+#define MIDI_STATUS_BIT(status) \
+	((status) >= 0xf0 ? 112 + ((status) & 0x0f) : \
+	(((status) >> 4) - 8) * 16 + ((status) & 0x0f))
+
 /* Get the version of the library as a 3-digits number (100, 101,..). */
 int midi_reader_get_version ();
 
@@ -170,8 +263,65 @@ midi_reader_add_source_path (midi_reader_t *reader,
 bool
 midi_reader_remove_source (midi_reader_t *reader, int fd);
 
+/* Add a filter function with optional argument to the source reading from
+ * 'fd' (transforms, assemblers, .. see midi_xform.h and midi_hires.h).
+ * Filters are called in the order they were added, each with the frames
+ * given by the previous one; with MIDIR_EXPAND, the frames given by the last
+ * one are expanded again. Returns false if there is no such source or if it
+ * has too many filters.
+ */
+bool
+midi_reader_add_filter (midi_reader_t *reader, int fd,
+			midi_reader_filter_t filter, void *user_data);
+
+/* Remove a filter function added with the same argument to the source
+ * reading from 'fd'. Returns false if not found.
+ */
+bool
+midi_reader_remove_filter (midi_reader_t *reader, int fd,
+				midi_reader_filter_t filter, void *user_data);
+
+/* Add a tap function with optional argument to the source reading from 'fd'
+ * (state mirrors, .. see midi_state.h): it sees the frames of this source
+ * accepted by the user callback, before the taps of the reader. Returns
+ * false if there is no such source or if it has too many taps.
+ */
+bool
+midi_reader_add_source_tap (midi_reader_t *reader, int fd,
+				midi_reader_tap_t tap, void *user_data);
+
+/* Remove a tap function added with the same argument to the source reading
+ * from 'fd'. Returns false if not found.
+ */
+bool
+midi_reader_remove_source_tap (midi_reader_t *reader, int fd,
+				midi_reader_tap_t tap, void *user_data);
+
+/* Get the id of the source reading from 'fd', or -1 if none. Ids are given
+ * in order of addition, starting at 0, and are reported in the frames.
+ */
+int
+midi_reader_get_source_id (midi_reader_t *reader, int fd);
+
+/* Get the current time of the reader (ns), as used for the frame
+ * timestamps: CLOCK_MONOTONIC, or the clock set by midi_reader_set_clock.
+ * Without reader, the time is that of CLOCK_MONOTONIC.
+ */
+uint64_t
+midi_reader_get_time (midi_reader_t *reader);
+
+/* Set the clock of the timestamps of the frames (see midi_clock.h), or
+ * the default CLOCK_MONOTONIC if 'clock' is NULL. 'arg' is given to the
+ * clock and must stay valid while set.
+ */
+void
+midi_reader_set_clock (midi_reader_t *reader, midi_reader_clock_t clock,
+			void *arg);
+
 /* Set the file descriptor where to dump frames. Dump file will be closed if
  * function "midi_reader_close" is called.
+ * In raw mode (MIDIR_RAW), the chunks read are dump'ed as-is: flag
+ * MIDIR_DUMPHEX is then refused.
  * Returns false on error.
  */
 bool
@@ -196,6 +346,45 @@ void
 midi_reader_set_callback (midi_reader_t *reader,
 			midi_reader_callback_t cb, void *user_data);
 
+/* Set the callback used in raw mode (MIDIR_RAW). In this mode the sources
+ * are read by "midi_reader_update" as usual, but each chunk read is given
+ * as-is to the callback and written to the dump file, no frame is parsed
+ * nor queued, and the stats count the chunks (field 'chunks').
+ */
+void
+midi_reader_set_raw_callback (midi_reader_t *reader,
+				midi_reader_raw_callback_t cb,
+				void *user_data);
+
+/* Set the writer of the dump, given the frames instead of the dump file
+ * until it is replaced or the reader is closed, when function 'close' of
+ * the writer is called; NULL for none. Refused in raw mode (MIDIR_RAW).
+ * Returns false on error.
+ */
+bool
+midi_reader_set_dump_writer (midi_reader_t *reader,
+				const midi_reader_writer_t *writer, void *w);
+
+/* Write buffered dump data, if any. Returns false on error. */
+bool
+midi_reader_flush_dump (midi_reader_t *reader);
+
+/* Add a tap function with optional argument, so that several consumers
+ * (recorders, ..) may see the frames besides the callback and the queue.
+ * With flag MIDIR_NOQUEUE, the frames are only given to the callback, the
+ * taps and the dump file. Returns false if there are too many taps.
+ */
+bool
+midi_reader_add_tap (midi_reader_t *reader, midi_reader_tap_t tap,
+			void *user_data);
+
+/* Remove a tap function added with the same argument. Returns false if not
+ * found.
+ */
+bool
+midi_reader_remove_tap (midi_reader_t *reader, midi_reader_tap_t tap,
+			void *user_data);
+
 /* Close a MIDI reader. Note that "midi_reader_get_next" may be called after
  * this until the frames already read and stored in the internal buffer are
  * exhausted, but no new frame will be read.
@@ -225,6 +414,30 @@ midi_reader_inject (midi_reader_t *reader, midi_frame_t *mf);
 int
 midi_reader_inject_bytes (midi_reader_t *reader, int n, ...);
 
+/* Initialize a parsing state for "midi_reader_parse"; frames parsed thru
+ * it will have source id 'id'.
+ */
+void
+midi_reader_init_source (midi_reader_source_t *src, int id);
+
+/* Parse 'len' bytes read at time 'ts' (ns) thru the parsing state 'src',
+ * which is kept between calls (running status, pending frame). Complete
+ * frames are processed as if read from a source. With 'end' set, a pending
+ * running-status frame is concluded. Returns the count of frames completed.
+ */
+int
+midi_reader_parse (midi_reader_t *reader, midi_reader_source_t *src,
+			const unsigned char *buf, int len, uint64_t ts,
+			bool end);
+
+/* Read all sources once and parse all the bytes read, unlike
+ * "midi_reader_update" which handles one byte per source. Frames go to the
+ * taps, callback and queue as usual. With MIDIR_RAW, this is the same as
+ * "midi_reader_update". Returns the count of frames completed.
+ */
+int
+midi_reader_pump (midi_reader_t *reader);
+
 /* Reset a MIDI frame. */
 void
 midi_frame_reset (midi_frame_t* mf);
@@ -242,6 +455,12 @@ midi_reader_update (midi_reader_t *reader);
 midi_frame_t*
 midi_reader_get_next (midi_reader_t *reader);
 
+/* Return the next frame of the internal queue without reading the sources
+ * (after "midi_reader_pump", ..), or NULL if none.
+ */
+midi_frame_t*
+midi_reader_pop (midi_reader_t *reader);
+
 /* Remove all recorded frames. */
 void
 midi_reader_clear_queue (midi_reader_t *reader);
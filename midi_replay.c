@@ -0,0 +1,290 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+#include "midi_replay.h"
+
+/* mapped bytes replayed before releasing them */
+#define MIDI_REPLAY_RELEASE	(16 * 1024 * 1024)
+
+/* maximal time of a single wait, so that a stop request is seen */
+#define MIDI_REPLAY_WAIT_MAX	100000000ULL
+
+static uint64_t
+midi_replay_now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+bool
+midi_replay_open (midi_replay_t *replay, const char *path)
+{
+	if (replay == NULL)
+		return (false);
+	memset (replay, 0, sizeof (midi_replay_t));
+	replay->timerfd = -1;
+	replay->speed = 1.0;
+	if ( ! midi_capture_open (&replay->cap, path))
+		return (false);
+#ifdef __linux__
+	replay->timerfd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+#endif
+	return (true);
+}
+
+void
+midi_replay_close (midi_replay_t *replay)
+{
+	if (replay) {
+		midi_capture_close (&replay->cap);
+		if (replay->timerfd > -1)
+			close (replay->timerfd);
+		replay->timerfd = -1;
+	}
+}
+
+bool
+midi_replay_set_mode (midi_replay_t *replay, midi_replay_mode_t mode,
+			double speed)
+{
+	if (replay == NULL || (mode == MIDI_REPLAY_SCALED && ! (speed > 0.0)))
+		return (false);
+	replay->mode = mode;
+	replay->speed = mode == MIDI_REPLAY_SCALED ? speed : 1.0;
+	return (true);
+}
+
+void
+midi_replay_set_range (midi_replay_t *replay, uint64_t from, uint64_t to)
+{
+	if (replay) {
+		replay->from = from;
+		replay->to = to;
+	}
+}
+
+void
+midi_replay_set_reader (midi_replay_t *replay, midi_reader_t *reader)
+{
+	if (replay)
+		replay->reader = reader;
+}
+
+void
+midi_replay_set_callback (midi_replay_t *replay,
+			midi_replay_callback_t cb, void *user_data)
+{
+	if (replay) {
+		replay->callback = cb;
+		replay->user_data = user_data;
+	}
+}
+
+void
+midi_replay_stop (midi_replay_t *replay)
+{
+	if (replay)
+		__atomic_store_n (&replay->stop, 1, __ATOMIC_RELEASE);
+}
+
+/* Wait until the absolute time 'deadline' (ns, monotonic). */
+static void
+midi_replay_wait (midi_replay_t *replay, uint64_t deadline)
+{
+	uint64_t now;
+
+	while ( ! __atomic_load_n (&replay->stop, __ATOMIC_ACQUIRE)) {
+		uint64_t t;
+
+		now = midi_replay_now ();
+		if (now >= deadline)
+			return;
+		t = deadline - now > MIDI_REPLAY_WAIT_MAX ?
+			now + MIDI_REPLAY_WAIT_MAX : deadline;
+#ifdef __linux__
+		if (replay->timerfd > -1) {
+			struct itimerspec its;
+			uint64_t expirations;
+
+			memset (&its, 0, sizeof (its));
+			its.it_value.tv_sec = t / 1000000000ULL;
+			its.it_value.tv_nsec = t % 1000000000ULL;
+			if (timerfd_settime (replay->timerfd, TFD_TIMER_ABSTIME,
+						&its, NULL) == 0) {
+				if (read (replay->timerfd, &expirations,
+					sizeof (expirations)) < 0 &&
+					errno != EINTR)
+					break;
+				continue;
+			}
+		}
+#endif
+		{
+			struct timespec ts;
+
+			ts.tv_sec = t / 1000000000ULL;
+			ts.tv_nsec = t % 1000000000ULL;
+			clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME,
+						&ts, NULL);
+		}
+	}
+}
+
+/* Release the mapped pages already replayed. */
+static void
+midi_replay_release (midi_replay_t *replay)
+{
+	size_t done, page;
+
+	if (replay->cap.p == NULL)
+		return;
+	done = (size_t) (replay->cap.p - replay->cap.map);
+	if (done < replay->released + MIDI_REPLAY_RELEASE)
+		return;
+	page = (size_t) sysconf (_SC_PAGESIZE);
+	done -= done % page;
+	madvise ((void *) replay->cap.map, done, MADV_DONTNEED);
+	replay->released = done;
+}
+
+static void
+midi_replay_account (midi_replay_t *replay, uint64_t late)
+{
+	midi_replay_stats_t *st = &replay->stats;
+	int h;
+
+	if (st->frames == 0 || late < st->late_min)
+		st->late_min = late;
+	if (late > st->late_max)
+		st->late_max = late;
+	st->late_sum += late;
+	if (late < 10000)
+		h = 0;
+	else if (late < 100000)
+		h = 1;
+	else if (late < 1000000)
+		h = 2;
+	else if (late < 10000000)
+		h = 3;
+	else
+		h = 4;
+	st->hist[h]++;
+	st->frames++;
+}
+
+bool
+midi_replay_run (midi_replay_t *replay)
+{
+	midi_frame_t mf;
+	uint64_t t0_cap = 0, t0, deadline, now;
+	bool first = true, ok = true;
+
+	if (replay == NULL || replay->cap.map == NULL)
+		return (false);
+	memset (&replay->stats, 0, sizeof (midi_replay_stats_t));
+	__atomic_store_n (&replay->stop, 0, __ATOMIC_RELEASE);
+	replay->released = 0;
+	madvise ((void *) replay->cap.map, replay->cap.size, MADV_SEQUENTIAL);
+	if ( ! midi_capture_seek (&replay->cap, replay->from))
+		return (true);
+
+	t0 = midi_replay_now ();
+	while ( ! __atomic_load_n (&replay->stop, __ATOMIC_ACQUIRE) &&
+		midi_capture_next (&replay->cap, &mf)) {
+		if (replay->to && mf.ts > replay->to)
+			break;
+		if (first) {
+			t0_cap = mf.ts;
+			first = false;
+		}
+
+		/* pacing */
+		if (replay->mode == MIDI_REPLAY_ASAP)
+			deadline = midi_replay_now ();
+		else {
+			deadline = t0 + (uint64_t) ((double) (mf.ts - t0_cap) /
+							replay->speed);
+			midi_replay_wait (replay, deadline);
+		}
+		now = midi_replay_now ();
+
+		/* dispatch */
+		if (replay->reader &&
+			midi_reader_inject (replay->reader, &mf) != mf.len)
+			replay->stats.errors++;
+		if (replay->callback &&
+			! replay->callback (&mf, replay->user_data)) {
+			ok = false;
+			break;
+		}
+		midi_replay_account (replay, now > deadline ? now - deadline : 0);
+		midi_replay_release (replay);
+	}
+	replay->stats.duration = midi_replay_now () - t0;
+	madvise ((void *) replay->cap.map, replay->cap.size, MADV_NORMAL);
+	return (ok);
+}
+
+void
+midi_replay_get_stats (midi_replay_t *replay, midi_replay_stats_t *stats)
+{
+	if (replay && stats)
+		*stats = replay->stats;
+}
+
+void
+midi_replay_dump_stats (midi_replay_t *replay, int fd)
+{
+	static const char *hist[MIDI_REPLAY_HIST_MAX] = {
+		"< 10us", "< 100us", "< 1ms", "< 10ms", ">= 10ms"
+	};
+	midi_replay_stats_t *st;
+
+	if (replay == NULL || fd < 0)
+		return;
+	st = &replay->stats;
+	dprintf (fd, "frames: %lu, errors: %lu, duration: %.3f s\n",
+		st->frames, st->errors, (double) st->duration / 1e9);
+	if (st->frames == 0)
+		return;
+	dprintf (fd, "lateness: min %.1f us, mean %.1f us, max %.1f us\n",
+		(double) st->late_min / 1e3,
+		(double) st->late_sum / (double) st->frames / 1e3,
+		(double) st->late_max / 1e3);
+	for (int i = 0; i < MIDI_REPLAY_HIST_MAX; i++)
+		dprintf (fd, "  %-8s %lu\n", hist[i], st->hist[i]);
+}
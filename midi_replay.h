@@ -0,0 +1,145 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_REPLAY_H
+#define MIDI_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+#include "midi_capture.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* pacing of a replay */
+typedef enum midi_replay_mode_t {
+	MIDI_REPLAY_ORIGINAL = 0, /* original timing */
+	MIDI_REPLAY_SCALED = 1, /* original timing divided by a speed factor */
+	MIDI_REPLAY_ASAP = 2, /* as fast as possible */
+} midi_replay_mode_t;
+
+/* User callback function called for each replayed frame. The replay stops
+ * if it returns false.
+ */
+typedef bool (*midi_replay_callback_t) (const midi_frame_t *mf,
+					void *user_data);
+
+/* count of buckets in the lateness histogram: < 10us, < 100us, < 1ms,
+ * < 10ms, >= 10ms */
+#define MIDI_REPLAY_HIST_MAX	5
+
+/* statistics of a replay. Lateness is the time between the scheduled
+ * dispatch time of a frame and the time it was dispatched (ns).
+ */
+typedef struct midi_replay_stats_t {
+	unsigned long frames; /* count of dispatched frames */
+	unsigned long errors; /* frames refused by the sinks */
+	uint64_t late_min; /* minimal lateness */
+	uint64_t late_max; /* maximal lateness */
+	uint64_t late_sum; /* sum of lateness, for the mean */
+	unsigned long hist[MIDI_REPLAY_HIST_MAX]; /* lateness histogram */
+	uint64_t duration; /* duration of the replay */
+} midi_replay_stats_t;
+
+/* replay of a capture file */
+typedef struct midi_replay_t {
+	midi_capture_t cap; /* the capture, memory-mapped */
+	midi_replay_mode_t mode; /* pacing */
+	double speed; /* speed factor for MIDI_REPLAY_SCALED */
+	uint64_t from; /* replay frames from this time... */
+	uint64_t to; /* ...up to this time (0: end of capture) */
+	midi_reader_t *reader; /* reader to inject frames into, or NULL */
+	midi_replay_callback_t callback; /* user callback, or NULL */
+	void *user_data; /* user data for callback */
+	int timerfd; /* timer used for pacing, or -1 */
+	int stop; /* set to stop the replay */
+	size_t released; /* mapped bytes already released */
+	midi_replay_stats_t stats;
+} midi_replay_t;
+
+/* Open the capture file 'path' for replay, in original timing. Returns
+ * false on failure.
+ */
+bool
+midi_replay_open (midi_replay_t *replay, const char *path);
+
+/* Close a replay. */
+void
+midi_replay_close (midi_replay_t *replay);
+
+/* Set the pacing. 'speed' is used with MIDI_REPLAY_SCALED (2.0 replays
+ * twice faster). Returns false if the speed is invalid.
+ */
+bool
+midi_replay_set_mode (midi_replay_t *replay, midi_replay_mode_t mode,
+			double speed);
+
+/* Replay only the frames from time 'from' up to 'to' (capture time, ns; 0
+ * for no limit).
+ */
+void
+midi_replay_set_range (midi_replay_t *replay, uint64_t from, uint64_t to);
+
+/* Inject the frames into 'reader' (NULL for none) with
+ * "midi_reader_inject".
+ */
+void
+midi_replay_set_reader (midi_replay_t *replay, midi_reader_t *reader);
+
+/* Set a user callback called for each frame (NULL for none). */
+void
+midi_replay_set_callback (midi_replay_t *replay,
+			midi_replay_callback_t cb, void *user_data);
+
+/* Run the replay until the end of the capture or the range, or until
+ * "midi_replay_stop" is called. Memory use does not depend on the size of
+ * the capture, since the pages already replayed are released.
+ * Returns false on error (corrupted capture, callback returned false).
+ */
+bool
+midi_replay_run (midi_replay_t *replay);
+
+/* Stop a running replay. May be called from another thread or a signal
+ * handler.
+ */
+void
+midi_replay_stop (midi_replay_t *replay);
+
+/* Get the statistics of the last replay. */
+void
+midi_replay_get_stats (midi_replay_t *replay, midi_replay_stats_t *stats);
+
+/* Print the statistics of the last replay to a file descriptor. */
+void
+midi_replay_dump_stats (midi_replay_t *replay, int fd);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_REPLAY_H */
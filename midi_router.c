@@ -0,0 +1,349 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "midi_router.h"
+#include "midi_xform.h"
+
+/* count of lists in the compiled table: one per status bit of each source,
+ * then of the other sources */
+#define MIDI_ROUTER_LISTS	((MIDI_ROUTER_SOURCES_MAX + 1) * 128)
+
+void
+midi_router_init (midi_router_t *r)
+{
+	if (r)
+		memset (r, 0, sizeof (midi_router_t));
+}
+
+void
+midi_router_destroy (midi_router_t *r)
+{
+	if (r == NULL)
+		return;
+	for (int i = 0; i < r->noutputs; i++)
+		pthread_mutex_destroy (&r->outputs[i].lock);
+	free (r->first);
+	free (r->list);
+	memset (r, 0, sizeof (midi_router_t));
+}
+
+int
+midi_router_add_output (midi_router_t *r, midi_router_output_t fn,
+			void *user_data)
+{
+	midi_router_out_t *o;
+
+	if (r == NULL || fn == NULL || r->noutputs >= MIDI_ROUTER_OUTPUTS_MAX)
+		return (-1);
+	o = &r->outputs[r->noutputs];
+	o->fn = fn;
+	o->user_data = user_data;
+	pthread_mutex_init (&o->lock, NULL);
+	return (r->noutputs++);
+}
+
+void
+midi_router_route_init (midi_router_route_t *route, int source, int output)
+{
+	if (route) {
+		memset (route, 0, sizeof (midi_router_route_t));
+		route->source = source;
+		route->output = output;
+		route->types[0] = route->types[1] = UINT64_MAX;
+		route->d1_max = 0x7f;
+		route->d2_max = 0x7f;
+		route->velocity = 64;
+	}
+}
+
+void
+midi_router_route_add_type (midi_router_route_t *route, unsigned char status,
+				int channel)
+{
+	int bit, ch;
+
+	if (route == NULL || status < 0x80)
+		return;
+	if (route->types[0] == UINT64_MAX && route->types[1] == UINT64_MAX)
+		route->types[0] = route->types[1] = 0;
+	for (ch = 0; ch < 16; ch++) {
+		if (status < 0xf0) {
+			if (channel >= 1 && channel <= 16 && ch != channel - 1)
+				continue;
+			bit = MIDI_STATUS_BIT ((status & 0xf0) | ch);
+		}
+		else if (ch == 0)
+			bit = MIDI_STATUS_BIT (status);
+		else
+			break;
+		route->types[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+int
+midi_router_add_route (midi_router_t *r, const midi_router_route_t *route)
+{
+	if (r == NULL || route == NULL ||
+		r->nroutes >= MIDI_ROUTER_ROUTES_MAX ||
+		route->output < 0 || route->output >= r->noutputs ||
+		route->source < -1 || route->source >= MIDI_ROUTER_SOURCES_MAX ||
+		route->channel < 0 || route->channel > 16)
+		return (-1);
+	r->routes[r->nroutes] = *route;
+	return (r->nroutes++);
+}
+
+void
+midi_router_clear_routes (midi_router_t *r)
+{
+	if (r) {
+		r->nroutes = 0;
+		free (r->first);
+		r->first = NULL;
+		free (r->list);
+		r->list = NULL;
+	}
+}
+
+/* Check if route 'k' applies to list 'n' (source * 128 + status bit). */
+static inline bool
+midi_router_applies (const midi_router_route_t *route, int n)
+{
+	int src = n / 128, bit = n % 128;
+
+	return ((route->source == -1 || route->source == src) &&
+		(route->types[bit >> 6] & (1ULL << (bit & 63))));
+}
+
+bool
+midi_router_compile (midi_router_t *r)
+{
+	uint32_t *first, total = 0;
+	unsigned char *list;
+	int n, k;
+
+	if (r == NULL)
+		return (false);
+	first = (uint32_t *) malloc ((MIDI_ROUTER_LISTS + 1) *
+					sizeof (uint32_t));
+	if (first == NULL)
+		return (false);
+	for (n = 0; n < MIDI_ROUTER_LISTS; n++) {
+		first[n] = total;
+		for (k = 0; k < r->nroutes; k++) {
+			if (midi_router_applies (&r->routes[k], n))
+				total++;
+		}
+	}
+	first[MIDI_ROUTER_LISTS] = total;
+	list = (unsigned char *) malloc (total ? total : 1);
+	if (list == NULL) {
+		free (first);
+		return (false);
+	}
+	for (n = 0, total = 0; n < MIDI_ROUTER_LISTS; n++) {
+		for (k = 0; k < r->nroutes; k++) {
+			if (midi_router_applies (&r->routes[k], n))
+				list[total++] = (unsigned char) k;
+		}
+	}
+	free (r->first);
+	free (r->list);
+	r->first = first;
+	r->list = list;
+	return (true);
+}
+
+void
+midi_router_ctx_init (midi_router_ctx_t *ctx, midi_router_t *r)
+{
+	if (ctx) {
+		ctx->router = r;
+		memset (ctx->len, 0, sizeof (ctx->len));
+		memset (ctx->count, 0, sizeof (ctx->count));
+		ctx->pending = 0;
+		memset (&ctx->stats, 0, sizeof (midi_router_stats_t));
+	}
+}
+
+/* Give the batch of output 'o' to the output. */
+static void
+midi_router_flush_output (midi_router_ctx_t *ctx, int o)
+{
+	midi_router_out_t *out = &ctx->router->outputs[o];
+
+	pthread_mutex_lock (&out->lock);
+	out->fn (ctx->buf[o], ctx->len[o], ctx->count[o], out->user_data);
+	pthread_mutex_unlock (&out->lock);
+	ctx->stats.batches++;
+	ctx->len[o] = 0;
+	ctx->count[o] = 0;
+	ctx->pending &= ~(1U << o);
+}
+
+/* Add a message to the batch of a route, with its simple transforms. */
+static inline bool
+midi_router_append (midi_router_ctx_t *ctx, const midi_router_route_t *route,
+			const midi_frame_t *mf)
+{
+	unsigned char *p, st = mf->data[0];
+	int o = route->output, v;
+
+	if (ctx->len[o] + mf->len > MIDI_ROUTER_BATCH_MAX)
+		midi_router_flush_output (ctx, o);
+	p = ctx->buf[o] + ctx->len[o];
+	memcpy (p, mf->data, mf->len);
+	if (st < 0xf0) {
+		if (route->channel)
+			p[0] = (unsigned char) ((st & 0xf0) | (route->channel - 1));
+		if (route->transpose && st < 0xb0 && mf->len > 1) {
+			v = p[1] + route->transpose;
+			if (v < 0 || v > 0x7f)
+				return (false);
+			p[1] = (unsigned char) v;
+		}
+		if (route->velocity != 64 && (st & 0xf0) == 0x90 &&
+			mf->len > 2 && p[2] > 0) {
+			v = (int) ((p[2] * route->velocity + 32) / 64);
+			p[2] = (unsigned char) (v < 1 ? 1 : v > 0x7f ? 0x7f : v);
+		}
+	}
+	ctx->len[o] += mf->len;
+	ctx->count[o]++;
+	ctx->pending |= 1U << o;
+	ctx->stats.messages++;
+	return (true);
+}
+
+/* Apply a route to a frame and add the messages to the batch. */
+static inline bool
+midi_router_apply (midi_router_ctx_t *ctx, const midi_router_route_t *route,
+			const midi_frame_t *mf)
+{
+	midi_frame_t out[16];
+	int i, n;
+	bool sent = false;
+
+	if (mf->data[0] < 0xf0) {
+		if ((mf->len > 1 && (mf->data[1] < route->d1_min ||
+					mf->data[1] > route->d1_max)) ||
+			(mf->len > 2 && (mf->data[2] < route->d2_min ||
+					mf->data[2] > route->d2_max)))
+			return (false);
+	}
+	if (route->xform == NULL)
+		return (midi_router_append (ctx, route, mf));
+	n = midi_xform_apply (route->xform, mf, out);
+	for (i = 0; i < n; i++) {
+		if (midi_router_append (ctx, route, &out[i]))
+			sent = true;
+	}
+	return (sent);
+}
+
+void
+midi_router_route (midi_router_ctx_t *ctx, const midi_frame_t *mf)
+{
+	midi_router_t *r;
+	uint32_t i, end;
+	int n;
+	bool sent = false;
+
+	if (ctx == NULL || (r = ctx->router) == NULL || r->first == NULL ||
+		mf == NULL || mf->len == 0 || mf->data[0] < 0x80)
+		return;
+	ctx->stats.frames++;
+	n = (mf->source >= 0 && mf->source < MIDI_ROUTER_SOURCES_MAX ?
+		mf->source : MIDI_ROUTER_SOURCES_MAX) * 128 +
+		MIDI_STATUS_BIT (mf->data[0]);
+	for (i = r->first[n], end = r->first[n + 1]; i < end; i++) {
+		if (midi_router_apply (ctx, &r->routes[r->list[i]], mf))
+			sent = true;
+	}
+	if ( ! sent)
+		ctx->stats.dropped++;
+}
+
+void
+midi_router_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_router_route ((midi_router_ctx_t *) user_data, mf);
+}
+
+void
+midi_router_flush (midi_router_ctx_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+	for (int o = 0; ctx->pending != 0; o++) {
+		if (ctx->pending & (1U << o))
+			midi_router_flush_output (ctx, o);
+	}
+}
+
+bool
+midi_router_run (midi_router_ctx_t *ctx, midi_reader_t *reader,
+			const int *stop, int timeout)
+{
+	struct pollfd pfd[MIDI_READER_IN_MAX];
+	int i, r, hup;
+	bool ok = true;
+
+	if (ctx == NULL || reader == NULL || stop == NULL ||
+		! midi_reader_add_tap (reader, midi_router_tap, ctx))
+		return (false);
+	while ( ! __atomic_load_n (stop, __ATOMIC_ACQUIRE)) {
+		for (i = 0; i < reader->nsources; i++) {
+			pfd[i].fd = reader->sources[i].fd;
+			pfd[i].events = POLLIN | POLLPRI;
+			pfd[i].revents = 0;
+		}
+		r = poll (pfd, reader->nsources, timeout);
+		if (r < 0 && errno != EINTR) {
+			ok = false;
+			break;
+		}
+		if (r > 0) {
+			midi_reader_pump (reader);
+			midi_router_flush (ctx);
+		}
+		/* end of all inputs */
+		for (i = hup = 0; r > 0 && i < reader->nsources; i++) {
+			if ((pfd[i].revents & (POLLHUP | POLLERR | POLLNVAL)) &&
+				! (pfd[i].revents & POLLIN))
+				hup++;
+		}
+		if (reader->nsources > 0 && hup == reader->nsources)
+			break;
+	}
+	midi_reader_remove_tap (reader, midi_router_tap, ctx);
+	return (ok);
+}
@@ -0,0 +1,195 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_ROUTER_H
+#define MIDI_ROUTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* limits of a router */
+#define MIDI_ROUTER_OUTPUTS_MAX	16
+#define MIDI_ROUTER_ROUTES_MAX	64
+
+/* sources with an id from 0 to MIDI_ROUTER_SOURCES_MAX - 1 have their own
+ * routes; other sources (injected frames, ..) only use routes of all
+ * sources */
+#define MIDI_ROUTER_SOURCES_MAX	MIDI_READER_IN_MAX
+
+/* size of the batch of each output */
+#define MIDI_ROUTER_BATCH_MAX	1024
+
+/* Output function called with a batch of 'count' complete messages, of
+ * 'len' bytes in total. Calls for the same output are serialized.
+ */
+typedef void (*midi_router_output_t) (const unsigned char *buf, uint32_t len,
+					uint32_t count, void *user_data);
+
+/* A route from a source to an output. The filters apply to channel
+ * messages; the transforms are applied in this order: the compiled
+ * transform, if any (see midi_xform.h), then channel, transpose and
+ * velocity.
+ */
+typedef struct midi_router_route_t {
+	int source; /* source id, or -1 for all sources */
+	int output; /* index of the output */
+	uint64_t types[2]; /* accepted status bytes (MIDI_STATUS_BIT) */
+	unsigned char d1_min; /* range of the first data byte */
+	unsigned char d1_max;
+	unsigned char d2_min; /* range of the second data byte */
+	unsigned char d2_max;
+	int channel; /* new channel (1..16), or 0 to keep it */
+	int transpose; /* added to the note of note and key pressure
+			* messages; notes out of range are dropped */
+	unsigned int velocity; /* scale of the velocity of note on, in 64th
+				* (64: unchanged), clamped to 1..127 */
+	const struct midi_xform_t *xform; /* transform, or NULL; must stay
+					   * valid while the route is used */
+} midi_router_route_t;
+
+/* an output of a router */
+typedef struct midi_router_out_t {
+	midi_router_output_t fn; /* output function */
+	void *user_data; /* user data for fn */
+	pthread_mutex_t lock; /* serializes the calls of fn */
+} midi_router_out_t;
+
+/* Router connecting sources to outputs thru routes. Routes are compiled
+ * into a table giving, for each source and status byte, the list of the
+ * routes to apply, so that routing a frame only tests the data-byte
+ * filters of the routes it may take. Frames are routed by contexts, one
+ * per input thread, which batch the messages of each output until they
+ * are flushed, typically once per wakeup of the thread. Outputs and routes
+ * must be set and compiled while no context is routing.
+ */
+typedef struct midi_router_t {
+	midi_router_out_t outputs[MIDI_ROUTER_OUTPUTS_MAX]; /* outputs */
+	int noutputs; /* count of outputs */
+	midi_router_route_t routes[MIDI_ROUTER_ROUTES_MAX]; /* routes */
+	int nroutes; /* count of routes */
+	uint32_t *first; /* compiled: first entry of list of each source and
+			  * status, and end of list */
+	unsigned char *list; /* compiled: routes to apply */
+} midi_router_t;
+
+/* statistics of a routing context */
+typedef struct midi_router_stats_t {
+	unsigned long frames; /* count of frames routed */
+	unsigned long messages; /* count of messages sent to outputs */
+	unsigned long batches; /* count of calls of output functions */
+	unsigned long dropped; /* frames not matching any route */
+} midi_router_stats_t;
+
+/* Routing context of an input thread: batches of each output. */
+typedef struct midi_router_ctx_t {
+	midi_router_t *router; /* router */
+	unsigned char buf[MIDI_ROUTER_OUTPUTS_MAX][MIDI_ROUTER_BATCH_MAX];
+	uint32_t len[MIDI_ROUTER_OUTPUTS_MAX]; /* length of the batches */
+	uint32_t count[MIDI_ROUTER_OUTPUTS_MAX]; /* messages of the batches */
+	uint32_t pending; /* bitmap of the outputs having a batch */
+	midi_router_stats_t stats;
+} midi_router_ctx_t;
+
+/* Initialize a router without outputs or routes. */
+void
+midi_router_init (midi_router_t *r);
+
+/* Release the compiled routes. */
+void
+midi_router_destroy (midi_router_t *r);
+
+/* Add an output. Returns its index, or -1 on error. */
+int
+midi_router_add_output (midi_router_t *r, midi_router_output_t fn,
+			void *user_data);
+
+/* Initialize a route from 'source' (-1: all) to 'output', accepting all
+ * messages without transform.
+ */
+void
+midi_router_route_init (midi_router_route_t *route, int source, int output);
+
+/* Restrict the status bytes of a route: the first call replaces "all
+ * types" by 'status' only, the next ones add types. For channel messages,
+ * 'status' is a type (0x80 .. 0xe0) and 'channel' is 1 .. 16, or 0 for all
+ * channels; system messages (0xf0 .. 0xff) ignore 'channel'.
+ */
+void
+midi_router_route_add_type (midi_router_route_t *route, unsigned char status,
+				int channel);
+
+/* Add a route. Returns its index, or -1 on error. The routes are used once
+ * compiled.
+ */
+int
+midi_router_add_route (midi_router_t *r, const midi_router_route_t *route);
+
+/* Remove all routes. */
+void
+midi_router_clear_routes (midi_router_t *r);
+
+/* Compile the routes. Returns false on error. */
+bool
+midi_router_compile (midi_router_t *r);
+
+/* Initialize a routing context. */
+void
+midi_router_ctx_init (midi_router_ctx_t *ctx, midi_router_t *r);
+
+/* Route a frame, using its source id; the messages are batched. */
+void
+midi_router_route (midi_router_ctx_t *ctx, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap", with a context as argument. */
+void
+midi_router_tap (const midi_frame_t *mf, void *user_data);
+
+/* Give the batches to the outputs. */
+void
+midi_router_flush (midi_router_ctx_t *ctx);
+
+/* Route the frames of 'reader' until '*stop' is set or all its sources
+ * are closed, waiting for input at most 'timeout' ms at a time: the
+ * sources are read and parsed at once (midi_reader_pump), then the batches
+ * are flushed. The context is added as
+ * a tap of the reader while running; the reader should have MIDIR_NOQUEUE.
+ * Returns false on error.
+ */
+bool
+midi_router_run (midi_router_ctx_t *ctx, midi_reader_t *reader,
+			const int *stop, int timeout);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_ROUTER_H */
@@ -0,0 +1,1117 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "midi_smf.h"
+
+static bool
+midi_smf_write_all (int fd, const unsigned char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n > 0) {
+		r = write (fd, p, n);
+		if (r < 0 && errno == EINTR)
+			continue;
+		else if (r <= 0)
+			return (false);
+		p += r;
+		n -= (size_t) r;
+	}
+	return (true);
+}
+
+static inline void
+midi_smf_put32 (unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static inline void
+midi_smf_put16 (unsigned char *p, uint16_t v)
+{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+}
+
+/* Encode a variable-length quantity, returns its length (1..5). */
+static inline int
+midi_smf_put_vlq (unsigned char *p, uint32_t v)
+{
+	unsigned char tmp[5];
+	int n = 0, i;
+
+	do {
+		tmp[n++] = v & 0x7f;
+		v >>= 7;
+	} while (v && n < 5);
+	for (i = 0; i < n; i++)
+		p[i] = tmp[n - 1 - i] | (i < n - 1 ? 0x80 : 0);
+	return (n);
+}
+
+static uint64_t
+midi_smf_now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
+static bool
+midi_smf_track_flush (midi_smf_writer_t *w, midi_smf_track_t *t)
+{
+	if (t->buf_len > 0) {
+		if ( ! midi_smf_write_all (t->fd, t->buf, t->buf_len))
+			w->error = true;
+		t->buf_len = 0;
+	}
+	return ( ! w->error);
+}
+
+static void
+midi_smf_track_put (midi_smf_writer_t *w, midi_smf_track_t *t,
+			const unsigned char *p, uint32_t n)
+{
+	while (n > 0) {
+		uint32_t k = MIDI_SMF_BUF_MAX - t->buf_len;
+
+		if (k == 0) {
+			midi_smf_track_flush (w, t);
+			continue;
+		}
+		if (k > n)
+			k = n;
+		memcpy (t->buf + t->buf_len, p, k);
+		t->buf_len += k;
+		t->length += k;
+		w->stats.bytes += k;
+		p += k;
+		n -= k;
+	}
+}
+
+/* Write the delta time of an event at tick 'tick'. */
+static void
+midi_smf_track_delta (midi_smf_writer_t *w, midi_smf_track_t *t,
+			uint64_t tick)
+{
+	unsigned char vlq[5];
+	uint64_t delta = tick > t->tick ? tick - t->tick : 0;
+
+	/* a delta is at most 0x0fffffff ticks: split longer ones with an
+	 * empty text meta event */
+	while (delta > 0x0fffffff) {
+		static const unsigned char text[] = { 0xff, 0x01, 0x00 };
+
+		midi_smf_track_put (w, t, vlq,
+			(uint32_t) midi_smf_put_vlq (vlq, 0x0fffffff));
+		midi_smf_track_put (w, t, text, sizeof (text));
+		delta -= 0x0fffffff;
+		t->running = 0;
+	}
+	midi_smf_track_put (w, t, vlq,
+				(uint32_t) midi_smf_put_vlq (vlq, (uint32_t) delta));
+	if (tick > t->tick)
+		t->tick = tick;
+}
+
+static int
+midi_smf_spool ()
+{
+	char path[256];
+	const char *dir = getenv ("TMPDIR");
+	int fd;
+
+	snprintf (path, sizeof (path), "%s/rtmidi-smfXXXXXX",
+			dir && *dir ? dir : "/tmp");
+	fd = mkstemp (path);
+	if (fd > -1)
+		unlink (path);
+	return (fd);
+}
+
+static midi_smf_track_t *
+midi_smf_get_track (midi_smf_writer_t *w, int source)
+{
+	midi_smf_track_t *t;
+	int i;
+
+	if (w->format == 0)
+		return (&w->tracks[0]);
+	for (i = 0; i < w->ntracks; i++) {
+		if (w->tracks[i].source == source)
+			return (&w->tracks[i]);
+	}
+	if (w->ntracks == MIDI_SMF_TRACKS_MAX)
+		return (&w->tracks[MIDI_SMF_TRACKS_MAX - 1]);
+
+	/* new track, spooled into a temporary file */
+	t = &w->tracks[w->ntracks];
+	t->buf = (unsigned char *) malloc (MIDI_SMF_BUF_MAX);
+	t->fd = midi_smf_spool ();
+	if (t->buf == NULL || t->fd < 0) {
+		free (t->buf);
+		t->buf = NULL;
+		if (t->fd > -1)
+			close (t->fd);
+		t->fd = -1;
+		w->error = true;
+		return (NULL);
+	}
+	t->source = source;
+	w->ntracks++;
+	return (t);
+}
+
+/* Convert a frame to track events (writer thread). */
+static void
+midi_smf_write_frame (midi_smf_writer_t *w, const midi_frame_t *mf)
+{
+	midi_smf_track_t *t;
+	unsigned char hdr[8];
+	unsigned char status = mf->data[0];
+	uint64_t tick = 0;
+	int flen, n, i;
+
+	if (mf->len == 0 || status < 0x80)
+		return;
+	t = midi_smf_get_track (w, mf->source);
+	if (t == NULL)
+		return;
+	if (mf->ts > w->t0)
+		tick = (uint64_t) ((double) (mf->ts - w->t0) * w->ppq /
+					((double) w->tempo * 1000.0));
+
+	if (status <= 0xef) {
+		/* channel message(s), written with running status */
+		flen = midi_frame_len[status - 0x80];
+		if ((mf->len - 1) % (flen - 1))
+			return;
+		for (i = 1; i < mf->len; i += flen - 1) {
+			midi_smf_track_delta (w, t, tick);
+			if (status != t->running) {
+				midi_smf_track_put (w, t, &status, 1);
+				t->running = status;
+			}
+			midi_smf_track_put (w, t, mf->data + i,
+						(uint32_t) flen - 1);
+		}
+	}
+	else if (status == 0xf0) {
+		/* system exclusive: F0 <length> <bytes after F0> */
+		midi_smf_track_delta (w, t, tick);
+		hdr[0] = 0xf0;
+		n = 1 + midi_smf_put_vlq (hdr + 1, mf->len - 1);
+		midi_smf_track_put (w, t, hdr, (uint32_t) n);
+		midi_smf_track_put (w, t, mf->data + 1, mf->len - 1);
+		t->running = 0;
+	}
+	else {
+		/* other system messages, as escaped events */
+		midi_smf_track_delta (w, t, tick);
+		hdr[0] = 0xf7;
+		n = 1 + midi_smf_put_vlq (hdr + 1, mf->len);
+		midi_smf_track_put (w, t, hdr, (uint32_t) n);
+		midi_smf_track_put (w, t, mf->data, mf->len);
+		t->running = 0;
+	}
+	w->stats.frames++;
+}
+
+/* Write all queued frames, returns their count. */
+static unsigned int
+midi_smf_drain (midi_smf_writer_t *w)
+{
+	unsigned int h = w->head, n = 0;
+
+	while (h != __atomic_load_n (&w->tail, __ATOMIC_ACQUIRE)) {
+		midi_smf_write_frame (w, &w->ring[h % MIDI_SMF_RING_MAX]);
+		h++;
+		n++;
+		__atomic_store_n (&w->head, h, __ATOMIC_RELEASE);
+	}
+	return (n);
+}
+
+static void *
+midi_smf_writer_thread (void *arg)
+{
+	midi_smf_writer_t *w = (midi_smf_writer_t *) arg;
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 2000000;
+	while ( ! __atomic_load_n (&w->stop, __ATOMIC_ACQUIRE)) {
+		if (midi_smf_drain (w) == 0)
+			nanosleep (&ts, NULL);
+	}
+	midi_smf_drain (w);
+	return (NULL);
+}
+
+bool
+midi_smf_writer_open (midi_smf_writer_t *w, const char *path, int format,
+			unsigned int ppq, unsigned int tempo)
+{
+	unsigned char hdr[40];
+	int n;
+
+	if (w == NULL || path == NULL || (format != 0 && format != 1) ||
+		ppq >= 0x8000 || tempo > 0xffffff)
+		return (false);
+	memset (w, 0, sizeof (midi_smf_writer_t));
+	for (int i = 0; i < MIDI_SMF_TRACKS_MAX; i++)
+		w->tracks[i].fd = -1;
+	w->format = format;
+	w->ppq = ppq ? ppq : MIDI_SMF_PPQ_DEFAULT;
+	w->tempo = tempo ? tempo : MIDI_SMF_TEMPO_DEFAULT;
+	w->ring = (midi_frame_t *) malloc (MIDI_SMF_RING_MAX *
+						sizeof (midi_frame_t));
+	if (w->ring == NULL)
+		return (false);
+	w->fd = open (path, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0644);
+	if (w->fd < 0)
+		goto fail;
+
+	/* header chunk; the count of tracks is fixed when closing */
+	memcpy (hdr, "MThd", 4);
+	midi_smf_put32 (hdr + 4, 6);
+	midi_smf_put16 (hdr + 8, (uint16_t) format);
+	midi_smf_put16 (hdr + 10, 1);
+	midi_smf_put16 (hdr + 12, (uint16_t) w->ppq);
+
+	/* first track, beginning with the tempo */
+	memcpy (hdr + 14, "MTrk", 4);
+	n = 22;
+	hdr[n++] = 0x00;
+	hdr[n++] = 0xff;
+	hdr[n++] = 0x51;
+	hdr[n++] = 0x03;
+	hdr[n++] = (w->tempo >> 16) & 0xff;
+	hdr[n++] = (w->tempo >> 8) & 0xff;
+	hdr[n++] = w->tempo & 0xff;
+	if (format == 1) {
+		/* the tempo track is complete */
+		hdr[n++] = 0x00;
+		hdr[n++] = 0xff;
+		hdr[n++] = 0x2f;
+		hdr[n++] = 0x00;
+	}
+	midi_smf_put32 (hdr + 18, (uint32_t) (n - 22));
+	if ( ! midi_smf_write_all (w->fd, hdr, (size_t) n))
+		goto fail;
+	if (format == 0) {
+		w->tracks[0].fd = w->fd;
+		w->tracks[0].length = (uint32_t) (n - 22);
+		w->tracks[0].buf = (unsigned char *) malloc (MIDI_SMF_BUF_MAX);
+		if (w->tracks[0].buf == NULL)
+			goto fail;
+		w->ntracks = 1;
+	}
+
+	w->t0 = midi_smf_now ();
+	if (pthread_create (&w->thread, NULL, midi_smf_writer_thread, w) != 0)
+		goto fail;
+	return (true);
+
+fail:
+	free (w->tracks[0].buf);
+	free (w->ring);
+	w->ring = NULL;
+	if (w->fd > -1)
+		close (w->fd);
+	w->fd = -1;
+	return (false);
+}
+
+bool
+midi_smf_writer_put (midi_smf_writer_t *w, const midi_frame_t *mf)
+{
+	unsigned int t;
+
+	if (w == NULL || w->ring == NULL || mf == NULL)
+		return (false);
+	t = w->tail;
+	if (t - __atomic_load_n (&w->head, __ATOMIC_ACQUIRE) >=
+		MIDI_SMF_RING_MAX) {
+		w->stats.dropped++;
+		return (false);
+	}
+	w->ring[t % MIDI_SMF_RING_MAX] = *mf;
+	__atomic_store_n (&w->tail, t + 1, __ATOMIC_RELEASE);
+	return (true);
+}
+
+void
+midi_smf_writer_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_smf_writer_put ((midi_smf_writer_t *) user_data, mf);
+}
+
+/* Copy a spooled track at the end of the output file. */
+static bool
+midi_smf_copy_track (midi_smf_writer_t *w, midi_smf_track_t *t)
+{
+	unsigned char hdr[8];
+	ssize_t r;
+
+	memcpy (hdr, "MTrk", 4);
+	midi_smf_put32 (hdr + 4, t->length);
+	if ( ! midi_smf_write_all (w->fd, hdr, 8) ||
+		lseek (t->fd, 0, SEEK_SET) != 0)
+		return (false);
+	while ((r = read (t->fd, t->buf, MIDI_SMF_BUF_MAX)) != 0) {
+		if (r < 0 && errno == EINTR)
+			continue;
+		else if (r < 0 ||
+			! midi_smf_write_all (w->fd, t->buf, (size_t) r))
+			return (false);
+	}
+	return (true);
+}
+
+bool
+midi_smf_writer_close (midi_smf_writer_t *w)
+{
+	static const unsigned char eot[] = { 0x00, 0xff, 0x2f, 0x00 };
+	unsigned char v[4];
+	bool ok;
+	int i;
+
+	if (w == NULL || w->ring == NULL)
+		return (false);
+	__atomic_store_n (&w->stop, 1, __ATOMIC_RELEASE);
+	pthread_join (w->thread, NULL);
+
+	/* end the tracks */
+	for (i = 0; i < w->ntracks; i++) {
+		midi_smf_track_put (w, &w->tracks[i], eot, sizeof (eot));
+		midi_smf_track_flush (w, &w->tracks[i]);
+	}
+
+	/* fix the chunk lengths */
+	if (w->format == 0) {
+		midi_smf_put32 (v, w->tracks[0].length);
+		if (pwrite (w->fd, v, 4, 18) != 4)
+			w->error = true;
+	}
+	else {
+		for (i = 0; i < w->ntracks; i++) {
+			if ( ! midi_smf_copy_track (w, &w->tracks[i]))
+				w->error = true;
+		}
+		midi_smf_put16 (v, (uint16_t) (w->ntracks + 1));
+		if (pwrite (w->fd, v, 2, 10) != 2)
+			w->error = true;
+	}
+
+	for (i = 0; i < w->ntracks; i++) {
+		if (w->tracks[i].fd != w->fd)
+			close (w->tracks[i].fd);
+		free (w->tracks[i].buf);
+		w->tracks[i].buf = NULL;
+		w->tracks[i].fd = -1;
+	}
+	w->ntracks = 0;
+	if (close (w->fd) != 0)
+		w->error = true;
+	w->fd = -1;
+	free (w->ring);
+	w->ring = NULL;
+	ok = ! w->error;
+	return (ok);
+}
+
+void
+midi_smf_writer_get_stats (midi_smf_writer_t *w,
+				midi_smf_writer_stats_t *stats)
+{
+	if (w && stats)
+		*stats = w->stats;
+}
+
+/*
+ * Player
+ */
+
+/* kinds of events returned by "midi_smf_cursor_step" */
+enum {
+	MIDI_SMF_EV_MIDI,
+	MIDI_SMF_EV_META,
+	MIDI_SMF_EV_END
+};
+
+static inline uint32_t
+midi_smf_get32 (const unsigned char *p)
+{
+	return (((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+		((uint32_t) p[2] << 8) | p[3]);
+}
+
+/* Decode a variable-length quantity. Returns false if it is truncated. */
+static inline bool
+midi_smf_get_vlq (const unsigned char **pp, const unsigned char *end,
+			uint32_t *v)
+{
+	const unsigned char *p = *pp;
+	uint32_t r = 0;
+	int i;
+
+	for (i = 0; i < 4 && p < end; i++) {
+		r = (r << 7) | (*p & 0x7f);
+		if ((*p++ & 0x80) == 0) {
+			*pp = p;
+			*v = r;
+			return (true);
+		}
+	}
+	return (false);
+}
+
+/* Decode the next event of a track into 'ev'. For a meta event, 'msg[0]' is
+ * its type, 'data' and 'len' its data. For a sysex, 'data' is the data after
+ * F0 or F7 in the file and 'len' the length of the message to send. The
+ * cursor is done at the end of the track or on error.
+ */
+static int
+midi_smf_cursor_step (midi_smf_cursor_t *c, midi_smf_event_t *ev)
+{
+	const unsigned char *p = c->p;
+	uint32_t delta, len;
+	unsigned char status;
+	int flen;
+
+	if (c->done || ! midi_smf_get_vlq (&p, c->end, &delta) || p >= c->end)
+		goto end;
+	ev->tick = c->tick + delta;
+	ev->data = NULL;
+	status = *p;
+
+	if (status == 0xff) {
+		/* meta event; they cancel the running status */
+		if (p + 2 >= c->end)
+			goto end;
+		ev->msg[0] = p[1];
+		p += 2;
+		if ( ! midi_smf_get_vlq (&p, c->end, &len) ||
+			len > (uint32_t) (c->end - p) || ev->msg[0] == 0x2f)
+			goto end;
+		ev->data = p;
+		ev->len = len;
+		c->p = p + len;
+		c->tick = ev->tick;
+		c->running = 0;
+		return (MIDI_SMF_EV_META);
+	}
+	else if (status == 0xf0 || status == 0xf7) {
+		/* sysex F0 <length> <bytes after F0>, or escaped bytes */
+		p++;
+		if ( ! midi_smf_get_vlq (&p, c->end, &len) ||
+			len > (uint32_t) (c->end - p))
+			goto end;
+		ev->msg[0] = status;
+		ev->data = p;
+		ev->len = status == 0xf0 ? len + 1 : len;
+		c->p = p + len;
+		c->tick = ev->tick;
+		c->running = 0;
+		return (MIDI_SMF_EV_MIDI);
+	}
+
+	if (status & 0x80) {
+		p++;
+		if (status < 0xf0)
+			c->running = status;
+	}
+	else if ((status = c->running) == 0)
+		goto end;
+	flen = midi_frame_len[status - 0x80];
+	if (flen < 1 || flen - 1 > c->end - p)
+		goto end;
+	ev->msg[0] = status;
+	memcpy (ev->msg + 1, p, (size_t) flen - 1);
+	ev->len = (uint32_t) flen;
+	c->p = p + flen - 1;
+	c->tick = ev->tick;
+	return (MIDI_SMF_EV_MIDI);
+
+end:
+	c->done = true;
+	return (MIDI_SMF_EV_END);
+}
+
+uint64_t
+midi_smf_player_tick_to_ns (midi_smf_player_t *p, uint64_t tick)
+{
+	midi_smf_tempo_t *e;
+	uint32_t lo = 0, hi, mid;
+	double rate;
+
+	if (p == NULL || p->division == 0)
+		return (0);
+	if (p->division & 0x8000) {
+		/* SMPTE division: frames per second and ticks per frame */
+		rate = (double) (0x100 - (p->division >> 8));
+		if (rate == 29.0)
+			rate = 29.97;
+		return ((uint64_t) ((double) tick * 1e9 /
+					(rate * (p->division & 0xff))));
+	}
+	hi = p->ntempos;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (p->tempos[mid].tick <= tick)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = &p->tempos[lo];
+	return (e->ns + (uint64_t) ((double) (tick - e->tick) * e->tempo *
+					1000.0 / p->division));
+}
+
+uint64_t
+midi_smf_player_ns_to_tick (midi_smf_player_t *p, uint64_t ns)
+{
+	midi_smf_tempo_t *e;
+	uint32_t lo = 0, hi, mid;
+	double rate;
+
+	if (p == NULL || p->division == 0)
+		return (0);
+	if (p->division & 0x8000) {
+		rate = (double) (0x100 - (p->division >> 8));
+		if (rate == 29.0)
+			rate = 29.97;
+		return ((uint64_t) ((double) ns * rate *
+					(p->division & 0xff) / 1e9));
+	}
+	hi = p->ntempos;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (p->tempos[mid].ns <= ns)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = &p->tempos[lo];
+	return (e->tick + (uint64_t) ((double) (ns - e->ns) * p->division /
+					((double) e->tempo * 1000.0)));
+}
+
+/* Move a cursor to its next event to send. */
+static void
+midi_smf_cursor_advance (midi_smf_player_t *p, midi_smf_cursor_t *c)
+{
+	int r;
+
+	do {
+		r = midi_smf_cursor_step (c, &c->next);
+	} while (r == MIDI_SMF_EV_META);
+	if (r == MIDI_SMF_EV_MIDI) {
+		c->next.ns = midi_smf_player_tick_to_ns (p, c->next.tick);
+		c->next.track = (int) (c - p->tracks);
+	}
+}
+
+/* Order of the tracks in the heap: next event first, then track index. */
+static inline bool
+midi_smf_heap_less (midi_smf_player_t *p, int a, int b)
+{
+	uint64_t ta = p->tracks[a].next.tick;
+	uint64_t tb = p->tracks[b].next.tick;
+
+	return (ta < tb || (ta == tb && a < b));
+}
+
+static void
+midi_smf_heap_down (midi_smf_player_t *p, int i)
+{
+	int k, tmp;
+
+	for (;;) {
+		k = 2 * i + 1;
+		if (k >= p->nheap)
+			break;
+		if (k + 1 < p->nheap &&
+			midi_smf_heap_less (p, p->heap[k + 1], p->heap[k]))
+			k++;
+		if ( ! midi_smf_heap_less (p, p->heap[k], p->heap[i]))
+			break;
+		tmp = p->heap[i];
+		p->heap[i] = p->heap[k];
+		p->heap[k] = tmp;
+		i = k;
+	}
+}
+
+/* Add a tempo change to the map, kept ordered by tick. */
+static bool
+midi_smf_add_tempo (midi_smf_player_t *p, uint64_t tick, uint32_t tempo,
+			uint32_t *max)
+{
+	midi_smf_tempo_t *t;
+	uint32_t i;
+
+	if (p->ntempos == *max) {
+		t = (midi_smf_tempo_t *) realloc (p->tempos, 2 * *max *
+						sizeof (midi_smf_tempo_t));
+		if (t == NULL)
+			return (false);
+		p->tempos = t;
+		*max *= 2;
+	}
+	for (i = p->ntempos; i > 0 && p->tempos[i - 1].tick > tick; i--)
+		p->tempos[i] = p->tempos[i - 1];
+	p->tempos[i].tick = tick;
+	p->tempos[i].tempo = tempo ? tempo : MIDI_SMF_TEMPO_DEFAULT;
+	p->ntempos++;
+	return (true);
+}
+
+/* Scan a track: build its seek index, add its tempo changes to the map and
+ * get the size of its largest sysex and its last tick.
+ */
+static bool
+midi_smf_scan_track (midi_smf_player_t *p, midi_smf_cursor_t *c,
+			uint32_t *tempo_max, uint64_t *last)
+{
+	midi_smf_checkpoint_t *cp;
+	midi_smf_event_t ev;
+	uint32_t max = 0, n = 0;
+	int r;
+
+	do {
+		if (n % MIDI_SMF_CHECKPOINT_STEP == 0) {
+			if (c->nindex == max) {
+				max = max ? 2 * max : 16;
+				cp = (midi_smf_checkpoint_t *) realloc (c->index,
+					max * sizeof (midi_smf_checkpoint_t));
+				if (cp == NULL)
+					return (false);
+				c->index = cp;
+			}
+			cp = &c->index[c->nindex++];
+			cp->tick = c->tick;
+			cp->offset = (uint32_t) (c->p - c->start);
+			cp->running = c->running;
+		}
+		n++;
+		r = midi_smf_cursor_step (c, &ev);
+		if (r == MIDI_SMF_EV_META && ev.msg[0] == 0x51 && ev.len == 3) {
+			if ( ! midi_smf_add_tempo (p, ev.tick,
+					((uint32_t) ev.data[0] << 16) |
+					((uint32_t) ev.data[1] << 8) |
+					ev.data[2], tempo_max))
+				return (false);
+		}
+		else if (r == MIDI_SMF_EV_MIDI && ev.data &&
+				ev.len > p->scratch_max)
+			p->scratch_max = ev.len;
+	} while (r != MIDI_SMF_EV_END);
+	if (c->tick > *last)
+		*last = c->tick;
+	return (true);
+}
+
+bool
+midi_smf_player_open (midi_smf_player_t *p, const char *path)
+{
+	struct stat st;
+	const unsigned char *q, *end;
+	uint32_t len, tempo_max = 16, i;
+	uint64_t last = 0;
+	midi_smf_tempo_t *e;
+	int n;
+
+	if (p == NULL || path == NULL)
+		return (false);
+	memset (p, 0, sizeof (midi_smf_player_t));
+	p->lookahead = MIDI_SMF_LOOKAHEAD_DEFAULT;
+	p->spin = MIDI_SMF_SPIN_DEFAULT;
+	p->fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (p->fd < 0)
+		return (false);
+	if (fstat (p->fd, &st) != 0 || st.st_size < 14 ||
+		(uint64_t) st.st_size > 0xffffffffULL)
+		goto fail;
+	p->size = (size_t) st.st_size;
+	p->map = (const unsigned char *) mmap (NULL, p->size, PROT_READ,
+						MAP_PRIVATE, p->fd, 0);
+	if (p->map == (const unsigned char *) MAP_FAILED) {
+		p->map = NULL;
+		goto fail;
+	}
+
+	/* header chunk */
+	end = p->map + p->size;
+	len = midi_smf_get32 (p->map + 4);
+	if (memcmp (p->map, "MThd", 4) || len < 6 || len > p->size - 8)
+		goto fail;
+	p->format = (p->map[8] << 8) | p->map[9];
+	p->division = (unsigned int) ((p->map[12] << 8) | p->map[13]);
+	if (p->format > 2 || p->division == 0 ||
+		((p->division & 0x8000) && (p->division & 0xff) == 0))
+		goto fail;
+
+	/* count the track chunks; other chunks are ignored */
+	for (n = 0, q = p->map + 8 + len; end - q >= 8;
+		q += 8 + midi_smf_get32 (q + 4)) {
+		if (midi_smf_get32 (q + 4) > (uint32_t) (end - q - 8))
+			break;
+		if (memcmp (q, "MTrk", 4) == 0)
+			n++;
+	}
+	p->tracks = (midi_smf_cursor_t *) calloc ((size_t) (n ? n : 1),
+						sizeof (midi_smf_cursor_t));
+	p->heap = (int *) malloc ((size_t) (n ? n : 1) * sizeof (int));
+	p->tempos = (midi_smf_tempo_t *) malloc (tempo_max *
+						sizeof (midi_smf_tempo_t));
+	p->window = (midi_smf_event_t *) malloc (MIDI_SMF_WINDOW_MAX *
+						sizeof (midi_smf_event_t));
+	if (p->tracks == NULL || p->heap == NULL || p->tempos == NULL ||
+		p->window == NULL)
+		goto fail;
+
+	/* 120 bpm until the first tempo change */
+	p->tempos[0].tick = 0;
+	p->tempos[0].ns = 0;
+	p->tempos[0].tempo = MIDI_SMF_TEMPO_DEFAULT;
+	p->ntempos = 1;
+
+	/* scan the tracks */
+	for (q = p->map + 8 + len; p->ntracks < n;
+		q += 8 + midi_smf_get32 (q + 4)) {
+		midi_smf_cursor_t *c;
+
+		if (memcmp (q, "MTrk", 4))
+			continue;
+		c = &p->tracks[p->ntracks++];
+		c->start = c->p = q + 8;
+		c->end = c->start + midi_smf_get32 (q + 4);
+		if ( ! midi_smf_scan_track (p, c, &tempo_max, &last))
+			goto fail;
+	}
+
+	/* time of the tempo changes */
+	for (i = 1; i < p->ntempos; i++) {
+		e = &p->tempos[i - 1];
+		p->tempos[i].ns = e->ns + (uint64_t) ((double)
+			(p->tempos[i].tick - e->tick) * e->tempo * 1000.0 /
+			(p->division & 0x7fff));
+	}
+
+	p->scratch_max++;
+	p->scratch = (unsigned char *) malloc (p->scratch_max);
+	if (p->scratch == NULL)
+		goto fail;
+	p->duration = midi_smf_player_tick_to_ns (p, last);
+	if ( ! midi_smf_player_seek (p, 0))
+		goto fail;
+	return (true);
+
+fail:
+	midi_smf_player_close (p);
+	return (false);
+}
+
+void
+midi_smf_player_close (midi_smf_player_t *p)
+{
+	int i;
+
+	if (p == NULL)
+		return;
+	midi_smf_player_stop (p);
+	if (p->tracks) {
+		for (i = 0; i < p->ntracks; i++)
+			free (p->tracks[i].index);
+	}
+	free (p->tracks);
+	free (p->heap);
+	free (p->tempos);
+	free (p->window);
+	free (p->scratch);
+	p->tracks = NULL;
+	p->heap = NULL;
+	p->tempos = NULL;
+	p->window = NULL;
+	p->scratch = NULL;
+	p->ntracks = p->nheap = 0;
+	p->ntempos = 0;
+	if (p->map)
+		munmap ((void *) p->map, p->size);
+	p->map = NULL;
+	if (p->fd > -1)
+		close (p->fd);
+	p->fd = -1;
+}
+
+void
+midi_smf_player_set_callback (midi_smf_player_t *p,
+				midi_smf_player_callback_t cb,
+				void *user_data)
+{
+	if (p) {
+		p->callback = cb;
+		p->user_data = user_data;
+	}
+}
+
+void
+midi_smf_player_set_lookahead (midi_smf_player_t *p, uint64_t lookahead,
+				uint64_t spin)
+{
+	if (p == NULL)
+		return;
+	if (lookahead)
+		p->lookahead = lookahead;
+	if (spin)
+		p->spin = spin;
+}
+
+uint64_t
+midi_smf_player_get_duration (midi_smf_player_t *p)
+{
+	return (p ? p->duration : 0);
+}
+
+uint64_t
+midi_smf_player_get_position (midi_smf_player_t *p)
+{
+	return (p ? p->position : 0);
+}
+
+bool
+midi_smf_player_seek (midi_smf_player_t *p, uint64_t ns)
+{
+	midi_smf_cursor_t *c;
+	midi_smf_checkpoint_t *cp;
+	uint64_t tick;
+	uint32_t lo, hi, mid;
+	int i;
+
+	if (p == NULL || p->map == NULL || p->playing)
+		return (false);
+
+	/* first tick at or after 'ns' */
+	tick = midi_smf_player_ns_to_tick (p, ns);
+	while (midi_smf_player_tick_to_ns (p, tick) < ns)
+		tick++;
+
+	p->nheap = 0;
+	for (i = 0; i < p->ntracks; i++) {
+		c = &p->tracks[i];
+
+		/* last checkpoint before the tick, whose previous event
+		 * cannot be at or after the tick */
+		lo = 0;
+		hi = c->nindex;
+		while (hi - lo > 1) {
+			mid = (lo + hi) / 2;
+			if (c->index[mid].tick < tick)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		cp = &c->index[lo];
+		c->p = c->start + cp->offset;
+		c->tick = cp->tick;
+		c->running = cp->running;
+		c->done = false;
+		do {
+			midi_smf_cursor_advance (p, c);
+		} while ( ! c->done && c->next.tick < tick);
+		if ( ! c->done)
+			p->heap[p->nheap++] = i;
+	}
+	for (i = p->nheap / 2 - 1; i >= 0; i--)
+		midi_smf_heap_down (p, i);
+	p->whead = 0;
+	p->wlen = 0;
+	p->position = ns;
+	return (true);
+}
+
+/* Decode the events up to time 'horizon' into the lookahead window. */
+static void
+midi_smf_fill (midi_smf_player_t *p, uint64_t horizon)
+{
+	midi_smf_cursor_t *c;
+
+	while (p->nheap > 0 && p->wlen < MIDI_SMF_WINDOW_MAX) {
+		c = &p->tracks[p->heap[0]];
+		if (c->next.ns > horizon)
+			break;
+		p->window[(p->whead + p->wlen) % MIDI_SMF_WINDOW_MAX] = c->next;
+		p->wlen++;
+		midi_smf_cursor_advance (p, c);
+		if (c->done)
+			p->heap[0] = p->heap[--p->nheap];
+		midi_smf_heap_down (p, 0);
+	}
+}
+
+/* Wait until the monotonic time 't', for at most 100 ms. The last 'spin'
+ * ns are busy-waited if 'spin' is set, for accuracy.
+ */
+static void
+midi_smf_wait (midi_smf_player_t *p, uint64_t t, bool spin)
+{
+	uint64_t now = midi_smf_now ();
+	uint64_t until = t;
+	struct timespec ts;
+
+	if (until > now + 100000000ULL) {
+		until = now + 100000000ULL;
+		spin = false;
+	}
+	if (spin)
+		until = until > now + p->spin ? until - p->spin : now;
+	if (until > now) {
+		ts.tv_sec = (time_t) (until / 1000000000ULL);
+		ts.tv_nsec = (long) (until % 1000000000ULL);
+		while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&ts, NULL) == EINTR)
+			;
+	}
+	while (spin && midi_smf_now () < t &&
+		! __atomic_load_n (&p->stop, __ATOMIC_ACQUIRE))
+		;
+}
+
+static bool
+midi_smf_play (midi_smf_player_t *p)
+{
+	midi_smf_event_t *ev;
+	const unsigned char *msg;
+	uint64_t t0, now, late;
+	bool ok = true;
+
+	memset (&p->stats, 0, sizeof (midi_smf_player_stats_t));
+	t0 = midi_smf_now () - p->position;
+	while (ok && ! __atomic_load_n (&p->stop, __ATOMIC_ACQUIRE)) {
+		now = midi_smf_now ();
+		midi_smf_fill (p, now - t0 + p->lookahead);
+		if (p->wlen == 0) {
+			if (p->nheap == 0)
+				break;
+			/* wait for the next event to enter the window */
+			midi_smf_wait (p, t0 + p->tracks[p->heap[0]].next.ns -
+					p->lookahead, false);
+			continue;
+		}
+		if (t0 + p->window[p->whead].ns > now) {
+			midi_smf_wait (p, t0 + p->window[p->whead].ns, true);
+			now = midi_smf_now ();
+		}
+
+		/* send the events due */
+		while (ok && p->wlen > 0 &&
+			t0 + (ev = &p->window[p->whead])->ns <= now) {
+			if (ev->data && ev->msg[0] == 0xf0) {
+				p->scratch[0] = 0xf0;
+				memcpy (p->scratch + 1, ev->data, ev->len - 1);
+				msg = p->scratch;
+			}
+			else
+				msg = ev->data ? ev->data : ev->msg;
+			if (ev->len > 0 && p->callback)
+				ok = p->callback (ev, msg, ev->len,
+							p->user_data);
+			late = now - (t0 + ev->ns);
+			if (late > p->stats.late_max)
+				p->stats.late_max = late;
+			p->stats.late_sum += late;
+			p->stats.events++;
+			p->position = ev->ns;
+			p->whead = (p->whead + 1) % MIDI_SMF_WINDOW_MAX;
+			p->wlen--;
+		}
+	}
+	return (ok);
+}
+
+bool
+midi_smf_player_run (midi_smf_player_t *p)
+{
+	if (p == NULL || p->map == NULL || p->playing)
+		return (false);
+	__atomic_store_n (&p->stop, 0, __ATOMIC_RELEASE);
+	return (midi_smf_play (p));
+}
+
+static void *
+midi_smf_player_thread (void *arg)
+{
+	midi_smf_play ((midi_smf_player_t *) arg);
+	return (NULL);
+}
+
+bool
+midi_smf_player_start (midi_smf_player_t *p)
+{
+	if (p == NULL || p->map == NULL || p->playing)
+		return (false);
+	__atomic_store_n (&p->stop, 0, __ATOMIC_RELEASE);
+	if (pthread_create (&p->thread, NULL, midi_smf_player_thread, p) != 0)
+		return (false);
+	p->playing = true;
+	return (true);
+}
+
+void
+midi_smf_player_stop (midi_smf_player_t *p)
+{
+	if (p == NULL)
+		return;
+	__atomic_store_n (&p->stop, 1, __ATOMIC_RELEASE);
+	if (p->playing) {
+		pthread_join (p->thread, NULL);
+		p->playing = false;
+	}
+}
+
+void
+midi_smf_player_get_stats (midi_smf_player_t *p,
+				midi_smf_player_stats_t *stats)
+{
+	if (p && stats)
+		*stats = p->stats;
+}
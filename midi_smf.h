@@ -0,0 +1,292 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_SMF_H
+#define MIDI_SMF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* default resolution (ticks per quarter note) and tempo (us per quarter
+ * note, i.e. 120 bpm) */
+#define MIDI_SMF_PPQ_DEFAULT	960
+#define MIDI_SMF_TEMPO_DEFAULT	500000
+
+/* max count of tracks written in format 1 (one per source, after the tempo
+ * track); frames of other sources go to the last track */
+#define MIDI_SMF_TRACKS_MAX	16
+
+/* count of frames buffered between the producer and the writer thread */
+#define MIDI_SMF_RING_MAX	4096
+
+/* size of the output buffer of each track */
+#define MIDI_SMF_BUF_MAX	65536
+
+/* statistics of a SMF writer */
+typedef struct midi_smf_writer_stats_t {
+	unsigned long frames; /* count of frames written */
+	unsigned long dropped; /* frames lost because the ring was full */
+	uint64_t bytes; /* count of bytes of the track chunks */
+} midi_smf_writer_stats_t;
+
+/* a track being written */
+typedef struct midi_smf_track_t {
+	int fd; /* spool file (format 1) or output file */
+	int source; /* source id of the frames of this track */
+	uint64_t tick; /* tick of the last event */
+	uint32_t length; /* length of the track chunk data */
+	unsigned char running; /* current running status or 0 */
+	unsigned char *buf; /* output buffer */
+	uint32_t buf_len; /* length of data in buffer */
+} midi_smf_track_t;
+
+/* Streaming Standard MIDI File writer. Frames are given by one producer
+ * thread (a reader tap, ..) thru a lock-free ring; a background thread
+ * converts them to track events and writes them, so that memory use stays
+ * constant. The chunk lengths are fixed when the writer is closed.
+ */
+typedef struct midi_smf_writer_t {
+	int fd; /* output file */
+	int format; /* 0 or 1 */
+	unsigned int ppq; /* ticks per quarter note */
+	unsigned int tempo; /* us per quarter note */
+	uint64_t t0; /* time of tick 0 (ns, monotonic) */
+	midi_smf_track_t tracks[MIDI_SMF_TRACKS_MAX]; /* tracks of events */
+	int ntracks; /* count of event tracks */
+	midi_frame_t *ring; /* frames to write */
+	unsigned int head; /* next frame to write (writer thread) */
+	unsigned int tail; /* next free slot (producer) */
+	pthread_t thread; /* writer thread */
+	int stop; /* set to stop the writer thread */
+	bool error; /* a write error occurred */
+	midi_smf_writer_stats_t stats;
+} midi_smf_writer_t;
+
+/* Create or truncate the Standard MIDI File 'path' and start the writer
+ * thread. 'format' is 0 (one track) or 1 (a tempo track, then one track per
+ * source). 'ppq' and 'tempo' may be 0 for the defaults. Tick 0 is the time
+ * of this call. Returns false on failure.
+ */
+bool
+midi_smf_writer_open (midi_smf_writer_t *w, const char *path, int format,
+			unsigned int ppq, unsigned int tempo);
+
+/* Queue a frame, using its timestamp (ns, monotonic) and source. Must be
+ * called from one thread at a time; never blocks. Returns false if the
+ * frame was dropped.
+ */
+bool
+midi_smf_writer_put (midi_smf_writer_t *w, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap", with the writer as argument. */
+void
+midi_smf_writer_tap (const midi_frame_t *mf, void *user_data);
+
+/* Stop the writer thread, write the pending events, end the tracks and fix
+ * the chunk lengths. Returns false if any write failed.
+ */
+bool
+midi_smf_writer_close (midi_smf_writer_t *w);
+
+/* Get the statistics of the writer. */
+void
+midi_smf_writer_get_stats (midi_smf_writer_t *w,
+				midi_smf_writer_stats_t *stats);
+
+/* count of events between two checkpoints of the seek index */
+#define MIDI_SMF_CHECKPOINT_STEP	1024
+
+/* max count of events in the lookahead window */
+#define MIDI_SMF_WINDOW_MAX	4096
+
+/* default lookahead window and busy-wait time before an event (ns) */
+#define MIDI_SMF_LOOKAHEAD_DEFAULT	20000000ULL
+#define MIDI_SMF_SPIN_DEFAULT		200000ULL
+
+/* an event of a track, decoded from the file */
+typedef struct midi_smf_event_t {
+	uint64_t tick; /* tick of the event */
+	uint64_t ns; /* time of the event from the start of the song */
+	int track; /* index of the track (0..) */
+	uint32_t len; /* length of the message */
+	const unsigned char *data; /* sysex data in the file, or NULL */
+	unsigned char msg[3]; /* short message, or first byte of a sysex */
+} midi_smf_event_t;
+
+/* User callback function called to send an event; 'msg' is the complete
+ * message of 'len' bytes. The playback stops if it returns false.
+ */
+typedef bool (*midi_smf_player_callback_t) (const midi_smf_event_t *ev,
+						const unsigned char *msg,
+						uint32_t len,
+						void *user_data);
+
+/* entry of the tempo map */
+typedef struct midi_smf_tempo_t {
+	uint64_t tick; /* tick of the tempo change */
+	uint64_t ns; /* time of the tempo change */
+	uint32_t tempo; /* us per quarter note from here */
+} midi_smf_tempo_t;
+
+/* entry of the seek index of a track: state before decoding an event */
+typedef struct midi_smf_checkpoint_t {
+	uint64_t tick; /* tick of the previous event */
+	uint32_t offset; /* offset of the event in the track */
+	unsigned char running; /* running status */
+} midi_smf_checkpoint_t;
+
+/* position in a track */
+typedef struct midi_smf_cursor_t {
+	const unsigned char *start; /* first event of the track */
+	const unsigned char *p; /* next event */
+	const unsigned char *end; /* end of the track */
+	uint64_t tick; /* tick of the previous event */
+	unsigned char running; /* running status */
+	bool done; /* end of track reached */
+	midi_smf_event_t next; /* next event to play, if not done */
+	midi_smf_checkpoint_t *index; /* seek index */
+	uint32_t nindex; /* count of checkpoints */
+} midi_smf_cursor_t;
+
+/* statistics of a playback (lateness of the events, in ns) */
+typedef struct midi_smf_player_stats_t {
+	unsigned long events; /* count of events sent */
+	uint64_t late_max; /* maximal lateness */
+	uint64_t late_sum; /* sum of lateness, for the mean */
+} midi_smf_player_stats_t;
+
+/* Standard MIDI File player. The file is memory-mapped and its tracks are
+ * merged with a heap; a tempo map and a seek index of each track are built
+ * when loading, so that seeking does not parse the file from its start.
+ * Events are decoded ahead of their time into a lookahead window, then
+ * sent at their time by sleeping and finally busy-waiting a short time.
+ */
+typedef struct midi_smf_player_t {
+	int fd; /* file descriptor */
+	const unsigned char *map; /* mapped file */
+	size_t size; /* size of the mapping */
+	int format; /* format of the file */
+	unsigned int division; /* division of the file */
+	midi_smf_cursor_t *tracks; /* tracks */
+	int ntracks; /* count of tracks */
+	midi_smf_tempo_t *tempos; /* tempo map */
+	uint32_t ntempos; /* count of tempo map entries */
+	int *heap; /* tracks ordered by time of their next event */
+	int nheap; /* count of tracks in heap */
+	midi_smf_event_t *window; /* ring of events decoded in advance */
+	unsigned int whead; /* first event of window */
+	unsigned int wlen; /* count of events in window */
+	unsigned char *scratch; /* buffer for sysex messages */
+	uint32_t scratch_max; /* size of scratch */
+	uint64_t lookahead; /* lookahead window (ns) */
+	uint64_t spin; /* busy-wait time before an event (ns) */
+	uint64_t position; /* time of the last event sent (ns) */
+	uint64_t duration; /* time of the last event (ns) */
+	midi_smf_player_callback_t callback; /* user callback */
+	void *user_data; /* user data for callback */
+	pthread_t thread; /* playback thread */
+	bool playing; /* thread is running */
+	int stop; /* set to stop the playback */
+	midi_smf_player_stats_t stats;
+} midi_smf_player_t;
+
+/* Load the Standard MIDI File 'path'. Returns false on failure. */
+bool
+midi_smf_player_open (midi_smf_player_t *p, const char *path);
+
+/* Stop the playback and release the file. */
+void
+midi_smf_player_close (midi_smf_player_t *p);
+
+/* Set the callback used to send the events. */
+void
+midi_smf_player_set_callback (midi_smf_player_t *p,
+				midi_smf_player_callback_t cb,
+				void *user_data);
+
+/* Set the lookahead window and the busy-wait time before each event (ns;
+ * 0 to keep the current value).
+ */
+void
+midi_smf_player_set_lookahead (midi_smf_player_t *p, uint64_t lookahead,
+				uint64_t spin);
+
+/* Convert a tick to a time from the start of the song (ns). */
+uint64_t
+midi_smf_player_tick_to_ns (midi_smf_player_t *p, uint64_t tick);
+
+/* Convert a time from the start of the song (ns) to a tick. */
+uint64_t
+midi_smf_player_ns_to_tick (midi_smf_player_t *p, uint64_t ns);
+
+/* Get the time of the last event (ns). */
+uint64_t
+midi_smf_player_get_duration (midi_smf_player_t *p);
+
+/* Get the time of the last event sent (ns). */
+uint64_t
+midi_smf_player_get_position (midi_smf_player_t *p);
+
+/* Move to the first events at or after time 'ns', thru the seek index.
+ * Must not be called while playing. Returns false on error.
+ */
+bool
+midi_smf_player_seek (midi_smf_player_t *p, uint64_t ns);
+
+/* Play from the current position in the calling thread, until the end of
+ * the song or until "midi_smf_player_stop" is called from another thread.
+ * Returns false if the callback failed.
+ */
+bool
+midi_smf_player_run (midi_smf_player_t *p);
+
+/* Play from the current position in a background thread. Returns false
+ * on failure. "midi_smf_player_stop" must be called before starting again,
+ * even if the end of the song was reached.
+ */
+bool
+midi_smf_player_start (midi_smf_player_t *p);
+
+/* Stop the playback. The position is kept for the next start. */
+void
+midi_smf_player_stop (midi_smf_player_t *p);
+
+/* Get the statistics of the playback. */
+void
+midi_smf_player_get_stats (midi_smf_player_t *p,
+				midi_smf_player_stats_t *stats);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_SMF_H */
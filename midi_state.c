@@ -0,0 +1,292 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "midi_state.h"
+
+/* Start a change of the state. */
+static void
+midi_state_write_begin (midi_state_t *st)
+{
+	__atomic_store_n (&st->seq, st->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+/* End a change of the state. */
+static void
+midi_state_write_end (midi_state_t *st)
+{
+	__atomic_store_n (&st->seq, st->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Wait for the end of a change and return the sequence counter. */
+static unsigned int
+midi_state_read_begin (const midi_state_t *st)
+{
+	unsigned int seq;
+
+	while ((seq = __atomic_load_n (&st->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return (seq);
+}
+
+/* Return true if the data read since "midi_state_read_begin" returned
+ * 'seq' may have been changed.
+ */
+static bool
+midi_state_read_retry (const midi_state_t *st, unsigned int seq)
+{
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	return (__atomic_load_n (&st->seq, __ATOMIC_RELAXED) != seq);
+}
+
+static void
+midi_state_init_channel (midi_state_channel_t *ch)
+{
+	memset (ch, 0, sizeof (midi_state_channel_t));
+	ch->bend = MIDI_STATE_BEND_CENTER;
+}
+
+void
+midi_state_init (midi_state_t *st)
+{
+	if (st == NULL)
+		return;
+	memset (st, 0, sizeof (midi_state_t));
+	for (int c = 0; c < 16; c++)
+		midi_state_init_channel (&st->channels[c]);
+}
+
+void
+midi_state_reset (midi_state_t *st)
+{
+	if (st == NULL)
+		return;
+	midi_state_write_begin (st);
+	for (int c = 0; c < 16; c++)
+		midi_state_init_channel (&st->channels[c]);
+	st->frames = 0;
+	st->ts = 0;
+	midi_state_write_end (st);
+}
+
+/* Set the value of a controller, with the channel mode messages. */
+static void
+midi_state_set_cc (midi_state_channel_t *ch, int cc, unsigned char v)
+{
+	ch->cc[cc] = v;
+	ch->cc_seen[cc >> 6] |= 1ULL << (cc & 63);
+	switch (cc) {
+	case 120: /* all sound off */
+	case 123: /* all notes off */
+		ch->notes[0] = ch->notes[1] = 0;
+		break;
+	case 121: /* reset all controllers */
+		ch->cc[1] = 0;
+		ch->cc[11] = 127;
+		ch->cc[64] = ch->cc[65] = ch->cc[66] = ch->cc[67] = 0;
+		ch->pressure = 0;
+		ch->bend = MIDI_STATE_BEND_CENTER;
+		break;
+	}
+}
+
+/* Apply one channel message. */
+static void
+midi_state_apply (midi_state_channel_t *ch, unsigned char type,
+			const unsigned char *d)
+{
+	uint64_t bit = 1ULL << (d[0] & 63);
+	int i = (d[0] >> 6) & 1;
+
+	switch (type) {
+	case 0x90:
+		if (d[1] != 0) {
+			ch->notes[i] |= bit;
+			break;
+		}
+		/* velocity 0: note off */
+		/* FALLTHROUGH */
+	case 0x80:
+		ch->notes[i] &= ~bit;
+		break;
+	case 0xb0:
+		midi_state_set_cc (ch, d[0] & 0x7f, d[1] & 0x7f);
+		break;
+	case 0xc0:
+		ch->program = d[0] & 0x7f;
+		break;
+	case 0xd0:
+		ch->pressure = d[0] & 0x7f;
+		break;
+	case 0xe0:
+		ch->bend = (uint16_t) ((d[0] & 0x7f) | ((d[1] & 0x7f) << 7));
+		break;
+	}
+}
+
+void
+midi_state_update (midi_state_t *st, const midi_frame_t *mf)
+{
+	unsigned char status;
+	int j, len;
+
+	if (st == NULL || mf == NULL || mf->len == 0 || mf->data[0] < 0x80)
+		return;
+	status = mf->data[0];
+	if (status >= 0xf0 && status != 0xff)
+		return;
+	midi_state_write_begin (st);
+	if (status == 0xff) {
+		for (int c = 0; c < 16; c++)
+			midi_state_init_channel (&st->channels[c]);
+	}
+	else if ((status & 0xf0) != 0xa0) {
+		len = midi_frame_len[status - 0x80];
+		for (j = 1; j + len - 1 <= mf->len; j += len - 1)
+			midi_state_apply (&st->channels[status & 0x0f],
+						status & 0xf0, mf->data + j);
+	}
+	st->ts = mf->ts;
+	st->frames++;
+	midi_state_write_end (st);
+}
+
+void
+midi_state_tap (const midi_frame_t *mf, void *user_data)
+{
+	midi_state_update ((midi_state_t *) user_data, mf);
+}
+
+void
+midi_state_snapshot (const midi_state_t *st, midi_state_t *copy)
+{
+	unsigned int seq;
+
+	if (st == NULL || copy == NULL)
+		return;
+	do {
+		seq = midi_state_read_begin (st);
+		memcpy (copy, st, sizeof (midi_state_t));
+	} while (midi_state_read_retry (st, seq));
+	copy->seq = seq;
+}
+
+bool
+midi_state_get_channel (const midi_state_t *st, int channel,
+			midi_state_channel_t *copy)
+{
+	unsigned int seq;
+
+	if (st == NULL || copy == NULL || channel < 1 || channel > 16)
+		return (false);
+	do {
+		seq = midi_state_read_begin (st);
+		memcpy (copy, &st->channels[channel - 1],
+			sizeof (midi_state_channel_t));
+	} while (midi_state_read_retry (st, seq));
+	return (true);
+}
+
+bool
+midi_state_note_on (const midi_state_t *st, int channel, int note)
+{
+	unsigned int seq;
+	uint64_t notes;
+
+	if (st == NULL || channel < 1 || channel > 16 || note < 0 ||
+		note > 127)
+		return (false);
+	do {
+		seq = midi_state_read_begin (st);
+		notes = st->channels[channel - 1].notes[note >> 6];
+	} while (midi_state_read_retry (st, seq));
+	return ((notes >> (note & 63)) & 1);
+}
+
+int
+midi_state_get_cc (const midi_state_t *st, int channel, int cc)
+{
+	const midi_state_channel_t *ch;
+	unsigned int seq;
+	uint64_t seen;
+	int v;
+
+	if (st == NULL || channel < 1 || channel > 16 || cc < 0 || cc > 127)
+		return (-1);
+	ch = &st->channels[channel - 1];
+	do {
+		seq = midi_state_read_begin (st);
+		seen = ch->cc_seen[cc >> 6];
+		v = ch->cc[cc];
+	} while (midi_state_read_retry (st, seq));
+	return (((seen >> (cc & 63)) & 1) ? v : -1);
+}
+
+int
+midi_state_get_program (const midi_state_t *st, int channel)
+{
+	unsigned int seq;
+	int v;
+
+	if (st == NULL || channel < 1 || channel > 16)
+		return (-1);
+	do {
+		seq = midi_state_read_begin (st);
+		v = st->channels[channel - 1].program;
+	} while (midi_state_read_retry (st, seq));
+	return (v);
+}
+
+int
+midi_state_get_pressure (const midi_state_t *st, int channel)
+{
+	unsigned int seq;
+	int v;
+
+	if (st == NULL || channel < 1 || channel > 16)
+		return (-1);
+	do {
+		seq = midi_state_read_begin (st);
+		v = st->channels[channel - 1].pressure;
+	} while (midi_state_read_retry (st, seq));
+	return (v);
+}
+
+int
+midi_state_get_bend (const midi_state_t *st, int channel)
+{
+	unsigned int seq;
+	int v;
+
+	if (st == NULL || channel < 1 || channel > 16)
+		return (-1);
+	do {
+		seq = midi_state_read_begin (st);
+		v = st->channels[channel - 1].bend;
+	} while (midi_state_read_retry (st, seq));
+	return (v);
+}
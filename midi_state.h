@@ -0,0 +1,129 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_STATE_H
+#define MIDI_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* center value of the pitch bend */
+#define MIDI_STATE_BEND_CENTER	8192
+
+/* state of a channel */
+typedef struct midi_state_channel_t {
+	uint64_t notes[2]; /* bitmap of the notes held */
+	uint64_t cc_seen[2]; /* bitmap of the controllers received */
+	unsigned char cc[128]; /* controller values */
+	unsigned char program; /* program */
+	unsigned char pressure; /* channel pressure */
+	uint16_t bend; /* pitch bend (0 .. 16383) */
+} midi_state_channel_t;
+
+/* Mirror of the state of the channels of a source, updated by one thread
+ * (the one reading the source) and read by any thread without locking: the
+ * writer increments a sequence counter before and after each change, and
+ * readers copy the data again while the counter is odd or has changed.
+ * Reads never block the writer, and a snapshot is a copy of fixed size.
+ */
+typedef struct midi_state_t {
+	unsigned int seq; /* sequence counter, odd while updating */
+	uint64_t ts; /* time of the last frame */
+	unsigned long frames; /* count of frames applied */
+	midi_state_channel_t channels[16]; /* state of each channel */
+} midi_state_t;
+
+/* Initialize a state: no note held, controllers and pressure 0, program 0,
+ * pitch bend centered.
+ */
+void
+midi_state_init (midi_state_t *st);
+
+/* Reset a state that may be read by other threads. */
+void
+midi_state_reset (midi_state_t *st);
+
+/* Apply a frame (running-status frames included): note on and off,
+ * control change (120 and 123 release the notes, 121 resets the
+ * controllers), program change, channel pressure, pitch bend and system
+ * reset. Must be called from one thread at a time.
+ */
+void
+midi_state_update (midi_state_t *st, const midi_frame_t *mf);
+
+/* Tap function for "midi_reader_add_tap" or "midi_reader_add_source_tap",
+ * with the state as argument.
+ */
+void
+midi_state_tap (const midi_frame_t *mf, void *user_data);
+
+/* Copy the whole state. */
+void
+midi_state_snapshot (const midi_state_t *st, midi_state_t *copy);
+
+/* Copy the state of channel 'channel' (1 .. 16). Returns false if the
+ * channel is out of range.
+ */
+bool
+midi_state_get_channel (const midi_state_t *st, int channel,
+			midi_state_channel_t *copy);
+
+/* Return true if note 'note' of channel 'channel' (1 .. 16) is held. */
+bool
+midi_state_note_on (const midi_state_t *st, int channel, int note);
+
+/* Get the value of controller 'cc' of channel 'channel' (1 .. 16), or -1
+ * if it was not received.
+ */
+int
+midi_state_get_cc (const midi_state_t *st, int channel, int cc);
+
+/* Get the program of channel 'channel' (1 .. 16), or -1 on error. */
+int
+midi_state_get_program (const midi_state_t *st, int channel);
+
+/* Get the channel pressure of channel 'channel' (1 .. 16), or -1 on
+ * error.
+ */
+int
+midi_state_get_pressure (const midi_state_t *st, int channel);
+
+/* Get the pitch bend of channel 'channel' (1 .. 16; 0 .. 16383), or -1 on
+ * error.
+ */
+int
+midi_state_get_bend (const midi_state_t *st, int channel);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_STATE_H */
@@ -0,0 +1,232 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include "midi_thru.h"
+
+/* max time waiting for the output to be writable (ms) */
+#define MIDI_THRU_WAIT	100
+
+void
+midi_thru_init (midi_thru_t *t, int fd)
+{
+	if (t) {
+		memset (t, 0, sizeof (midi_thru_t));
+		t->fd = fd;
+		t->types[0] = t->types[1] = UINT64_MAX;
+	}
+}
+
+void
+midi_thru_skip (midi_thru_t *t, unsigned char status, int channel)
+{
+	int bit;
+
+	if (t == NULL || status < 0x80)
+		return;
+	for (int ch = 0; ch < 16; ch++) {
+		if (status < 0xf0) {
+			if (channel >= 1 && channel <= 16 && ch != channel - 1)
+				continue;
+			bit = MIDI_STATUS_BIT ((status & 0xf0) | ch);
+		}
+		else if (ch == 0)
+			bit = MIDI_STATUS_BIT (status);
+		else
+			break;
+		t->types[bit >> 6] &= ~(1ULL << (bit & 63));
+	}
+}
+
+/* Check if messages with status 'st' are forwarded. */
+static inline bool
+midi_thru_accepts (const midi_thru_t *t, unsigned char st)
+{
+	int bit = MIDI_STATUS_BIT (st);
+
+	return ((t->types[bit >> 6] & (1ULL << (bit & 63))) != 0);
+}
+
+bool
+midi_thru_put (midi_thru_t *t, const unsigned char *data, uint32_t len)
+{
+	if (t == NULL || data == NULL || len == 0)
+		return (false);
+	if (data[0] >= 0x80 && ! midi_thru_accepts (t, data[0])) {
+		t->stats.filtered++;
+		return (false);
+	}
+	if (t->len + len > MIDI_THRU_BUF_MAX)
+		midi_thru_flush (t);
+	if (len > MIDI_THRU_BUF_MAX) {
+		/* too long to be buffered */
+		t->len = 0;
+		return (false);
+	}
+	memcpy (t->buf + t->len, data, len);
+	t->len += len;
+	t->stats.frames++;
+	return (true);
+}
+
+void
+midi_thru_put_raw (midi_thru_t *t, const unsigned char *data, uint32_t len)
+{
+	uint32_t i;
+	bool all;
+
+	if (t == NULL || data == NULL || len == 0)
+		return;
+	/* all real-time messages forwarded (bits of 0xf8 .. 0xff) */
+	all = (t->types[1] >> 56) == 0xff;
+	t->stats.frames++;
+	for (i = 0; i < len; i++) {
+		if (t->len == MIDI_THRU_BUF_MAX)
+			midi_thru_flush (t);
+		if (all) {
+			/* copy as much as possible at once */
+			uint32_t n = len - i;
+
+			if (n > MIDI_THRU_BUF_MAX - t->len)
+				n = MIDI_THRU_BUF_MAX - t->len;
+			memcpy (t->buf + t->len, data + i, n);
+			t->len += n;
+			i += n - 1;
+		}
+		else if (data[i] >= 0xf8 && ! midi_thru_accepts (t, data[i]))
+			t->stats.filtered++;
+		else
+			t->buf[t->len++] = data[i];
+	}
+}
+
+void
+midi_thru_tap (const midi_frame_t *mf, void *user_data)
+{
+	if (mf)
+		midi_thru_put ((midi_thru_t *) user_data, mf->data, mf->len);
+}
+
+void
+midi_thru_raw (const unsigned char *buf, int len, int source, uint64_t ts,
+		void *user_data)
+{
+	(void) source;
+	(void) ts;
+	if (len > 0)
+		midi_thru_put_raw ((midi_thru_t *) user_data, buf,
+					(uint32_t) len);
+}
+
+bool
+midi_thru_flush (midi_thru_t *t)
+{
+	struct pollfd pfd;
+	uint32_t off = 0;
+	ssize_t r = 0;
+
+	if (t == NULL || t->len == 0)
+		return (true);
+	while (off < t->len) {
+		r = write (t->fd, t->buf + off, t->len - off);
+		if (r > 0) {
+			off += (uint32_t) r;
+			continue;
+		}
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			/* output full: wait a little */
+			pfd.fd = t->fd;
+			pfd.events = POLLOUT;
+			if (poll (&pfd, 1, MIDI_THRU_WAIT) > 0)
+				continue;
+		}
+		break;
+	}
+	t->stats.writes++;
+	t->stats.bytes += off;
+	t->len = 0;
+	if (off == 0 || r <= 0) {
+		t->stats.errors++;
+		return (false);
+	}
+	return (true);
+}
+
+bool
+midi_thru_run (midi_thru_t *t, midi_reader_t *reader, const int *stop,
+		int timeout)
+{
+	struct pollfd pfd[MIDI_READER_IN_MAX];
+	midi_reader_raw_callback_t raw_cb = NULL;
+	void *raw_ud = NULL;
+	int i, r, hup;
+	bool raw, ok = true;
+
+	if (t == NULL || reader == NULL || stop == NULL)
+		return (false);
+	raw = (reader->flags & MIDIR_RAW) != 0;
+	if (raw) {
+		raw_cb = reader->raw_callback;
+		raw_ud = reader->raw_user_data;
+		midi_reader_set_raw_callback (reader, midi_thru_raw, t);
+	}
+	else if ( ! midi_reader_add_tap (reader, midi_thru_tap, t))
+		return (false);
+	while ( ! __atomic_load_n (stop, __ATOMIC_ACQUIRE)) {
+		for (i = 0; i < reader->nsources; i++) {
+			pfd[i].fd = reader->sources[i].fd;
+			pfd[i].events = POLLIN | POLLPRI;
+			pfd[i].revents = 0;
+		}
+		r = poll (pfd, reader->nsources, timeout);
+		if (r < 0 && errno != EINTR) {
+			ok = false;
+			break;
+		}
+		if (r > 0) {
+			midi_reader_pump (reader);
+			midi_thru_flush (t);
+		}
+		/* end of all inputs */
+		for (i = hup = 0; r > 0 && i < reader->nsources; i++) {
+			if ((pfd[i].revents & (POLLHUP | POLLERR | POLLNVAL)) &&
+				! (pfd[i].revents & POLLIN))
+				hup++;
+		}
+		if (reader->nsources > 0 && hup == reader->nsources)
+			break;
+	}
+	if (raw)
+		midi_reader_set_raw_callback (reader, raw_cb, raw_ud);
+	else
+		midi_reader_remove_tap (reader, midi_thru_tap, t);
+	return (ok);
+}
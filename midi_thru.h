@@ -0,0 +1,116 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_THRU_H
+#define MIDI_THRU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* size of the output buffer of a thru */
+#define MIDI_THRU_BUF_MAX	4096
+
+/* statistics of a thru */
+typedef struct midi_thru_stats_t {
+	unsigned long frames; /* count of frames or raw chunks forwarded */
+	unsigned long filtered; /* frames or real-time bytes not forwarded */
+	unsigned long writes; /* count of writes */
+	unsigned long errors; /* count of failed writes */
+	uint64_t bytes; /* count of bytes written */
+} midi_thru_stats_t;
+
+/* Soft-thru forwarding the input of a reader to an output descriptor from
+ * the thread reading the input: the frames (a tap) or the raw chunks (the
+ * raw callback) are appended to a buffer, which is written at once after
+ * the sources were read, so that the bytes are forwarded in the same
+ * iteration without queue nor thread switch.
+ */
+typedef struct midi_thru_t {
+	int fd; /* output descriptor */
+	uint64_t types[2]; /* forwarded status bytes (MIDI_STATUS_BIT) */
+	unsigned char buf[MIDI_THRU_BUF_MAX]; /* bytes to write */
+	uint32_t len; /* count of bytes in buf */
+	midi_thru_stats_t stats;
+} midi_thru_t;
+
+/* Initialize a thru to 'fd', forwarding all messages. The descriptor is
+ * not closed by the thru.
+ */
+void
+midi_thru_init (midi_thru_t *t, int fd);
+
+/* Do not forward the messages with status byte 'status'. For channel
+ * messages, 'status' is a type (0x80 .. 0xe0) and 'channel' is 1 .. 16, or
+ * 0 for all channels. In raw mode, only the real-time messages (0xf8 ..
+ * 0xff) are filtered.
+ */
+void
+midi_thru_skip (midi_thru_t *t, unsigned char status, int channel);
+
+/* Add a complete message to the buffer, unless filtered. Returns false if
+ * the message was filtered.
+ */
+bool
+midi_thru_put (midi_thru_t *t, const unsigned char *data, uint32_t len);
+
+/* Add raw bytes to the buffer, without the filtered real-time bytes. */
+void
+midi_thru_put_raw (midi_thru_t *t, const unsigned char *data, uint32_t len);
+
+/* Tap function for "midi_reader_add_tap", with the thru as argument. */
+void
+midi_thru_tap (const midi_frame_t *mf, void *user_data);
+
+/* Raw callback for "midi_reader_set_raw_callback", with the thru as
+ * argument.
+ */
+void
+midi_thru_raw (const unsigned char *buf, int len, int source, uint64_t ts,
+		void *user_data);
+
+/* Write the buffer. Returns false on error. */
+bool
+midi_thru_flush (midi_thru_t *t);
+
+/* Forward the input of 'reader' until '*stop' is set or all its sources
+ * are closed, waiting for input at most 'timeout' ms at a time. The thru
+ * is set as tap (or raw callback, with MIDIR_RAW) of the reader while
+ * running; the reader should have MIDIR_NOQUEUE. Returns false on error.
+ */
+bool
+midi_thru_run (midi_thru_t *t, midi_reader_t *reader, const int *stop,
+		int timeout);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_THRU_H */
@@ -0,0 +1,244 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "midi_xform.h"
+
+void
+midi_xform_init (midi_xform_t *x)
+{
+	int c, n;
+
+	if (x == NULL)
+		return;
+	x->types[0] = x->types[1] = UINT64_MAX;
+	for (c = 0; c < 16; c++) {
+		x->channels[c] = (uint16_t) (1U << c);
+		for (n = 0; n < 128; n++)
+			x->notes[c][n] = (unsigned char) n;
+	}
+	for (n = 0; n < 128; n++) {
+		x->velocity[n] = (unsigned char) n;
+		x->cc[n] = (unsigned char) n;
+	}
+}
+
+void
+midi_xform_filter (midi_xform_t *x, unsigned char status, int channel)
+{
+	int bit;
+
+	if (x == NULL || status < 0x80)
+		return;
+	for (int ch = 0; ch < 16; ch++) {
+		if (status < 0xf0) {
+			if (channel >= 1 && channel <= 16 && ch != channel - 1)
+				continue;
+			bit = MIDI_STATUS_BIT ((status & 0xf0) | ch);
+		}
+		else if (ch == 0)
+			bit = MIDI_STATUS_BIT (status);
+		else
+			break;
+		x->types[bit >> 6] &= ~(1ULL << (bit & 63));
+	}
+}
+
+void
+midi_xform_map_channel (midi_xform_t *x, int from, int to, bool layer)
+{
+	if (x == NULL || from < 0 || from > 16 || to < 0 || to > 16)
+		return;
+	for (int c = 0; c < 16; c++) {
+		if (from != 0 && c != from - 1)
+			continue;
+		if ( ! layer)
+			x->channels[c] = 0;
+		if (to > 0)
+			x->channels[c] |= (uint16_t) (1U << (to - 1));
+	}
+}
+
+void
+midi_xform_map_note (midi_xform_t *x, int channel, int from, int to)
+{
+	if (x == NULL || channel < 0 || channel > 16 || from < 0 ||
+		from > 0x7f || (to < 0 || (to > 0x7f && to != MIDI_XFORM_DROP)))
+		return;
+	for (int c = 0; c < 16; c++) {
+		if (channel == 0 || c == channel - 1)
+			x->notes[c][from] = (unsigned char) to;
+	}
+}
+
+void
+midi_xform_transpose (midi_xform_t *x, int channel, int semitones)
+{
+	int c, n, v;
+
+	if (x == NULL || channel < 0 || channel > 16)
+		return;
+	for (c = 0; c < 16; c++) {
+		if (channel != 0 && c != channel - 1)
+			continue;
+		for (n = 0; n < 128; n++) {
+			if (x->notes[c][n] == MIDI_XFORM_DROP)
+				continue;
+			v = x->notes[c][n] + semitones;
+			x->notes[c][n] = (unsigned char) (v < 0 || v > 0x7f ?
+						MIDI_XFORM_DROP : v);
+		}
+	}
+}
+
+void
+midi_xform_note_range (midi_xform_t *x, int channel, int low, int high)
+{
+	if (x == NULL || channel < 0 || channel > 16)
+		return;
+	for (int c = 0; c < 16; c++) {
+		if (channel != 0 && c != channel - 1)
+			continue;
+		for (int n = 0; n < 128; n++) {
+			if (n < low || n > high)
+				x->notes[c][n] = MIDI_XFORM_DROP;
+		}
+	}
+}
+
+void
+midi_xform_velocity_curve (midi_xform_t *x, int min, int max, double gamma)
+{
+	double v;
+
+	if (x == NULL || gamma <= 0.0)
+		return;
+	min = min < 1 ? 1 : min > 0x7f ? 0x7f : min;
+	max = max < 1 ? 1 : max > 0x7f ? 0x7f : max;
+	x->velocity[0] = 0;
+	for (int n = 1; n < 128; n++) {
+		v = min + (max - min) * pow (n / 127.0, gamma);
+		x->velocity[n] = (unsigned char) (v < 1.0 ? 1 :
+						v > 127.0 ? 0x7f : v + 0.5);
+	}
+}
+
+void
+midi_xform_velocity_table (midi_xform_t *x, const unsigned char table[128])
+{
+	if (x == NULL || table == NULL)
+		return;
+	x->velocity[0] = 0;
+	for (int n = 1; n < 128; n++) {
+		x->velocity[n] = table[n] & 0x7f;
+		if (x->velocity[n] == 0)
+			x->velocity[n] = 1;
+	}
+}
+
+void
+midi_xform_map_cc (midi_xform_t *x, int from, int to)
+{
+	if (x == NULL || from < 0 || from > 0x7f ||
+		(to < 0 || (to > 0x7f && to != MIDI_XFORM_DROP)))
+		return;
+	x->cc[from] = (unsigned char) to;
+}
+
+/* Transform the messages of 'mf' for the new channel 'c' into 'f'. Returns
+ * false if all were dropped.
+ */
+static bool
+midi_xform_channel (const midi_xform_t *x, const midi_frame_t *mf, int c,
+			midi_frame_t *f)
+{
+	unsigned char type = mf->data[0] & 0xf0, d1;
+	int i, n = midi_frame_len[mf->data[0] - 0x80] - 1;
+
+	f->data[0] = (unsigned char) (type | c);
+	f->len = 1;
+	f->source = mf->source;
+	f->ts = mf->ts;
+	for (i = 1; i + n <= mf->len; i += n) {
+		d1 = mf->data[i];
+		switch (type) {
+		case 0x80:
+		case 0x90:
+		case 0xa0:
+			d1 = x->notes[c][d1 & 0x7f];
+			break;
+		case 0xb0:
+			d1 = x->cc[d1 & 0x7f];
+			break;
+		default:
+			break;
+		}
+		if (d1 == MIDI_XFORM_DROP)
+			continue;
+		f->data[f->len++] = d1;
+		if (n == 2) {
+			f->data[f->len++] = type == 0x90 ?
+				x->velocity[mf->data[i + 1] & 0x7f] :
+				mf->data[i + 1];
+		}
+	}
+	return (f->len > 1);
+}
+
+int
+midi_xform_apply (const midi_xform_t *x, const midi_frame_t *mf,
+			midi_frame_t *out)
+{
+	unsigned char st;
+	int bit, c, count = 0;
+	unsigned int map;
+
+	if (x == NULL || mf == NULL || out == NULL || mf->len == 0)
+		return (0);
+	st = mf->data[0];
+	if (st >= 0x80) {
+		bit = MIDI_STATUS_BIT (st);
+		if ( ! (x->types[bit >> 6] & (1ULL << (bit & 63))))
+			return (0);
+	}
+	if (st < 0x80 || st >= 0xf0) {
+		out[0] = *mf;
+		return (1);
+	}
+	map = x->channels[st & 0x0f];
+	for (c = 0; map != 0; c++, map >>= 1) {
+		if ((map & 1) && midi_xform_channel (x, mf, c, &out[count]))
+			count++;
+	}
+	return (count);
+}
+
+int
+midi_xform_run (const midi_frame_t *mf, midi_frame_t *out, void *user_data)
+{
+	return (midi_xform_apply ((const midi_xform_t *) user_data, mf, out));
+}
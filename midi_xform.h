@@ -0,0 +1,130 @@
+/*-
+ * Copyright (c) 2025 Nicolas Provost <dev@nicolas-provost.fr>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIDI_XFORM_H
+#define MIDI_XFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "midi_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* value of a dropped note or controller in the tables */
+#define MIDI_XFORM_DROP	0xff
+
+/* Transform of the channel messages, compiled into lookup tables. A
+ * message is transformed in this order:
+ * - filter on its status byte;
+ * - channel map: the message goes to each channel mapped from its channel
+ *   (none: dropped, several: layered);
+ * - note map of the new channel (note off, note on, key pressure), so that
+ *   split points and transpositions may differ between layers;
+ * - velocity table (note on, velocity 0 excepted);
+ * - controller map (control change).
+ * System messages are only filtered. Tables are changed by the functions
+ * below while the transform is not used.
+ */
+typedef struct midi_xform_t {
+	uint64_t types[2]; /* accepted status bytes (MIDI_STATUS_BIT) */
+	uint16_t channels[16]; /* channel map: bit 'c' of entry 's' is set if
+				* messages of channel 's' go to channel 'c' */
+	unsigned char notes[16][128]; /* note map of each channel */
+	unsigned char velocity[128]; /* velocity table of note on */
+	unsigned char cc[128]; /* controller map */
+} midi_xform_t;
+
+/* Initialize a transform keeping all messages unchanged. */
+void
+midi_xform_init (midi_xform_t *x);
+
+/* Drop the messages with status byte 'status'. For channel messages,
+ * 'status' is a type (0x80 .. 0xe0) and 'channel' is 1 .. 16, or 0 for
+ * all channels.
+ */
+void
+midi_xform_filter (midi_xform_t *x, unsigned char status, int channel);
+
+/* Send the messages of channel 'from' (1 .. 16, or 0 for all) to channel
+ * 'to' (1 .. 16, or 0 to drop them). With 'layer', channel 'to' is added
+ * to the channels of 'from' instead of replacing them.
+ */
+void
+midi_xform_map_channel (midi_xform_t *x, int from, int to, bool layer);
+
+/* Map note 'from' to note 'to' (or MIDI_XFORM_DROP) on the new channel
+ * 'channel' (1 .. 16, or 0 for all).
+ */
+void
+midi_xform_map_note (midi_xform_t *x, int channel, int from, int to);
+
+/* Transpose the notes of the new channel 'channel' (1 .. 16, or 0 for
+ * all) by 'semitones'; notes out of range are dropped.
+ */
+void
+midi_xform_transpose (midi_xform_t *x, int channel, int semitones);
+
+/* Keep only the notes 'low' .. 'high' (before the note map) of the new
+ * channel 'channel' (1 .. 16, or 0 for all): a split point.
+ */
+void
+midi_xform_note_range (midi_xform_t *x, int channel, int low, int high);
+
+/* Set the velocity table to a curve from 'min' to 'max' (1 .. 127):
+ * velocity v gives min + (max - min) * (v / 127) ^ gamma, so that 'gamma'
+ * below 1 raises low velocities and above 1 lowers them.
+ */
+void
+midi_xform_velocity_curve (midi_xform_t *x, int min, int max, double gamma);
+
+/* Set the velocity table; entries 1 .. 127 are used, 0 is changed to 1. */
+void
+midi_xform_velocity_table (midi_xform_t *x, const unsigned char table[128]);
+
+/* Map controller 'from' to controller 'to' (or MIDI_XFORM_DROP). */
+void
+midi_xform_map_cc (midi_xform_t *x, int from, int to);
+
+/* Transform a frame (a message, or several with running status) into at
+ * most 16 frames 'out'. Returns the count of frames, 0 if dropped.
+ */
+int
+midi_xform_apply (const midi_xform_t *x, const midi_frame_t *mf,
+			midi_frame_t *out);
+
+/* Filter function for "midi_reader_add_filter", with the transform as
+ * argument: the transform then runs in the parser of a source.
+ */
+int
+midi_xform_run (const midi_frame_t *mf, midi_frame_t *out, void *user_data);
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* MIDI_XFORM_H */
@@ -21,6 +21,7 @@ class StaticEnumAssertions { StaticEnumAssertions() {
     ENUM_EQUAL( RTMIDI_API_WEB_MIDI_API,    RtMidi::WEB_MIDI_API );
     ENUM_EQUAL( RTMIDI_API_WINDOWS_UWP,     RtMidi::WINDOWS_UWP );
     ENUM_EQUAL( RTMIDI_API_DIRECT,          RtMidi::DIRECT );
+    ENUM_EQUAL( RTMIDI_API_LOOPBACK,        RtMidi::LOOPBACK );
 
     ENUM_EQUAL( RTMIDI_ERROR_WARNING,            RtMidiError::WARNING );
     ENUM_EQUAL( RTMIDI_ERROR_DEBUG_WARNING,      RtMidiError::DEBUG_WARNING );
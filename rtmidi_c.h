@@ -69,6 +69,7 @@ enum RtMidiApi {
     RTMIDI_API_WINDOWS_UWP,    /*!< The Microsoft Universal Windows Platform MIDI API. */
     RTMIDI_API_ANDROID,        /*!< The Android MIDI API. */
     RTMIDI_API_DIRECT,         /*!< API for direct access to MIDI devices. */
+    RTMIDI_API_LOOPBACK,       /*!< In-process loopback of output ports to input ports. */
     RTMIDI_API_NUM             /*!< Number of values in this enum. */
 };
 
@@ -0,0 +1,76 @@
+//*****************************************//
+//  batchtest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that the batch transform kernels of each
+//  instruction set give the results of the scalar one.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Compare the batch kernels of each instruction set with the scalar one
+// on random messages.
+static void testBatch()
+{
+  const size_t n = 1003;
+  std::vector<uint32_t> msgs( n ), ref, res;
+  std::vector<unsigned char> packed( n * 3 );
+  unsigned char table[128];
+  MidiBatchTransform bt;
+  MidiBatchIsa best;
+  size_t i, kept, kept3;
+  uint32_t seed = 7;
+
+  for ( i = 0; i < 128; i++ )
+    table[i] = (unsigned char) ( 127 - i );
+  bt.filter( 0xd0 );
+  bt.filter( 0xf8 );
+  bt.mapChannel( 3, 10 );
+  bt.transpose( 5 );
+  bt.velocityTable( table );
+  for ( i = 0; i < n; i++ ) {
+    seed = seed * 1103515245 + 12345;
+    msgs[i] = ( 0x80 + ( ( seed >> 8 ) & 0x7f ) ) |
+              ( ( ( seed >> 16 ) & 0x7f ) << 8 ) | ( ( ( seed >> 24 ) & 0x7f ) << 16 );
+    packed[i * 3] = (unsigned char) msgs[i];
+    packed[i * 3 + 1] = (unsigned char) ( msgs[i] >> 8 );
+    packed[i * 3 + 2] = (unsigned char) ( msgs[i] >> 16 );
+  }
+
+  // a few known messages
+  msgs[0] = 0x407b92;    // note on, channel 3, note 0x7b -> 0x7f, velocity 0x40 -> 0x3f
+  msgs[1] = 0x000a80;    // note off, note 10 -> 15
+  msgs[2] = 0x0020d5;    // channel pressure: filtered
+  ref = msgs;
+  CHECK( MidiBatchTransform::setIsa( MIDI_BATCH_SCALAR ) == MIDI_BATCH_SCALAR );
+  kept = bt.apply( ref.data(), n );
+  CHECK( kept < n && kept > n / 2 );
+  CHECK( ref[0] == 0x3f7f99 && ref[1] == 0x000f80 && ref[2] != 0x0020d5 );
+
+  best = MidiBatchTransform::setIsa( MIDI_BATCH_AVX2 );
+  for ( int isa = MIDI_BATCH_SCALAR; isa <= best; isa++ ) {
+    MidiBatchTransform::setIsa( (MidiBatchIsa) isa );
+    res = msgs;
+    CHECK( bt.apply( res.data(), n ) == kept );
+    CHECK( memcmp( res.data(), ref.data(), kept * 4 ) == 0 );
+    std::vector<unsigned char> p3( packed );
+    p3[0] = 0x92; p3[1] = 0x7b; p3[2] = 0x40;
+    p3[3] = 0x80; p3[4] = 0x0a; p3[5] = 0x00;
+    p3[6] = 0xd5; p3[7] = 0x20; p3[8] = 0x00;
+    kept3 = bt.apply3( p3.data(), n );
+    CHECK( kept3 == kept );
+    for ( i = 0; i < kept3 && i < kept; i++ ) {
+      if ( ( p3[i * 3] | ( p3[i * 3 + 1] << 8 ) | ( p3[i * 3 + 2] << 16 ) ) != (int) ref[i] )
+        break;
+    }
+    CHECK( i == kept );
+  }
+  MidiBatchTransform::setIsa( best );
+}
+
+int main()
+{
+  testBatch();
+  return testResult( "batchtest" );
+}
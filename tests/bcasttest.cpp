@@ -0,0 +1,113 @@
+//*****************************************//
+//  bcasttest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the broadcast of the frames of a
+//  MidiReader to subscriber threads.
+//
+//*****************************************//
+
+#include <pthread.h>
+#include <sched.h>
+#include "testutil.h"
+
+// Subscriber of a broadcast, releasing each frame.
+struct BroadcastSubscriber {
+  MidiBroadcast *bcast;
+  int id;
+  int count;
+  int bad;
+};
+
+static void *broadcastSubscriber( void *arg )
+{
+  BroadcastSubscriber *s = (BroadcastSubscriber *) arg;
+  const MidiFrame *f;
+
+  while ( s->count < 5000 ) {
+    if ( ( f = s->bcast->next( s->id ) ) == NULL ) {
+      sched_yield();
+      continue;
+    }
+    if ( f->data[1] != ( s->count & 0x7f ) || f->data[2] != ( ( s->count >> 7 ) & 0x7f ) )
+      s->bad++;
+    s->bcast->release( f );
+    __atomic_store_n( &s->count, s->count + 1, __ATOMIC_RELEASE );
+  }
+  return NULL;
+}
+
+// Broadcast the frames of a reader to subscribers with filters, then
+// check that a stalled subscriber does not stop the others.
+static void testBroadcast()
+{
+  static const unsigned char in[] = { 0x90, 0x3c, 0x40, 0xf8, 0xb0, 0x07, 0x10 };
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiBroadcast bcast;
+  MidiBroadcastStats stats;
+  BroadcastSubscriber s[2];
+  pthread_t threads[2];
+  const MidiFrame *f, *g;
+  MidiFrame frame;
+  int all, notes, slow, fi[2], i;
+
+  CHECK( bcast.open( 8 ) );
+  all = bcast.subscribe();
+  notes = bcast.subscribe();
+  CHECK( all == 0 && notes == 1 );
+  bcast.filter( notes, 0xf8 );
+  bcast.filter( notes, 0xb0 );
+  CHECK( pipeSource( reader, fi ) );
+  CHECK( bcast.attach( reader ) );
+  CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+  close( fi[1] );
+  reader.pump();
+  bcast.detach( reader );
+  reader.close();
+  // the same frame is given to both subscribers
+  f = bcast.next( all );
+  g = bcast.next( notes );
+  CHECK( f != NULL && f == g && f->data[0] == 0x90 );
+  bcast.release( f );
+  bcast.release( g );
+  CHECK( bcast.next( notes ) == NULL );
+  CHECK( ( f = bcast.next( all ) ) && f->data[0] == 0xf8 );
+  bcast.release( f );
+  CHECK( ( f = bcast.next( all ) ) && f->data[0] == 0xb0 );
+  bcast.release( f );
+  CHECK( bcast.getStats( notes, stats ) && stats.frames == 1 && stats.filtered == 2 );
+  bcast.unsubscribe( notes );
+  CHECK( bcast.getStats( notes, stats ) == false );
+
+  // 'slow' never reads, the others get all the frames
+  slow = bcast.subscribe();
+  for ( i = 0; i < 2; i++ ) {
+    s[i].bcast = &bcast;
+    s[i].id = i == 0 ? all : bcast.subscribe();
+    s[i].count = s[i].bad = 0;
+    CHECK( pthread_create( &threads[i], NULL, broadcastSubscriber, &s[i] ) == 0 );
+  }
+  frame.len = 3;
+  frame.data[0] = 0x90;
+  for ( i = 0; i < 5000; i++ ) {
+    // keep the rings of the fast subscribers from being full
+    while ( i - __atomic_load_n( &s[0].count, __ATOMIC_ACQUIRE ) > 4 ||
+            i - __atomic_load_n( &s[1].count, __ATOMIC_ACQUIRE ) > 4 )
+      sched_yield();
+    frame.data[1] = i & 0x7f;
+    frame.data[2] = ( i >> 7 ) & 0x7f;
+    CHECK( bcast.put( frame ) == ( i < 8 ? 3 : 2 ) );
+  }
+  for ( i = 0; i < 2; i++ ) {
+    pthread_join( threads[i], NULL );
+    CHECK( s[i].count == 5000 && s[i].bad == 0 );
+  }
+  CHECK( bcast.getStats( slow, stats ) && stats.frames == 8 && stats.dropped == 4992 );
+  bcast.close();
+}
+
+int main()
+{
+  testBroadcast();
+  return testResult( "bcasttest" );
+}
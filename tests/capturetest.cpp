@@ -0,0 +1,251 @@
+//*****************************************//
+//  capturetest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that MIDI frames dumped by a MidiReader
+//  in capture format are read back with their timing and source, that
+//  captures are searched by time, and that compressed captures keep
+//  all their frames.
+//
+//*****************************************//
+
+#include <pthread.h>
+#include "testutil.h"
+
+// Dump injected frames thru a reader, then read them back.
+static void testReaderDump( const char *path )
+{
+  static const unsigned char noteOn[] = { 0x90, 0x3c, 0x40 };
+  static const unsigned char noteOn2[] = { 0x90, 0x3e, 0x40 };
+  static const unsigned char sysex[] = { 0xf0, 0x7e, 0x7f, 0x06, 0x01, 0xf7 };
+  MidiReader *reader = new MidiReader( MIDIR_EXPAND, NULL );
+  MidiCapture cap;
+  MidiFrame f;
+  uint64_t first, last;
+
+  CHECK( reader->setDumpCapture( path ) );
+  CHECK( reader->inject( 5, 0x90, 0x3c, 0x40, 0x3e, 0x40 ) == 5 );
+  CHECK( reader->inject( 1, 0xf8 ) == 1 );
+  CHECK( reader->inject( 6, 0xf0, 0x7e, 0x7f, 0x06, 0x01, 0xf7 ) == 6 );
+  CHECK( reader->inject( 3, 0x90, 0x3c, 0x00 ) == 3 );
+  delete reader;
+
+  CHECK( cap.open( path ) );
+  CHECK( cap.count() == 5 );
+  CHECK( cap.getRange( first, last ) && first <= last );
+  CHECK( cap.next( f ) && sameFrame( f, 3, noteOn ) && f.source == -1 );
+  CHECK( cap.next( f ) && sameFrame( f, 3, noteOn2 ) );
+  CHECK( cap.next( f ) && f.len == 1 && f.data[0] == 0xf8 );
+  CHECK( cap.next( f ) && sameFrame( f, 6, sysex ) );
+  CHECK( cap.next( f ) && f.len == 3 && f.data[2] == 0 && f.ts == last );
+  CHECK( !cap.next( f ) );
+  cap.close();
+}
+
+// Cut the end of a file, as after a crash of the writer.
+static bool truncateFile( const char *path )
+{
+  off_t len;
+  bool ok;
+  int fd = open( path, O_RDWR );
+
+  if ( fd < 0 ) return false;
+  len = lseek( fd, 0, SEEK_END );
+  ok = ftruncate( fd, len - 20 ) == 0;
+  close( fd );
+  return ok;
+}
+
+// Write many frames in small blocks and seek in them.
+static void testSeek( const char *path, bool unclean )
+{
+  MidiCapture cap;
+  MidiFrame f;
+  const unsigned int count = 20000;
+
+  CHECK( writeControls( path, count, 1024 ) );
+
+  // Simulate an unclean shutdown: the block index is lost.
+  if ( unclean )
+    CHECK( truncateFile( path ) );
+
+  CHECK( cap.open( path ) );
+  CHECK( cap.getBlockCount() > 1 );
+  CHECK( cap.count() == count );
+  CHECK( cap.seek( 1000000ULL + 12345 * 1000ULL - 10 ) );
+  CHECK( cap.next( f ) && f.ts == 1000000ULL + 12345 * 1000ULL );
+  CHECK( f.len == 3 && f.data[0] == ( 0xb0 | ( 12345 % 3 ) ) && f.source == 12345 % 2 );
+  CHECK( f.data[1] == 12345 % 128 && f.data[2] == ( 12345 / 128 ) % 128 );
+  CHECK( !cap.seek( 1000000ULL + count * 1000ULL ) );
+  CHECK( !cap.next( f ) );
+  CHECK( cap.seek( 0 ) && cap.next( f ) && f.ts == 1000000ULL );
+  cap.close();
+}
+
+struct PipeCopy {
+  int in;
+  const char *path;
+  bool ok;
+};
+
+// Copy a pipe to a file until its end.
+static void *pipeCopy( void *arg )
+{
+  PipeCopy *copy = (PipeCopy *) arg;
+  char buf[4096];
+  ssize_t n;
+  int fd;
+
+  fd = open( copy->path, O_CREAT | O_WRONLY | O_TRUNC, 0600 );
+  copy->ok = fd >= 0;
+  while ( ( n = read( copy->in, buf, sizeof( buf ) ) ) > 0 )
+    if ( fd < 0 || write( fd, buf, n ) != n )
+      copy->ok = false;
+  if ( fd >= 0 )
+    close( fd );
+  return NULL;
+}
+
+// Write the same frames with and without compression, and read them back.
+static void testCompressed( const char *path )
+{
+  std::string plain = std::string( path ) + ".plain";
+  MidiCaptureWriter writer, zwriter;
+  MidiCaptureStats stats;
+  MidiCapture cap, zcap;
+  MidiFrame f, g;
+  off_t len, zlen;
+  unsigned int r = 3, i, n = 0, bad = 0;
+  int fd;
+
+  CHECK( writer.open( plain.c_str(), 4096 ) );
+  CHECK( zwriter.open( path, 4096 ) );
+  CHECK( zwriter.setCodec( MIDI_CAPTURE_CODEC_PACK, true ) );
+  for ( i = 0; i < 50000; i++ ) {
+    r = r * 1103515245 + 12345;
+    f.ts = 5000000ULL + i * 250000ULL + ( r >> 24 ) % 16;
+    f.source = ( i / 100 ) % 2;
+    if ( i % 500 == 0 ) {
+      f.len = 8;
+      f.data[0] = 0xf0;
+      for ( int j = 1; j < 7; j++ ) f.data[j] = ( i + j ) & 0x7f;
+      f.data[7] = 0xf7;
+    }
+    else if ( i % 24 == 0 ) {
+      f.len = 1;
+      f.data[0] = 0xf8;
+    }
+    else {
+      // a pattern of notes and a controller sweep
+      f.len = 3;
+      f.data[0] = ( ( r >> 12 ) & 1 ? 0x90 : 0xb0 ) | ( ( i / 1000 ) % 4 );
+      f.data[1] = f.data[0] < 0xb0 ? 0x30 + ( i % 8 ) * 2 : 0x07;
+      f.data[2] = f.data[0] < 0xb0 ? 0x40 + ( r >> 20 ) % 4 : ( i / 4 ) & 0x7f;
+    }
+    CHECK( writer.write( f ) );
+    CHECK( zwriter.write( f ) );
+    // a paced input, so that the thread keeps up
+    if ( i % 500 == 499 )
+      usleep( 1000 );
+  }
+  zwriter.getStats( stats );
+  CHECK( stats.refused == 0 );
+  CHECK( writer.close() );
+  CHECK( zwriter.close() );
+
+  fd = open( plain.c_str(), O_RDONLY );
+  len = lseek( fd, 0, SEEK_END );
+  close( fd );
+  fd = open( path, O_RDONLY );
+  zlen = lseek( fd, 0, SEEK_END );
+  close( fd );
+  // blocks are written uncompressed when the thread falls behind
+  CHECK( zlen > 0 && zlen < len );
+
+  CHECK( cap.open( plain.c_str() ) && zcap.open( path ) );
+  CHECK( zcap.getBlockCount() == cap.getBlockCount() );
+  while ( cap.next( f ) ) {
+    if ( !zcap.next( g ) || g.ts != f.ts || g.source != f.source ||
+         !sameFrame( g, f.len, f.data ) )
+      bad++;
+    n++;
+  }
+  CHECK( n == 50000 && bad == 0 && !zcap.next( g ) );
+  CHECK( zcap.seek( 5000000ULL + 33333 * 250000ULL ) && zcap.next( g ) );
+  CHECK( g.ts >= 5000000ULL + 33333 * 250000ULL && g.ts < 5000000ULL + 33334 * 250000ULL );
+  cap.close();
+  zcap.close();
+
+  // compression in the writing thread: all blocks are compressed
+  CHECK( writer.open( plain.c_str(), 4096 ) );
+  CHECK( writer.setCodec( MIDI_CAPTURE_CODEC_PACK, false ) );
+  CHECK( cap.open( path ) );
+  while ( cap.next( f ) )
+    CHECK( writer.write( f ) );
+  cap.close();
+  CHECK( writer.flush() );
+  writer.getStats( stats );
+  CHECK( stats.blocks > 1 && stats.compressed == stats.blocks );
+  CHECK( stats.bytes_out < (uint64_t) len * 3 / 4 );
+  CHECK( writer.close() );
+  CHECK( cap.open( plain.c_str() ) && zcap.open( path ) );
+  for ( n = 0; cap.next( f ); n++ )
+    if ( !zcap.next( g ) || g.ts != f.ts || !sameFrame( g, f.len, f.data ) ) break;
+  CHECK( n == 50000 );
+  cap.close();
+  zcap.close();
+  unlink( plain.c_str() );
+
+  // a writer whose file is stalled refuses frames after a bounded wait,
+  // and keeps all the frames it accepted
+  int fds[2];
+  pthread_t thread;
+  PipeCopy copy;
+  MidiFrame last;
+  CHECK( pipe( fds ) == 0 );
+  CHECK( writer.open( fds[1], 4096 ) );
+  CHECK( writer.setCodec( MIDI_CAPTURE_CODEC_PACK, true ) );
+  for ( i = 0; i < 200000; i++ ) {
+    r = r * 1103515245 + 12345;
+    f.ts = 1000000ULL + i * 1000ULL + ( r >> 24 );
+    f.source = 0;
+    f.len = 3;
+    f.data[0] = 0x90;
+    f.data[1] = ( r >> 8 ) & 0x7f;
+    f.data[2] = ( r >> 16 ) & 0x7f;
+    if ( !writer.write( f ) )
+      break;
+  }
+  CHECK( i < 200000 );
+  writer.getStats( stats );
+  CHECK( stats.frames == i && stats.stalls > 0 && stats.refused == 1 );
+  copy.in = fds[0];
+  copy.path = path;
+  CHECK( pthread_create( &thread, NULL, pipeCopy, &copy ) == 0 );
+  // the refused frame is accepted once the file drains
+  CHECK( writer.write( f ) );
+  CHECK( writer.close() );
+  close( fds[1] );
+  pthread_join( thread, NULL );
+  close( fds[0] );
+  CHECK( copy.ok && cap.open( path ) );
+  CHECK( cap.count() == i + 1 );
+  for ( n = 0; cap.next( g ); n++ )
+    last = g;
+  CHECK( n == i + 1 && last.ts == f.ts && sameFrame( last, f.len, f.data ) );
+  cap.close();
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "capturetest" ) )
+    return 1;
+  testReaderDump( path.c_str() );
+  testSeek( path.c_str(), false );
+  testSeek( path.c_str(), true );
+  testCompressed( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "capturetest" );
+}
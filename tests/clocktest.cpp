@@ -0,0 +1,82 @@
+//*****************************************//
+//  clocktest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the clocks of the timestamps of a
+//  MidiReader and of RtMidiIn.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Reproducible timestamps thru a manual clock; a clock of the counter of
+// the processor follows CLOCK_MONOTONIC.
+static void testClock()
+{
+  static const unsigned char note[] = { 0x90, 0x3c, 0x40 };
+  std::vector<unsigned char> message;
+  MidiManualClock manual( 1000 );
+  MidiTscClock tsc( 5 );
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiFrame *mf;
+  uint64_t t, m;
+  unsigned int i;
+  double ts = -1.0;
+  int fds[2];
+
+  CHECK( pipeSource( reader, fds ) );
+  reader.setClock( &manual );
+  CHECK( reader.getTime() == 1000 && manual.now() == 1000 );
+  CHECK( write( fds[1], note, sizeof( note ) ) == sizeof( note ) );
+  reader.pump();
+  mf = reader.pop();
+  CHECK( mf && mf->ts == 1000 );
+  CHECK( manual.advance( 500 ) == 1500 );
+  CHECK( write( fds[1], note, sizeof( note ) ) == sizeof( note ) );
+  reader.pump();
+  mf = reader.pop();
+  CHECK( mf && mf->ts == 1500 );
+  reader.setClock( NULL );
+  CHECK( reader.getTime() > 1500 );
+  reader.close();
+  close( fds[1] );
+
+  // within a millisecond of CLOCK_MONOTONIC, and never going back
+  m = midi_clock_monotonic( NULL );
+  t = tsc.now();
+  CHECK( t + 1000000 > m && t < m + 1000000 );
+  for ( i = 0; i < 1000; i++ ) {
+    m = tsc.now();
+    CHECK( m >= t );
+    t = m;
+  }
+
+  // the messages of RtMidiIn are stamped by the clock at their reception
+  RtMidiIn rtIn( RtMidi::LOOPBACK );
+  RtMidiOut rtOut( RtMidi::LOOPBACK );
+  rtIn.setClock( manual.getFunction(), manual.getArg() );
+  rtIn.openVirtualPort( "clocktest" );
+  rtOut.openPort( 0 );
+  rtOut.sendMessage( note, sizeof( note ) );
+  for ( i = 0; i < 1000 && message.empty(); i++ ) {
+    rtIn.getMessage( &message );
+    usleep( 1000 );
+  }
+  CHECK( message.size() == 3 );
+  manual.advance( 2000000 );
+  rtOut.sendMessage( note, sizeof( note ) );
+  message.clear();
+  for ( i = 0; i < 1000 && message.empty(); i++ ) {
+    ts = rtIn.getMessage( &message );
+    usleep( 1000 );
+  }
+  CHECK( message.size() == 3 && ts > 0.0019999 && ts < 0.0020001 );
+  rtOut.closePort();
+  rtIn.closePort();
+}
+
+int main()
+{
+  testClock();
+  return testResult( "clocktest" );
+}
@@ -0,0 +1,92 @@
+//*****************************************//
+//  colstoretest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that queries of a column store match a
+//  scan of the capture it was built from.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+static bool countRow( const MidiColumnRow *row, void *userData )
+{
+  uint64_t *n = (uint64_t *) userData;
+
+  if ( row->status != 0x92 || row->d2 <= 100 ) return false;
+  ( *n )++;
+  return true;
+}
+
+// Build a column store from a capture and query it.
+static void testColumnStore( const char *path )
+{
+  std::string store = std::string( path ) + ".col";
+  MidiCaptureWriter writer;
+  MidiColumnStore cs;
+  MidiColumnQuery q;
+  MidiColumnStats stats;
+  MidiColumnRow row;
+  MidiFrame f;
+  uint64_t expect = 0, n = 0, i;
+  unsigned int r = 7;
+
+  CHECK( writer.open( path ) );
+  for ( i = 0; i < 100000; i++ ) {
+    r = r * 1103515245 + 12345;
+    f.ts = 1000000ULL * i;
+    f.source = ( r >> 8 ) % 3;
+    f.len = 3;
+    f.data[0] = ( ( r >> 12 ) & 1 ? 0x90 : 0xb0 ) | ( ( r >> 16 ) & 0x0f );
+    f.data[1] = ( r >> 4 ) & 0x7f;
+    f.data[2] = ( r >> 20 ) & 0x7f;
+    if ( i % 1000 == 999 ) {
+      f.len = 1;
+      f.data[0] = 0xfa;
+      f.data[1] = f.data[2] = 0;
+    }
+    // note on of channel 3, velocity > 100, between 20 s and 30 s
+    if ( f.data[0] == 0x92 && f.data[2] > 100 && f.ts >= 20000000000ULL &&
+         f.ts <= 30000000000ULL )
+      expect++;
+    CHECK( writer.write( f ) );
+  }
+  CHECK( writer.close() );
+
+  CHECK( MidiColumnStore::build( path, store.c_str(), 2, 1024 ) );
+  CHECK( cs.open( store.c_str() ) );
+  CHECK( cs.getRowCount() == 100000 );
+  CHECK( cs.getRow( 999, row ) && row.status == 0xfa && row.ts == 999000000ULL );
+  CHECK( cs.getRow( 100000, row ) == false );
+
+  MidiColumnStore::initQuery( q );
+  CHECK( cs.query( q ) == 100000 );
+  MidiColumnStore::addType( q, 0x90, 3 );
+  q.d2_min = 101;
+  q.ts_min = 20000000000ULL;
+  q.ts_max = 30000000000ULL;
+  CHECK( cs.query( q, countRow, &n, &stats ) == expect );
+  CHECK( n == expect && expect > 0 );
+  // only the blocks of the time interval are read
+  CHECK( stats.blocks <= 12 && stats.skipped >= 85 );
+
+  MidiColumnStore::initQuery( q );
+  MidiColumnStore::addType( q, 0xfa );
+  q.source = 7;
+  CHECK( cs.query( q, NULL, NULL, &stats ) == 0 && stats.blocks == 0 );
+  q.source = -2;
+  CHECK( cs.query( q ) == 100 );
+  cs.close();
+  unlink( store.c_str() );
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "colstoretest" ) )
+    return 1;
+  testColumnStore( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "colstoretest" );
+}
@@ -0,0 +1,105 @@
+//*****************************************//
+//  demuxtest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the demultiplexer of the frames of a
+//  MidiReader into rings per channel, read by consumer threads.
+//
+//*****************************************//
+
+#include <pthread.h>
+#include <sched.h>
+#include "testutil.h"
+
+// Consumer of the ring of one channel.
+struct DemuxConsumer {
+  MidiDemux *demux;
+  int channel;
+  int count;
+  int bad;
+};
+
+static void *demuxConsumer( void *arg )
+{
+  DemuxConsumer *c = (DemuxConsumer *) arg;
+  MidiFrame f;
+
+  while ( c->count < 1000 ) {
+    if ( !c->demux->get( c->channel, f ) ) {
+      sched_yield();
+      continue;
+    }
+    if ( ( f.data[0] & 0x0f ) != c->channel - 1 || f.data[1] != ( c->count & 0x7f ) )
+      c->bad++;
+    c->count++;
+  }
+  return NULL;
+}
+
+// Demultiplex the frames of a reader, then of a producer thread to
+// consumer threads.
+static void testDemux()
+{
+  static const unsigned char in[] = { 0x90, 0x3c, 0x40, 0xf8, 0x92, 0x3c, 0x40,
+                                      0xb2, 0x07, 0x10, 0xc5, 0x01 };
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiDemux demux, small;
+  MidiDemuxStats stats;
+  MidiFrame f;
+  DemuxConsumer c[2];
+  pthread_t threads[2];
+  int fi[2];
+
+  CHECK( demux.open( 1 | ( 1 << 2 ) | MIDI_DEMUX_SYSTEM ) );
+  CHECK( demux.open() == false );
+  CHECK( pipeSource( reader, fi ) );
+  CHECK( demux.attach( reader ) );
+  CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+  close( fi[1] );
+  reader.pump();
+  CHECK( demux.count( 1 ) == 1 && demux.count( 3 ) == 2 && demux.count( 0 ) == 1 );
+  CHECK( demux.count( 6 ) == 0 && demux.getStats( 6, stats ) == false );
+  CHECK( demux.get( 3, f ) && f.data[0] == 0x92 );
+  CHECK( demux.get( 3, f ) && f.data[0] == 0xb2 && demux.get( 3, f ) == false );
+  CHECK( demux.get( 0, f ) && f.data[0] == 0xf8 );
+  CHECK( demux.get( 1, f ) && f.data[0] == 0x90 );
+  CHECK( demux.getStats( 3, stats ) && stats.frames == 2 && stats.dropped == 0 );
+  demux.detach( reader );
+  reader.close();
+
+  // a full ring drops the frames of its channel only
+  CHECK( small.open( MIDI_DEMUX_ALL, 2 ) );
+  f.len = 3;
+  f.data[0] = 0x90;
+  for ( int i = 0; i < 3; i++ )
+    small.put( f );
+  f.data[0] = 0x91;
+  CHECK( small.put( f ) );
+  CHECK( small.getStats( 1, stats ) && stats.frames == 2 && stats.dropped == 1 );
+  small.close();
+
+  for ( int i = 0; i < 2; i++ ) {
+    c[i].demux = &demux;
+    c[i].channel = i == 0 ? 1 : 3;
+    c[i].count = c[i].bad = 0;
+    CHECK( pthread_create( &threads[i], NULL, demuxConsumer, &c[i] ) == 0 );
+  }
+  for ( int i = 0; i < 2000; ) {
+    f.data[0] = ( i & 1 ) ? 0x92 : 0x90;
+    f.data[1] = ( i / 2 ) & 0x7f;
+    if ( demux.put( f ) )
+      i++;
+    else
+      sched_yield();
+  }
+  for ( int i = 0; i < 2; i++ ) {
+    pthread_join( threads[i], NULL );
+    CHECK( c[i].count == 1000 && c[i].bad == 0 );
+  }
+}
+
+int main()
+{
+  testDemux();
+  return testResult( "demuxtest" );
+}
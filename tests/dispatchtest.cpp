@@ -0,0 +1,70 @@
+//*****************************************//
+//  dispatchtest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the dispatch of the frames of a
+//  MidiReader to handlers.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Count the frames given to a handler, skipping them.
+static MidiFrameState countFrame( MidiFrame *f, void *userData )
+{
+  (void) f;
+  ( *(int *) userData )++;
+  return MIDIF_SKIPPED;
+}
+
+// Dispatch the frames of a reader to handlers by status, channel,
+// controller and sysex ID.
+static void testDispatch()
+{
+  static const unsigned char in[] = {
+    0x90, 0x3c, 0x40, 0x3c, 0x00,       // note on, then off by velocity 0
+    0x81, 0x3c, 0x00,                   // note off of channel 2
+    0xb0, 0x07, 0x10, 0xb0, 0x0a, 0x10, // volume, pan
+    0xf0, 0x43, 0x10, 0xf7,             // Yamaha
+    0xf0, 0x00, 0x20, 0x29, 0x01, 0xf7, // 3-byte ID
+    0xf0, 0x41, 0x10, 0xf7,             // Roland: default handler
+    0xf8, 0xe3, 0x00, 0x40 };
+  static const unsigned char yamaha[] = { 0x43 };
+  static const unsigned char novation[] = { 0x00, 0x20, 0x29 };
+  static const unsigned char bad[] = { 0x00 };
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiDispatcher d;
+  int noteOn = 0, noteOff = 0, volume = 0, sysex = 0, sysex3 = 0, clock = 0, bend = 0;
+  int fi[2], n = 0;
+
+  CHECK( d.on( 0x90, 1, -1, countFrame, &noteOn ) );
+  CHECK( d.on( 0x80, 0, 0x3c, countFrame, &noteOff ) );
+  CHECK( d.on( 0xb0, 1, 7, countFrame, &volume ) );
+  CHECK( d.on( 0xe0, 4, 0x40, countFrame, &bend ) );
+  CHECK( d.on( 0xf8, 0, -1, countFrame, &clock ) );
+  CHECK( d.on( 0xf0, 0, -1, countFrame, &sysex ) == false );
+  CHECK( d.onSysex( yamaha, 1, countFrame, &sysex ) );
+  CHECK( d.onSysex( novation, 3, countFrame, &sysex3 ) );
+  CHECK( d.onSysex( bad, 1, countFrame, &sysex3 ) == false );
+  // the same handler is stored once
+  CHECK( d.getHandle()->nhandlers == 8 );
+
+  CHECK( pipeSource( reader, fi ) );
+  d.attach( reader );
+  CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+  close( fi[1] );
+  reader.pump();
+  CHECK( noteOn == 1 && noteOff == 2 && volume == 1 && bend == 1 );
+  CHECK( sysex == 1 && sysex3 == 1 && clock == 1 );
+  // pan and the Roland sysex were kept by the default handler
+  while ( reader.pop() )
+    n++;
+  CHECK( n == 2 && d.getHandle()->dispatched == 8 );
+  reader.close();
+}
+
+int main()
+{
+  testDispatch();
+  return testResult( "dispatchtest" );
+}
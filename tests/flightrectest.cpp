@@ -0,0 +1,68 @@
+//*****************************************//
+//  flightrectest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that the flight recorder keeps the last
+//  frames of a MidiReader and saves them on demand, on a signal or
+//  after a crash.
+//
+//*****************************************//
+
+#include <csignal>
+#include "testutil.h"
+
+// Record more frames than the ring holds, then save it in all ways.
+static void testFlightRecorder( const char *path )
+{
+  static const unsigned char sysex[] = { 0xf0, 0x7e, 0x7f, 0x06, 0x01, 0x00,
+                                         0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                                         0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c,
+                                         0x0d, 0xf7 };
+  std::string ring = std::string( path ) + ".ring";
+  std::string signalled = std::string( path ) + ".sig";
+  MidiReader reader( MIDIR_NOQUEUE, NULL );
+  MidiFlightRecorder rec;
+  MidiFrame f;
+
+  CHECK( !rec.open( ring.c_str(), 100 ) );
+  CHECK( rec.open( ring.c_str(), 64 ) );
+  CHECK( rec.attach( reader ) );
+  for ( int i = 0; i < 100; i++ )
+    CHECK( reader.inject( 3, 0x90, i, 0x40 ) == 3 );
+  f.len = sizeof( sysex );
+  memcpy( f.data, sysex, sizeof( sysex ) );
+  f.source = 7;
+  f.ts = reader.getTime();
+  rec.record( f );
+  rec.detach( reader );
+
+  // 100 notes and a sysex taking 2 slots: the last 62 notes are kept
+  CHECK( rec.getCount() == 102 );
+  CHECK( rec.snapshot( path ) );
+  CHECK( countFrames( path, f ) == 63 );
+  CHECK( sameFrame( f, sizeof( sysex ), sysex ) && f.source == 7 );
+  CHECK( rec.snapshot( path, 1 ) && countFrames( path, f ) >= 1 );
+
+  CHECK( rec.setSignal( SIGUSR1, signalled.c_str() ) );
+  CHECK( raise( SIGUSR1 ) == 0 );
+  rec.close();
+  signalled += ".1";
+  CHECK( countFrames( signalled.c_str(), f ) == 63 );
+
+  // the ring file is kept, as after a crash
+  CHECK( MidiFlightRecorder::recover( ring.c_str(), path ) );
+  CHECK( countFrames( path, f ) == 63 );
+  unlink( signalled.c_str() );
+  unlink( ring.c_str() );
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "flightrectest" ) )
+    return 1;
+  testFlightRecorder( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "flightrectest" );
+}
@@ -0,0 +1,77 @@
+//*****************************************//
+//  hirestest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the assembler of 14-bit controllers, RPN
+//  and NRPN of a source of a MidiReader.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Events of a high-resolution assembler.
+struct HiResEvents {
+  int count;
+  MidiHiResEvent ev[8];
+};
+
+static void hiResEvent( const MidiHiResEvent *ev, void *userData )
+{
+  HiResEvents *e = (HiResEvents *) userData;
+
+  if ( e->count < 8 )
+    e->ev[e->count] = *ev;
+  e->count++;
+}
+
+// Assemble 14-bit controllers and NRPN from a source, with and without
+// pass-through.
+static void testHiRes()
+{
+  static const unsigned char in[] = {
+    0xb0, 0x01, 0x40, 0x21, 0x05,             // modulation 0x2005
+    0xb1, 0x63, 0x01, 0x62, 0x02, 0x06, 0x10, // NRPN 0x82, MSB only
+    0x91, 0x3c, 0x40,                         // gives the NRPN event
+    0xb1, 0x60, 0x00,                         // increment
+    0xb1, 0x07, 0x64, 0x27, 0x01 };           // volume, 7-bit only
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  HiResEvents events;
+  MidiHiResStats stats;
+  MidiFrame *f;
+  int fi[2], n = 0;
+
+  for ( int pass = 0; pass < 2; pass++ ) {
+    MidiHiRes hires( hiResEvent, &events );
+    memset( &events, 0, sizeof( events ) );
+    CHECK( hires.enableController( 1 ) && hires.enableController( 32 ) == false );
+    hires.setPassthrough( pass == 1 );
+    CHECK( pipeSource( reader, fi ) );
+    CHECK( hires.attach( reader, fi[0] ) );
+    CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+    close( fi[1] );
+    reader.pump();
+    hires.flush();
+    CHECK( events.count == 3 );
+    CHECK( events.ev[0].type == MIDI_HIRES_CC && events.ev[0].channel == 1 );
+    CHECK( events.ev[0].param == 1 && events.ev[0].value == 0x2005 && events.ev[0].fine );
+    CHECK( events.ev[1].type == MIDI_HIRES_NRPN && events.ev[1].channel == 2 );
+    CHECK( events.ev[1].param == 0x82 && events.ev[1].value == 0x800 && !events.ev[1].fine );
+    CHECK( events.ev[2].type == MIDI_HIRES_NRPN && events.ev[2].value == 0x801 );
+    hires.getStats( stats );
+    CHECK( stats.events == 3 && stats.consumed == ( pass == 0 ? 6u : 0u ) );
+    // the note and the 7-bit controllers are left, or all the frames
+    n = 0;
+    while ( ( f = reader.pop() ) != NULL ) {
+      CHECK( pass == 1 || f->data[0] == 0x91 || f->data[1] == 0x07 || f->data[1] == 0x27 );
+      n++;
+    }
+    CHECK( n == ( pass == 0 ? 3 : 9 ) );
+    reader.removeSource( fi[0] );
+  }
+}
+
+int main()
+{
+  testHiRes();
+  return testResult( "hirestest" );
+}
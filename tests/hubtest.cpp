@@ -0,0 +1,128 @@
+//*****************************************//
+//  hubtest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the hub publishing the frames of a
+//  MidiReader to other processes, and the hub ports of the DIRECT API.
+//
+//*****************************************//
+
+#include <cerrno>
+#include "testutil.h"
+
+// Publish the frames of a reader thru a hub to a client and to a port of
+// the DIRECT API, and send frames back to the owner.
+static void testHub()
+{
+  static const unsigned char in[] = { 0x90, 0x3c, 0x40, 0xb0, 0x07, 0x10 };
+  static const unsigned char out[] = { 0x80, 0x3c, 0x00 };
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiHub owner, client, other;
+  MidiHubStats stats;
+  midi_hub_t raw;
+  MidiFrame f;
+  RtMessages messages;
+  unsigned char buf[16];
+  std::string name;
+  unsigned int i, port;
+  int fi[2], fo[2];
+
+  CHECK( owner.create( "bad/name" ) == false );
+  CHECK( client.join( "hubtest" ) == false );
+  CHECK( owner.create( "hubtest", 4 ) );
+  CHECK( other.create( "hubtest", 4 ) == false && errno == EEXIST );
+  CHECK( client.join( "hubtest" ) );
+  for ( i = 0; MidiHub::list( i, name ) && name != "hubtest"; i++ )
+    ;
+  CHECK( name == "hubtest" );
+  // the hubs of other users are not listed (only checked as root)
+  fi[0] = open( "/dev/shm/midihub.hubtest-other", O_CREAT | O_RDWR, 0600 );
+  if ( fi[0] >= 0 && fchown( fi[0], geteuid() + 1, (gid_t) -1 ) == 0 ) {
+    for ( i = 0; MidiHub::list( i, name ); i++ )
+      CHECK( name != "hubtest-other" );
+  }
+  if ( fi[0] >= 0 ) {
+    close( fi[0] );
+    unlink( "/dev/shm/midihub.hubtest-other" );
+  }
+
+  RtMidiIn rtIn( RtMidi::DIRECT );
+  unsigned int nports = rtIn.getPortCount();
+  for ( port = 0; port < nports; port++ ) {
+    if ( rtIn.getPortName( port ) == "hub:hubtest" )
+      break;
+  }
+  CHECK( port < nports );
+  memset( &messages, 0, sizeof( messages ) );
+  rtIn.setCallback( rtMessage, &messages );
+  rtIn.openPort( port );
+  CHECK( rtIn.isPortOpen() );
+
+  CHECK( pipeSource( reader, fi ) );
+  CHECK( owner.attach( reader ) );
+  CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+  close( fi[1] );
+  reader.pump();
+  CHECK( client.next( f, 0 ) == 1 && f.data[0] == 0x90 && f.len == 3 );
+  CHECK( client.next( f, 0 ) == 1 && f.data[0] == 0xb0 );
+  CHECK( client.next( f, 10 ) == 0 );
+  waitMessages( messages, 2 );
+  CHECK( messages.count == 2 && messages.status[0] == 0x90 && messages.status[1] == 0xb0 );
+  rtIn.closePort();
+
+  // a client too slow loses the frames overwritten
+  f.len = 1;
+  f.data[0] = 0xf8;
+  for ( i = 0; i < 6; i++ )
+    owner.publish( f );
+  for ( i = 0; client.next( f, 0 ) == 1; i++ )
+    ;
+  client.getStats( stats );
+  CHECK( i == 4 && stats.lost == 2 );
+
+  // a client writing a bad size or frame in the shared memory does not
+  // make the others read out of their rings
+  CHECK( midi_hub_attach( &raw, "hubtest" ) );
+  raw.shm->size = 1000000;
+  f.len = 1;
+  owner.publish( f );
+  raw.in[raw.cursor & raw.mask].frame.len = 255;
+  CHECK( client.next( f, 0 ) == 1 && f.len == MIDI_FRAME_MAX );
+  raw.shm->size = 4;
+  midi_hub_close( &raw );
+
+  // output of the clients
+  CHECK( other.join( "hubtest" ) );
+  CHECK( client.send( out, sizeof( out ) ) && other.send( out, 1 ) );
+  CHECK( owner.getOutput( f ) && f.len == 3 && memcmp( f.data, out, 3 ) == 0 );
+  CHECK( owner.getOutput( f ) && f.len == 1 && owner.getOutput( f ) == false );
+  CHECK( pipe( fo ) == 0 );
+  CHECK( owner.startOutput( fo[1] ) );
+  CHECK( client.send( out, sizeof( out ) ) );
+  CHECK( read( fo[0], buf, sizeof( buf ) ) == sizeof( out ) );
+  // a client dying after taking an output slot does not stop the output
+  CHECK( midi_hub_attach( &raw, "hubtest" ) );
+  __atomic_add_fetch( &raw.shm->out_tail, 1, __ATOMIC_SEQ_CST );
+  midi_hub_close( &raw );
+  CHECK( client.send( out, sizeof( out ) ) );
+  CHECK( read( fo[0], buf, sizeof( buf ) ) == sizeof( out ) );
+  owner.stopOutput();
+  owner.getStats( stats );
+  CHECK( stats.sent == 2 && stats.dropped == 1 && stats.frames == 9 );
+
+  owner.detach( reader );
+  owner.close();
+  CHECK( client.next( f, -1 ) == -1 );
+  CHECK( client.send( out, 1 ) == false );
+  client.close();
+  other.close();
+  reader.close();
+  close( fo[0] );
+  close( fo[1] );
+}
+
+int main()
+{
+  testHub();
+  return testResult( "hubtest" );
+}
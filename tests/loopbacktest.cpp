@@ -0,0 +1,104 @@
+//*****************************************//
+//  loopbacktest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the ports of the LOOPBACK API.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Connect ports of the LOOPBACK API, with and without a simulated line.
+static void testLoopback()
+{
+  static const unsigned char note[] = { 0x90, 0x3c, 0x40 };
+  static const unsigned char clock[] = { 0xf8 };
+  static const unsigned char program[] = { 0xc0, 0x05 };
+  std::vector<unsigned char> message;
+  RtMessages messages;
+  unsigned int i;
+  uint64_t t0;
+  double ts = 0.0;
+
+  RtMidiIn rtIn( RtMidi::LOOPBACK );
+  RtMidiOut rtOut( RtMidi::LOOPBACK );
+  CHECK( rtIn.getCurrentApi() == RtMidi::LOOPBACK );
+  CHECK( RtMidi::getCompiledApiByName( "loopback" ) == RtMidi::LOOPBACK );
+  CHECK( rtIn.getPortCount() == 0 && rtOut.getPortCount() == 0 );
+
+  // a virtual input port, in queue mode; timing messages are ignored
+  rtIn.openVirtualPort( "loopbacktest" );
+  CHECK( rtIn.getPortCount() == 0 && rtOut.getPortCount() == 1 );
+  CHECK( rtOut.getPortName( 0 ) == "loopbacktest" );
+  rtOut.openPort( 0 );
+  CHECK( rtOut.isPortOpen() );
+  rtOut.sendMessage( note, sizeof( note ) );
+  rtOut.sendMessage( clock, sizeof( clock ) );
+  rtOut.sendMessage( note, 1 );
+  for ( i = 0; i < 1000; i++ ) {
+    rtIn.getMessage( &message );
+    if ( ! message.empty() )
+      break;
+    usleep( 1000 );
+  }
+  CHECK( message.size() == 3 && message[0] == 0x90 );
+  for ( i = 0; i < 1000; i++ ) {
+    ts = rtIn.getMessage( &message );
+    if ( ! message.empty() )
+      break;
+    usleep( 1000 );
+  }
+  CHECK( message.size() == 1 && message[0] == 0x90 && ts >= 0.0 );
+
+  // a line at 31250 bps, 2 ms latency: 3 bytes then 1 byte
+  memset( &messages, 0, sizeof( messages ) );
+  rtIn.setCallback( rtMessage, &messages );
+  rtOut.setLink( 31250, 0.002 );
+  t0 = midi_reader_get_time( NULL );
+  rtOut.sendMessage( note, sizeof( note ) );
+  rtOut.sendMessage( note, 1 );
+  waitMessages( messages, 2, 100 );
+  CHECK( messages.count == 2 );
+  CHECK( midi_reader_get_time( NULL ) - t0 >= 2000000ULL + 4 * 320000ULL );
+  rtOut.closePort();
+  rtIn.closePort();
+  CHECK( rtOut.getPortCount() == 0 );
+
+  // a virtual output port
+  memset( &messages, 0, sizeof( messages ) );
+  rtOut.openVirtualPort( "loopbacktest out" );
+  CHECK( rtIn.getPortCount() == 1 && rtIn.getPortName( 0 ) == "loopbacktest out" );
+  rtIn.openPort( 0 );
+  rtOut.sendMessage( note, sizeof( note ) );
+  waitMessages( messages, 1 );
+  CHECK( messages.count == 1 && messages.status[0] == 0x90 );
+  rtOut.closePort();
+  rtIn.closePort();
+
+  // messages are received in the order of their time of reception
+  RtMidiOut slow( RtMidi::LOOPBACK );
+  memset( &messages, 0, sizeof( messages ) );
+  rtIn.openVirtualPort( "loopbacktest order" );
+  rtOut.openPort( 0 );
+  slow.openPort( 0 );
+  rtOut.setLink( 0, 0.0 );
+  slow.setLink( 0, 0.005 );
+  slow.sendMessage( note, sizeof( note ) );
+  rtOut.sendMessage( program, sizeof( program ) );
+  waitMessages( messages, 2 );
+  CHECK( messages.count == 2 && messages.status[0] == 0xc0 && messages.status[1] == 0x90 );
+  slow.closePort();
+  rtOut.closePort();
+  rtIn.closePort();
+
+  // the in-process ports are tried last when no API is given
+  std::vector<RtMidi::Api> apis;
+  RtMidi::getCompiledApi( apis );
+  CHECK( !apis.empty() && apis.back() == RtMidi::LOOPBACK );
+}
+
+int main()
+{
+  testLoopback();
+  return testResult( "loopbacktest" );
+}
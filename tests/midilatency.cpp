@@ -0,0 +1,340 @@
+//*****************************************//
+//  midilatency.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Measure the latency added by RtMidi: probe messages are sent at a
+//  given rate thru a RtMidiOut, received by the callback of a RtMidiIn,
+//  and the time between both is reported for each message size and
+//  rate (min, median, p99, p99.9, max, jitter and histograms). The path
+//  is an in-process LOOPBACK connection, a pty virtual port of the
+//  DIRECT API, or two ports joined by a loopback cable.
+//
+//*****************************************//
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <time.h>
+#include "RtMidi.h"
+
+// max count of probes of a run (the id of a probe has 14 bits)
+#define PROBES_MAX 16384
+
+// count of buckets of the histograms: < 1 us, < 2 us, .., >= 2^(n-2) us
+#define BUCKETS 22
+
+static void usage()
+{
+  std::cout << "\nusage: midilatency [-a api] [-i port -o port] [-n count]\n";
+  std::cout << "                   [-s sizes] [-r rates] [-c file] [-g file]\n";
+  std::cout << "    where api = loopback (default) or direct: without -i and -o,\n";
+  std::cout << "        a virtual input port is created and opened by the output,\n";
+  std::cout << "    -i and -o = input and output ports joined by a cable,\n";
+  std::cout << "    count = count of probes per run (default: 2000, max: 16384),\n";
+  std::cout << "    sizes = message sizes in bytes, 3 or 5..1024 (default: 3,16,64;\n";
+  std::cout << "        the direct api receives up to 128 bytes),\n";
+  std::cout << "    rates = messages per second (default: 100,1000),\n";
+  std::cout << "    -c = write the results as CSV to file,\n";
+  std::cout << "    -g = write the histograms as CSV to file.\n\n";
+  exit( 1 );
+}
+
+static uint64_t now()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Times of a run, indexed by the id of the probes.
+struct Run {
+  uint64_t sent[PROBES_MAX];
+  uint64_t received[PROBES_MAX];
+  int count;
+};
+
+// Probes are note on messages, or sysex messages, whose two first data
+// bytes hold the id.
+static void probeReceived( double timeStamp, std::vector<unsigned char> *message,
+                           void *userData )
+{
+  Run *run = (Run *) userData;
+  uint64_t t = now();
+  int id;
+
+  (void) timeStamp;
+  if ( message->size() < 3 )
+    return;
+  if ( message->at( 0 ) == 0xf0 ) {
+    if ( message->size() < 5 || message->at( 1 ) != 0x7d )
+      return;
+    id = message->at( 2 ) | ( message->at( 3 ) << 7 );
+  }
+  else if ( message->at( 0 ) == 0x90 )
+    id = message->at( 1 ) | ( message->at( 2 ) << 7 );
+  else
+    return;
+  if ( id < run->count && run->received[id] == 0 )
+    __atomic_store_n( &run->received[id], t, __ATOMIC_RELEASE );
+}
+
+static void makeProbe( std::vector<unsigned char> &msg, size_t size, int id )
+{
+  msg.assign( size, 0 );
+  if ( size == 3 ) {
+    msg[0] = 0x90;
+    msg[1] = id & 0x7f;
+    msg[2] = ( id >> 7 ) & 0x7f;
+    return;
+  }
+  // sysex of the non-commercial id
+  msg[0] = 0xf0;
+  msg[1] = 0x7d;
+  msg[2] = id & 0x7f;
+  msg[3] = ( id >> 7 ) & 0x7f;
+  for ( size_t i = 4; i < size - 1; i++ )
+    msg[i] = i & 0x7f;
+  msg[size - 1] = 0xf7;
+}
+
+static int bucket( uint64_t ns )
+{
+  int b = 0;
+
+  for ( uint64_t us = ns / 1000; us > 0 && b < BUCKETS - 1; us >>= 1 )
+    b++;
+  return b;
+}
+
+static void parseList( const char *s, std::vector<int> &list )
+{
+  list.clear();
+  while ( *s ) {
+    list.push_back( atoi( s ) );
+    while ( *s && *s != ',' )
+      s++;
+    if ( *s == ',' )
+      s++;
+  }
+}
+
+// Find a port whose name ends with 'name'.
+static int findPort( RtMidi &rt, const std::string &name )
+{
+  for ( unsigned int i = 0; i < rt.getPortCount(); i++ ) {
+    std::string p = rt.getPortName( i );
+    if ( p.size() >= name.size() &&
+         p.compare( p.size() - name.size(), name.size(), name ) == 0 )
+      return (int) i;
+  }
+  return -1;
+}
+
+// Send the probes of a run, then wait for them.
+static void measure( RtMidiOut &out, Run *run, size_t size, int rate )
+{
+  std::vector<unsigned char> msg;
+  uint64_t period = 1000000000ULL / rate, t0, t;
+  struct timespec ts;
+  int i;
+
+  memset( run->sent, 0, sizeof( run->sent ) );
+  memset( run->received, 0, sizeof( run->received ) );
+  t0 = now() + 10000000ULL;
+  for ( i = 0; i < run->count; i++ ) {
+    makeProbe( msg, size, i );
+    // absolute times, so that the rate does not drift
+    t = t0 + i * period;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) != 0 )
+      ;
+    run->sent[i] = now();
+    out.sendMessage( &msg );
+  }
+
+  // wait up to one second for the last probes
+  for ( i = 0; i < 1000; i++ ) {
+    if ( __atomic_load_n( &run->received[run->count - 1], __ATOMIC_ACQUIRE ) )
+      break;
+    usleep( 1000 );
+  }
+  usleep( 10000 );
+}
+
+static void report( Run *run, size_t size, int rate, std::ostream *csv,
+                    std::ostream *hist )
+{
+  std::vector<uint64_t> times;
+  uint64_t lh[BUCKETS], jh[BUCKETS], prev = 0, jsum = 0;
+  bool first = true;
+  int i, n;
+
+  memset( lh, 0, sizeof( lh ) );
+  memset( jh, 0, sizeof( jh ) );
+  for ( i = 0; i < run->count; i++ ) {
+    uint64_t r = __atomic_load_n( &run->received[i], __ATOMIC_ACQUIRE );
+    uint64_t l, j;
+
+    if ( r == 0 )
+      continue;
+    l = r > run->sent[i] ? r - run->sent[i] : 0;
+    times.push_back( l );
+    lh[bucket( l )]++;
+    // jitter: change of the latency from the previous probe received
+    if ( ! first ) {
+      j = l > prev ? l - prev : prev - l;
+      jh[bucket( j )]++;
+      jsum += j;
+    }
+    prev = l;
+    first = false;
+  }
+  n = (int) times.size();
+
+  std::cout << "size " << std::setw( 4 ) << size << ", rate "
+            << std::setw( 6 ) << rate << "/s: ";
+  if ( n == 0 ) {
+    std::cout << "no probe received" << std::endl;
+    return;
+  }
+  std::sort( times.begin(), times.end() );
+  std::cout << std::fixed << std::setprecision( 1 )
+            << "min " << times[0] / 1000.0
+            << " us, median " << times[n / 2] / 1000.0
+            << " us, p99 " << times[(size_t) n * 99 / 100] / 1000.0
+            << " us, p99.9 " << times[(size_t) n * 999 / 1000] / 1000.0
+            << " us, max " << times[n - 1] / 1000.0
+            << " us, jitter " << ( n > 1 ? jsum / ( n - 1 ) / 1000.0 : 0.0 )
+            << " us";
+  if ( n < run->count )
+    std::cout << ", lost " << run->count - n;
+  std::cout << std::endl;
+
+  // latency histogram, upper bound of each bucket
+  std::cout << "    latency (us):";
+  for ( i = 0; i < BUCKETS; i++ ) {
+    if ( lh[i] )
+      std::cout << " <" << ( 1 << i ) << ":" << lh[i];
+  }
+  std::cout << "\n    jitter (us): ";
+  for ( i = 0; i < BUCKETS; i++ ) {
+    if ( jh[i] )
+      std::cout << " <" << ( 1 << i ) << ":" << jh[i];
+  }
+  std::cout << std::endl;
+
+  if ( csv ) {
+    *csv << size << "," << rate << "," << run->count << "," << n << ","
+         << times[0] / 1000.0 << "," << times[n / 2] / 1000.0 << ","
+         << times[(size_t) n * 99 / 100] / 1000.0 << ","
+         << times[(size_t) n * 999 / 1000] / 1000.0 << ","
+         << times[n - 1] / 1000.0 << ","
+         << ( n > 1 ? jsum / ( n - 1 ) / 1000.0 : 0.0 ) << std::endl;
+  }
+  if ( hist ) {
+    for ( i = 0; i < BUCKETS; i++ ) {
+      *hist << size << "," << rate << ",latency," << ( 1 << i ) << ","
+            << lh[i] << "\n";
+    }
+    for ( i = 0; i < BUCKETS; i++ ) {
+      *hist << size << "," << rate << ",jitter," << ( 1 << i ) << ","
+            << jh[i] << "\n";
+    }
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  RtMidi::Api api = RtMidi::LOOPBACK;
+  std::vector<int> sizes, rates;
+  std::ofstream csv, hist;
+  int count = 2000, inPort = -1, outPort = -1, c;
+  const char *csvPath = NULL, *histPath = NULL;
+  Run *run;
+
+  parseList( "3,16,64", sizes );
+  parseList( "100,1000", rates );
+  while ( ( c = getopt( argc, argv, "a:i:o:n:s:r:c:g:" ) ) != -1 ) {
+    switch ( c ) {
+    case 'a':
+      api = RtMidi::getCompiledApiByName( optarg );
+      if ( api == RtMidi::UNSPECIFIED ) usage();
+      break;
+    case 'i': inPort = atoi( optarg ); break;
+    case 'o': outPort = atoi( optarg ); break;
+    case 'n': count = atoi( optarg ); break;
+    case 's': parseList( optarg, sizes ); break;
+    case 'r': parseList( optarg, rates ); break;
+    case 'c': csvPath = optarg; break;
+    case 'g': histPath = optarg; break;
+    default: usage();
+    }
+  }
+  if ( optind != argc || count <= 1 || count > PROBES_MAX ||
+       ( inPort < 0 ) != ( outPort < 0 ) || sizes.empty() || rates.empty() )
+    usage();
+  for ( size_t i = 0; i < sizes.size(); i++ ) {
+    if ( sizes[i] != 3 && ( sizes[i] < 5 || sizes[i] > 1024 ) ) usage();
+  }
+  for ( size_t i = 0; i < rates.size(); i++ ) {
+    if ( rates[i] <= 0 ) usage();
+  }
+
+  run = new Run;
+  run->count = count;
+  try {
+    RtMidiIn in( api, "midilatency" );
+    RtMidiOut out( api, "midilatency" );
+
+    in.ignoreTypes( false, true, true );
+    in.setCallback( probeReceived, run );
+    if ( inPort < 0 ) {
+      in.openVirtualPort( "midilatency" );
+      outPort = findPort( out, "midilatency" );
+      if ( outPort < 0 ) {
+        std::cout << "the virtual port is not listed" << std::endl;
+        delete run;
+        return 1;
+      }
+    }
+    else
+      in.openPort( inPort );
+    out.openPort( outPort );
+    std::cout << "api " << RtMidi::getApiName( api ) << ", "
+              << out.getPortName( outPort ) << std::endl;
+
+    if ( csvPath ) {
+      csv.open( csvPath );
+      csv << "size,rate,sent,received,min_us,median_us,p99_us,p999_us,"
+          << "max_us,jitter_us" << std::endl;
+    }
+    if ( histPath ) {
+      hist.open( histPath );
+      hist << "size,rate,histogram,below_us,count" << std::endl;
+    }
+    for ( size_t s = 0; s < sizes.size(); s++ ) {
+      for ( size_t r = 0; r < rates.size(); r++ ) {
+        measure( out, run, sizes[s], rates[r] );
+        report( run, sizes[s], rates[r], csvPath ? &csv : NULL,
+                histPath ? &hist : NULL );
+      }
+    }
+    out.closePort();
+    in.closePort();
+  }
+  catch ( RtMidiError &error ) {
+    error.printMessage();
+    delete run;
+    return 1;
+  }
+  delete run;
+  return 0;
+}
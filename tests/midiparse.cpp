@@ -0,0 +1,74 @@
+//*****************************************//
+//  midiparse.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Parse a raw MIDI dump, a raw capture or a capture file with a
+//  MidiParallelParser, and optionally write the frames to a capture
+//  file, with compressed blocks.
+//
+//*****************************************//
+
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include "MidiReader.h"
+
+static void usage()
+{
+  std::cout << "\nusage: midiparse [-j threads] [-c chunk] [-o out.cap [-z]] file\n";
+  std::cout << "    where threads = count of threads (default: count of CPUs),\n";
+  std::cout << "    chunk = size of the chunks in bytes (default: 4 MB),\n";
+  std::cout << "    out.cap = capture file to write,\n";
+  std::cout << "    and -z compresses its blocks.\n\n";
+  exit( 1 );
+}
+
+static bool writeFrame( const MidiFrame *mf, void *userData )
+{
+  return ( (MidiCaptureWriter *) userData )->write( *mf );
+}
+
+int main( int argc, char *argv[] )
+{
+  MidiCaptureWriter writer;
+  MidiParallelStats stats;
+  const char *out = NULL;
+  int threads = 0, c;
+  size_t chunk = 0;
+  bool ok, compress = false;
+
+  while ( ( c = getopt( argc, argv, "j:c:o:z" ) ) != -1 ) {
+    switch ( c ) {
+    case 'j': threads = atoi( optarg ); break;
+    case 'c': chunk = strtoul( optarg, NULL, 0 ); break;
+    case 'o': out = optarg; break;
+    case 'z': compress = true; break;
+    default: usage();
+    }
+  }
+  if ( optind != argc - 1 ) usage();
+
+  MidiParallelParser parser( MIDIR_EXPAND, threads, chunk );
+  if ( out ) {
+    if ( !writer.open( out ) ) {
+      std::cout << "cannot create " << out << std::endl;
+      return 1;
+    }
+    if ( compress )
+      writer.setCodec( MIDI_CAPTURE_CODEC_PACK );
+    parser.setCallback( writeFrame, &writer );
+  }
+  ok = parser.parseFile( argv[optind] );
+  if ( out && !writer.close() )
+    ok = false;
+  parser.getStats( stats );
+
+  std::cout << stats.frames << " frames, " << stats.bytes << " bytes, "
+            << stats.chunks << " chunks, " << stats.threads << " threads, "
+            << stats.duration / 1000000 << " ms" << std::endl;
+  if ( !ok ) {
+    std::cout << "error while parsing " << argv[optind] << std::endl;
+    return 1;
+  }
+  return 0;
+}
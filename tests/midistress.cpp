@@ -0,0 +1,399 @@
+//*****************************************//
+//  midistress.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Stress test of the input path: N feeder threads write a mix of
+//  MIDI traffic into pipes or ptys, each at a multiple of the rate of a
+//  DIN line, read by one MidiReader or by a RtMidiIn of the DIRECT API
+//  per source. Reports the throughput, the CPU time per message, the
+//  high-water mark of the reader queue, the drops and the latency
+//  percentiles of each source.
+//
+//*****************************************//
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "MidiReader.h"
+#include "RtMidi.h"
+
+// bytes per second of a DIN line (31250 bps, 10 bits per byte)
+#define DIN_RATE 3125.0
+
+// messages carrying a sequence number: the id has 14 bits
+#define SEQ_MAX 16384
+
+// max count of latencies kept per source
+#define LATENCIES_MAX 1000000
+
+static void usage()
+{
+  std::cout << "\nusage: midistress [-n sources] [-x rate] [-t seconds] [-m mode] [-p]\n";
+  std::cout << "    where sources = count of feeders (default: 4, max: 64),\n";
+  std::cout << "    rate = rate of each feeder, in DIN lines (default: 1),\n";
+  std::cout << "    seconds = duration of the test (default: 5),\n";
+  std::cout << "    mode = reader (one MidiReader, default) or rtmidi (a RtMidiIn\n";
+  std::cout << "        of the DIRECT API per source, on a virtual port),\n";
+  std::cout << "    -p = feed ptys instead of pipes (always with rtmidi).\n\n";
+  exit( 1 );
+}
+
+static uint64_t now( clockid_t clock = CLOCK_MONOTONIC )
+{
+  struct timespec ts;
+
+  clock_gettime( clock, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct Source {
+  // feeder
+  int fd;
+  double rate;
+  uint64_t sent[SEQ_MAX];
+  unsigned long messages;
+  unsigned long bytes;
+  uint64_t cpu;
+  unsigned int seed;
+  unsigned char running;
+  unsigned int seq;
+  bool noteOn;
+  int stop;
+  pthread_t thread;
+  // receiver
+  unsigned long received;
+  std::vector<uint32_t> latencies;
+};
+
+// Append the next message of the mix to 'buf', returns its length. The
+// voice messages of 3 bytes carry the sequence number of the source in
+// their data bytes, to measure their latency; running status is used as
+// by a DIN sender.
+static int nextMessage( Source *s, unsigned char *buf, unsigned int *seq )
+{
+  unsigned char status, msg[16];
+  int r, len, n = 0;
+
+  s->seed = s->seed * 1103515245 + 12345;
+  r = ( s->seed >> 16 ) % 100;
+  *seq = SEQ_MAX;
+  if ( r < 18 ) {
+    // timing clock, does not change the running status
+    buf[0] = 0xf8;
+    return 1;
+  }
+  if ( r < 20 ) {
+    // a short sysex
+    msg[0] = 0xf0;
+    msg[1] = 0x7d;
+    for ( len = 2; len < 15; len++ )
+      msg[len] = len;
+    msg[len++] = 0xf7;
+    memcpy( buf, msg, len );
+    s->running = 0;
+    return len;
+  }
+  if ( r < 30 ) {
+    // program change or channel pressure
+    status = ( r & 1 ? 0xc0 : 0xd0 ) | ( r & 0x0f );
+    msg[0] = status;
+    msg[1] = r & 0x7f;
+    len = 2;
+  }
+  else {
+    if ( r < 65 ) {
+      status = s->noteOn ? 0x90 : 0x80;
+      s->noteOn = ! s->noteOn;
+    }
+    else if ( r < 90 )
+      status = 0xb0;
+    else
+      status = 0xe0;
+    status |= s->seq & 0x03;
+    *seq = s->seq;
+    s->seq = ( s->seq + 1 ) % SEQ_MAX;
+    msg[0] = status;
+    msg[1] = *seq & 0x7f;
+    msg[2] = ( *seq >> 7 ) & 0x7f;
+    len = 3;
+  }
+  if ( status != s->running )
+    buf[n++] = status;
+  s->running = status;
+  memcpy( buf + n, msg + 1, len - 1 );
+  return n + len - 1;
+}
+
+// Write the mix at the rate of the source, 1 ms at a time.
+static void *feed( void *ptr )
+{
+  Source *s = (Source *) ptr;
+  unsigned char buf[65536];
+  unsigned int seqs[4096];
+  double budget = 0.0;
+  uint64_t t;
+  struct timespec ts;
+  int len, n, i, w;
+
+  t = now();
+  while ( !__atomic_load_n( &s->stop, __ATOMIC_ACQUIRE ) ) {
+    t += 1000000ULL;
+    ts.tv_sec = t / 1000000000ULL;
+    ts.tv_nsec = t % 1000000000ULL;
+    while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) != 0 )
+      ;
+    budget += s->rate / 1000.0;
+    for ( len = 0, n = 0; budget > 0.0 && len < (int) sizeof( buf ) - 16 &&
+                          n < 4096; n++ ) {
+      i = nextMessage( s, buf + len, &seqs[n] );
+      len += i;
+      budget -= i;
+    }
+    // the messages are sent when written
+    t = std::max( t, now() );
+    for ( i = 0; i < n; i++ ) {
+      if ( seqs[i] < SEQ_MAX )
+        __atomic_store_n( &s->sent[seqs[i]], now(), __ATOMIC_RELEASE );
+    }
+    for ( i = 0; i < len; i += w ) {
+      w = write( s->fd, buf + i, len - i );
+      if ( w <= 0 )
+        break;
+    }
+    if ( i < len )
+      break;
+    s->messages += n;
+    s->bytes += len;
+  }
+  s->cpu = now( CLOCK_THREAD_CPUTIME_ID );
+  return NULL;
+}
+
+static void received( Source *s, const unsigned char *data, int len )
+{
+  unsigned int seq;
+  uint64_t sent;
+
+  s->received++;
+  if ( len != 3 || data[0] < 0x80 || ( data[0] >= 0xc0 && data[0] < 0xe0 ) ||
+       data[0] >= 0xf0 )
+    return;
+  seq = data[1] | ( data[2] << 7 );
+  sent = __atomic_load_n( &s->sent[seq], __ATOMIC_ACQUIRE );
+  if ( sent && s->latencies.size() < LATENCIES_MAX )
+    s->latencies.push_back( (uint32_t) std::min( now() - sent, (uint64_t) 0xffffffffULL ) );
+}
+
+static void rtReceived( double timeStamp, std::vector<unsigned char> *message,
+                        void *userData )
+{
+  (void) timeStamp;
+  if ( ! message->empty() )
+    received( (Source *) userData, &message->at( 0 ), (int) message->size() );
+}
+
+static double percentile( std::vector<uint32_t> &v, int perMille )
+{
+  if ( v.empty() )
+    return 0.0;
+  return v[(size_t) v.size() * perMille / 1000] / 1000.0;
+}
+
+int main( int argc, char *argv[] )
+{
+  int nsources = 4, seconds = 5, c, i;
+  double rate = 1.0;
+  bool rtmidi = false, pty = false;
+  std::vector<Source *> sources;
+  std::vector<MidiVirtualPort *> ports;
+  std::vector<RtMidiIn *> inputs;
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiReaderStats stats;
+  struct pollfd pfd[MIDI_READER_IN_MAX];
+  struct rusage ru;
+  uint64_t t0, t1, end, cpu0, cpu1, feeders = 0;
+  unsigned long sent = 0, total = 0, errors = 0;
+  int ids[MIDI_READER_IN_MAX];
+
+  while ( ( c = getopt( argc, argv, "n:x:t:m:p" ) ) != -1 ) {
+    switch ( c ) {
+    case 'n': nsources = atoi( optarg ); break;
+    case 'x': rate = atof( optarg ); break;
+    case 't': seconds = atoi( optarg ); break;
+    case 'm':
+      if ( !strcmp( optarg, "reader" ) ) rtmidi = false;
+      else if ( !strcmp( optarg, "rtmidi" ) ) rtmidi = true;
+      else usage();
+      break;
+    case 'p': pty = true; break;
+    default: usage();
+    }
+  }
+  if ( optind != argc || nsources <= 0 || nsources > MIDI_READER_IN_MAX ||
+       rate <= 0.0 || seconds <= 0 )
+    usage();
+  if ( rtmidi )
+    pty = true;
+
+  // the sources and their input side
+  for ( i = 0; i < nsources; i++ ) {
+    Source *s = new Source;
+    int fds[2];
+
+    memset( s->sent, 0, sizeof( s->sent ) );
+    s->rate = rate * DIN_RATE;
+    s->messages = s->bytes = s->received = 0;
+    s->cpu = 0;
+    s->seed = i + 1;
+    s->running = 0;
+    s->seq = 0;
+    s->noteOn = true;
+    s->stop = 0;
+    sources.push_back( s );
+    if ( rtmidi ) {
+      std::string name = "midistress-" + std::to_string( i );
+      RtMidiIn *in = new RtMidiIn( RtMidi::DIRECT );
+
+      in->ignoreTypes( false, false, true );
+      in->setCallback( rtReceived, s );
+      in->openVirtualPort( name );
+      inputs.push_back( in );
+      s->fd = open( ( std::string( MIDI_PTY_DIR "/" ) + name ).c_str(),
+                    O_WRONLY | O_NOCTTY );
+    }
+    else if ( pty ) {
+      MidiVirtualPort *vp = new MidiVirtualPort;
+      std::string name = "midistress-" + std::to_string( i );
+
+      s->fd = -1;
+      if ( vp->open( name.c_str() ) ) {
+        // the reader closes its sources
+        fds[0] = dup( vp->getDescriptor() );
+        reader.addSource( fds[0], 0 );
+        ids[i] = reader.getSourceId( fds[0] );
+        s->fd = open( vp->getPath(), O_WRONLY | O_NOCTTY );
+      }
+      ports.push_back( vp );
+    }
+    else if ( pipe( fds ) == 0 ) {
+      fcntl( fds[0], F_SETFL, O_NONBLOCK );
+      reader.addSource( fds[0], 0 );
+      ids[i] = reader.getSourceId( fds[0] );
+      s->fd = fds[1];
+    }
+    else
+      s->fd = -1;
+    if ( s->fd < 0 ) {
+      std::cout << "cannot create source " << i << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << nsources << " sources at " << rate << " DIN line(s) ("
+            << rate * DIN_RATE << " bytes/s) thru "
+            << ( pty ? "ptys" : "pipes" ) << " to "
+            << ( rtmidi ? "RtMidiIn" : "MidiReader" ) << ", "
+            << seconds << " s" << std::endl;
+
+  getrusage( RUSAGE_SELF, &ru );
+  cpu0 = ( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) * 1000000000ULL +
+         ( ru.ru_utime.tv_usec + ru.ru_stime.tv_usec ) * 1000ULL;
+  t0 = now();
+  for ( i = 0; i < nsources; i++ )
+    pthread_create( &sources[i]->thread, NULL, feed, sources[i] );
+
+  // read until the end, then drain for 100 ms
+  end = t0 + seconds * 1000000000ULL;
+  for ( i = 0; i < nsources; i++ ) {
+    pfd[i].fd = rtmidi ? -1 : reader.getHandle()->sources[i].fd;
+    pfd[i].events = POLLIN;
+  }
+  while ( ( t1 = now() ) < end + 100000000ULL ) {
+    MidiFrame *mf;
+
+    if ( t1 >= end && sources[0]->stop == 0 ) {
+      for ( i = 0; i < nsources; i++ )
+        __atomic_store_n( &sources[i]->stop, 1, __ATOMIC_RELEASE );
+    }
+    if ( rtmidi ) {
+      usleep( 10000 );
+      continue;
+    }
+    if ( poll( pfd, nsources, 10 ) <= 0 )
+      continue;
+    reader.pump();
+    while ( ( mf = reader.pop() ) != NULL ) {
+      for ( i = 0; i < nsources && ids[i] != mf->source; i++ )
+        ;
+      if ( i < nsources )
+        received( sources[i], mf->data, mf->len );
+    }
+  }
+  for ( i = 0; i < nsources; i++ ) {
+    pthread_join( sources[i]->thread, NULL );
+    feeders += sources[i]->cpu;
+  }
+  getrusage( RUSAGE_SELF, &ru );
+  cpu1 = ( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) * 1000000000ULL +
+         ( ru.ru_utime.tv_usec + ru.ru_stime.tv_usec ) * 1000ULL;
+
+  std::cout << "source     sent     recv   dropped  errors   msg/s"
+            << "     p50     p99   p99.9     max (us)" << std::endl;
+  for ( i = 0; i < nsources; i++ ) {
+    Source *s = sources[i];
+    unsigned long errs = 0;
+
+    if ( ! rtmidi && reader.getStats( i, stats ) )
+      errs = stats.errors;
+    std::sort( s->latencies.begin(), s->latencies.end() );
+    std::cout << std::setw( 6 ) << i << std::setw( 9 ) << s->messages
+              << std::setw( 9 ) << s->received << std::setw( 10 )
+              << ( s->messages > s->received ? s->messages - s->received : 0 )
+              << std::setw( 8 ) << errs << std::setw( 8 )
+              << (unsigned long) ( s->messages / (double) seconds )
+              << std::fixed << std::setprecision( 1 )
+              << std::setw( 8 ) << percentile( s->latencies, 500 )
+              << std::setw( 8 ) << percentile( s->latencies, 990 )
+              << std::setw( 8 ) << percentile( s->latencies, 999 )
+              << std::setw( 8 ) << ( s->latencies.empty() ? 0.0 :
+                                      s->latencies.back() / 1000.0 )
+              << std::endl;
+    sent += s->messages;
+    total += s->received;
+    errors += errs;
+  }
+
+  // the CPU time of the feeders is not counted
+  std::cout << "throughput: " << (unsigned long) ( total / (double) seconds )
+            << " msg/s, CPU per message: "
+            << ( total ? ( cpu1 - cpu0 - std::min( cpu1 - cpu0, feeders ) ) /
+                 (double) total : 0.0 ) << " ns, dropped: " << sent - std::min( sent, total )
+            << ", errors: " << errors;
+  if ( ! rtmidi && reader.getStats( -1, stats ) )
+    std::cout << ", queue high-water mark: " << stats.queued_max
+              << ", missed: " << stats.missed;
+  std::cout << std::endl;
+
+  for ( i = 0; i < nsources; i++ ) {
+    close( sources[i]->fd );
+    if ( rtmidi ) {
+      inputs[i]->closePort();
+      delete inputs[i];
+    }
+    delete sources[i];
+  }
+  reader.close();
+  for ( size_t p = 0; p < ports.size(); p++ )
+    delete ports[p];
+  return 0;
+}
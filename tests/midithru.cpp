@@ -0,0 +1,156 @@
+//*****************************************//
+//  midithru.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Benchmark of the round-trip time of a soft-thru between two pipes:
+//  the MidiThru path (frames or raw bytes forwarded in the thread
+//  reading them) against a queue path (reader queue, then a write per
+//  message, polling with a 200 us sleep).
+//
+//*****************************************//
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include "MidiReader.h"
+
+static void usage()
+{
+  std::cout << "\nusage: midithru [-n count] [-m mode]\n";
+  std::cout << "    where count = count of round trips (default: 10000),\n";
+  std::cout << "    and mode = thru, raw or queue (default: all).\n\n";
+  exit( 1 );
+}
+
+struct Bench {
+  int in;  // read end of the input pipe
+  int out; // write end of the output pipe
+  int mode; // 0: thru, 1: raw, 2: queue
+  int stop;
+  MidiThru *thru;
+};
+
+static void *forward( void *ptr )
+{
+  Bench *b = (Bench *) ptr;
+  MidiReader reader( b->mode == 1 ? MIDIR_RAW :
+                     (MidiReaderFlags) ( MIDIR_EXPAND | MIDIR_NOQUEUE ), NULL );
+  MidiFrame *mf;
+  struct timespec wts = { 0, 200000 };
+
+  if ( b->mode < 2 ) {
+    reader.addSource( b->in, 0 );
+    b->thru->run( reader, 100 );
+    return NULL;
+  }
+  // the path of the former Direct input thread
+  MidiReader queue( MIDIR_EXPAND, NULL );
+  fcntl( b->in, F_SETFL, O_NONBLOCK );
+  queue.addSource( b->in, 0 );
+  while ( !__atomic_load_n( &b->stop, __ATOMIC_ACQUIRE ) ) {
+    if ( queue.update() && ( mf = queue.getNext() ) != NULL ) {
+      if ( write( b->out, mf->data, mf->len ) < 0 )
+        break;
+    }
+    else
+      nanosleep( &wts, NULL );
+  }
+  return NULL;
+}
+
+static uint64_t now()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench( int mode, int count )
+{
+  static const char *names[] = { "thru", "raw", "queue" };
+  unsigned char msg[3] = { 0x90, 0x3c, 0x40 }, buf[3];
+  std::vector<uint64_t> times;
+  int fi[2], fo[2], i, n, r;
+  pthread_t thread;
+  Bench b;
+
+  if ( pipe( fi ) < 0 || pipe( fo ) < 0 ) {
+    std::cout << "cannot create pipes" << std::endl;
+    exit( 1 );
+  }
+  MidiThru thru( fo[1] );
+  b.in = fi[0];
+  b.out = fo[1];
+  b.mode = mode;
+  b.stop = 0;
+  b.thru = &thru;
+  pthread_create( &thread, NULL, forward, &b );
+
+  for ( i = 0; i < count; i++ ) {
+    uint64_t t0 = now();
+
+    msg[1] = 0x3c + ( i & 0x0f );
+    if ( write( fi[1], msg, 3 ) != 3 )
+      break;
+    for ( n = 0; n < 3; n += r ) {
+      r = read( fo[0], buf + n, 3 - n );
+      if ( r <= 0 )
+        break;
+    }
+    if ( n < 3 || memcmp( buf, msg, 3 ) )
+      break;
+    times.push_back( now() - t0 );
+  }
+
+  // closing the input stops the thru
+  close( fi[1] );
+  thru.stop();
+  __atomic_store_n( &b.stop, 1, __ATOMIC_RELEASE );
+  pthread_join( thread, NULL );
+  close( fi[0] );
+  close( fo[0] );
+  close( fo[1] );
+
+  if ( times.size() != (size_t) count ) {
+    std::cout << names[mode] << ": error after " << times.size()
+              << " round trips" << std::endl;
+    return;
+  }
+  std::sort( times.begin(), times.end() );
+  std::cout << names[mode] << ": min " << times[0] / 1000.0
+            << " us, median " << times[count / 2] / 1000.0
+            << " us, p99 " << times[count * 99 / 100] / 1000.0
+            << " us, max " << times[count - 1] / 1000.0 << " us" << std::endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  int count = 10000, mode = -1, c;
+
+  while ( ( c = getopt( argc, argv, "n:m:" ) ) != -1 ) {
+    switch ( c ) {
+    case 'n': count = atoi( optarg ); break;
+    case 'm':
+      if ( !strcmp( optarg, "thru" ) ) mode = 0;
+      else if ( !strcmp( optarg, "raw" ) ) mode = 1;
+      else if ( !strcmp( optarg, "queue" ) ) mode = 2;
+      else usage();
+      break;
+    default: usage();
+    }
+  }
+  if ( optind != argc || count <= 0 ) usage();
+
+  for ( int m = 0; m < 3; m++ ) {
+    if ( mode < 0 || mode == m )
+      bench( m, count );
+  }
+  return 0;
+}
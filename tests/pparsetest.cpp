@@ -0,0 +1,112 @@
+//*****************************************//
+//  pparsetest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that the parallel parser gives the frames
+//  of one MidiReader, from raw bytes and from a capture file.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Frames of a parse, in order.
+static void collectTap( const midi_frame_t *mf, void *userData )
+{
+  ( (std::vector<MidiFrame> *) userData )->push_back( *mf );
+}
+
+static bool collectFrame( const midi_frame_t *mf, void *userData )
+{
+  collectTap( mf, userData );
+  return true;
+}
+
+static bool sameFrames( const std::vector<MidiFrame>& a,
+                        const std::vector<MidiFrame>& b )
+{
+  if ( a.size() != b.size() ) return false;
+  for ( size_t i = 0; i < a.size(); i++ ) {
+    if ( a[i].ts != b[i].ts || !sameFrame( a[i], b[i].len, b[i].data ) )
+      return false;
+  }
+  return true;
+}
+
+// Parse a random stream with running status, sysex and real-time bytes in
+// small chunks, and compare with one reader; then parse a capture file.
+static void testParallelParse( const char *path )
+{
+  std::vector<unsigned char> raw;
+  std::vector<MidiFrame> seq, par;
+  midi_reader_t reader;
+  midi_reader_source_t src;
+  MidiParallelParser parser( MIDIR_EXPAND, 4, 4096 );
+  MidiParallelStats stats;
+  MidiCaptureWriter writer;
+  unsigned int r = 1, i, j, n;
+
+  while ( raw.size() < 200000 ) {
+    r = r * 1103515245 + 12345;
+    switch ( ( r >> 16 ) % 4 ) {
+    case 0:
+      // sysex
+      raw.push_back( 0xf0 );
+      n = ( r >> 8 ) % 60;
+      for ( j = 0; j < n; j++ )
+        raw.push_back( ( r >> ( j % 8 ) ) & 0x7f );
+      raw.push_back( 0xf7 );
+      break;
+    case 1:
+      raw.push_back( 0xf8 );
+      break;
+    default:
+      // note or control change, then data bytes with running status
+      raw.push_back( ( ( r >> 20 ) & 1 ? 0x90 : 0xb0 ) | ( ( r >> 8 ) & 0x0f ) );
+      n = 1 + ( r >> 24 ) % 40;
+      for ( j = 0; j < 2 * n; j++ ) {
+        raw.push_back( ( r + j ) & 0x7f );
+        if ( j == n )
+          raw.push_back( 0xfe );
+      }
+      break;
+    }
+  }
+
+  midi_reader_init( &reader, (MidiReaderFlags) ( MIDIR_EXPAND | MIDIR_NOQUEUE ), NULL );
+  midi_reader_add_tap( &reader, collectTap, &seq );
+  midi_reader_init_source( &src, 0 );
+  midi_reader_parse( &reader, &src, &raw[0], (int) raw.size(), 0, true );
+
+  parser.setCallback( collectFrame, &par );
+  CHECK( parser.parse( &raw[0], raw.size() ) );
+  parser.getStats( stats );
+  CHECK( stats.chunks > 40 && stats.threads == 4 );
+  CHECK( stats.bytes == raw.size() && stats.frames == seq.size() );
+  CHECK( seq.size() > 10000 && sameFrames( seq, par ) );
+
+  // a capture file in small blocks
+  CHECK( writer.open( path, 256 ) );
+  for ( i = 0; i < seq.size(); i++ ) {
+    seq[i].ts = i;
+    seq[i].source = i % 3;
+    CHECK( writer.write( seq[i] ) );
+  }
+  CHECK( writer.close() );
+  par.clear();
+  CHECK( parser.parseFile( path ) );
+  CHECK( sameFrames( seq, par ) );
+  for ( i = 0; i < par.size(); i++ )
+    if ( par[i].source != (int) ( i % 3 ) ) break;
+  CHECK( i == par.size() );
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "pparsetest" ) )
+    return 1;
+  testParallelParse( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "pparsetest" );
+}
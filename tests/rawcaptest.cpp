@@ -0,0 +1,74 @@
+//*****************************************//
+//  rawcaptest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that raw captures keep the bytes of a
+//  device with their timing, and are parsed later into a capture.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Capture chunks written to a pipe, then parse them with their timing.
+static void testRawCapture( const char *path )
+{
+  static const unsigned char chunk1[] = { 0x90, 0x3c, 0x40, 0x3e, 0x40 };
+  static const unsigned char chunk2[] = { 0xf0, 0x7e, 0x01 };
+  static const unsigned char chunk3[] = { 0x02, 0xf7, 0x80, 0x3c, 0x00 };
+  std::string raw = std::string( path ) + ".raw";
+  std::string idx = raw + ".idx";
+  MidiReader reader( MIDIR_NONE, NULL );
+  MidiRawCapture rc;
+  MidiRawCaptureStats stats;
+  MidiCapture cap;
+  MidiFrame f, notes[2], sysex;
+  uint64_t t0;
+  int fds[2];
+
+  CHECK( pipe( fds ) == 0 );
+  fcntl( fds[0], F_SETFL, O_NONBLOCK );
+  CHECK( rc.open( fds[0], raw.c_str() ) );
+  CHECK( rc.pump() == 0 );
+  t0 = reader.getTime();
+  CHECK( write( fds[1], chunk1, sizeof( chunk1 ) ) == sizeof( chunk1 ) );
+  CHECK( rc.pump() == sizeof( chunk1 ) );
+  usleep( 2000 );
+  CHECK( write( fds[1], chunk2, sizeof( chunk2 ) ) == sizeof( chunk2 ) );
+  CHECK( rc.pump() == sizeof( chunk2 ) );
+  usleep( 2000 );
+  CHECK( write( fds[1], chunk3, sizeof( chunk3 ) ) == sizeof( chunk3 ) );
+  CHECK( rc.pump() == sizeof( chunk3 ) );
+  close( fds[1] );
+  CHECK( rc.pump() == -1 );
+  rc.getStats( stats );
+  CHECK( stats.chunks == 3 && stats.bytes == 13 );
+#if defined(__linux__)
+  CHECK( stats.spliced );
+#endif
+  CHECK( rc.close() );
+  close( fds[0] );
+
+  // the notes are concluded by the sysex, which ends in the third chunk
+  CHECK( MidiRawCapture::convert( raw.c_str(), path ) );
+  CHECK( countFrames( path, f ) == 4 );
+  CHECK( f.len == 3 && f.data[0] == 0x80 && f.source == 0 );
+  CHECK( cap.open( path ) );
+  CHECK( cap.next( notes[0] ) && cap.next( notes[1] ) && cap.next( sysex ) );
+  CHECK( notes[0].ts == notes[1].ts && notes[0].ts >= t0 );
+  CHECK( sysex.len == 5 && sysex.ts >= notes[0].ts + 2000000ULL );
+  CHECK( f.ts == sysex.ts );
+  cap.close();
+  unlink( idx.c_str() );
+  unlink( raw.c_str() );
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "rawcaptest" ) )
+    return 1;
+  testRawCapture( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "rawcaptest" );
+}
@@ -0,0 +1,266 @@
+//*****************************************//
+//  readertest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the parser of the MidiReader (running
+//  status, real-time bytes), its raw mode, the statistics of its
+//  queue and the filters and taps of its sources.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Chunks received by a reader in raw mode.
+struct RawChunks {
+  int count;
+  int len;
+  int source;
+  uint64_t ts;
+  unsigned char data[16];
+};
+
+static void rawChunk( const unsigned char *buf, int len, int source,
+                      uint64_t ts, void *userData )
+{
+  RawChunks *c = (RawChunks *) userData;
+
+  if ( len <= 16 )
+    memcpy( c->data, buf, len );
+  c->len = len;
+  c->source = source;
+  c->ts = ts;
+  c->count++;
+}
+
+// Messages using running status: with MIDIR_EXPAND, each one is a frame
+// given as soon as its last byte is read.
+static void testRunningStatus()
+{
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiReader packed( MIDIR_NONE, NULL );
+  MidiReaderStats stats;
+  MidiFrame *mf, f;
+  int fds[2];
+
+  CHECK( pipeSource( reader, fds ) );
+  CHECK( write( fds[1], "\x90\x3c\x40\x3e\x40", 5 ) == 5 );
+  CHECK( reader.pump() == 2 );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3c\x40" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3e\x40" ) );
+
+  // an injected frame with running status gives a frame per message
+  f.len = 5;
+  memcpy( f.data, "\x80\x3c\x00\x3e\x00", 5 );
+  CHECK( reader.inject( f ) == 5 );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x80\x3c\x00" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x80\x3e\x00" ) );
+  CHECK( reader.getNext() == NULL );
+
+  // a clock between two messages does not cancel the running status
+  CHECK( write( fds[1], "\x90\x3c\x40\xf8\x3e\x40", 6 ) == 6 );
+  CHECK( reader.pump() == 3 );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3c\x40" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 1, (const unsigned char *) "\xf8" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3e\x40" ) );
+
+  // nor between two program changes, which are expanded in two bytes
+  CHECK( write( fds[1], "\xc1\x05\xf8\x06", 4 ) == 4 );
+  CHECK( reader.pump() == 3 );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 2, (const unsigned char *) "\xc1\x05" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 1, (const unsigned char *) "\xf8" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 2, (const unsigned char *) "\xc1\x06" ) );
+
+  // a clock within a message, or a system exclusive, is a frame of its own
+  CHECK( write( fds[1], "\x90\x3c\xf8\x40\x3e\xfe\x40", 7 ) == 7 );
+  CHECK( write( fds[1], "\xf0\x01\xf8\x02\xf7", 5 ) == 5 );
+  CHECK( reader.pump() == 6 );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 1, (const unsigned char *) "\xf8" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3c\x40" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 1, (const unsigned char *) "\xfe" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3e\x40" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 1, (const unsigned char *) "\xf8" ) );
+  mf = reader.getNext();
+  CHECK( mf && sameFrame( *mf, 4, (const unsigned char *) "\xf0\x01\x02\xf7" ) );
+  CHECK( reader.getStats( -1, stats ) && stats.errors == 0 );
+  reader.close();
+  close( fds[1] );
+
+  // without expansion, program changes with running status are one frame,
+  // concluded by the next status byte
+  CHECK( pipeSource( packed, fds ) );
+  CHECK( write( fds[1], "\xc1\x05\x06\xf8\x07\x90", 6 ) == 6 );
+  CHECK( packed.pump() == 2 );
+  mf = packed.getNext();
+  CHECK( mf && sameFrame( *mf, 1, (const unsigned char *) "\xf8" ) );
+  mf = packed.getNext();
+  CHECK( mf && sameFrame( *mf, 4, (const unsigned char *) "\xc1\x05\x06\x07" ) );
+  CHECK( packed.getStats( -1, stats ) && stats.errors == 0 );
+  packed.close();
+  close( fds[1] );
+}
+
+// Bytes read in raw mode are given as-is, even partial frames.
+static void testRawMode()
+{
+  static const unsigned char bytes[] = { 0x90, 0x3c, 0x40, 0x3e, 0xf0, 0x01 };
+  MidiReader reader( MIDIR_RAW, NULL );
+  MidiReaderStats stats;
+  RawChunks chunks;
+  uint64_t t0;
+  int fds[2];
+
+  memset( &chunks, 0, sizeof( chunks ) );
+  CHECK( pipeSource( reader, fds ) );
+  reader.setRawCallback( rawChunk, &chunks );
+  CHECK( !reader.update() && chunks.count == 0 );
+  t0 = reader.getTime();
+  CHECK( write( fds[1], bytes, sizeof( bytes ) ) == sizeof( bytes ) );
+  CHECK( !reader.update() );
+  CHECK( chunks.count == 1 && chunks.len == sizeof( bytes ) );
+  CHECK( memcmp( chunks.data, bytes, sizeof( bytes ) ) == 0 );
+  CHECK( chunks.source == reader.getSourceId( fds[0] ) && chunks.ts >= t0 );
+  CHECK( !reader.update() && chunks.count == 1 );
+  CHECK( reader.available() == 0 );
+  CHECK( reader.getStats( -1, stats ) && stats.chunks == 1 );
+  CHECK( stats.read == 0 );
+  reader.close();
+  close( fds[1] );
+
+  // raw chunks are dump'ed as-is, never as frames
+  MidiReader hex( (midi_reader_flags_t) ( MIDIR_RAW | MIDIR_DUMPHEX ), NULL );
+  MidiReader capture( MIDIR_RAW, NULL );
+  CHECK( pipe( fds ) == 0 );
+  CHECK( !hex.setDumpFile( fds[1] ) && !capture.setDumpCapture( fds[1] ) );
+  close( fds[0] );
+  close( fds[1] );
+}
+
+// Frames not stored in a full queue are counted for their source, and the
+// most frames waiting in the queue at once are kept.
+static void testQueueStats()
+{
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiReaderStats stats;
+  unsigned char clocks[MIDI_READER_FRAMES_MAX + 6];
+  int fds[2], i;
+
+  memset( clocks, 0xf8, sizeof( clocks ) );
+  CHECK( pipeSource( reader, fds ) );
+
+  // 3 frames read, 2 of them popped, then 2 more: at most 3 waiting
+  CHECK( write( fds[1], clocks, 3 ) == 3 );
+  reader.pump();
+  CHECK( reader.pop() && reader.pop() );
+  CHECK( write( fds[1], clocks, 2 ) == 2 );
+  reader.pump();
+  CHECK( reader.getStats( -1, stats ) && stats.queued_max == 3 );
+  reader.clearQueue();
+
+  CHECK( write( fds[1], clocks, sizeof( clocks ) ) == sizeof( clocks ) );
+  for ( i = 0; i < 100 && reader.getStats( -1, stats ) &&
+        stats.read < sizeof( clocks ) + 5; i++ )
+    reader.pump();
+  CHECK( reader.getStats( -1, stats ) && stats.read == sizeof( clocks ) + 5 );
+  CHECK( stats.missed == 6 && stats.queued_max == MIDI_READER_FRAMES_MAX );
+  CHECK( reader.getStats( 0, stats ) && stats.missed == 6 );
+  reader.clearQueue();
+  reader.close();
+  close( fds[1] );
+}
+
+// Filter doubling the notes on channel 1 onto channel 2, and skipping the
+// clocks.
+static int layerFilter( const midi_frame_t *mf, midi_frame_t *out, void *userData )
+{
+  (void) userData;
+  if ( mf->data[0] == 0xf8 )
+    return 0;
+  out[0] = *mf;
+  if ( ( mf->data[0] & 0xf0 ) != 0x90 )
+    return 1;
+  out[1] = *mf;
+  out[1].data[0] = 0x91;
+  return 2;
+}
+
+// Filter transposing the notes an octave up.
+static int octaveFilter( const midi_frame_t *mf, midi_frame_t *out, void *userData )
+{
+  (void) userData;
+  out[0] = *mf;
+  if ( ( mf->data[0] & 0xe0 ) == 0x80 )
+    out[0].data[1] += 12;
+  return 1;
+}
+
+static void countTap( const midi_frame_t *mf, void *userData )
+{
+  (void) mf;
+  ( *(int *) userData )++;
+}
+
+// Filters of a source are chained in their order, and its taps only see
+// its frames, after the callback.
+static void testHooks()
+{
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiReaderStats stats;
+  MidiFrame *mf;
+  int fa[2], fb[2], a = 0, b = 0;
+
+  CHECK( pipeSource( reader, fa ) && pipeSource( reader, fb ) );
+  CHECK( reader.addFilter( fa[0], layerFilter, NULL ) );
+  CHECK( reader.addFilter( fa[0], octaveFilter, NULL ) );
+  CHECK( !reader.addFilter( fa[1], octaveFilter, NULL ) );
+  CHECK( reader.addSourceTap( fa[0], countTap, &a ) );
+  CHECK( reader.addSourceTap( fb[0], countTap, &b ) );
+  CHECK( write( fa[1], "\x90\x3c\x40\xf8", 4 ) == 4 );
+  CHECK( write( fb[1], "\x90\x3c\x40", 3 ) == 3 );
+  // the layered note completes one frame, the skipped clock none
+  CHECK( reader.pump() == 2 );
+  mf = reader.pop();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x48\x40" ) );
+  mf = reader.pop();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x91\x48\x40" ) );
+  mf = reader.pop();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x3c\x40" ) );
+  CHECK( reader.pop() == NULL );
+  CHECK( a == 2 && b == 1 );
+  CHECK( reader.getStats( -1, stats ) && stats.skipped == 1 );
+
+  // removed, in any order
+  CHECK( reader.removeFilter( fa[0], layerFilter, NULL ) );
+  CHECK( !reader.removeFilter( fa[0], layerFilter, NULL ) );
+  CHECK( reader.removeSourceTap( fa[0], countTap, &a ) );
+  CHECK( write( fa[1], "\x90\x3c\x40", 3 ) == 3 );
+  CHECK( reader.pump() == 1 );
+  mf = reader.pop();
+  CHECK( mf && sameFrame( *mf, 3, (const unsigned char *) "\x90\x48\x40" ) );
+  CHECK( a == 2 );
+  reader.close();
+  close( fa[1] );
+  close( fb[1] );
+}
+int main()
+{
+  testRunningStatus();
+  testRawMode();
+  testQueueStats();
+  testHooks();
+  return testResult( "readertest" );
+}
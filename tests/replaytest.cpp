@@ -0,0 +1,57 @@
+//*****************************************//
+//  replaytest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that a capture is replayed into a
+//  MidiReader as fast as possible or with its timing scaled.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+static bool countFrame( const midi_frame_t *mf, void *userData )
+{
+  unsigned int *n = (unsigned int *) userData;
+
+  (*n)++;
+  return mf->len > 0;
+}
+
+// Replay a capture as fast as possible, then scaled, into a reader.
+static void testReplay( const char *path )
+{
+  MidiReplay replay;
+  MidiReader reader( MIDIR_NONE, NULL );
+  MidiReplayStats stats;
+  unsigned int n = 0;
+
+  CHECK( replay.open( path ) );
+  replay.setCallback( countFrame, &n );
+  CHECK( replay.setMode( MIDI_REPLAY_ASAP ) );
+  CHECK( replay.run() );
+  CHECK( n == 20000 );
+
+  // 100 frames at 1us intervals, replayed 100 times slower.
+  n = 0;
+  replay.setReader( &reader );
+  CHECK( replay.setMode( MIDI_REPLAY_SCALED, 0.01 ) );
+  replay.setRange( 1000000ULL + 5000 * 1000ULL, 1000000ULL + 5099 * 1000ULL );
+  CHECK( replay.run() );
+  replay.getStats( stats );
+  CHECK( n == 100 && stats.frames == 100 && stats.errors == 0 );
+  CHECK( stats.duration >= 99 * 1000ULL * 100 );
+  CHECK( reader.available() == 100 );
+  replay.close();
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "replaytest" ) )
+    return 1;
+  CHECK( writeControls( path.c_str(), 20000, 1024 ) );
+  testReplay( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "replaytest" );
+}
@@ -0,0 +1,101 @@
+//*****************************************//
+//  routertest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that the router gives the frames of the
+//  sources of a MidiReader to its outputs, filtered and transformed.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Batches received by an output of a router.
+struct RouterSink {
+  std::vector<unsigned char> bytes;
+  unsigned int calls;
+  unsigned int count;
+};
+
+static void routerSink( const unsigned char *buf, uint32_t len,
+                        uint32_t count, void *userData )
+{
+  RouterSink *s = (RouterSink *) userData;
+
+  s->bytes.insert( s->bytes.end(), buf, buf + len );
+  s->calls++;
+  s->count += count;
+}
+
+// Route two sources to two outputs with filters and transforms, until the
+// sources are closed.
+static void testRouter()
+{
+  static const unsigned char a[] = { 0x90, 0x3c, 0x40, 0x3e, 0x70,
+                                     0x91, 0x40, 0x40, 0x90, 0x7a, 0x40, 0xfa };
+  static const unsigned char b[] = { 0xb0, 0x07, 0x64, 0xb0, 0x0a, 0x20, 0xfa };
+  static const unsigned char out0[] = { 0x90, 0x3c, 0x40, 0x90, 0x3e, 0x70,
+                                        0x91, 0x40, 0x40, 0x90, 0x7a, 0x40,
+                                        0xfa, 0xb0, 0x07, 0x64 };
+  static const unsigned char out1[] = { 0x92, 0x48, 0x60, 0x92, 0x4a, 0x7f,
+                                        0xfa, 0xfa };
+  MidiReader reader( (MidiReaderFlags) ( MIDIR_EXPAND | MIDIR_NOQUEUE ), NULL );
+  MidiRouter router;
+  MidiRouterStats stats;
+  MidiRoute route;
+  RouterSink sinks[2];
+  int fa[2], fb[2], sa, sb;
+
+  CHECK( pipe( fa ) == 0 && pipe( fb ) == 0 );
+  CHECK( reader.addSource( fa[0], 0 ) && reader.addSource( fb[0], 0 ) );
+  sa = reader.getSourceId( fa[0] );
+  sb = reader.getSourceId( fb[0] );
+  sinks[0].calls = sinks[0].count = sinks[1].calls = sinks[1].count = 0;
+  CHECK( router.addOutput( routerSink, &sinks[0] ) == 0 );
+  CHECK( router.addOutput( routerSink, &sinks[1] ) == 1 );
+
+  // everything of a to output 0
+  MidiRouter::initRoute( route, sa, 0 );
+  CHECK( router.addRoute( route ) == 0 );
+  // notes on of channel 1 of a to channel 3 of output 1, an octave up
+  MidiRouter::initRoute( route, sa, 1 );
+  MidiRouter::addType( route, 0x90, 1 );
+  route.channel = 3;
+  route.transpose = 12;
+  route.velocity = 96;
+  CHECK( router.addRoute( route ) == 1 );
+  // start of all sources to output 1
+  MidiRouter::initRoute( route, -1, 1 );
+  MidiRouter::addType( route, 0xfa );
+  CHECK( router.addRoute( route ) == 2 );
+  // volume of b to output 0
+  MidiRouter::initRoute( route, sb, 0 );
+  MidiRouter::addType( route, 0xb0 );
+  route.d1_min = route.d1_max = 7;
+  CHECK( router.addRoute( route ) == 3 );
+  route.output = 2;
+  CHECK( router.addRoute( route ) == -1 );
+  CHECK( router.compile() );
+
+  CHECK( write( fa[1], a, sizeof( a ) ) == sizeof( a ) );
+  CHECK( write( fb[1], b, sizeof( b ) ) == sizeof( b ) );
+  close( fa[1] );
+  close( fb[1] );
+  CHECK( router.run( reader, 1000 ) );
+  router.getStats( stats );
+
+  CHECK( sinks[0].bytes.size() == sizeof( out0 ) && sinks[0].count == 6 );
+  CHECK( memcmp( sinks[0].bytes.data(), out0, sizeof( out0 ) ) == 0 );
+  CHECK( sinks[1].bytes.size() == sizeof( out1 ) && sinks[1].count == 4 );
+  CHECK( memcmp( sinks[1].bytes.data(), out1, sizeof( out1 ) ) == 0 );
+  // one batch per output for the wakeup reading both sources
+  CHECK( sinks[0].calls == 1 && sinks[1].calls == 1 );
+  CHECK( stats.frames == 8 && stats.messages == 10 );
+  CHECK( stats.batches == 2 && stats.dropped == 1 );
+  reader.close();
+}
+
+int main()
+{
+  testRouter();
+  return testResult( "routertest" );
+}
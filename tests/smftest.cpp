@@ -0,0 +1,211 @@
+//*****************************************//
+//  smftest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the Standard MIDI File writer fed by a
+//  MidiReader, and the Standard MIDI File player.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+static unsigned int get32( const unsigned char *p )
+{
+  return ( p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+// Read a whole file, returns its length.
+static int readFile( const char *path, unsigned char *buf, int max )
+{
+  int fd = open( path, O_RDONLY );
+  int len;
+
+  if ( fd < 0 ) return -1;
+  len = read( fd, buf, max );
+  close( fd );
+  return len;
+}
+
+// Check the chunks of a file and count its tracks.
+static int countTracks( const unsigned char *buf, int len, int format )
+{
+  int n = 0, off = 14;
+
+  if ( len < 14 || memcmp( buf, "MThd", 4 ) || get32( buf + 4 ) != 6 )
+    return -1;
+  if ( buf[9] != format )
+    return -1;
+  while ( off + 8 <= len ) {
+    if ( memcmp( buf + off, "MTrk", 4 ) )
+      return -1;
+    off += 8 + get32( buf + off + 4 );
+    // each track ends with an end-of-track meta event
+    if ( off > len || memcmp( buf + off - 3, "\xff\x2f\x00", 3 ) )
+      return -1;
+    n++;
+  }
+  if ( off != len || n != ( ( buf[10] << 8 ) | buf[11] ) )
+    return -1;
+  return n;
+}
+
+static void testWriter( const char *path, int format )
+{
+  MidiReader reader( (MidiReaderFlags) ( MIDIR_EXPAND | MIDIR_NOQUEUE ), NULL );
+  MidiSmfWriter writer;
+  MidiSmfWriterStats stats;
+  MidiFrame f;
+  unsigned char buf[4096];
+  int len;
+
+  CHECK( writer.open( path, format, 480, 500000 ) );
+  CHECK( writer.attach( reader ) );
+  CHECK( reader.inject( 5, 0x90, 0x3c, 0x40, 0x3e, 0x40 ) == 5 );
+  CHECK( reader.inject( 4, 0xf0, 0x43, 0x10, 0xf7 ) == 4 );
+  CHECK( reader.inject( 1, 0xfa ) == 1 );
+  CHECK( reader.available() == 0 );
+
+  // A frame of another source, half a second (480 ticks) after tick 0.
+  f.len = 3;
+  f.data[0] = 0x80;
+  f.data[1] = 0x3c;
+  f.data[2] = 0x00;
+  f.source = 3;
+  f.ts = reader.getTime() + 500000000ULL;
+  CHECK( writer.write( f ) );
+  writer.detach( reader );
+  CHECK( writer.close() );
+  writer.getStats( stats );
+  CHECK( stats.frames == 5 && stats.dropped == 0 );
+
+  len = readFile( path, buf, sizeof( buf ) );
+  CHECK( countTracks( buf, len, format ) == ( format == 0 ? 1 : 3 ) );
+  if ( format == 0 ) {
+    // tempo, then note on with running status, sysex, start, note off
+    static const unsigned char events[] = {
+      0x00, 0xff, 0x51, 0x03, 0x07, 0xa1, 0x20,
+      0x00, 0x90, 0x3c, 0x40, 0x00, 0x3e, 0x40,
+      0x00, 0xf0, 0x03, 0x43, 0x10, 0xf7,
+      0x00, 0xf7, 0x01, 0xfa };
+    CHECK( len > 22 + (int) sizeof( events ) );
+    CHECK( memcmp( buf + 22, events, sizeof( events ) ) == 0 );
+  }
+}
+
+// Events received from a player.
+struct Played {
+  int count;
+  int track[16];
+  uint64_t ns[16];
+  unsigned char status[16];
+  unsigned int len[16];
+};
+
+static bool playEvent( const MidiSmfEvent *ev, const unsigned char *msg,
+                       uint32_t len, void *userData )
+{
+  Played *p = (Played *) userData;
+
+  if ( p->count < 16 ) {
+    p->track[p->count] = ev->track;
+    p->ns[p->count] = ev->ns;
+    p->status[p->count] = msg[0];
+    p->len[p->count] = len;
+  }
+  p->count++;
+  return true;
+}
+
+// Play the format 1 file written by testWriter.
+static void testPlayerRoundTrip( const char *path )
+{
+  MidiSmfPlayer player;
+  Played played;
+
+  memset( &played, 0, sizeof( played ) );
+  CHECK( player.open( path ) );
+  CHECK( player.getTrackCount() == 3 );
+  player.setCallback( playEvent, &played );
+  CHECK( player.run() );
+  CHECK( played.count == 5 );
+  CHECK( played.status[0] == 0x90 && played.status[1] == 0x90 );
+  CHECK( played.status[2] == 0xf0 && played.len[2] == 4 );
+  CHECK( played.status[3] == 0xfa && played.len[3] == 1 );
+  CHECK( played.status[4] == 0x80 && played.track[4] == 2 );
+  CHECK( played.ns[4] >= 500000000ULL && played.ns[4] < 600000000ULL );
+  CHECK( player.getPosition() == played.ns[4] );
+
+  // only the last event is after 400 ms
+  played.count = 0;
+  CHECK( player.seek( 400000000ULL ) );
+  CHECK( player.run() );
+  CHECK( played.count == 1 && played.status[0] == 0x80 );
+  player.close();
+}
+
+// Play a file with tempo changes and sysex, built by hand.
+static void testPlayer( const char *path )
+{
+  static const unsigned char file[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 3, 0, 96,
+    // tempo track: 5 ms per quarter note, then 2.5 ms at tick 96
+    'M', 'T', 'r', 'k', 0, 0, 0, 18,
+    0x00, 0xff, 0x51, 0x03, 0x00, 0x13, 0x88,
+    0x60, 0xff, 0x51, 0x03, 0x00, 0x09, 0xc4,
+    0x00, 0xff, 0x2f, 0x00,
+    // notes at ticks 0, 96, 192 with running status
+    'M', 'T', 'r', 'k', 0, 0, 0, 14,
+    0x00, 0x90, 0x3c, 0x40, 0x60, 0x3e, 0x40, 0x60, 0x40, 0x40,
+    0x00, 0xff, 0x2f, 0x00,
+    // a sysex at tick 48
+    'M', 'T', 'r', 'k', 0, 0, 0, 10,
+    0x30, 0xf0, 0x03, 0x7e, 0x01, 0xf7,
+    0x00, 0xff, 0x2f, 0x00 };
+  MidiSmfPlayer player;
+  MidiSmfPlayerStats stats;
+  Played played;
+  int fd = open( path, O_WRONLY | O_TRUNC ), i;
+
+  CHECK( fd >= 0 && write( fd, file, sizeof( file ) ) == (ssize_t) sizeof( file ) );
+  close( fd );
+
+  memset( &played, 0, sizeof( played ) );
+  CHECK( player.open( path ) );
+  CHECK( player.getTrackCount() == 3 );
+  CHECK( player.getDuration() == 7500000ULL );
+  CHECK( player.setTrackOutput( 1, 0 ) == false );
+  player.setCallback( playEvent, &played );
+  player.setLookahead( 2000000ULL );
+  CHECK( player.start() );
+  for ( i = 0; i < 1000 && played.count < 4; i++ )
+    usleep( 1000 );
+  player.stop();
+  player.getStats( stats );
+  CHECK( played.count == 4 && stats.events == 4 );
+  CHECK( played.track[0] == 1 && played.ns[0] == 0 );
+  CHECK( played.track[1] == 2 && played.ns[1] == 2500000ULL );
+  CHECK( played.status[1] == 0xf0 && played.len[1] == 4 );
+  CHECK( played.track[2] == 1 && played.ns[2] == 5000000ULL );
+  CHECK( played.track[3] == 1 && played.ns[3] == 7500000ULL );
+
+  // seek uses the tempo map: 6 ms is after the second note
+  played.count = 0;
+  CHECK( player.seek( 6000000ULL ) );
+  CHECK( player.run() );
+  CHECK( played.count == 1 && played.ns[0] == 7500000ULL );
+  player.close();
+}
+
+int main()
+{
+  std::string path;
+
+  if ( !tempFile( path, "smftest" ) )
+    return 1;
+  testWriter( path.c_str(), 0 );
+  testWriter( path.c_str(), 1 );
+  testPlayerRoundTrip( path.c_str() );
+  testPlayer( path.c_str() );
+  unlink( path.c_str() );
+  return testResult( "smftest" );
+}
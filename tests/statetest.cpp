@@ -0,0 +1,96 @@
+//*****************************************//
+//  statetest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the state mirror of a source of a
+//  MidiReader, read by other threads while it is updated.
+//
+//*****************************************//
+
+#include <pthread.h>
+#include "testutil.h"
+
+// Writer of the state mirror: controllers 1 and 2 are always changed
+// together, by one running-status frame.
+static void *stateWriter( void *arg )
+{
+  MidiState *state = (MidiState *) arg;
+  MidiFrame f;
+
+  memset( &f, 0, sizeof( f ) );
+  f.len = 5;
+  f.data[0] = 0xb0;
+  f.data[1] = 0x01;
+  f.data[3] = 0x02;
+  for ( int i = 0; i < 200000; i++ ) {
+    f.data[2] = f.data[4] = (unsigned char) ( i & 0x7f );
+    state->update( f );
+  }
+  return NULL;
+}
+
+// Mirror the state of a source, and read it while another thread updates
+// it.
+static void testState()
+{
+  static const unsigned char in[] = { 0x90, 0x3c, 0x40, 0x3e, 0x40, 0x40, 0x40,
+                                      0xb1, 0x07, 0x64, 0xc2, 0x05, 0xd0, 0x30,
+                                      0xe0, 0x00, 0x50, 0x90, 0x3c, 0x00,
+                                      0x83, 0x10, 0x00, 0xf8 };
+  MidiReader reader( MIDIR_NOQUEUE, NULL );
+  MidiState state, copy, shared;
+  MidiChannelState ch;
+  pthread_t thread;
+  int fi[2], bad = 0;
+
+  CHECK( pipeSource( reader, fi ) );
+  CHECK( state.attach( reader, fi[0] ) );
+  CHECK( state.attach( reader, fi[1] ) == false );
+  CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+  close( fi[1] );
+  CHECK( reader.pump() > 0 );
+  CHECK( state.isNoteOn( 1, 0x3c ) == false );
+  CHECK( state.isNoteOn( 1, 0x3e ) && state.isNoteOn( 1, 0x40 ) );
+  CHECK( state.getController( 2, 7 ) == 0x64 );
+  CHECK( state.getController( 1, 7 ) == -1 );
+  CHECK( state.getProgram( 3 ) == 5 && state.getPressure( 1 ) == 0x30 );
+  CHECK( state.getPitchBend( 1 ) == 0x2800 && state.getPitchBend( 2 ) == 8192 );
+  CHECK( state.getProgram( 17 ) == -1 );
+
+  // a late consumer takes a snapshot
+  state.snapshot( copy );
+  CHECK( copy.getChannel( 1, ch ) );
+  CHECK( ch.notes[0] == ( 1ULL << 0x3e ) && ch.notes[1] == 1 );
+
+  // all notes off, reset all controllers
+  MidiFrame f;
+  f.len = 5;
+  f.data[0] = 0xb0;
+  f.data[1] = 123;
+  f.data[2] = 0;
+  f.data[3] = 121;
+  f.data[4] = 0;
+  state.update( f );
+  CHECK( state.isNoteOn( 1, 0x3e ) == false && state.getPitchBend( 1 ) == 8192 );
+  CHECK( state.getPressure( 1 ) == 0 && copy.isNoteOn( 1, 0x3e ) );
+  reader.close();
+
+  CHECK( pthread_create( &thread, NULL, stateWriter, &shared ) == 0 );
+  for ( int i = 0; i < 20000; i++ ) {
+    shared.snapshot( copy );
+    if ( copy.getController( 1, 1 ) != copy.getController( 1, 2 ) )
+      bad++;
+    shared.getChannel( 1, ch );
+    if ( ch.cc[1] != ch.cc[2] )
+      bad++;
+  }
+  pthread_join( thread, NULL );
+  CHECK( bad == 0 );
+  CHECK( shared.getController( 1, 2 ) == ( 199999 & 0x7f ) );
+}
+
+int main()
+{
+  testState();
+  return testResult( "statetest" );
+}
@@ -0,0 +1,152 @@
+//*****************************************//
+//  testutil.h
+//  by Nicolas Provost, 2025.
+//
+//  Checks and fixtures shared by the test programs of the MidiReader
+//  and of its modules: each program includes it once.
+//
+//*****************************************//
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include "MidiReader.h"
+#include "RtMidi.h"
+
+static int failures = 0;
+
+#define CHECK( cond ) \
+  do { if ( !(cond) ) { std::cout << "FAILED line " << __LINE__ << ": " #cond << std::endl; failures++; } } while ( 0 )
+
+// Report the result of the program 'name', returns its exit status.
+inline int testResult( const char *name )
+{
+  if ( failures == 0 )
+    std::cout << name << ": all checks passed" << std::endl;
+  return failures ? 1 : 0;
+}
+
+// Create an empty temporary file "/tmp/<name>XXXXXX" and set its path.
+inline bool tempFile( std::string& path, const char *name )
+{
+  std::string tmpl = std::string( "/tmp/" ) + name + "XXXXXX";
+  std::vector<char> buf( tmpl.begin(), tmpl.end() );
+  int fd;
+
+  buf.push_back( '\0' );
+  fd = mkstemp( &buf[0] );
+  if ( fd < 0 ) {
+    std::cout << "cannot create temporary file" << std::endl;
+    return false;
+  }
+  close( fd );
+  path = &buf[0];
+  return true;
+}
+
+inline bool sameFrame( const MidiFrame& f, int n, const unsigned char *data )
+{
+  return f.len == n && memcmp( f.data, data, n ) == 0;
+}
+
+// Open a pipe and add its reading end, non-blocking, as a source of
+// 'reader' (channel unchanged). Returns false on error.
+inline bool pipeSource( MidiReader& reader, int fds[2] )
+{
+  if ( pipe( fds ) != 0 )
+    return false;
+  fcntl( fds[0], F_SETFL, O_NONBLOCK );
+  return reader.addSource( fds[0], 0 );
+}
+
+// Write 'count' control changes at 1 us intervals from 1 ms, from sources
+// 0 and 1 in turn, into the capture file 'path' in blocks of 'block'
+// bytes. Returns false on error.
+inline bool writeControls( const char *path, unsigned int count,
+                           unsigned int block )
+{
+  MidiCaptureWriter writer;
+  unsigned char msg[3];
+  bool ok;
+
+  if ( !writer.open( path, block ) )
+    return false;
+  ok = true;
+  for ( unsigned int i = 0; i < count; i++ ) {
+    msg[0] = 0xb0 | ( i % 3 );
+    msg[1] = i % 128;
+    msg[2] = ( i / 128 ) % 128;
+    ok = writer.write( 1000000ULL + i * 1000ULL, i % 2, msg, 3 ) && ok;
+  }
+  return writer.close() && ok;
+}
+
+// Count the frames of a capture file and get the last one.
+inline uint64_t countFrames( const char *path, MidiFrame& last )
+{
+  MidiCapture cap;
+  uint64_t n = 0;
+
+  if ( !cap.open( path ) ) return 0;
+  while ( cap.next( last ) )
+    n++;
+  return n;
+}
+
+// Messages received thru a RtMidiIn.
+struct RtMessages {
+  int count;
+  unsigned char status[8];
+};
+
+inline void rtMessage( double timeStamp, std::vector<unsigned char> *message,
+                       void *userData )
+{
+  RtMessages *m = (RtMessages *) userData;
+
+  (void) timeStamp;
+  if ( m->count < 8 )
+    m->status[m->count] = message->at( 0 );
+  __atomic_add_fetch( &m->count, 1, __ATOMIC_RELEASE );
+}
+
+// Wait at most 1000 steps of 'step' us for 'n' messages.
+inline bool waitMessages( RtMessages& m, int n, useconds_t step = 1000 )
+{
+  for ( int i = 0; i < 1000; i++ ) {
+    if ( __atomic_load_n( &m.count, __ATOMIC_ACQUIRE ) >= n )
+      return true;
+    usleep( step );
+  }
+  return __atomic_load_n( &m.count, __ATOMIC_ACQUIRE ) >= n;
+}
+
+// Error callback counting the warnings.
+inline void rtError( RtMidiError::Type type, const std::string &text,
+                     void *userData )
+{
+  (void) text;
+  if ( type == RtMidiError::WARNING )
+    (*(int *) userData)++;
+}
+
+// Find the port named 'name', returns the count of ports if none.
+inline unsigned int findPort( RtMidi& rt, const std::string& name )
+{
+  unsigned int port, nports = rt.getPortCount();
+
+  for ( port = 0; port < nports; port++ ) {
+    if ( rt.getPortName( port ) == name )
+      break;
+  }
+  return port;
+}
+
+#endif // TESTUTIL_H
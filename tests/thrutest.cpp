@@ -0,0 +1,65 @@
+//*****************************************//
+//  thrutest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check that the soft-thru forwards the frames,
+//  or the raw chunks, of a MidiReader with its filters.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Forward frames, then raw chunks, from a pipe to another with filters.
+static void testThru()
+{
+  static const unsigned char in[] = { 0x90, 0x3c, 0x40, 0x3e, 0x40, 0xf8,
+                                      0xb1, 0x07, 0x10, 0xb0, 0x07, 0x10 };
+  static const unsigned char out[] = { 0x90, 0x3c, 0x40, 0x90, 0x3e, 0x40,
+                                       0xb0, 0x07, 0x10 };
+  static const unsigned char rawIn[] = { 0x90, 0x3c, 0xf8, 0x40, 0xfe };
+  static const unsigned char rawOut[] = { 0x90, 0x3c, 0x40, 0xfe };
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiReader raw( MIDIR_RAW, NULL );
+  MidiThruStats stats;
+  unsigned char buf[64];
+  int fi[2], fo[2], n = 0;
+
+  CHECK( pipe( fi ) == 0 && pipe( fo ) == 0 );
+  CHECK( reader.addSource( fi[0], 0 ) );
+  MidiThru thru( fo[1] );
+  thru.skip( 0xf8 );
+  thru.skip( 0xb0, 2 );
+  CHECK( write( fi[1], in, sizeof( in ) ) == sizeof( in ) );
+  close( fi[1] );
+  CHECK( thru.run( reader, 1000 ) );
+  thru.getStats( stats );
+  CHECK( read( fo[0], buf, sizeof( buf ) ) == sizeof( out ) );
+  CHECK( memcmp( buf, out, sizeof( out ) ) == 0 );
+  CHECK( stats.frames == 3 && stats.filtered == 2 );
+  CHECK( stats.writes == 1 && stats.bytes == sizeof( out ) );
+  // the frames were also queued
+  while ( reader.pop() )
+    n++;
+  CHECK( n == 5 && reader.pop() == NULL );
+  reader.close();
+
+  CHECK( pipeSource( raw, fi ) );
+  MidiThru rawThru( fo[1] );
+  rawThru.skip( 0xf8 );
+  CHECK( write( fi[1], rawIn, sizeof( rawIn ) ) == sizeof( rawIn ) );
+  close( fi[1] );
+  CHECK( rawThru.run( raw, 1000 ) );
+  rawThru.getStats( stats );
+  CHECK( read( fo[0], buf, sizeof( buf ) ) == sizeof( rawOut ) );
+  CHECK( memcmp( buf, rawOut, sizeof( rawOut ) ) == 0 );
+  CHECK( stats.frames == 1 && stats.filtered == 1 );
+  raw.close();
+  close( fo[0] );
+  close( fo[1] );
+}
+
+int main()
+{
+  testThru();
+  return testResult( "thrutest" );
+}
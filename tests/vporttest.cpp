@@ -0,0 +1,117 @@
+//*****************************************//
+//  vporttest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the virtual ports of the DIRECT API.
+//
+//*****************************************//
+
+#include <cerrno>
+#include <sys/stat.h>
+#include "testutil.h"
+
+// Pass bytes unchanged thru a virtual port, then connect ports of the
+// DIRECT API thru virtual ports created by other ports.
+static void testVirtualPort()
+{
+  static const unsigned char in[] = { 0xf0, 0x0d, 0x03, 0x11, 0x7f, 0xf7 };
+  static const unsigned char note[] = { 0x90, 0x3c, 0x40 };
+  MidiVirtualPort vp, vp2;
+  RtMessages messages;
+  unsigned char buf[16];
+  char path[256];
+  struct stat st;
+  unsigned int i, port;
+  int fd, len, a, b, warnings = 0;
+
+  CHECK( vp.open( "bad/name" ) == false && vp.getDescriptor() == -1 );
+  CHECK( vp.open( "vporttest" ) );
+  CHECK( strcmp( vp.getPath(), MIDI_PTY_DIR "/vporttest" ) == 0 );
+  fd = open( vp.getPath(), O_RDWR | O_NOCTTY );
+  CHECK( fd >= 0 );
+
+  // no translation of CR nor signal on ^C, both ways
+  CHECK( write( fd, in, sizeof( in ) ) == sizeof( in ) );
+  for ( i = 0, len = 0; i < 1000 && len < (int) sizeof( in ); i++ ) {
+    int r = read( vp.getDescriptor(), buf + len, sizeof( buf ) - len );
+    if ( r > 0 )
+      len += r;
+    else
+      usleep( 1000 );
+  }
+  CHECK( len == sizeof( in ) && memcmp( buf, in, sizeof( in ) ) == 0 );
+  CHECK( write( vp.getDescriptor(), in, sizeof( in ) ) == sizeof( in ) );
+  CHECK( read( fd, buf, sizeof( buf ) ) == sizeof( in ) );
+  CHECK( memcmp( buf, in, sizeof( in ) ) == 0 );
+  close( fd );
+  vp.close();
+  CHECK( access( MIDI_PTY_DIR "/vporttest", F_OK ) < 0 );
+
+  // ports are listed in the order of their names
+  CHECK( vp.open( "vporttest-b" ) && vp2.open( "vporttest-a" ) );
+  for ( i = 0, a = b = -1; midi_pty_list( i, path, sizeof( path ) ); i++ ) {
+    if ( strcmp( path, vp2.getPath() ) == 0 ) a = i;
+    if ( strcmp( path, vp.getPath() ) == 0 ) b = i;
+  }
+  CHECK( a >= 0 && b == a + 1 );
+  vp2.close();
+  // a name is taken while its port is open
+  CHECK( vp2.open( "vporttest-b" ) == false && errno == EEXIST );
+  vp.close();
+
+  // a stale link, whose terminal may belong to another program now, is
+  // not listed and is removed
+  unlink( MIDI_PTY_DIR "/vporttest-stale" );
+  CHECK( symlink( "/dev/null", MIDI_PTY_DIR "/vporttest-stale" ) == 0 );
+  for ( i = 0; midi_pty_list( i, path, sizeof( path ) ); i++ )
+    CHECK( strcmp( path, MIDI_PTY_DIR "/vporttest-stale" ) != 0 );
+  CHECK( lstat( MIDI_PTY_DIR "/vporttest-stale", &st ) < 0 );
+
+  // the directory is shared like /tmp
+  CHECK( stat( MIDI_PTY_DIR, &st ) == 0 && ( st.st_mode & 07777 ) == 01777 );
+
+  // a virtual input port, opened by an output port
+  RtMidiIn rtIn( RtMidi::DIRECT );
+  RtMidiOut rtOut( RtMidi::DIRECT );
+  memset( &messages, 0, sizeof( messages ) );
+  rtIn.setCallback( rtMessage, &messages );
+  rtIn.openVirtualPort( "vporttest in" );
+  CHECK( rtIn.isPortOpen() );
+  port = findPort( rtOut, "virtual:vporttest_in" );
+  CHECK( port < rtOut.getPortCount() );
+  rtOut.openPort( port );
+  CHECK( rtOut.isPortOpen() );
+  rtOut.sendMessage( note, sizeof( note ) );
+  waitMessages( messages, 1 );
+  CHECK( messages.count == 1 && messages.status[0] == 0x90 );
+  rtOut.closePort();
+  rtIn.closePort();
+  CHECK( findPort( rtOut, "virtual:vporttest_in" ) == rtOut.getPortCount() );
+
+  // a virtual output port, opened by an input port
+  memset( &messages, 0, sizeof( messages ) );
+  rtOut.openVirtualPort( "vporttest-out" );
+  CHECK( rtOut.isPortOpen() );
+  port = findPort( rtIn, "virtual:vporttest-out" );
+  CHECK( port < rtIn.getPortCount() );
+  rtIn.openPort( port );
+  CHECK( rtIn.isPortOpen() );
+  rtOut.sendMessage( note, sizeof( note ) );
+  waitMessages( messages, 1 );
+  CHECK( messages.count == 1 && messages.status[0] == 0x90 );
+  rtIn.closePort();
+
+  // nobody reads the port: a message which does not fit is reported
+  rtOut.setErrorCallback( rtError, &warnings );
+  for ( i = 0; i < 100000 && warnings == 0; i++ )
+    rtOut.sendMessage( note, sizeof( note ) );
+  CHECK( warnings == 1 );
+  rtOut.setErrorCallback( NULL, NULL );
+  rtOut.closePort();
+}
+
+int main()
+{
+  testVirtualPort();
+  return testResult( "vporttest" );
+}
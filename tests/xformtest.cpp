@@ -0,0 +1,75 @@
+//*****************************************//
+//  xformtest.cpp
+//  by Nicolas Provost, 2025.
+//
+//  Simple program to check the transforms of the frames of a source
+//  of a MidiReader.
+//
+//*****************************************//
+
+#include "testutil.h"
+
+// Split channel 1 into two layers, remap controllers and filter with a
+// transform set on a source.
+static void testTransform()
+{
+  static const unsigned char in[] = { 0x90, 0x3c, 0x50, 0x30, 0x50,
+                                      0x80, 0x30, 0x00, 0xb0, 0x01, 0x10,
+                                      0xb0, 0x40, 0x7f, 0xd0, 0x20,
+                                      0xc0, 0x05, 0xf8 };
+  static const unsigned char out[][3] = {
+    { 0x90, 0x3c, 0x40 }, { 0x91, 0x24, 0x40 }, { 0x81, 0x24, 0x00 },
+    { 0xb0, 0x0b, 0x10 }, { 0xb1, 0x0b, 0x10 }, { 0xc0, 0x05 },
+    { 0xc1, 0x05 }, { 0xf8 } };
+  static const unsigned char lens[] = { 3, 3, 3, 3, 3, 2, 2, 1 };
+  MidiReader reader( MIDIR_EXPAND, NULL );
+  MidiReaderStats stats;
+  MidiTransform t;
+  MidiFrame f, res[16], *mf;
+  int fds[2], n = 0;
+
+  // channel 1 keeps the upper part, channel 2 gets the lower part one
+  // octave down, at a fixed velocity
+  t.mapChannel( 1, 2, true );
+  t.noteRange( 1, 60, 127 );
+  t.noteRange( 2, 0, 59 );
+  t.transpose( 2, -12 );
+  t.velocityCurve( 64, 64 );
+  t.mapController( 1, 11 );
+  t.mapController( 64, MIDI_XFORM_DROP );
+  t.filter( 0xd0 );
+
+  CHECK( pipeSource( reader, fds ) );
+  CHECK( t.attach( reader, fds[0] ) );
+  CHECK( !t.attach( reader, fds[1] ) );
+  CHECK( write( fds[1], in, sizeof( in ) ) == sizeof( in ) );
+  reader.pump();
+  while ( ( mf = reader.pop() ) != NULL ) {
+    CHECK( n < 8 && sameFrame( *mf, lens[n], out[n] ) );
+    n++;
+  }
+  CHECK( n == 8 );
+  CHECK( reader.getStats( -1, stats ) && stats.skipped == 2 );
+
+  // a frame with running status gives a frame per layer
+  f.len = 5;
+  memcpy( f.data, "\x90\x3c\x50\x30\x50", 5 );
+  f.source = 0;
+  f.ts = 0;
+  CHECK( t.apply( f, res ) == 2 );
+  CHECK( sameFrame( res[0], 3, out[0] ) && sameFrame( res[1], 3, out[1] ) );
+
+  // detached, the frames pass unchanged
+  t.detach( reader, fds[0] );
+  CHECK( write( fds[1], "\xd0\x30", 2 ) == 2 );
+  reader.pump();
+  CHECK( ( mf = reader.pop() ) != NULL && sameFrame( *mf, 2, (const unsigned char *) "\xd0\x30" ) );
+  reader.close();
+  close( fds[1] );
+}
+
+int main()
+{
+  testTransform();
+  return testResult( "xformtest" );
+}